@@ -14,6 +14,8 @@ const std::unordered_map<std::string,
         {"first", AggregateHandler::AggregateFunctionEnumType::kFirst},
         {"last", AggregateHandler::AggregateFunctionEnumType::kLast},
         {"mean", AggregateHandler::AggregateFunctionEnumType::kMean},
+        {"count_distinct",
+         AggregateHandler::AggregateFunctionEnumType::kCountDistinct},
     };
 
 const std::string AggregateOptionsParser::AGGREGATES_OPTION_NAME{"aggregate"};
@@ -21,6 +23,8 @@ const std::string AggregateOptionsParser::TIME_AGGREGATE_RULE_OPTION_NAME{
     "timeAggregateRule"};
 const std::regex AggregateOptionsParser::AGGREGATE_STRING_REGEX{
     R"((\S+)\((\w+)\)\s+as\s+(\S+))"};
+const std::regex AggregateOptionsParser::QUANTILE_FUNCTION_REGEX{
+    R"(p(\d+(?:\.\d+)?))"};
 
 google::protobuf::Map<std::string, agent::OptionInfo>
 AggregateOptionsParser::getResponseOptionsMap() {
@@ -55,6 +59,23 @@ void AggregateOptionsParser::parseAggregates(
     std::smatch match;
     if (std::regex_match(aggregate_string_value.stringvalue(), match,
                          AGGREGATE_STRING_REGEX)) {
+      std::smatch quantile_match;
+      auto function_name = match[1].str();
+      if (std::regex_match(function_name, quantile_match,
+                           QUANTILE_FUNCTION_REGEX)) {
+        auto percentile = std::stod(quantile_match[1].str());
+        if (percentile > 100) {
+          throw InvalidOptionException(fmt::format(
+              "Invalid percentile in aggregate function: {}", function_name));
+        }
+
+        aggregate_options->aggregate_columns[match[2]].push_back(
+            {AggregateHandler::AggregateFunctionEnumType::kQuantile,
+             match[3], metadata::FIELD, percentile / 100});
+
+        continue;
+      }
+
       if (FUNCTION_NAMES_TO_TYPES.find(match[1]) ==
           FUNCTION_NAMES_TO_TYPES.end()) {
         throw InvalidOptionException(fmt::format(
@@ -86,6 +107,14 @@ void AggregateOptionsParser::parseTimeAggregateRule(
         "Invalid aggregate function name: {}", time_aggregate_function_name));
   }
 
+  // Distinct count of timestamps is not a timestamp
+  if (FUNCTION_NAMES_TO_TYPES.at(time_aggregate_function_name) ==
+      AggregateHandler::AggregateFunctionEnumType::kCountDistinct) {
+    throw InvalidOptionException(
+        fmt::format("Invalid time aggregate function name: {}",
+                    time_aggregate_function_name));
+  }
+
   aggregate_options->result_time_column_rule.aggregate_function =
       FUNCTION_NAMES_TO_TYPES.at(time_aggregate_function_name);
 }
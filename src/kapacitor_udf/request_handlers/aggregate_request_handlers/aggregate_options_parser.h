@@ -45,6 +45,7 @@ class AggregateOptionsParser {
                                   AggregateHandler::AggregateFunctionEnumType>
       FUNCTION_NAMES_TO_TYPES;
   static const std::regex AGGREGATE_STRING_REGEX;
+  static const std::regex QUANTILE_FUNCTION_REGEX;
 };
 
 }  // namespace kapacitor_udf
@@ -23,21 +23,27 @@ inline const std::string UNIT_TIME_SEGMENT_OPTION_NAME{"unit"};
 inline const std::string NEIGHBOURHOOD_OPTION_NAME{"neighbourhood"};
 inline const std::string EMIT_TIMEOUT_OPTION_NAME{"emitTimeout"};
 inline const std::string NO_WAIT_FUTURE_OPTION_NAME{"noWait"};
+inline const std::string GROUP_IDLE_TIMEOUT_OPTION_NAME{"groupIdleTimeout"};
+inline const std::string MAX_GROUPS_OPTION_NAME{"maxGroups"};
 
 inline const std::unordered_set<std::string> REQUIRED_DERIVATIVE_CASE_OPTIONS{
     DERIVATIVE_OPTION_NAME, RESULT_OPTION_NAME};
 
 inline const std::unordered_map<std::string, agent::ValueType>
-    DERIVATIVE_OPTIONS_TYPES{{DERIVATIVE_OPTION_NAME, agent::STRING},
-                             {RESULT_OPTION_NAME, agent::STRING},
-                             {ORDER_OPTION_NAME, agent::INT},
-                             {UNIT_TIME_SEGMENT_OPTION_NAME, agent::DURATION},
-                             {NEIGHBOURHOOD_OPTION_NAME, agent::DURATION},
-                             {EMIT_TIMEOUT_OPTION_NAME, agent::DURATION}};
+    DERIVATIVE_OPTIONS_TYPES{
+        {DERIVATIVE_OPTION_NAME, agent::STRING},
+        {RESULT_OPTION_NAME, agent::STRING},
+        {ORDER_OPTION_NAME, agent::INT},
+        {UNIT_TIME_SEGMENT_OPTION_NAME, agent::DURATION},
+        {NEIGHBOURHOOD_OPTION_NAME, agent::DURATION},
+        {EMIT_TIMEOUT_OPTION_NAME, agent::DURATION},
+        {GROUP_IDLE_TIMEOUT_OPTION_NAME, agent::DURATION},
+        {MAX_GROUPS_OPTION_NAME, agent::INT}};
 
 inline const std::unordered_set<std::string> OPTIONAL_GLOBAL_OPTIONS{
     UNIT_TIME_SEGMENT_OPTION_NAME, NEIGHBOURHOOD_OPTION_NAME,
-    EMIT_TIMEOUT_OPTION_NAME};
+    EMIT_TIMEOUT_OPTION_NAME, GROUP_IDLE_TIMEOUT_OPTION_NAME,
+    MAX_GROUPS_OPTION_NAME};
 
 using namespace std::chrono_literals;
 
@@ -163,6 +169,20 @@ DerivativeOptions parseDerivativeOptions(
 
         derivative_options.emit_timeout =
             std::chrono::duration_cast<std::chrono::seconds>(emit_timeout);
+      } else if (option_name == GROUP_IDLE_TIMEOUT_OPTION_NAME) {
+        std::chrono::nanoseconds idle_timeout(option_value.durationvalue());
+
+        derivative_options.dispatcher_options.idle_ttl =
+            std::chrono::duration_cast<std::chrono::seconds>(idle_timeout);
+      } else if (option_name == MAX_GROUPS_OPTION_NAME) {
+        if (option_value.intvalue() <= 0) {
+          throw InvalidOptionException(fmt::format(
+              "Positive value of option {} was expected, got: {}",
+              option_name, option_value.intvalue()));
+        }
+
+        derivative_options.dispatcher_options.max_groups =
+            option_value.intvalue();
       } else {
         throw InvalidOptionException(
             fmt::format("Unexpected option name: {}", option_name));
@@ -279,8 +299,9 @@ agent::Response DerivativeRequestHandler::init(
   std::unique_ptr<RecordBatchHandler> handler =
       std::make_unique<GroupDispatcher>(
           std::make_shared<DerivativeHandlerFactory>(
-              std::make_unique<compute_utils::FDDerivativeCalculator>(),
-              std::move(derivative_options.options)));
+              std::make_unique<compute_utils::FornbergDerivativeCalculator>(),
+              std::move(derivative_options.options)),
+          derivative_options.dispatcher_options);
 
   setPointsStorage(std::make_unique<storage_utils::PointsStorage>(
       getAgent(),
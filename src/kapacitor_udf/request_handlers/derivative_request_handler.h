@@ -1,5 +1,6 @@
 #pragma once
 
+#include "record_batch_handlers/group_dispatcher.h"
 #include "record_batch_handlers/stateful_handlers/derivative_handler.h"
 #include "record_batch_request_handler.h"
 
@@ -11,6 +12,7 @@ namespace internal {
 struct DerivativeOptions {
   DerivativeHandler::DerivativeOptions options;
   std::chrono::seconds emit_timeout;
+  GroupDispatcher::Options dispatcher_options;
 };
 
 google::protobuf::Map<std::string, agent::OptionInfo>
@@ -6,6 +6,7 @@
 #include "invalid_option_exception.h"
 #include "metadata/time_metadata.h"
 #include "record_batch_handlers/group_dispatcher.h"
+#include "record_batch_handlers/stateful_handlers/multi_group_window_handler.h"
 #include "utils/string_utils.h"
 
 namespace stream_data_processor {
@@ -23,6 +24,14 @@ inline const std::string DEFAULT_EVERY_OPTION_NAME{"defaultEvery"};
 inline const std::string EMIT_TIMEOUT_OPTION_NAME{"emitTimeout"};
 inline const std::string STATIC_PERIOD_OPTION_NAME{"staticPeriod"};
 inline const std::string STATIC_EVERY_OPTION_NAME{"staticEvery"};
+inline const std::string ALLOWED_LATENESS_OPTION_NAME{"allowedLateness"};
+inline const std::string IDLE_TIMEOUT_OPTION_NAME{"idleTimeout"};
+inline const std::string LATE_ROWS_MEASUREMENT_OPTION_NAME{
+    "lateRowsMeasurement"};
+inline const std::string MEMORY_BUDGET_OPTION_NAME{"memoryBudget"};
+inline const std::string SPILL_DIRECTORY_OPTION_NAME{"spillDirectory"};
+inline const std::string GROUP_IDLE_TIMEOUT_OPTION_NAME{"groupIdleTimeout"};
+inline const std::string MAX_GROUPS_OPTION_NAME{"maxGroups"};
 
 inline const std::unordered_map<std::string, agent::ValueType>
     WINDOW_OPTIONS_TYPES{{PERIOD_FIELD_OPTION_NAME, agent::STRING},
@@ -33,14 +42,25 @@ inline const std::unordered_map<std::string, agent::ValueType>
                          {DEFAULT_EVERY_OPTION_NAME, agent::DURATION},
                          {EMIT_TIMEOUT_OPTION_NAME, agent::DURATION},
                          {STATIC_PERIOD_OPTION_NAME, agent::DURATION},
-                         {STATIC_EVERY_OPTION_NAME, agent::DURATION}};
+                         {STATIC_EVERY_OPTION_NAME, agent::DURATION},
+                         {ALLOWED_LATENESS_OPTION_NAME, agent::DURATION},
+                         {IDLE_TIMEOUT_OPTION_NAME, agent::DURATION},
+                         {LATE_ROWS_MEASUREMENT_OPTION_NAME, agent::STRING},
+                         {MEMORY_BUDGET_OPTION_NAME, agent::INT},
+                         {SPILL_DIRECTORY_OPTION_NAME, agent::STRING},
+                         {GROUP_IDLE_TIMEOUT_OPTION_NAME, agent::DURATION},
+                         {MAX_GROUPS_OPTION_NAME, agent::INT}};
 
 inline const std::unordered_map<std::string, int> OPTIONS_SIZE{
     {PERIOD_FIELD_OPTION_NAME, 1},  {PERIOD_TIME_UNIT_OPTION_NAME, 1},
     {EVERY_FIELD_OPTION_NAME, 1},   {EVERY_TIME_UNIT_OPTION_NAME, 1},
     {FILL_PERIOD_OPTION_NAME, 0},   {DEFAULT_PERIOD_OPTION_NAME, 1},
     {DEFAULT_EVERY_OPTION_NAME, 1}, {EMIT_TIMEOUT_OPTION_NAME, 1},
-    {STATIC_PERIOD_OPTION_NAME, 1}, {STATIC_EVERY_OPTION_NAME, 1}};
+    {STATIC_PERIOD_OPTION_NAME, 1}, {STATIC_EVERY_OPTION_NAME, 1},
+    {ALLOWED_LATENESS_OPTION_NAME, 1}, {IDLE_TIMEOUT_OPTION_NAME, 1},
+    {LATE_ROWS_MEASUREMENT_OPTION_NAME, 1}, {MEMORY_BUDGET_OPTION_NAME, 1},
+    {SPILL_DIRECTORY_OPTION_NAME, 1}, {GROUP_IDLE_TIMEOUT_OPTION_NAME, 1},
+    {MAX_GROUPS_OPTION_NAME, 1}};
 
 inline const std::vector<std::vector<std::unordered_set<std::string>>>
     PRESENTED_OPTIONS_EXCLUSIVE_CNF{
@@ -238,6 +258,44 @@ WindowOptions parseWindowOptions(
 
       window_options.window_handler_options.every =
           std::chrono::duration_cast<std::chrono::seconds>(static_every);
+    } else if (option_name == ALLOWED_LATENESS_OPTION_NAME) {
+      std::chrono::nanoseconds allowed_lateness(option_value.durationvalue());
+
+      window_options.window_handler_options.allowed_lateness =
+          std::chrono::duration_cast<std::chrono::seconds>(allowed_lateness);
+    } else if (option_name == IDLE_TIMEOUT_OPTION_NAME) {
+      std::chrono::nanoseconds idle_timeout(option_value.durationvalue());
+
+      window_options.window_handler_options.idle_timeout =
+          std::chrono::duration_cast<std::chrono::seconds>(idle_timeout);
+    } else if (option_name == LATE_ROWS_MEASUREMENT_OPTION_NAME) {
+      window_options.window_handler_options.keep_late_rows = true;
+      window_options.window_handler_options.late_rows_measurement =
+          option_value.stringvalue();
+    } else if (option_name == MEMORY_BUDGET_OPTION_NAME) {
+      if (option_value.intvalue() < 0) {
+        throw InvalidOptionException(
+            fmt::format("{} option should be non-negative",
+                        MEMORY_BUDGET_OPTION_NAME));
+      }
+
+      window_options.window_handler_options.memory_budget_bytes =
+          option_value.intvalue();
+    } else if (option_name == SPILL_DIRECTORY_OPTION_NAME) {
+      window_options.window_handler_options.spill_directory =
+          option_value.stringvalue();
+    } else if (option_name == GROUP_IDLE_TIMEOUT_OPTION_NAME) {
+      std::chrono::nanoseconds idle_timeout(option_value.durationvalue());
+
+      window_options.dispatcher_options.idle_ttl =
+          std::chrono::duration_cast<std::chrono::seconds>(idle_timeout);
+    } else if (option_name == MAX_GROUPS_OPTION_NAME) {
+      if (option_value.intvalue() <= 0) {
+        throw InvalidOptionException(fmt::format(
+            "{} option should be positive", MAX_GROUPS_OPTION_NAME));
+      }
+
+      window_options.dispatcher_options.max_groups = option_value.intvalue();
     } else {
       throw InvalidOptionException(
           fmt::format("Unexpected option name: {}", option_name));
@@ -322,11 +380,26 @@ agent::Response DynamicWindowRequestHandler::init(
         window_options.convert_options.every_option.value().first;
   }
 
-  std::unique_ptr<RecordBatchHandler> handler =
-      std::make_unique<GroupDispatcher>(
-          std::make_shared<DynamicWindowHandlerFactory>(
-              window_options.window_handler_options,
-              std::move(dynamic_window_options)));
+  // With static period and every all groups are windowed by one handler
+  // instead of a window handler per group unless options it doesn't
+  // support, e.g. the memory budget or groups limits, are set
+  auto& dispatcher_options = window_options.dispatcher_options;
+  std::unique_ptr<RecordBatchHandler> handler;
+  if (!dynamic_window_options.period_column_name.has_value() &&
+      !dynamic_window_options.every_column_name.has_value() &&
+      !dispatcher_options.idle_ttl.has_value() &&
+      !dispatcher_options.max_groups.has_value() &&
+      MultiGroupWindowHandler::isSupported(
+          window_options.window_handler_options)) {
+    handler = std::make_unique<MultiGroupWindowHandler>(
+        window_options.window_handler_options);
+  } else {
+    handler = std::make_unique<GroupDispatcher>(
+        std::make_shared<DynamicWindowHandlerFactory>(
+            window_options.window_handler_options,
+            std::move(dynamic_window_options)),
+        dispatcher_options);
+  }
 
   setPointsStorage(std::make_unique<storage_utils::PointsStorage>(
       getAgent(),
@@ -6,6 +6,7 @@
 #include <utility>
 
 #include "kapacitor_udf/utils/points_converter.h"
+#include "record_batch_handlers/group_dispatcher.h"
 #include "record_batch_handlers/stateful_handlers/window_handler.h"
 #include "record_batch_request_handler.h"
 #include "utils/time_utils.h"
@@ -44,6 +45,7 @@ struct WindowOptions {
   internal::WindowOptionsConverterDecorator::WindowOptions convert_options;
   WindowHandler::WindowOptions window_handler_options;
   std::chrono::seconds emit_timeout;
+  GroupDispatcher::Options dispatcher_options;
 };
 
 google::protobuf::Map<std::string, agent::OptionInfo> getWindowOptionsMap();
@@ -6,7 +6,6 @@
 #include <spdlog/spdlog.h>
 
 #include "invalid_option_exception.h"
-#include "kapacitor_udf/utils/points_storage.h"
 #include "record_batch_handlers/group_dispatcher.h"
 #include "record_batch_handlers/stateful_handlers/threshold_state_machine.h"
 #include "stateful_threshold_request_handler.h"
@@ -27,6 +26,13 @@ inline const std::string DECREASE_TRIGGER_OPTION_NAME{
 inline const std::string DECREASE_AFTER_OPTION_NAME{"decreaseAfter"};
 inline const std::string MIN_LEVEL_OPTION_NAME{"minLevel"};
 inline const std::string MAX_LEVEL_OPTION_NAME{"maxLevel"};
+inline const std::string GROUP_IDLE_TIMEOUT_OPTION_NAME{"groupIdleTimeout"};
+inline const std::string MAX_GROUPS_OPTION_NAME{"maxGroups"};
+
+// Snapshot keeps a point per group with the group state in its fields
+inline const std::string STATE_TYPE_SNAPSHOT_FIELD{"type"};
+inline const std::string THRESHOLD_SNAPSHOT_FIELD{"threshold"};
+inline const std::string START_SNAPSHOT_FIELD{"start"};
 
 inline const std::unordered_set<std::string> REQUIRED_THRESHOLD_OPTIONS{
     WATCH_COLUMN_OPTION_NAME, THRESHOLD_COLUMN_OPTION_NAME,
@@ -43,7 +49,9 @@ inline const std::unordered_map<std::string, agent::ValueType>
                             {DECREASE_TRIGGER_OPTION_NAME, agent::DOUBLE},
                             {DECREASE_AFTER_OPTION_NAME, agent::DURATION},
                             {MIN_LEVEL_OPTION_NAME, agent::DOUBLE},
-                            {MAX_LEVEL_OPTION_NAME, agent::DOUBLE}};
+                            {MAX_LEVEL_OPTION_NAME, agent::DOUBLE},
+                            {GROUP_IDLE_TIMEOUT_OPTION_NAME, agent::DURATION},
+                            {MAX_GROUPS_OPTION_NAME, agent::INT}};
 
 google::protobuf::Map<std::string, agent::OptionInfo>
 getThresholdOptionsMap() {
@@ -55,10 +63,17 @@ getThresholdOptionsMap() {
   return options_map;
 }
 
-ThresholdStateMachine::Options parseThresholdOptions(
+struct ThresholdOptions {
+  ThresholdStateMachine::Options state_machine_options;
+  GroupDispatcher::Options groups_options;
+};
+
+ThresholdOptions parseThresholdOptions(
     const google::protobuf::RepeatedPtrField<agent::Option>&
         request_options) {
-  ThresholdStateMachine::Options threshold_options;
+  ThresholdOptions parsed_threshold_options;
+  auto& threshold_options = parsed_threshold_options.state_machine_options;
+  auto& groups_options = parsed_threshold_options.groups_options;
   std::unordered_set<std::string> parsed_options;
   for (auto& option : request_options) {
     auto& option_name = option.name();
@@ -119,6 +134,18 @@ ThresholdStateMachine::Options parseThresholdOptions(
       threshold_options.min_threshold = option_value.doublevalue();
     } else if (option_name == MAX_LEVEL_OPTION_NAME) {
       threshold_options.max_threshold = option_value.doublevalue();
+    } else if (option_name == GROUP_IDLE_TIMEOUT_OPTION_NAME) {
+      std::chrono::nanoseconds idle_timeout(option_value.durationvalue());
+
+      groups_options.idle_ttl =
+          std::chrono::duration_cast<std::chrono::seconds>(idle_timeout);
+    } else if (option_name == MAX_GROUPS_OPTION_NAME) {
+      if (option_value.intvalue() <= 0) {
+        throw InvalidOptionException(fmt::format(
+            "{} option should be positive", MAX_GROUPS_OPTION_NAME));
+      }
+
+      groups_options.max_groups = option_value.intvalue();
     } else {
       throw InvalidOptionException(
           fmt::format("Unexpected option name: {}", option_name));
@@ -134,18 +161,14 @@ ThresholdStateMachine::Options parseThresholdOptions(
 
   threshold_options.threshold_column_type = metadata::FIELD;
 
-  return threshold_options;
+  return parsed_threshold_options;
 }
 
 }  // namespace
 
-const BasePointsConverter::PointsToRecordBatchesConversionOptions
-    StatefulThresholdRequestHandler::DEFAULT_TO_RECORD_BATCHES_OPTIONS{
-        "time", "name"};
-
 StatefulThresholdRequestHandler::StatefulThresholdRequestHandler(
     const IUDFAgent* agent)
-    : StreamRecordBatchRequestHandlerBase(agent) {}
+    : StreamRequestHandlerBase(agent) {}
 
 agent::Response StatefulThresholdRequestHandler::info() const {
   agent::Response response;
@@ -159,7 +182,7 @@ agent::Response StatefulThresholdRequestHandler::info() const {
 agent::Response StatefulThresholdRequestHandler::init(
     const agent::InitRequest& init_request) {
   agent::Response response;
-  ThresholdStateMachine::Options threshold_options;
+  ThresholdOptions threshold_options;
 
   try {
     threshold_options = parseThresholdOptions(init_request.options());
@@ -169,24 +192,127 @@ agent::Response StatefulThresholdRequestHandler::init(
     return response;
   }
 
-  std::unique_ptr<RecordBatchHandler> handler =
-      std::make_unique<GroupDispatcher>(
-          std::make_shared<ThresholdStateMachineFactory>(
-              std::move(threshold_options)));
-
-  setPointsStorage(std::make_unique<storage_utils::PointsStorage>(
-      getAgent(),
-      std::make_unique<BasePointsConverter>(
-          DEFAULT_TO_RECORD_BATCHES_OPTIONS),
-      std::move(handler), false));
+  threshold_options_ = threshold_options.state_machine_options;
+  groups_options_ = threshold_options.groups_options;
+  groups_state_machines_.clear();
 
   response.mutable_init()->set_success(true);
   return response;
 }
 
+agent::Response StatefulThresholdRequestHandler::snapshot() const {
+  // The least recently used groups go first, so restore keeps the order
+  agent::PointBatch groups_states;
+  auto& groups_entries = groups_state_machines_.getEntries();
+  for (auto group_iter = groups_entries.rbegin();
+       group_iter != groups_entries.rend(); ++group_iter) {
+    auto& state = group_iter->state.getState();
+    auto group_state = groups_states.add_points();
+    group_state->set_group(group_iter->key);
+    (*group_state->mutable_fieldsint())[STATE_TYPE_SNAPSHOT_FIELD] =
+        state.type;
+    (*group_state->mutable_fieldsdouble())[THRESHOLD_SNAPSHOT_FIELD] =
+        state.threshold;
+    (*group_state->mutable_fieldsint())[START_SNAPSHOT_FIELD] = state.start;
+  }
+
+  agent::Response response;
+  response.mutable_snapshot()->set_snapshot(
+      groups_states.SerializeAsString());
+  return response;
+}
+
+agent::Response StatefulThresholdRequestHandler::restore(
+    const agent::RestoreRequest& restore_request) {
+  agent::Response response;
+  agent::PointBatch groups_states;
+  if (!groups_states.ParseFromString(restore_request.snapshot())) {
+    response.mutable_restore()->set_success(false);
+    response.mutable_restore()->set_error(fmt::format(
+        "Can't restore from snapshot: {}", restore_request.snapshot()));
+    return response;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  groups_state_machines_.clear();
+  for (auto& group_state : groups_states.points()) {
+    auto& fields_int = group_state.fieldsint();
+    auto& fields_double = group_state.fieldsdouble();
+    auto type_iter = fields_int.find(STATE_TYPE_SNAPSHOT_FIELD);
+    auto threshold_iter = fields_double.find(THRESHOLD_SNAPSHOT_FIELD);
+    auto start_iter = fields_int.find(START_SNAPSHOT_FIELD);
+    if (type_iter == fields_int.end() ||
+        threshold_iter == fields_double.end() ||
+        start_iter == fields_int.end() ||
+        type_iter->second < ThresholdStateMachine::OK ||
+        type_iter->second > ThresholdStateMachine::DECREASE) {
+      groups_state_machines_.clear();
+      response.mutable_restore()->set_success(false);
+      response.mutable_restore()->set_error(fmt::format(
+          "Invalid state of group {} in snapshot", group_state.group()));
+      return response;
+    }
+
+    getGroupStateMachine(group_state.group(), now)
+        ->setState({static_cast<ThresholdStateMachine::StateType>(
+                        type_iter->second),
+                    threshold_iter->second, start_iter->second});
+  }
+
+  evictGroups(now);
+  response.mutable_restore()->set_success(true);
+  return response;
+}
+
 void StatefulThresholdRequestHandler::point(const agent::Point& point) {
-  getPointsStorage()->addPoint(point);
-  handleBatch();
+  double value = 0;
+  auto& watch_column_name = threshold_options_.watch_column_name;
+  if (auto double_field = point.fieldsdouble().find(watch_column_name);
+      double_field != point.fieldsdouble().end()) {
+    value = double_field->second;
+  } else if (auto int_field = point.fieldsint().find(watch_column_name);
+             int_field != point.fieldsint().end()) {
+    value = int_field->second;
+  } else {
+    spdlog::error("Point has no numeric field {} to watch",
+                  watch_column_name);
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::nanoseconds point_time(point.time());
+  auto threshold = getGroupStateMachine(point.group(), now)->addThreshold(
+      value,
+      std::chrono::duration_cast<std::chrono::seconds>(point_time).count());
+
+  evictGroups(now);
+
+  agent::Response response;
+  response.mutable_point()->CopyFrom(point);
+  (*response.mutable_point()
+        ->mutable_fieldsdouble())[threshold_options_.threshold_column_name] =
+      threshold;
+
+  getAgent()->writeResponse(response);
+}
+
+ThresholdStateMachine* StatefulThresholdRequestHandler::getGroupStateMachine(
+    const std::string& group, std::chrono::steady_clock::time_point now) {
+  return groups_state_machines_.get(group, now, [this]() {
+    return ThresholdStateMachine(threshold_options_);
+  });
+}
+
+void StatefulThresholdRequestHandler::evictGroups(
+    std::chrono::steady_clock::time_point now) {
+  // Evicted groups are just dropped, so eviction doesn't fail
+  auto status = groups_state_machines_.evict(
+      now, groups_options_.idle_ttl, groups_options_.max_groups,
+      [](auto* /* group */) { return arrow::Status::OK(); });
+
+  if (!status.ok()) {
+    spdlog::error(status.message());
+  }
 }
 
 }  // namespace kapacitor_udf
@@ -1,31 +1,48 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <string>
 
-#include "kapacitor_udf/utils/points_converter.h"
-#include "record_batch_handlers/record_batch_handler.h"
-#include "record_batch_request_handler.h"
+#include "record_batch_handlers/group_dispatcher.h"
+#include "record_batch_handlers/group_states.h"
+#include "record_batch_handlers/stateful_handlers/threshold_state_machine.h"
+#include "request_handler.h"
 
 #include "udf.pb.h"
 
 namespace stream_data_processor {
 namespace kapacitor_udf {
 
-using convert_utils::BasePointsConverter;
-
-class StatefulThresholdRequestHandler
-    : public StreamRecordBatchRequestHandlerBase {
+// Points are handled one by one without converting to record batches: the
+// threshold state machine of the point group is updated with the watch field
+// value and the point is sent back with the threshold field. State machines
+// of groups idle for longer than the idle timeout and of the least recently
+// used groups above the groups limit are dropped, so these groups start
+// over from the default level. Snapshots keep states of all kept groups.
+class StatefulThresholdRequestHandler : public StreamRequestHandlerBase {
  public:
   explicit StatefulThresholdRequestHandler(const IUDFAgent* agent);
 
   [[nodiscard]] agent::Response info() const override;
   [[nodiscard]] agent::Response init(
       const agent::InitRequest& init_request) override;
+  [[nodiscard]] agent::Response snapshot() const override;
+  [[nodiscard]] agent::Response restore(
+      const agent::RestoreRequest& restore_request) override;
   void point(const agent::Point& point) override;
 
  private:
-  static const BasePointsConverter::PointsToRecordBatchesConversionOptions
-      DEFAULT_TO_RECORD_BATCHES_OPTIONS;
+  // Returns the state machine of the group making it the most recently used
+  ThresholdStateMachine* getGroupStateMachine(
+      const std::string& group, std::chrono::steady_clock::time_point now);
+
+  void evictGroups(std::chrono::steady_clock::time_point now);
+
+ private:
+  ThresholdStateMachine::Options threshold_options_;
+  GroupDispatcher::Options groups_options_;
+  GroupStates<std::string, ThresholdStateMachine> groups_state_machines_;
 };
 
 }  // namespace kapacitor_udf
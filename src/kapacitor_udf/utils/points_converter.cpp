@@ -1,12 +1,16 @@
 #include <unordered_map>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 
 #include "grouping_utils.h"
 #include "metadata/column_typing.h"
 #include "metadata/grouping.h"
+#include "metadata/sorting.h"
 #include "points_converter.h"
 #include "utils/arrow_utils.h"
+#include "utils/compute_utils.h"
+#include "utils/convert_utils.h"
 
 namespace stream_data_processor {
 namespace kapacitor_udf {
@@ -39,7 +43,21 @@ BasePointsConverter::convertToRecordBatches(
 }
 
 arrow::Result<agent::PointBatch> BasePointsConverter::convertToPoints(
-    const arrow::RecordBatchVector& record_batches) const {
+    const arrow::RecordBatchVector& input_record_batches) const {
+  arrow::RecordBatchVector record_batches;
+  for (auto& input_record_batch : input_record_batches) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batch,
+        compute_utils::materializeSelection(input_record_batch));
+
+    // Groups of multi-group record batches are converted separately
+    ARROW_ASSIGN_OR_RAISE(auto groups,
+                          compute_utils::splitGroups(record_batch));
+
+    stream_data_processor::convert_utils::append(std::move(groups),
+                                                record_batches);
+  }
+
   agent::PointBatch points;
 
   int total_points_size = 0;
@@ -61,9 +79,9 @@ arrow::Result<agent::PointBatch> BasePointsConverter::convertToPoints(
     ARROW_ASSIGN_OR_RAISE(auto column_types,
                           metadata::getColumnTypes(*record_batch));
 
-    auto group = metadata::extractGroup(*record_batch);
-    auto group_string =
-        grouping_utils::encode(group, measurement_column_name, column_types);
+    auto group = metadata::extractInternedGroup(*record_batch);
+    auto group_string = grouping_utils::encode(
+        group->group, measurement_column_name, column_types);
 
     for (int i = 0; i < record_batch->num_columns(); ++i) {
       auto& column_name = record_batch->column_name(i);
@@ -71,13 +89,14 @@ arrow::Result<agent::PointBatch> BasePointsConverter::convertToPoints(
       auto column_type = column_types[column_name];
 
       for (int j = 0; j < column->length(); ++j) {
-        ARROW_ASSIGN_OR_RAISE(auto scalar_value, column->GetScalar(j));
+        ARROW_ASSIGN_OR_RAISE(auto scalar_value,
+                              arrow_utils::getDecodedScalar(*column, j));
 
         if (i == 0) {
           auto point = points.mutable_points()->Add();
           point->set_group(group_string);
           for (auto& grouping_column :
-               group.group_columns_names().columns_names()) {
+               group->group.group_columns_names().columns_names()) {
             if (grouping_column == measurement_column_name) {
               point->set_byname(true);
             } else {
@@ -227,8 +246,15 @@ BasePointsConverter::convertPointsGroup(
     addBuilders(point.fieldsbool(), &bool_fields_builders, pool);
   }
 
-  for (auto& i : group_indexes) {
-    auto& point = points.points(static_cast<int>(i));
+  bool is_sorted_by_time = true;
+  for (size_t j = 0; j < group_indexes.size(); ++j) {
+    auto& point = points.points(static_cast<int>(group_indexes[j]));
+    if (j > 0 &&
+        point.time() <
+            points.points(static_cast<int>(group_indexes[j - 1])).time()) {
+      is_sorted_by_time = false;
+    }
+
     ARROW_RETURN_NOT_OK(timestamp_builder.Append(point.time()));
     ARROW_RETURN_NOT_OK(measurement_builder.Append(point.name()));
     ARROW_RETURN_NOT_OK(appendValues(point.tags(), &tags_builders));
@@ -294,6 +320,15 @@ BasePointsConverter::convertPointsGroup(
   ARROW_RETURN_NOT_OK(metadata::setMeasurementColumnNameMetadata(
       &record_batch, options_.measurement_column_name));
 
+  if (is_sorted_by_time) {
+    ARROW_RETURN_NOT_OK(metadata::setSortedByMetadata(
+        &record_batch, options_.time_column_name));
+  }
+
+  if (options_.dictionary_encode_tags) {
+    ARROW_RETURN_NOT_OK(compute_utils::dictionaryEncodeTags(&record_batch));
+  }
+
   return record_batch;
 }
 
@@ -39,6 +39,9 @@ class BasePointsConverter : public PointsConverter {
   struct PointsToRecordBatchesConversionOptions {
     std::string time_column_name;
     std::string measurement_column_name;
+
+    // Measurement and tag columns are dictionary-encoded
+    bool dictionary_encode_tags{false};
   };
 
  public:
@@ -31,15 +31,30 @@ arrow::Status PointsStorage::handleBatch() const {
     return arrow::Status::Invalid(response.error().error());
   }
 
-  if (points_.points_size() == 0) {
+  arrow::RecordBatchVector handled_batches;
+  if (points_.points_size() > 0) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batches,
+        points_converter_->convertToRecordBatches(points_));
+
+    ARROW_ASSIGN_OR_RAISE(handled_batches, handler_->handle(record_batches));
+  }
+
+  // Handlers are polled on every call, so results ready by timeouts are
+  // emitted by the UDF timer without new points
+  ARROW_ASSIGN_OR_RAISE(auto polled_batches, handler_->poll());
+  stream_data_processor::convert_utils::append(std::move(polled_batches),
+                                              handled_batches);
+  if (handled_batches.empty()) {
     return arrow::Status::OK();
   }
 
-  ARROW_ASSIGN_OR_RAISE(auto record_batches,
-                        points_converter_->convertToRecordBatches(points_));
+  ARROW_ASSIGN_OR_RAISE(auto logical_batches,
+                        concatenateChunks(handled_batches));
 
+  // Each group of multi-group record batches is sent as a separate batch
   ARROW_ASSIGN_OR_RAISE(auto result_batches,
-                        handler_->handle(record_batches));
+                        compute_utils::splitGroups(logical_batches));
 
   for (auto& result_batch : result_batches) {
     ARROW_ASSIGN_OR_RAISE(auto response_points,
@@ -79,6 +94,43 @@ arrow::Status PointsStorage::handleBatch() const {
   return arrow::Status::OK();
 }
 
+arrow::Result<arrow::RecordBatchVector> PointsStorage::concatenateChunks(
+    const arrow::RecordBatchVector& input_record_batches) {
+  arrow::RecordBatchVector record_batches;
+  for (auto& input_record_batch : input_record_batches) {
+    ARROW_ASSIGN_OR_RAISE(
+        record_batches.emplace_back(),
+        compute_utils::materializeSelection(input_record_batch));
+  }
+
+  auto logical_batches_ids = metadata::getLogicalBatchesIds(record_batches);
+
+  arrow::RecordBatchVector logical_batches;
+  size_t chunks_begin = 0;
+  while (chunks_begin < record_batches.size()) {
+    auto chunks_end = chunks_begin + 1;
+    while (chunks_end < record_batches.size() &&
+           logical_batches_ids[chunks_end] ==
+               logical_batches_ids[chunks_begin]) {
+      ++chunks_end;
+    }
+
+    if (chunks_end - chunks_begin == 1) {
+      logical_batches.push_back(record_batches[chunks_begin]);
+    } else {
+      ARROW_ASSIGN_OR_RAISE(
+          logical_batches.emplace_back(),
+          stream_data_processor::convert_utils::concatenateRecordBatches(
+              {record_batches.begin() + chunks_begin,
+               record_batches.begin() + chunks_end}));
+    }
+
+    chunks_begin = chunks_end;
+  }
+
+  return logical_batches;
+}
+
 void PointsStorage::clear() { points_.mutable_points()->Clear(); }
 
 std::string PointsStorage::snapshot() const {
@@ -139,8 +191,9 @@ arrow::Result<std::string> PointsStorage::getGroupString(
   ARROW_ASSIGN_OR_RAISE(auto column_types,
                         metadata::getColumnTypes(record_batch));
 
-  auto group = metadata::extractGroup(record_batch);
-  return grouping_utils::encode(group, measurement_column_name, column_types);
+  auto group = metadata::extractInternedGroup(record_batch);
+  return grouping_utils::encode(group->group, measurement_column_name,
+                                column_types);
 }
 
 arrow::Result<int64_t> PointsStorage::getTMax(
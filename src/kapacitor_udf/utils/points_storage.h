@@ -66,6 +66,12 @@ class PointsStorage : public IPointsStorage {
   }
 
  private:
+  // Chunks of one logical record batch, e.g. of one window, are sent to
+  // Kapacitor as one batch. Deselected rows are dropped before, so begin and
+  // end of the batch are computed from the sent points only.
+  static arrow::Result<arrow::RecordBatchVector> concatenateChunks(
+      const arrow::RecordBatchVector& record_batches);
+
   static arrow::Result<agent::BeginBatch> getBeginBatchResponse(
       const arrow::RecordBatch& record_batch);
 
@@ -84,7 +90,8 @@ class PointsStorage : public IPointsStorage {
         measurement_column_name,
         metadata::getMeasurementColumnNameMetadata(record_batch));
 
-    auto group = metadata::extractGroup(record_batch);
+    auto interned_group = metadata::extractInternedGroup(record_batch);
+    auto& group = interned_group->group;
 
     batch_response->set_byname(false);
     for (size_t i = 0; i < group.group_columns_values_size(); ++i) {
@@ -0,0 +1,98 @@
+#include <atomic>
+#include <optional>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "chunking.h"
+#include "grouping.h"
+#include "help.h"
+
+namespace stream_data_processor {
+namespace metadata {
+
+namespace {
+
+inline const std::string CHUNK_ID_METADATA_KEY{"chunk_id"};
+
+}  // namespace
+
+arrow::Status setChunkIdMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch, int64_t chunk_id) {
+  ARROW_RETURN_NOT_OK(help::setSchemaMetadata(
+      record_batch, CHUNK_ID_METADATA_KEY, std::to_string(chunk_id)));
+
+  return arrow::Status::OK();
+}
+
+arrow::Status setChunksMetadata(arrow::RecordBatchVector* record_batches,
+                                int64_t chunk_id) {
+  if (record_batches->size() == 1) {
+    ARROW_RETURN_NOT_OK(help::removeSchemaMetadata(&record_batches->front(),
+                                                   CHUNK_ID_METADATA_KEY));
+
+    return arrow::Status::OK();
+  }
+
+  for (auto& record_batch : *record_batches) {
+    ARROW_RETURN_NOT_OK(setChunkIdMetadata(&record_batch, chunk_id));
+  }
+
+  return arrow::Status::OK();
+}
+
+int64_t nextChunkId() {
+  static std::atomic<int64_t> next_chunk_id{0};
+  return next_chunk_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+arrow::Result<int64_t> getChunkIdMetadata(
+    const arrow::RecordBatch& record_batch) {
+  auto metadata = record_batch.schema()->metadata();
+  if (metadata == nullptr || !metadata->Contains(CHUNK_ID_METADATA_KEY)) {
+    return arrow::Status::KeyError("RecordBatch has no chunk id metadata");
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto chunk_id_string,
+                        metadata->Get(CHUNK_ID_METADATA_KEY));
+
+  try {
+    return std::stoll(chunk_id_string);
+  } catch (const std::exception&) {
+    return arrow::Status::Invalid(
+        fmt::format("Invalid chunk id metadata: {}", chunk_id_string));
+  }
+}
+
+std::vector<int64_t> getLogicalBatchesIds(
+    const arrow::RecordBatchVector& record_batches) {
+  std::vector<int64_t> logical_batches_ids;
+  logical_batches_ids.reserve(record_batches.size());
+
+  std::optional<int64_t> last_chunk_id;
+  std::string last_group_metadata;
+  int64_t logical_batch_id = -1;
+  for (auto& record_batch : record_batches) {
+    auto chunk_id_result = getChunkIdMetadata(*record_batch);
+    std::optional<int64_t> chunk_id;
+    if (chunk_id_result.ok()) {
+      chunk_id = chunk_id_result.ValueOrDie();
+    }
+
+    // Grouping splits chunks, so groups of one chunk keep its id
+    auto group_metadata = extractGroupMetadata(*record_batch);
+    if (!chunk_id.has_value() || chunk_id != last_chunk_id ||
+        group_metadata != last_group_metadata) {
+      ++logical_batch_id;
+    }
+
+    last_chunk_id = chunk_id;
+    last_group_metadata = std::move(group_metadata);
+    logical_batches_ids.push_back(logical_batch_id);
+  }
+
+  return logical_batches_ids;
+}
+
+}  // namespace metadata
+}  // namespace stream_data_processor
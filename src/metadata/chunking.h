@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <arrow/api.h>
+
+namespace stream_data_processor {
+namespace metadata {
+
+// Consecutive record batches with the same chunk id are parts of one
+// logical record batch (e.g. of one emitted window) which is split to avoid
+// copying of data.
+arrow::Status setChunkIdMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch, int64_t chunk_id);
+
+// Marks record batches as chunks of one logical record batch. Chunk id is
+// removed if there is only one record batch.
+arrow::Status setChunksMetadata(arrow::RecordBatchVector* record_batches,
+                                int64_t chunk_id);
+
+// Returns a new process-wide unique chunk id, so chunks of different handlers
+// never share an id
+int64_t nextChunkId();
+
+arrow::Result<int64_t> getChunkIdMetadata(
+    const arrow::RecordBatch& record_batch);
+
+// Returns index of logical record batch for each of record batches.
+// Record batches without chunk id are logical record batches themselves,
+// chunks of different groups belong to different logical record batches.
+std::vector<int64_t> getLogicalBatchesIds(
+    const arrow::RecordBatchVector& record_batches);
+
+}  // namespace metadata
+}  // namespace stream_data_processor
@@ -1,7 +1,10 @@
+#include <vector>
+
 #include <spdlog/spdlog.h>
 
 #include "column_typing.h"
 #include "help.h"
+#include "utils/arrow_utils.h"
 
 namespace stream_data_processor {
 namespace metadata {
@@ -12,6 +15,8 @@ inline const std::string COLUMN_TYPE_METADATA_KEY{"column_type"};
 inline const std::string TIME_COLUMN_NAME_METADATA_KEY{"time_column_name"};
 inline const std::string MEASUREMENT_COLUMN_NAME_METADATA_KEY{
     "measurement_column_name"};
+inline const std::string SELECTION_COLUMN_NAME_METADATA_KEY{
+    "selection_column_name"};
 
 arrow::Status setColumnNameMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch,
@@ -23,7 +28,13 @@ arrow::Status setColumnNameMetadata(
         "No such column to set {} metadata: {}", metadata_key, column_name));
   }
 
-  if (column->type_id() != arrow_column_type) {
+  auto arrow_type = column->type();
+  if (arrow_type->id() == arrow::Type::DICTIONARY) {
+    arrow_type =
+        static_cast<const arrow::DictionaryType&>(*arrow_type).value_type();
+  }
+
+  if (arrow_type->id() != arrow_column_type) {
     return arrow::Status::Invalid(fmt::format(
         "Column {} must have {} arrow type", column_name, arrow_column_type));
   }
@@ -37,10 +48,40 @@ arrow::Status setColumnNameMetadata(
   return arrow::Status::OK();
 }
 
+// Fields having no other metadata share one metadata object per column
+// type, so their column type is found by the metadata address
+const std::vector<std::shared_ptr<const arrow::KeyValueMetadata>>&
+getColumnTypesMetadata() {
+  static const auto column_types_metadata = [] {
+    std::vector<std::shared_ptr<const arrow::KeyValueMetadata>> metadata;
+    for (int type = ColumnType_MIN; type <= ColumnType_MAX; ++type) {
+      metadata.push_back(arrow::key_value_metadata(
+          {COLUMN_TYPE_METADATA_KEY},
+          {ColumnType_Name(static_cast<ColumnType>(type))}));
+    }
+
+    return metadata;
+  }();
+
+  return column_types_metadata;
+}
+
 }  // namespace
 
 arrow::Status setColumnTypeMetadata(
     std::shared_ptr<arrow::Field>* column_field, ColumnType type) {
+  auto metadata = column_field->get()->metadata();
+  auto has_other_metadata =
+      metadata != nullptr && metadata->size() > 0 &&
+      (metadata->size() > 1 || metadata->key(0) != COLUMN_TYPE_METADATA_KEY);
+
+  if (ColumnType_IsValid(type) && !has_other_metadata) {
+    *column_field = column_field->get()->WithMetadata(
+        getColumnTypesMetadata()[type - ColumnType_MIN]);
+
+    return arrow::Status::OK();
+  }
+
   ARROW_RETURN_NOT_OK(help::setFieldMetadata(
       column_field, COLUMN_TYPE_METADATA_KEY, ColumnType_Name(type)));
 
@@ -50,19 +91,30 @@ arrow::Status setColumnTypeMetadata(
 arrow::Status setColumnTypeMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch, int i,
     ColumnType type) {
-  ARROW_RETURN_NOT_OK(help::setColumnMetadata(
-      record_batch, i, COLUMN_TYPE_METADATA_KEY, ColumnType_Name(type)));
+  if (i < 0 || i >= record_batch->get()->num_columns()) {
+    return arrow::Status::IndexError(
+        fmt::format("Column index {} is out of bounds", i));
+  }
 
-  return arrow::Status::OK();
+  return help::updateFields(
+      record_batch,
+      help::makeUpdateKey({COLUMN_TYPE_METADATA_KEY, std::to_string(i),
+                           ColumnType_Name(type)}),
+      [i, type](arrow::FieldVector* fields) {
+        return setColumnTypeMetadata(&fields->at(i), type);
+      });
 }
 
 arrow::Status setColumnTypeMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch,
     const std::string& column_name, ColumnType type) {
-  ARROW_RETURN_NOT_OK(help::setColumnMetadata(record_batch, column_name,
-                                              COLUMN_TYPE_METADATA_KEY,
-                                              ColumnType_Name(type)));
+  auto i = record_batch->get()->schema()->GetFieldIndex(column_name);
+  if (i == -1) {
+    return arrow::Status::KeyError(
+        fmt::format("No such column: {}", column_name));
+  }
 
+  ARROW_RETURN_NOT_OK(setColumnTypeMetadata(record_batch, i, type));
   return arrow::Status::OK();
 }
 
@@ -73,6 +125,13 @@ ColumnType getColumnType(const arrow::Field& column_field) {
   }
 
   auto metadata = column_field.metadata();
+  auto& column_types_metadata = getColumnTypesMetadata();
+  for (size_t i = 0; i < column_types_metadata.size(); ++i) {
+    if (metadata == column_types_metadata[i]) {
+      return static_cast<ColumnType>(ColumnType_MIN + i);
+    }
+  }
+
   if (!metadata->Contains(COLUMN_TYPE_METADATA_KEY)) {
     return type;
   }
@@ -99,6 +158,11 @@ arrow::Result<std::string> getTimeColumnNameMetadata(
                                      TIME_COLUMN_NAME_METADATA_KEY);
 }
 
+arrow::Result<std::string> getTimeColumnNameMetadata(
+    const arrow::Schema& schema) {
+  return help::getColumnNameMetadata(schema, TIME_COLUMN_NAME_METADATA_KEY);
+}
+
 arrow::Status setMeasurementColumnNameMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch,
     const std::string& measurement_column_name) {
@@ -116,6 +180,47 @@ arrow::Result<std::string> getMeasurementColumnNameMetadata(
                                      MEASUREMENT_COLUMN_NAME_METADATA_KEY);
 }
 
+arrow::Result<std::string> getMeasurementColumnNameMetadata(
+    const arrow::Schema& schema) {
+  return help::getColumnNameMetadata(schema,
+                                     MEASUREMENT_COLUMN_NAME_METADATA_KEY);
+}
+
+arrow::Status setSelectionColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& selection_column_name) {
+  auto column = record_batch->get()->GetColumnByName(selection_column_name);
+  if (column == nullptr) {
+    return arrow::Status::KeyError(fmt::format(
+        "No such column to set {} metadata: {}",
+        SELECTION_COLUMN_NAME_METADATA_KEY, selection_column_name));
+  }
+
+  if (column->type_id() != arrow::Type::BOOL || column->null_count() != 0) {
+    return arrow::Status::Invalid(
+        fmt::format("Selection column {} must be non-null boolean column",
+                    selection_column_name));
+  }
+
+  ARROW_RETURN_NOT_OK(help::setSchemaMetadata(
+      record_batch, SELECTION_COLUMN_NAME_METADATA_KEY,
+      selection_column_name));
+
+  return arrow::Status::OK();
+}
+
+arrow::Result<std::string> getSelectionColumnNameMetadata(
+    const arrow::RecordBatch& record_batch) {
+  return help::getColumnNameMetadata(record_batch,
+                                     SELECTION_COLUMN_NAME_METADATA_KEY);
+}
+
+arrow::Status removeSelectionColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch) {
+  return help::removeSchemaMetadata(record_batch,
+                                    SELECTION_COLUMN_NAME_METADATA_KEY);
+}
+
 arrow::Result<std::unordered_map<std::string, ColumnType>> getColumnTypes(
     const arrow::RecordBatch& record_batch) {
   std::unordered_map<std::string, ColumnType> column_types;
@@ -152,8 +257,10 @@ arrow::Result<std::string> getMeasurement(
   }
 
   std::string measurement_value;
-  ARROW_ASSIGN_OR_RAISE(auto measurement_scalar,
-                        measurement_column->GetScalar(0));
+  ARROW_ASSIGN_OR_RAISE(
+      auto measurement_scalar,
+      arrow_utils::getDecodedScalar(*measurement_column, 0));
+
   return measurement_scalar->ToString();
 }
 
@@ -169,8 +276,9 @@ arrow::Result<std::string> getMeasurementAndValidate(
 
   std::shared_ptr<arrow::Scalar> measurement_scalar;
   for (int i = 0; i < record_batch.num_rows(); ++i) {
-    ARROW_ASSIGN_OR_RAISE(measurement_scalar,
-                          measurement_column->GetScalar(i));
+    ARROW_ASSIGN_OR_RAISE(
+        measurement_scalar,
+        arrow_utils::getDecodedScalar(*measurement_column, i));
     if (measurement_value != measurement_scalar->ToString()) {
       return arrow::Status::Invalid(
           fmt::format("Found more than one unique measurement values: "
@@ -31,6 +31,9 @@ arrow::Status setTimeColumnNameMetadata(
 arrow::Result<std::string> getTimeColumnNameMetadata(
     const arrow::RecordBatch& record_batch);
 
+arrow::Result<std::string> getTimeColumnNameMetadata(
+    const arrow::Schema& schema);
+
 arrow::Status setMeasurementColumnNameMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch,
     const std::string& measurement_column_name);
@@ -38,6 +41,19 @@ arrow::Status setMeasurementColumnNameMetadata(
 arrow::Result<std::string> getMeasurementColumnNameMetadata(
     const arrow::RecordBatch& record_batch);
 
+arrow::Result<std::string> getMeasurementColumnNameMetadata(
+    const arrow::Schema& schema);
+
+arrow::Status setSelectionColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& selection_column_name);
+
+arrow::Result<std::string> getSelectionColumnNameMetadata(
+    const arrow::RecordBatch& record_batch);
+
+arrow::Status removeSelectionColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch);
+
 arrow::Result<std::unordered_map<std::string, ColumnType>> getColumnTypes(
     const arrow::RecordBatch& record_batch);
 
@@ -1,9 +1,14 @@
 #include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
 
 #include <spdlog/spdlog.h>
 
 #include "grouping.h"
 #include "help.h"
+#include "utils/arrow_utils.h"
 
 namespace stream_data_processor {
 namespace metadata {
@@ -11,6 +16,7 @@ namespace metadata {
 namespace {
 
 inline const std::string GROUP_METADATA_KEY{"group"};
+inline const std::string GROUP_COLUMN_NAME_METADATA_KEY{"group_column"};
 
 arrow::Status fillGroupMap(std::map<std::string, std::string>* group_map,
                            const arrow::RecordBatch& record_batch,
@@ -25,13 +31,109 @@ arrow::Status fillGroupMap(std::map<std::string, std::string>* group_map,
       continue;
     }
 
-    ARROW_ASSIGN_OR_RAISE(auto column_value, column->GetScalar(0));
+    ARROW_ASSIGN_OR_RAISE(auto column_value,
+                          arrow_utils::getDecodedScalar(*column, 0));
     (*group_map)[grouping_column_name] = column_value->ToString();
   }
 
   return arrow::Status::OK();
 }
 
+// View of the group metadata kept by the record batch schema
+std::string_view getGroupMetadataView(
+    const arrow::RecordBatch& record_batch) {
+  auto metadata = record_batch.schema()->metadata().get();
+  if (metadata == nullptr) {
+    return {};
+  }
+
+  auto key_index = metadata->FindKey(GROUP_METADATA_KEY);
+  if (key_index == -1) {
+    return {};
+  }
+
+  return metadata->value(key_index);
+}
+
+class GroupsTable {
+ public:
+  GroupsTable() : no_group_(intern("")) {}
+
+  InternedGroupPtr intern(std::string_view group_metadata) {
+    {
+      std::shared_lock lock(mutex_);
+      auto group_iter = groups_.find(group_metadata);
+      if (group_iter != groups_.end()) {
+        auto group = group_iter->second.handle.lock();
+        if (group != nullptr) {
+          return group;
+        }
+      }
+    }
+
+    std::unique_lock lock(mutex_);
+    auto group_iter = groups_.find(group_metadata);
+    if (group_iter != groups_.end()) {
+      auto group = group_iter->second.handle.lock();
+      if (group != nullptr) {
+        return group;
+      }
+
+      // The last handle is released, but the group isn't erased yet
+      groups_.erase(group_iter);
+    }
+
+    auto interned_group = std::make_unique<InternedGroup>();
+    interned_group->id = next_id_++;
+    interned_group->group_metadata = group_metadata;
+    interned_group->group.ParseFromString(interned_group->group_metadata);
+    for (auto& column_name :
+         interned_group->group.group_columns_names().columns_names()) {
+      interned_group->grouping_columns_names.push_back(column_name);
+    }
+
+    InternedGroupPtr group(interned_group.release(),
+                           [this](const InternedGroup* released_group) {
+                             release(released_group);
+                           });
+
+    // Keys are views of the interned strings which are never moved
+    std::string_view key{group->group_metadata};
+    groups_.emplace(key, TableEntry{group.get(), group});
+    return group;
+  }
+
+ private:
+  struct TableEntry {
+    const InternedGroup* group;
+    std::weak_ptr<const InternedGroup> handle;
+  };
+
+ private:
+  void release(const InternedGroup* group) {
+    {
+      std::unique_lock lock(mutex_);
+      auto group_iter = groups_.find(group->group_metadata);
+      if (group_iter != groups_.end() && group_iter->second.group == group) {
+        groups_.erase(group_iter);
+      }
+    }
+
+    delete group;
+  }
+
+ private:
+  std::shared_mutex mutex_;
+  std::unordered_map<std::string_view, TableEntry> groups_;
+  GroupId next_id_{0};
+  InternedGroupPtr no_group_;
+};
+
+GroupsTable& getGroupsTable() {
+  static GroupsTable groups_table;
+  return groups_table;
+}
+
 }  // namespace
 
 arrow::Status fillGroupMetadata(
@@ -53,47 +155,31 @@ arrow::Status fillGroupMetadata(
 }
 
 std::string extractGroupMetadata(const arrow::RecordBatch& record_batch) {
-  if (!record_batch.schema()->HasMetadata()) {
-    return "";
-  }
+  return std::string{getGroupMetadataView(record_batch)};
+}
 
-  auto metadata = record_batch.schema()->metadata();
-  if (!metadata->Contains(GROUP_METADATA_KEY)) {
-    return "";
-  }
+InternedGroupPtr internGroup(std::string_view group_metadata) {
+  return getGroupsTable().intern(group_metadata);
+}
 
-  return metadata->Get(GROUP_METADATA_KEY).ValueOrDie();
+InternedGroupPtr extractInternedGroup(
+    const arrow::RecordBatch& record_batch) {
+  return internGroup(getGroupMetadataView(record_batch));
 }
 
 RecordBatchGroup extractGroup(const arrow::RecordBatch& record_batch) {
-  RecordBatchGroup group;
-  if (!record_batch.schema()->HasMetadata()) {
-    return group;
-  }
-
-  auto metadata = record_batch.schema()->metadata();
-  if (!metadata->Contains(GROUP_METADATA_KEY)) {
-    return group;
-  }
-
-  group.ParseFromString(metadata->Get(GROUP_METADATA_KEY).ValueOrDie());
-  return group;
+  return extractInternedGroup(record_batch)->group;
 }
 
 std::vector<std::string> extractGroupingColumnsNames(
     const arrow::RecordBatch& record_batch) {
-  std::vector<std::string> grouping_columns_names;
-  auto group = extractGroup(record_batch);
-  for (auto& group_column : group.group_columns_names().columns_names()) {
-    grouping_columns_names.push_back(group_column);
-  }
-
-  return grouping_columns_names;
+  return extractInternedGroup(record_batch)->grouping_columns_names;
 }
 
 std::string getGroupingColumnsSetKey(const arrow::RecordBatch& record_batch) {
-  auto group = extractGroup(record_batch);
-  return group.group_columns_names().SerializeAsString();
+  return extractInternedGroup(record_batch)
+      ->group.group_columns_names()
+      .SerializeAsString();
 }
 
 RecordBatchGroup constructGroupFromOrderedMap(
@@ -107,6 +193,7 @@ RecordBatchGroup constructGroupFromOrderedMap(
 
   return group;
 }
+
 arrow::Status setGroupMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch,
     const RecordBatchGroup& group) {
@@ -116,5 +203,51 @@ arrow::Status setGroupMetadata(
   return arrow::Status::OK();
 }
 
+arrow::Status setGroupMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const InternedGroup& group) {
+  if (group.group_metadata.empty()) {
+    return removeGroupMetadata(record_batch);
+  }
+
+  return help::setSchemaMetadata(record_batch, GROUP_METADATA_KEY,
+                                 group.group_metadata);
+}
+
+arrow::Status removeGroupMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch) {
+  return help::removeSchemaMetadata(record_batch, GROUP_METADATA_KEY);
+}
+
+arrow::Status setGroupColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& group_column_name) {
+  if (record_batch->get()->GetColumnByName(group_column_name) == nullptr) {
+    return arrow::Status::KeyError(fmt::format(
+        "RecordBatch has no group column with name {}", group_column_name));
+  }
+
+  return help::setSchemaMetadata(record_batch, GROUP_COLUMN_NAME_METADATA_KEY,
+                                 group_column_name);
+}
+
+arrow::Result<std::string> getGroupColumnNameMetadata(
+    const arrow::RecordBatch& record_batch) {
+  return help::getColumnNameMetadata(record_batch,
+                                     GROUP_COLUMN_NAME_METADATA_KEY);
+}
+
+arrow::Status removeGroupColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch) {
+  return help::removeSchemaMetadata(record_batch,
+                                    GROUP_COLUMN_NAME_METADATA_KEY);
+}
+
+bool isMultiGroup(const arrow::RecordBatch& record_batch) {
+  return record_batch.schema()->HasMetadata() &&
+         record_batch.schema()->metadata()->Contains(
+             GROUP_COLUMN_NAME_METADATA_KEY);
+}
+
 }  // namespace metadata
 }  // namespace stream_data_processor
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <arrow/api.h>
@@ -18,6 +20,30 @@ arrow::Status fillGroupMetadata(
 
 std::string extractGroupMetadata(const arrow::RecordBatch& record_batch);
 
+using GroupId = uint64_t;
+
+// Group parsed once and shared by handles to it. The group is kept in the
+// process-wide interning table while there are handles, e.g. held by group
+// states of handlers, and is erased with the last one. Record batches
+// without group metadata belong to the group with id 0 which is never
+// erased. Ids are not reused, so equal ids mean the same group while its
+// handle is held. Ids are local to the process: serialized group metadata
+// is used across processes.
+struct InternedGroup {
+  GroupId id;
+  std::string group_metadata;
+  RecordBatchGroup group;
+  std::vector<std::string> grouping_columns_names;
+};
+
+using InternedGroupPtr = std::shared_ptr<const InternedGroup>;
+
+InternedGroupPtr internGroup(std::string_view group_metadata);
+
+// Looks the group up by a view of the record batch group metadata without
+// copying it
+InternedGroupPtr extractInternedGroup(const arrow::RecordBatch& record_batch);
+
 RecordBatchGroup extractGroup(const arrow::RecordBatch& record_batch);
 
 std::vector<std::string> extractGroupingColumnsNames(
@@ -32,5 +58,27 @@ arrow::Status setGroupMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch,
     const RecordBatchGroup& group);
 
+arrow::Status setGroupMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const InternedGroup& group);
+
+arrow::Status removeGroupMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch);
+
+// Multi-group record batch holds rows of many groups. Serialized group
+// metadata of each row is kept in the dictionary-encoded group column which
+// name is set in the schema metadata.
+arrow::Status setGroupColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& group_column_name);
+
+arrow::Result<std::string> getGroupColumnNameMetadata(
+    const arrow::RecordBatch& record_batch);
+
+arrow::Status removeGroupColumnNameMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch);
+
+bool isMultiGroup(const arrow::RecordBatch& record_batch);
+
 }  // namespace metadata
 }  // namespace stream_data_processor
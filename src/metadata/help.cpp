@@ -1,4 +1,7 @@
+#include <functional>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include <arrow/api.h>
 #include <spdlog/spdlog.h>
@@ -9,6 +12,130 @@ namespace stream_data_processor {
 namespace metadata {
 namespace help {
 
+namespace {
+
+// An arbitrary cached update is dropped when there are more cached updates
+constexpr size_t MAX_CACHED_UPDATES = 1024;
+
+// Caches results of field updates by the source fields and the update key.
+// Fields are compared by their objects, so schemas that differ in schema
+// metadata only, e.g. per-batch chunk ids and groups, share the cached
+// fields. The cache is per thread, so it is used without locking.
+class FieldsUpdatesCache {
+ public:
+  std::shared_ptr<arrow::Schema> find(
+      const std::shared_ptr<arrow::Schema>& schema,
+      const std::string& update_key) {
+    auto update_iter = updates_.find(makeKey(*schema, update_key));
+    if (update_iter == updates_.end()) {
+      return nullptr;
+    }
+
+    auto& update = update_iter->second;
+    if (update.last_schema.lock() != schema) {
+      update.last_schema = schema;
+      update.last_updated_schema =
+          arrow::schema(update.updated_fields, schema->metadata());
+    }
+
+    return update.last_updated_schema;
+  }
+
+  void add(const std::shared_ptr<arrow::Schema>& schema,
+           const std::string& update_key,
+           const std::shared_ptr<arrow::Schema>& updated_schema) {
+    if (updates_.size() >= MAX_CACHED_UPDATES) {
+      updates_.erase(updates_.begin());
+    }
+
+    updates_[makeKey(*schema, update_key)] = {
+        schema->fields(), updated_schema->fields(), schema, updated_schema};
+  }
+
+ private:
+  struct UpdateKey {
+    std::vector<const arrow::Field*> fields;
+    std::string update_key;
+
+    bool operator==(const UpdateKey& other) const {
+      return fields == other.fields && update_key == other.update_key;
+    }
+  };
+
+  struct UpdateKeyHash {
+    size_t operator()(const UpdateKey& key) const {
+      auto hash = std::hash<std::string>()(key.update_key);
+      for (auto field : key.fields) {
+        hash = hash * 31 + std::hash<const arrow::Field*>()(field);
+      }
+
+      return hash;
+    }
+  };
+
+  struct FieldsUpdate {
+    // Keeps the source fields alive while their addresses are the key
+    arrow::FieldVector fields;
+    arrow::FieldVector updated_fields;
+
+    // Batches with the same schema object get the same updated schema
+    std::weak_ptr<arrow::Schema> last_schema;
+    std::shared_ptr<arrow::Schema> last_updated_schema;
+  };
+
+ private:
+  static UpdateKey makeKey(const arrow::Schema& schema,
+                           const std::string& update_key) {
+    UpdateKey key{{}, update_key};
+    key.fields.reserve(schema.num_fields());
+    for (auto& field : schema.fields()) {
+      key.fields.push_back(field.get());
+    }
+
+    return key;
+  }
+
+ private:
+  std::unordered_map<UpdateKey, FieldsUpdate, UpdateKeyHash> updates_;
+};
+
+FieldsUpdatesCache& getFieldsUpdatesCache() {
+  thread_local FieldsUpdatesCache fields_updates_cache;
+  return fields_updates_cache;
+}
+
+}  // namespace
+
+std::string makeUpdateKey(std::initializer_list<std::string> parts) {
+  std::string update_key;
+  for (auto& part : parts) {
+    update_key += part;
+    update_key.push_back('\0');
+  }
+
+  return update_key;
+}
+
+arrow::Status updateFields(std::shared_ptr<arrow::RecordBatch>* record_batch,
+                           const std::string& update_key,
+                           const FieldsUpdate& update) {
+  auto& schema = record_batch->get()->schema();
+  auto& fields_updates_cache = getFieldsUpdatesCache();
+  auto updated_schema = fields_updates_cache.find(schema, update_key);
+  if (updated_schema == nullptr) {
+    auto fields = schema->fields();
+    ARROW_RETURN_NOT_OK(update(&fields));
+    updated_schema = arrow::schema(fields, schema->metadata());
+    fields_updates_cache.add(schema, update_key, updated_schema);
+  }
+
+  *record_batch = arrow::RecordBatch::Make(
+      updated_schema, record_batch->get()->num_rows(),
+      record_batch->get()->column_data());
+
+  return arrow::Status::OK();
+}
+
 arrow::Status setFieldMetadata(std::shared_ptr<arrow::Field>* field,
                                const std::string& key,
                                const std::string& metadata) {
@@ -39,9 +166,9 @@ arrow::Status replaceField(std::shared_ptr<arrow::RecordBatch>* record_batch,
       auto new_schema,
       record_batch->get()->schema()->SetField(field_index, field));
 
-  *record_batch =
-      arrow::RecordBatch::Make(new_schema, record_batch->get()->num_rows(),
-                               record_batch->get()->columns());
+  *record_batch = arrow::RecordBatch::Make(new_schema,
+                                           record_batch->get()->num_rows(),
+                                           record_batch->get()->columns());
 
   return arrow::Status::OK();
 }
@@ -54,10 +181,12 @@ arrow::Status setColumnMetadata(
         fmt::format("Column index {} is out of bounds", i));
   }
 
-  auto field = record_batch->get()->schema()->field(i);
-  ARROW_RETURN_NOT_OK(setFieldMetadata(&field, key, metadata));
-  ARROW_RETURN_NOT_OK(replaceField(record_batch, field));
-  return arrow::Status::OK();
+  return updateFields(
+      record_batch,
+      makeUpdateKey({"column_metadata", std::to_string(i), key, metadata}),
+      [&](arrow::FieldVector* fields) {
+        return setFieldMetadata(&fields->at(i), key, metadata);
+      });
 }
 
 arrow::Status setColumnMetadata(
@@ -89,6 +218,20 @@ arrow::Status setSchemaMetadata(
   return arrow::Status::OK();
 }
 
+arrow::Status removeSchemaMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& key) {
+  if (!record_batch->get()->schema()->HasMetadata() ||
+      !record_batch->get()->schema()->metadata()->Contains(key)) {
+    return arrow::Status::OK();
+  }
+
+  auto arrow_metadata = record_batch->get()->schema()->metadata()->Copy();
+  ARROW_RETURN_NOT_OK(arrow_metadata->Delete(key));
+  *record_batch = record_batch->get()->ReplaceSchemaMetadata(arrow_metadata);
+  return arrow::Status::OK();
+}
+
 arrow::Result<std::string> getFieldMetadata(const arrow::Field& field,
                                             const std::string& key) {
   auto metadata = field.metadata();
@@ -106,7 +249,12 @@ arrow::Result<std::string> getFieldMetadata(const arrow::Field& field,
 
 arrow::Result<std::string> getColumnNameMetadata(
     const arrow::RecordBatch& record_batch, const std::string& metadata_key) {
-  auto metadata = record_batch.schema()->metadata();
+  return getColumnNameMetadata(*record_batch.schema(), metadata_key);
+}
+
+arrow::Result<std::string> getColumnNameMetadata(
+    const arrow::Schema& schema, const std::string& metadata_key) {
+  auto metadata = schema.metadata();
   if (metadata == nullptr) {
     return arrow::Status::Invalid("RecordBatch has no metadata");
   }
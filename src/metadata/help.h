@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+#include <initializer_list>
 #include <memory>
 #include <string>
 
@@ -9,6 +11,18 @@ namespace stream_data_processor {
 namespace metadata {
 namespace help {
 
+using FieldsUpdate = std::function<arrow::Status(arrow::FieldVector*)>;
+
+// Replaces the record batch fields with the result of the update keeping
+// the schema metadata. Results are cached per thread by the source fields
+// objects and update_key, so each distinct update runs once per distinct
+// fields however schema metadata of record batches differs.
+arrow::Status updateFields(std::shared_ptr<arrow::RecordBatch>* record_batch,
+                           const std::string& update_key,
+                           const FieldsUpdate& update);
+
+std::string makeUpdateKey(std::initializer_list<std::string> parts);
+
 arrow::Status setFieldMetadata(std::shared_ptr<arrow::Field>* field,
                                const std::string& key,
                                const std::string& metadata);
@@ -29,12 +43,19 @@ arrow::Status setSchemaMetadata(
     std::shared_ptr<arrow::RecordBatch>* record_batch, const std::string& key,
     const std::string& metadata);
 
+arrow::Status removeSchemaMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& key);
+
 arrow::Result<std::string> getFieldMetadata(const arrow::Field& field,
                                             const std::string& key);
 
 arrow::Result<std::string> getColumnNameMetadata(
     const arrow::RecordBatch& record_batch, const std::string& metadata_key);
 
+arrow::Result<std::string> getColumnNameMetadata(
+    const arrow::Schema& schema, const std::string& metadata_key);
+
 }  // namespace help
 }  // namespace metadata
 }  // namespace stream_data_processor
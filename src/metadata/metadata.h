@@ -1,5 +1,7 @@
 #pragma once
 
+#include "chunking.h"
 #include "column_typing.h"
 #include "grouping.h"
+#include "sorting.h"
 #include "time_metadata.h"
@@ -0,0 +1,48 @@
+#include <spdlog/spdlog.h>
+
+#include "help.h"
+#include "sorting.h"
+
+namespace stream_data_processor {
+namespace metadata {
+
+namespace {
+
+inline const std::string SORTED_BY_METADATA_KEY{"sorted_by"};
+
+}  // namespace
+
+arrow::Status setSortedByMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& column_name) {
+  if (record_batch->get()->GetColumnByName(column_name) == nullptr) {
+    return arrow::Status::KeyError(fmt::format(
+        "RecordBatch has no column with name {} to be sorted by",
+        column_name));
+  }
+
+  ARROW_RETURN_NOT_OK(help::setSchemaMetadata(
+      record_batch, SORTED_BY_METADATA_KEY, column_name));
+
+  return arrow::Status::OK();
+}
+
+arrow::Status removeSortedByMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch) {
+  return help::removeSchemaMetadata(record_batch, SORTED_BY_METADATA_KEY);
+}
+
+arrow::Result<std::string> getSortedByMetadata(
+    const arrow::RecordBatch& record_batch) {
+  return help::getColumnNameMetadata(record_batch, SORTED_BY_METADATA_KEY);
+}
+
+bool isSortedByMetadata(const arrow::RecordBatch& record_batch,
+                        const std::string& column_name) {
+  auto sorted_by_result = getSortedByMetadata(record_batch);
+  return sorted_by_result.ok() &&
+         sorted_by_result.ValueOrDie() == column_name;
+}
+
+}  // namespace metadata
+}  // namespace stream_data_processor
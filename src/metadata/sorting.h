@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <arrow/api.h>
+
+namespace stream_data_processor {
+namespace metadata {
+
+// Marks record batch as sorted in ascending order by the column without
+// nulls. Handlers which preserve rows order keep this mark with schema
+// metadata, handlers which reorder rows should remove it.
+arrow::Status setSortedByMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const std::string& column_name);
+
+arrow::Status removeSortedByMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch);
+
+arrow::Result<std::string> getSortedByMetadata(
+    const arrow::RecordBatch& record_batch);
+
+bool isSortedByMetadata(const arrow::RecordBatch& record_batch,
+                        const std::string& column_name);
+
+}  // namespace metadata
+}  // namespace stream_data_processor
@@ -3,6 +3,8 @@
 
 #include "graphite_parser.h"
 #include "metadata/column_typing.h"
+#include "metadata/sorting.h"
+#include "utils/compute_utils.h"
 #include "utils/string_utils.h"
 
 namespace stream_data_processor {
@@ -10,7 +12,8 @@ namespace stream_data_processor {
 GraphiteParser::GraphiteParser(const GraphiteParserOptions& parser_options)
     : separator_(parser_options.separator),
       time_column_name_(parser_options.time_column_name),
-      measurement_column_name_(parser_options.measurement_column_name) {
+      measurement_column_name_(parser_options.measurement_column_name),
+      dictionary_encode_tags_(parser_options.dictionary_encode_tags) {
   for (auto& template_string : parser_options.template_strings) {
     templates_.emplace_back(template_string);
   }
@@ -73,14 +76,20 @@ arrow::Result<arrow::RecordBatchVector> GraphiteParser::parseRecordBatches(
   arrow::TimestampBuilder timestamp_builder(
       arrow::timestamp(arrow::TimeUnit::SECOND), pool);
   arrow::StringBuilder measurement_name_builder;
+  bool is_sorted_by_time = true;
+  std::time_t last_timestamp = 0;
   for (auto& metric : parsed_metrics_) {
     // Building timestamp field
-    if (metric->timestamp != -1) {
-      ARROW_RETURN_NOT_OK(timestamp_builder.Append(metric->timestamp));
-    } else {
-      ARROW_RETURN_NOT_OK(timestamp_builder.Append(std::time(nullptr)));
+    auto timestamp =
+        metric->timestamp != -1 ? metric->timestamp : std::time(nullptr);
+
+    if (timestamp_builder.length() > 0 && timestamp < last_timestamp) {
+      is_sorted_by_time = false;
     }
 
+    last_timestamp = timestamp;
+    ARROW_RETURN_NOT_OK(timestamp_builder.Append(timestamp));
+
     // Building measurement field
     ARROW_RETURN_NOT_OK(
         measurement_name_builder.Append(metric->measurement_name));
@@ -184,6 +193,16 @@ arrow::Result<arrow::RecordBatchVector> GraphiteParser::parseRecordBatches(
   ARROW_RETURN_NOT_OK(metadata::setMeasurementColumnNameMetadata(
       &record_batches.back(), measurement_column_name_));
 
+  if (is_sorted_by_time) {
+    ARROW_RETURN_NOT_OK(metadata::setSortedByMetadata(&record_batches.back(),
+                                                      time_column_name_));
+  }
+
+  if (dictionary_encode_tags_) {
+    ARROW_RETURN_NOT_OK(
+        compute_utils::dictionaryEncodeTags(&record_batches.back()));
+  }
+
   parsed_metrics_.clear();
   return record_batches;
 }
@@ -25,6 +25,9 @@ class GraphiteParser : public Parser {
     std::string time_column_name{"time"};
     std::string separator{"."};
     std::string measurement_column_name{"measurement"};
+
+    // Measurement and tag columns are dictionary-encoded
+    bool dictionary_encode_tags{false};
   };
 
   explicit GraphiteParser(const GraphiteParserOptions& parser_options);
@@ -109,6 +112,7 @@ class GraphiteParser : public Parser {
   std::string separator_;
   std::string time_column_name_;
   std::string measurement_column_name_;
+  bool dictionary_encode_tags_;
   std::vector<MetricTemplate> templates_;
   std::set<std::shared_ptr<Metric>, MetricComparator> parsed_metrics_;
 };
@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include <arrow/array/concatenate.h>
+#include <arrow/compute/api.h>
+#include <spdlog/spdlog.h>
+
+#include "column_accumulator.h"
+#include "utils/arrow_utils.h"
+
+namespace stream_data_processor {
+
+namespace {
+
+template <typename ArrayType>
+inline constexpr bool IS_SUMMABLE =
+    !std::is_same_v<ArrayType, arrow::BooleanArray> &&
+    !std::is_base_of_v<arrow::BinaryArray, ArrayType> &&
+    !std::is_same_v<ArrayType, arrow::DictionaryArray>;
+
+template <typename ArrayType>
+inline auto getValue(const ArrayType& array, int64_t i) {
+  if constexpr (std::is_base_of_v<arrow::BinaryArray, ArrayType>) {
+    auto value = array.GetView(i);
+    return std::string_view(value.data(), value.size());
+  } else if constexpr (std::is_same_v<ArrayType, arrow::DictionaryArray>) {
+    // Chunks may have different dictionaries, so values are compared
+    // decoded
+    auto& dictionary =
+        static_cast<const arrow::BinaryArray&>(*array.dictionary());
+
+    auto value = dictionary.GetView(array.GetValueIndex(i));
+    return std::string_view(value.data(), value.size());
+  } else {
+    return array.Value(i);
+  }
+}
+
+template <typename ValueType>
+inline uint64_t hashValue(const ValueType& value) {
+  if constexpr (std::is_same_v<ValueType, std::string_view>) {
+    return sketch_utils::hash(value.data(), value.size());
+  } else if constexpr (std::is_floating_point_v<ValueType>) {
+    double double_value = value == 0 ? 0 : static_cast<double>(value);
+    uint64_t bits;
+    std::memcpy(&bits, &double_value, sizeof(bits));
+    return sketch_utils::hash(bits);
+  } else {
+    return sketch_utils::hash(static_cast<uint64_t>(value));
+  }
+}
+
+template <typename Visitor>
+arrow::Status visitArrayType(const arrow::DataType& type,
+                             Visitor&& visitor) {
+  switch (type.id()) {
+    case arrow::Type::BOOL:
+      return visitor(static_cast<arrow::BooleanArray*>(nullptr));
+    case arrow::Type::INT8:
+      return visitor(static_cast<arrow::Int8Array*>(nullptr));
+    case arrow::Type::INT16:
+      return visitor(static_cast<arrow::Int16Array*>(nullptr));
+    case arrow::Type::INT32:
+      return visitor(static_cast<arrow::Int32Array*>(nullptr));
+    case arrow::Type::INT64:
+      return visitor(static_cast<arrow::Int64Array*>(nullptr));
+    case arrow::Type::UINT8:
+      return visitor(static_cast<arrow::UInt8Array*>(nullptr));
+    case arrow::Type::UINT16:
+      return visitor(static_cast<arrow::UInt16Array*>(nullptr));
+    case arrow::Type::UINT32:
+      return visitor(static_cast<arrow::UInt32Array*>(nullptr));
+    case arrow::Type::UINT64:
+      return visitor(static_cast<arrow::UInt64Array*>(nullptr));
+    case arrow::Type::FLOAT:
+      return visitor(static_cast<arrow::FloatArray*>(nullptr));
+    case arrow::Type::DOUBLE:
+      return visitor(static_cast<arrow::DoubleArray*>(nullptr));
+    case arrow::Type::TIMESTAMP:
+      return visitor(static_cast<arrow::TimestampArray*>(nullptr));
+    case arrow::Type::STRING:
+      return visitor(static_cast<arrow::StringArray*>(nullptr));
+    case arrow::Type::DICTIONARY: {
+      auto value_type_id =
+          static_cast<const arrow::DictionaryType&>(type).value_type()->id();
+
+      if (value_type_id == arrow::Type::STRING ||
+          value_type_id == arrow::Type::BINARY) {
+        return visitor(static_cast<arrow::DictionaryArray*>(nullptr));
+      }
+
+      return arrow::Status::NotImplemented(fmt::format(
+          "Aggregation of column with type {} is not supported",
+          type.ToString()));
+    }
+    default:
+      return arrow::Status::NotImplemented(fmt::format(
+          "Aggregation of column with type {} is not supported",
+          type.ToString()));
+  }
+}
+
+}  // namespace
+
+ColumnAccumulator::ColumnAccumulator(std::shared_ptr<arrow::DataType> type,
+                                     bool track_quantiles,
+                                     bool track_distinct_count)
+    : type_(std::move(type)),
+      track_quantiles_(track_quantiles),
+      track_distinct_count_(track_distinct_count) {}
+
+arrow::Status ColumnAccumulator::consume(
+    const std::shared_ptr<arrow::Array>& values, const int64_t* times,
+    int64_t group) {
+  ARROW_RETURN_NOT_OK(checkType(*values));
+  ensureGroupsNumber(group + 1);
+
+  int64_t chunk = chunks_.size();
+  chunks_.push_back(values);
+  return visitArrayType(*type_, [&](auto* array_type) {
+    using ArrayType = std::remove_pointer_t<decltype(array_type)>;
+    consumeTyped<ArrayType>(chunk, times,
+                            [group](int64_t /* row */) { return group; });
+    return arrow::Status::OK();
+  });
+}
+
+arrow::Status ColumnAccumulator::consume(
+    const std::shared_ptr<arrow::Array>& values, const int64_t* times,
+    const std::vector<int64_t>& group_ids) {
+  ARROW_RETURN_NOT_OK(checkType(*values));
+  if (group_ids.size() != values->length()) {
+    return arrow::Status::Invalid(
+        "Group ids should be provided for each row of aggregated column");
+  }
+
+  if (!group_ids.empty()) {
+    ensureGroupsNumber(
+        *std::max_element(group_ids.begin(), group_ids.end()) + 1);
+  }
+
+  int64_t chunk = chunks_.size();
+  chunks_.push_back(values);
+  return visitArrayType(*type_, [&](auto* array_type) {
+    using ArrayType = std::remove_pointer_t<decltype(array_type)>;
+    consumeTyped<ArrayType>(
+        chunk, times, [&group_ids](int64_t row) { return group_ids[row]; });
+
+    return arrow::Status::OK();
+  });
+}
+
+arrow::Status ColumnAccumulator::merge(
+    const ColumnAccumulator& other, const std::vector<int64_t>& group_ids) {
+  if (!other.type_->Equals(type_)) {
+    return arrow::Status::TypeError(fmt::format(
+        "Can't merge aggregates of columns with different types: {} and {}",
+        type_->ToString(), other.type_->ToString()));
+  }
+
+  if (group_ids.size() != other.group_states_.size()) {
+    return arrow::Status::Invalid(
+        "Target group should be provided for each merged group");
+  }
+
+  for (auto group_id : group_ids) { ensureGroupsNumber(group_id + 1); }
+
+  int64_t chunks_offset = chunks_.size();
+  chunks_.insert(chunks_.end(), other.chunks_.begin(), other.chunks_.end());
+  return visitArrayType(*type_, [&](auto* array_type) {
+    using ArrayType = std::remove_pointer_t<decltype(array_type)>;
+    mergeTyped<ArrayType>(other, chunks_offset, group_ids);
+    return arrow::Status::OK();
+  });
+}
+
+arrow::Status ColumnAccumulator::compact() {
+  if (chunks_.empty()) {
+    return arrow::Status::OK();
+  }
+
+  auto chunks_offsets = getChunksOffsets();
+
+  arrow::Int64Builder indices_builder;
+  ARROW_RETURN_NOT_OK(indices_builder.Reserve(4 * group_states_.size()));
+  int64_t compacted_rows = 0;
+  auto compact_ref = [&](ValueRef* ref) {
+    if (ref->row != -1) {
+      indices_builder.UnsafeAppend(chunks_offsets[ref->chunk] + ref->row);
+      *ref = {0, compacted_rows++};
+    }
+  };
+
+  for (auto& state : group_states_) {
+    compact_ref(&state.first);
+    compact_ref(&state.last);
+    compact_ref(&state.min);
+    compact_ref(&state.max);
+  }
+
+  std::shared_ptr<arrow::Array> indices;
+  ARROW_RETURN_NOT_OK(indices_builder.Finish(&indices));
+  ARROW_ASSIGN_OR_RAISE(auto compacted_values, takeValues(indices));
+
+  chunks_ = {compacted_values};
+  return arrow::Status::OK();
+}
+
+void ColumnAccumulator::ensureGroupsNumber(int64_t groups_number) {
+  if (groups_number <= group_states_.size()) {
+    return;
+  }
+
+  group_states_.resize(groups_number);
+  if (track_quantiles_) {
+    quantile_sketches_.resize(groups_number);
+  }
+
+  if (track_distinct_count_) {
+    distinct_count_sketches_.resize(groups_number);
+  }
+}
+
+arrow::Result<std::shared_ptr<arrow::Array>> ColumnAccumulator::finish(
+    Statistic statistic, double quantile) const {
+  // Mean of timestamps is the timestamp of the exact integer quotient
+  if (statistic == kMeanValue && type_->id() == arrow::Type::TIMESTAMP) {
+    arrow::TimestampBuilder result_builder(type_,
+                                           arrow::default_memory_pool());
+    for (auto& state : group_states_) {
+      if (state.count == 0) {
+        ARROW_RETURN_NOT_OK(result_builder.AppendNull());
+      } else {
+        ARROW_RETURN_NOT_OK(result_builder.Append(
+            static_cast<int64_t>(state.integer_sum / state.count)));
+      }
+    }
+
+    std::shared_ptr<arrow::Array> result;
+    ARROW_RETURN_NOT_OK(result_builder.Finish(&result));
+    return result;
+  }
+
+  if (statistic == kMeanValue || statistic == kQuantileValue) {
+    if (statistic == kQuantileValue && !track_quantiles_) {
+      return arrow::Status::Invalid("Quantiles are not tracked");
+    }
+
+    arrow::DoubleBuilder result_builder;
+    ARROW_RETURN_NOT_OK(visitArrayType(*type_, [&](auto* array_type) {
+      using ArrayType = std::remove_pointer_t<decltype(array_type)>;
+      if constexpr (!IS_SUMMABLE<ArrayType>) {
+        return arrow::Status::NotImplemented(fmt::format(
+            "Mean and quantiles of column with type {} are not supported",
+            type_->ToString()));
+      } else {
+        for (size_t i = 0; i < group_states_.size(); ++i) {
+          auto& state = group_states_[i];
+          if (state.count == 0) {
+            ARROW_RETURN_NOT_OK(result_builder.AppendNull());
+          } else if (statistic == kMeanValue) {
+            ARROW_RETURN_NOT_OK(
+                result_builder.Append(getMean<ArrayType>(state)));
+          } else {
+            ARROW_RETURN_NOT_OK(result_builder.Append(
+                quantile_sketches_[i].getQuantile(quantile)));
+          }
+        }
+
+        return arrow::Status::OK();
+      }
+    }));
+
+    std::shared_ptr<arrow::Array> result;
+    ARROW_RETURN_NOT_OK(result_builder.Finish(&result));
+    return result;
+  }
+
+  if (statistic == kDistinctCount) {
+    if (!track_distinct_count_) {
+      return arrow::Status::Invalid("Distinct values count is not tracked");
+    }
+
+    arrow::Int64Builder result_builder;
+    for (auto& sketch : distinct_count_sketches_) {
+      ARROW_RETURN_NOT_OK(result_builder.Append(sketch.getEstimate()));
+    }
+
+    std::shared_ptr<arrow::Array> result;
+    ARROW_RETURN_NOT_OK(result_builder.Finish(&result));
+    return result;
+  }
+
+  if (chunks_.empty()) {
+    return arrow::MakeArrayOfNull(type_, group_states_.size());
+  }
+
+  auto chunks_offsets = getChunksOffsets();
+
+  arrow::Int64Builder indices_builder;
+  ARROW_RETURN_NOT_OK(indices_builder.Reserve(group_states_.size()));
+  for (auto& state : group_states_) {
+    ValueRef ref;
+    switch (statistic) {
+      case kFirstValue:
+        ref = state.first;
+        break;
+      case kLastValue:
+        ref = state.last;
+        break;
+      case kMinValue:
+        ref = state.min;
+        break;
+      case kMaxValue:
+        ref = state.max;
+        break;
+      default:
+        return arrow::Status::Invalid(
+            fmt::format("Unexpected statistic type: {}", statistic));
+    }
+
+    if (ref.row == -1) {
+      indices_builder.UnsafeAppendNull();
+    } else {
+      indices_builder.UnsafeAppend(chunks_offsets[ref.chunk] + ref.row);
+    }
+  }
+
+  std::shared_ptr<arrow::Array> indices;
+  ARROW_RETURN_NOT_OK(indices_builder.Finish(&indices));
+  return takeValues(indices);
+}
+
+std::shared_ptr<arrow::DataType> ColumnAccumulator::getResultType(
+    const std::shared_ptr<arrow::DataType>& type, Statistic statistic) {
+  switch (statistic) {
+    case kMeanValue:
+      if (type->id() == arrow::Type::TIMESTAMP) {
+        return type;
+      }
+
+      return arrow::float64();
+    case kQuantileValue:
+      return arrow::float64();
+    case kDistinctCount:
+      return arrow::int64();
+    default:
+      return type;
+  }
+}
+
+template <typename ArrayType>
+double ColumnAccumulator::getMean(const GroupState& state) {
+  if constexpr (std::is_integral_v<typename ArrayType::value_type>) {
+    auto quotient = state.integer_sum / state.count;
+    auto remainder = state.integer_sum % state.count;
+    return static_cast<double>(quotient) +
+           static_cast<double>(remainder) / static_cast<double>(state.count);
+  } else {
+    return state.sum / state.count;
+  }
+}
+
+template <typename ArrayType, typename GroupIdGetter>
+void ColumnAccumulator::consumeTyped(int64_t chunk, const int64_t* times,
+                                     const GroupIdGetter& get_group_id) {
+  auto& array = static_cast<const ArrayType&>(*chunks_[chunk]);
+  auto value_of = [this](const ValueRef& ref) {
+    return getValue(static_cast<const ArrayType&>(*chunks_[ref.chunk]),
+                    ref.row);
+  };
+
+  for (int64_t i = 0; i < array.length(); ++i) {
+    auto group = get_group_id(i);
+    if (group == -1) {
+      continue;
+    }
+
+    auto& state = group_states_[group];
+    if (state.first.row == -1 || times[i] < state.first_time) {
+      state.first = {chunk, i};
+      state.first_time = times[i];
+    }
+
+    if (state.last.row == -1 || times[i] > state.last_time) {
+      state.last = {chunk, i};
+      state.last_time = times[i];
+    }
+
+    if (array.IsNull(i)) {
+      continue;
+    }
+
+    auto value = getValue(array, i);
+    if (state.min.row == -1 || value < value_of(state.min)) {
+      state.min = {chunk, i};
+    }
+
+    if (state.max.row == -1 || value > value_of(state.max)) {
+      state.max = {chunk, i};
+    }
+
+    if constexpr (IS_SUMMABLE<ArrayType>) {
+      if constexpr (std::is_integral_v<decltype(value)>) {
+        state.integer_sum += value;
+      } else {
+        state.sum += value;
+      }
+
+      if (track_quantiles_) {
+        quantile_sketches_[group].add(static_cast<double>(value));
+      }
+    }
+
+    if (track_distinct_count_) {
+      distinct_count_sketches_[group].add(hashValue(value));
+    }
+
+    ++state.count;
+  }
+}
+
+template <typename ArrayType>
+void ColumnAccumulator::mergeTyped(const ColumnAccumulator& other,
+                                   int64_t chunks_offset,
+                                   const std::vector<int64_t>& group_ids) {
+  auto value_of = [this](const ValueRef& ref) {
+    return getValue(static_cast<const ArrayType&>(*chunks_[ref.chunk]),
+                    ref.row);
+  };
+
+  auto shifted = [chunks_offset](ValueRef ref) {
+    if (ref.row != -1) {
+      ref.chunk += chunks_offset;
+    }
+
+    return ref;
+  };
+
+  for (size_t i = 0; i < other.group_states_.size(); ++i) {
+    if (group_ids[i] == -1) {
+      continue;
+    }
+
+    if (track_quantiles_ && other.track_quantiles_) {
+      quantile_sketches_[group_ids[i]].merge(other.quantile_sketches_[i]);
+    }
+
+    if (track_distinct_count_ && other.track_distinct_count_) {
+      distinct_count_sketches_[group_ids[i]].merge(
+          other.distinct_count_sketches_[i]);
+    }
+
+    auto& other_state = other.group_states_[i];
+    auto& state = group_states_[group_ids[i]];
+    if (other_state.first.row != -1 &&
+        (state.first.row == -1 ||
+         other_state.first_time < state.first_time)) {
+      state.first = shifted(other_state.first);
+      state.first_time = other_state.first_time;
+    }
+
+    if (other_state.last.row != -1 &&
+        (state.last.row == -1 || other_state.last_time > state.last_time)) {
+      state.last = shifted(other_state.last);
+      state.last_time = other_state.last_time;
+    }
+
+    if (other_state.count == 0) {
+      continue;
+    }
+
+    auto other_min = shifted(other_state.min);
+    if (state.min.row == -1 || value_of(other_min) < value_of(state.min)) {
+      state.min = other_min;
+    }
+
+    auto other_max = shifted(other_state.max);
+    if (state.max.row == -1 || value_of(other_max) > value_of(state.max)) {
+      state.max = other_max;
+    }
+
+    state.sum += other_state.sum;
+    state.integer_sum += other_state.integer_sum;
+    state.count += other_state.count;
+  }
+}
+
+arrow::Result<std::shared_ptr<arrow::Array>> ColumnAccumulator::takeValues(
+    const std::shared_ptr<arrow::Array>& indices) const {
+  std::shared_ptr<arrow::Array> values;
+  if (chunks_.size() == 1) {
+    values = chunks_.front();
+  } else {
+    // Chunks of dictionary-encoded columns may have different dictionaries
+    auto chunks = chunks_;
+    ARROW_RETURN_NOT_OK(arrow_utils::unifyDictionaries(&chunks));
+    ARROW_ASSIGN_OR_RAISE(values, arrow::Concatenate(chunks));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto result_datum,
+                        arrow::compute::Take(values, indices));
+
+  return result_datum.make_array();
+}
+
+std::vector<int64_t> ColumnAccumulator::getChunksOffsets() const {
+  std::vector<int64_t> chunks_offsets{0};
+  for (auto& chunk : chunks_) {
+    chunks_offsets.push_back(chunks_offsets.back() + chunk->length());
+  }
+
+  return chunks_offsets;
+}
+
+arrow::Status ColumnAccumulator::checkType(const arrow::Array& values) const {
+  if (!values.type()->Equals(type_)) {
+    return arrow::Status::TypeError(fmt::format(
+        "Aggregated column of type {} expected, got {}", type_->ToString(),
+        values.type()->ToString()));
+  }
+
+  return arrow::Status::OK();
+}
+
+}  // namespace stream_data_processor
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <arrow/api.h>
+
+#include "utils/sketch_utils.h"
+
+namespace stream_data_processor {
+
+// Accumulates first and last (by time), min, max and mean values of one
+// column for a number of groups in a single typed pass over the column
+// buffers. Quantiles and distinct values count are estimated with sketches
+// if they are tracked. Accumulators of the same column can be merged.
+class ColumnAccumulator {
+ public:
+  enum Statistic {
+    kFirstValue,
+    kLastValue,
+    kMinValue,
+    kMaxValue,
+    kMeanValue,
+    kQuantileValue,
+    kDistinctCount
+  };
+
+  explicit ColumnAccumulator(std::shared_ptr<arrow::DataType> type,
+                             bool track_quantiles = false,
+                             bool track_distinct_count = false);
+
+  arrow::Status consume(const std::shared_ptr<arrow::Array>& values,
+                        const int64_t* times, int64_t group);
+
+  // Row i goes to group group_ids[i], -1 skips the row.
+  arrow::Status consume(const std::shared_ptr<arrow::Array>& values,
+                        const int64_t* times,
+                        const std::vector<int64_t>& group_ids);
+
+  // Merges groups of other accumulator into groups of this one: group i of
+  // other accumulator goes to group group_ids[i], -1 skips the group.
+  arrow::Status merge(const ColumnAccumulator& other,
+                      const std::vector<int64_t>& group_ids);
+
+  // Keeps only values referenced by groups states so accumulated input
+  // arrays can be released.
+  arrow::Status compact();
+
+  void ensureGroupsNumber(int64_t groups_number);
+
+  [[nodiscard]] int64_t getGroupsNumber() const {
+    return group_states_.size();
+  }
+
+  [[nodiscard]] const std::shared_ptr<arrow::DataType>& getType() const {
+    return type_;
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Array>> finish(
+      Statistic statistic, double quantile = 0.5) const;
+
+  static std::shared_ptr<arrow::DataType> getResultType(
+      const std::shared_ptr<arrow::DataType>& type, Statistic statistic);
+
+ private:
+  struct ValueRef {
+    int64_t chunk{-1};
+    int64_t row{-1};
+  };
+
+  struct GroupState {
+    int64_t first_time{0};
+    int64_t last_time{0};
+    ValueRef first;
+    ValueRef last;
+    ValueRef min;
+    ValueRef max;
+    double sum{0};
+
+    // Integer values are summed exactly and divided once by finish, so
+    // means of large values, e.g. timestamps, don't lose precision
+    __int128 integer_sum{0};
+    int64_t count{0};
+  };
+
+ private:
+  template <typename ArrayType, typename GroupIdGetter>
+  void consumeTyped(int64_t chunk, const int64_t* times,
+                    const GroupIdGetter& get_group_id);
+
+  template <typename ArrayType>
+  static double getMean(const GroupState& state);
+
+  template <typename ArrayType>
+  void mergeTyped(const ColumnAccumulator& other, int64_t chunks_offset,
+                  const std::vector<int64_t>& group_ids);
+
+  arrow::Status checkType(const arrow::Array& values) const;
+
+  arrow::Result<std::shared_ptr<arrow::Array>> takeValues(
+      const std::shared_ptr<arrow::Array>& indices) const;
+
+  [[nodiscard]] std::vector<int64_t> getChunksOffsets() const;
+
+ private:
+  std::shared_ptr<arrow::DataType> type_;
+  arrow::ArrayVector chunks_;
+  std::vector<GroupState> group_states_;
+  bool track_quantiles_;
+  bool track_distinct_count_;
+  std::vector<sketch_utils::DDSketch> quantile_sketches_;
+  std::vector<sketch_utils::HyperLogLog> distinct_count_sketches_;
+};
+
+}  // namespace stream_data_processor
@@ -1,11 +1,13 @@
-#include <unordered_set>
+#include <string>
 #include <utility>
 
+#include <arrow/compute/api.h>
 #include <spdlog/spdlog.h>
 
 #include "aggregate_handler.h"
 
-#include "aggregate_functions/aggregate_functions.h"
+#include "aggregate_functions/column_accumulator.h"
+#include "metadata/chunking.h"
 #include "metadata/column_typing.h"
 #include "metadata/grouping.h"
 
@@ -13,21 +15,6 @@
 
 namespace stream_data_processor {
 
-const std::unordered_map<AggregateHandler::AggregateFunctionEnumType,
-                         std::unique_ptr<AggregateFunction>>
-    AggregateHandler::TYPES_TO_FUNCTIONS = []() {
-      std::unordered_map<AggregateHandler::AggregateFunctionEnumType,
-                         std::unique_ptr<AggregateFunction>>
-          init_map;
-
-      init_map[kFirst] = std::make_unique<FirstAggregateFunction>();
-      init_map[kLast] = std::make_unique<LastAggregateFunction>();
-      init_map[kMax] = std::make_unique<MaxAggregateFunction>();
-      init_map[kMin] = std::make_unique<MinAggregateFunction>();
-      init_map[kMean] = std::make_unique<MeanAggregateFunction>();
-      return init_map;
-    }();
-
 AggregateHandler::AggregateHandler(
     const AggregateHandler::AggregateOptions& options)
     : options_(options) {}
@@ -42,6 +29,11 @@ arrow::Result<arrow::RecordBatchVector> AggregateHandler::handle(
     return arrow::RecordBatchVector{};
   }
 
+  // Multi-group record batch is aggregated to a record batch for each group
+  if (metadata::isMultiGroup(*record_batch)) {
+    return handle(arrow::RecordBatchVector{record_batch});
+  }
+
   ARROW_ASSIGN_OR_RAISE(auto result_vector,
                         handle(std::vector{record_batch}));
   if (result_vector.size() != 1) {
@@ -54,113 +46,381 @@ arrow::Result<arrow::RecordBatchVector> AggregateHandler::handle(
 }
 
 arrow::Result<arrow::RecordBatchVector> AggregateHandler::handle(
-    const arrow::RecordBatchVector& record_batches) {
-  if (record_batches.empty()) {
-    return arrow::RecordBatchVector{};
+    const arrow::RecordBatchVector& input_record_batches) {
+  std::vector<GroupedRecordBatch> record_batches;
+  for (auto& input_record_batch : input_record_batches) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batch,
+        compute_utils::materializeSelection(input_record_batch));
+
+    if (record_batch->num_rows() > 0) {
+      ARROW_ASSIGN_OR_RAISE(record_batches.emplace_back(),
+                            groupRows(record_batch));
+    }
   }
 
   ARROW_RETURN_NOT_OK(isValid(record_batches));
 
-  auto grouped = splitByGroups(record_batches);
+  std::vector<GroupResult> groups_results;
+  std::unordered_map<metadata::GroupId, size_t> groups_results_index;
+  for (size_t i = 0; i < record_batches.size(); ++i) {
+    auto& record_batch = record_batches[i];
+    for (size_t j = 0; j < record_batch.groups.size(); ++j) {
+      auto& group = record_batch.groups[j];
+      auto [group_result_iter, inserted] =
+          groups_results_index.try_emplace(group->id, groups_results.size());
 
-  arrow::RecordBatchVector result;
-  for ([[maybe_unused]] auto& [_, record_batches_group] : grouped) {
-    if (record_batches_group.empty()) {
-      return arrow::Status::ExecutionError(
-          "RecordBatchVector after splitting"
-          " by groups must be non-empty");
+      if (inserted) {
+        ARROW_ASSIGN_OR_RAISE(auto plan,
+                              getPlan(*record_batch.record_batch, *group));
+
+        groups_results.push_back({group, std::move(plan)});
+      }
+
+      auto& group_result = groups_results[group_result_iter->second];
+      if (group_result.fronts.empty() ||
+          (group_result.last_record_batch != i &&
+           (!record_batch.chunk_id.has_value() ||
+            record_batch.chunk_id != group_result.last_chunk_id))) {
+        group_result.fronts.emplace_back(i,
+                                         record_batch.groups_first_rows[j]);
+      }
+
+      group_result.last_record_batch = i;
+      group_result.last_chunk_id = record_batch.chunk_id;
+      record_batch.groups_results.push_back(group_result_iter->second);
+      record_batch.groups_result_rows.push_back(
+          group_result.fronts.size() - 1);
     }
+  }
 
-    auto pool = arrow::default_memory_pool();
-    arrow::ArrayVector result_arrays;
+  std::vector<std::vector<size_t>> plans_groups_results;
+  std::unordered_map<const SchemaPlan*, size_t> plans_index;
+  for (size_t i = 0; i < groups_results.size(); ++i) {
+    auto [plan_iter, inserted] = plans_index.try_emplace(
+        groups_results[i].plan.get(), plans_groups_results.size());
+
+    if (inserted) {
+      plans_groups_results.emplace_back();
+    }
+
+    plans_groups_results[plan_iter->second].push_back(i);
+  }
 
-    auto grouping_columns =
-        metadata::extractGroupingColumnsNames(*record_batches_group.front());
+  arrow::RecordBatchVector result;
+  for (auto& plan_groups_results : plans_groups_results) {
+    ARROW_RETURN_NOT_OK(aggregateGroups(record_batches, plan_groups_results,
+                                        &groups_results, &result));
+  }
+
+  return result;
+}
 
-    std::string time_column_name;
+arrow::Result<std::shared_ptr<const AggregateHandler::SchemaPlan>>
+AggregateHandler::getPlan(const arrow::RecordBatch& record_batch,
+                          const metadata::InternedGroup& group) {
+  auto& grouping_columns = group.grouping_columns_names;
+
+  // Grouping columns are a part of the group metadata the plan reads
+  std::string grouping_columns_key;
+  for (auto& column_name : grouping_columns) {
+    grouping_columns_key += column_name;
+    grouping_columns_key.push_back('\0');
+  }
+
+  auto& schema = record_batch.schema();
+  auto compile = [this, &schema, &grouping_columns](
+                     const arrow::Schema& /* unused */) {
+    return compilePlan(schema, grouping_columns);
+  };
+
+  return plans_.get(schema, grouping_columns_key, compile);
+}
+
+arrow::Result<AggregateHandler::GroupedRecordBatch>
+AggregateHandler::groupRows(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  GroupedRecordBatch grouped;
+  auto chunk_id_result = metadata::getChunkIdMetadata(*record_batch);
+  if (chunk_id_result.ok()) {
+    grouped.chunk_id = chunk_id_result.ValueOrDie();
+  }
+
+  if (!metadata::isMultiGroup(*record_batch)) {
+    grouped.record_batch = record_batch;
+    grouped.groups.push_back(metadata::extractInternedGroup(*record_batch));
+    grouped.groups_first_rows.push_back(0);
+    return grouped;
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto group_column_index,
+                        compute_utils::getGroupColumnIndex(*record_batch));
+
+  // Rows are keyed by the dictionary indices, so the group metadata is
+  // interned once for each group
+  auto group_column = record_batch->column(group_column_index);
+  compute_utils::KeyTable key_table;
+  ARROW_RETURN_NOT_OK(key_table.encode({group_column}, &grouped.rows_groups));
+
+  grouped.groups_first_rows.assign(key_table.size(), -1);
+  for (int64_t i = 0; i < record_batch->num_rows(); ++i) {
+    auto& first_row = grouped.groups_first_rows[grouped.rows_groups[i]];
+    if (first_row == -1) {
+      first_row = i;
+    }
+  }
+
+  // Rows with null group belong to the group without metadata
+  for (auto first_row : grouped.groups_first_rows) {
     ARROW_ASSIGN_OR_RAISE(
-        time_column_name,
-        metadata::getTimeColumnNameMetadata(*record_batches.front()));
-
-    for (auto group_iter = grouping_columns.begin();
-         group_iter != grouping_columns.end(); ++group_iter) {
-      if (*group_iter == time_column_name) {
-        grouping_columns.erase(
-            group_iter);  // we should remove time grouping -- time column
-                          // will be replaced with aggregated one
-        break;
+        auto group_scalar,
+        arrow_utils::getDecodedScalar(*group_column, first_row));
+
+    std::string_view group_metadata;
+    if (group_scalar->is_valid) {
+      auto& group_value =
+          *static_cast<const arrow::BaseBinaryScalar&>(*group_scalar).value;
+
+      group_metadata = std::string_view(
+          reinterpret_cast<const char*>(group_value.data()),
+          group_value.size());
+    }
+
+    grouped.groups.push_back(metadata::internGroup(group_metadata));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(grouped.record_batch,
+                        record_batch->RemoveColumn(group_column_index));
+
+  ARROW_RETURN_NOT_OK(
+      metadata::removeGroupColumnNameMetadata(&grouped.record_batch));
+
+  return grouped;
+}
+
+arrow::Status AggregateHandler::aggregateGroups(
+    const std::vector<GroupedRecordBatch>& record_batches,
+    const std::vector<size_t>& groups_results_indices,
+    std::vector<GroupResult>* groups_results,
+    arrow::RecordBatchVector* result) const {
+  auto& plan = *(*groups_results)[groups_results_indices.front()].plan;
+  auto& time_column_name = plan.time_column_name;
+  auto& grouping_columns = plan.grouping_columns;
+  auto& measurement_column_name = plan.measurement_column_name;
+
+  int64_t rows_number = 0;
+  for (auto i : groups_results_indices) {
+    auto& group_result = (*groups_results)[i];
+    group_result.rows_offset = rows_number;
+    rows_number += group_result.fronts.size();
+  }
+
+  // Rows of groups with other plans are skipped
+  std::vector<const arrow::RecordBatch*> parts;
+  std::vector<std::vector<int64_t>> parts_rows_ids;
+  for (auto& record_batch : record_batches) {
+    std::vector<int64_t> groups_rows_ids(record_batch.groups.size(), -1);
+    bool has_rows = false;
+    for (size_t j = 0; j < record_batch.groups.size(); ++j) {
+      auto& group_result =
+          (*groups_results)[record_batch.groups_results[j]];
+
+      if (group_result.plan.get() == &plan) {
+        groups_rows_ids[j] =
+            group_result.rows_offset + record_batch.groups_result_rows[j];
+
+        has_rows = true;
       }
     }
 
-    bool explicitly_add_measurement_field = true;
-    bool has_measurement = false;
-
-    std::string measurement_column_name;
-    auto measurement_column_name_result =
-        metadata::getMeasurementColumnNameMetadata(*record_batches.front());
-
-    if (!measurement_column_name_result.ok()) {
-      explicitly_add_measurement_field = false;
-    } else {
-      has_measurement = true;
-      measurement_column_name =
-          std::move(measurement_column_name_result).ValueOrDie();
-      for (auto& grouping_column : grouping_columns) {
-        if (grouping_column == measurement_column_name) {
-          explicitly_add_measurement_field = false;
-          break;
-        }
+    if (!has_rows) {
+      continue;
+    }
+
+    auto num_rows = record_batch.record_batch->num_rows();
+    auto& rows_ids = parts_rows_ids.emplace_back(num_rows);
+    for (int64_t i = 0; i < num_rows; ++i) {
+      rows_ids[i] = record_batch.rows_groups.empty()
+                        ? groups_rows_ids.front()
+                        : groups_rows_ids[record_batch.rows_groups[i]];
+    }
+
+    parts.push_back(record_batch.record_batch.get());
+  }
+
+  auto time_type =
+      parts.front()->GetColumnByName(time_column_name)->type();
+
+  ColumnAccumulator time_accumulator(time_type);
+  std::vector<const int64_t*> parts_times;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    auto time_column = parts[i]->GetColumnByName(time_column_name);
+    if (!time_column->type()->Equals(time_type)) {
+      ARROW_ASSIGN_OR_RAISE(time_column,
+                            arrow::compute::Cast(*time_column, time_type));
+    }
+
+    parts_times.push_back(
+        std::static_pointer_cast<arrow::TimestampArray>(time_column)
+            ->raw_values());
+
+    ARROW_RETURN_NOT_OK(time_accumulator.consume(
+        time_column, parts_times.back(), parts_rows_ids[i]));
+  }
+
+  time_accumulator.ensureGroupsNumber(rows_number);
+  ARROW_ASSIGN_OR_RAISE(
+      auto time_array,
+      finishTimeAggregate(
+          time_accumulator,
+          options_.result_time_column_rule.aggregate_function));
+
+  arrow::ArrayVector aggregated_arrays;
+  for (auto& [column_name, aggregate_cases] : options_.aggregate_columns) {
+    std::optional<ColumnAccumulator> accumulator;
+    for (size_t i = 0; i < parts.size(); ++i) {
+      auto column = parts[i]->GetColumnByName(column_name);
+      if (column == nullptr) {
+        continue;
+      }
+
+      if (!accumulator.has_value()) {
+        accumulator.emplace(
+            createAccumulator(column->type(), aggregate_cases));
       }
+
+      ARROW_RETURN_NOT_OK(
+          accumulator->consume(column, parts_times[i], parts_rows_ids[i]));
+    }
+
+    for (auto& aggregate_case : aggregate_cases) {
+      if (!accumulator.has_value()) {
+        aggregated_arrays.push_back(
+            std::make_shared<arrow::NullArray>(rows_number));
+
+        continue;
+      }
+
+      accumulator->ensureGroupsNumber(rows_number);
+      ARROW_ASSIGN_OR_RAISE(
+          aggregated_arrays.emplace_back(),
+          accumulator->finish(getStatistic(aggregate_case.aggregate_function),
+                              aggregate_case.quantile));
+    }
+  }
+
+  auto result_schema = plan.result_schema;
+  if (result_schema == nullptr) {
+    std::vector<std::shared_ptr<arrow::Schema>> schemas;
+    for (auto& record_batch : record_batches) {
+      schemas.push_back(record_batch.record_batch->schema());
     }
 
-    std::shared_ptr<arrow::Schema> result_schema;
     ARROW_ASSIGN_OR_RAISE(
         result_schema,
-        createResultSchema(record_batches, grouping_columns,
-                           explicitly_add_measurement_field,
+        createResultSchema(schemas, grouping_columns,
+                           plan.explicitly_add_measurement,
                            measurement_column_name, time_column_name));
+  }
 
-    ARROW_RETURN_NOT_OK(
-        aggregateTimeColumn(record_batches_group, &result_arrays, pool));
+  for (auto i : groups_results_indices) {
+    auto& group_result = (*groups_results)[i];
+    auto offset = group_result.rows_offset;
+    int64_t group_rows_number = group_result.fronts.size();
 
-    if (explicitly_add_measurement_field) {
-      ARROW_RETURN_NOT_OK(fillMeasurementColumn(
-          record_batches_group, &result_arrays, measurement_column_name));
+    arrow::ArrayVector result_arrays;
+    result_arrays.push_back(time_array->Slice(offset, group_rows_number));
+
+    if (plan.explicitly_add_measurement) {
+      ARROW_RETURN_NOT_OK(
+          fillMeasurementColumn(record_batches, group_result.fronts,
+                                &result_arrays, measurement_column_name));
     }
 
+    auto& [front_index, front_row] = group_result.fronts.front();
     ARROW_RETURN_NOT_OK(fillGroupingColumns(
-        record_batches_group, &result_arrays, grouping_columns));
-
-    for (auto& [column_name, aggregate_functions] :
-         options_.aggregate_columns) {
-      for (auto& aggregate_case : aggregate_functions) {
-        ARROW_RETURN_NOT_OK(aggregate(record_batches_group, column_name,
-                                      aggregate_case.aggregate_function,
-                                      &result_arrays, pool));
-      }
+        *record_batches[front_index].record_batch, front_row,
+        group_rows_number, &result_arrays, grouping_columns));
+
+    for (auto& aggregated_array : aggregated_arrays) {
+      result_arrays.push_back(
+          aggregated_array->Slice(offset, group_rows_number));
     }
 
-    result.push_back(arrow::RecordBatch::Make(
-        result_schema, record_batches_group.size(), result_arrays));
+    result->push_back(arrow::RecordBatch::Make(
+        result_schema, group_rows_number, result_arrays));
 
     ARROW_RETURN_NOT_OK(
-        metadata::fillGroupMetadata(&result.back(), grouping_columns));
+        metadata::fillGroupMetadata(&result->back(), grouping_columns));
 
     ARROW_RETURN_NOT_OK(metadata::setTimeColumnNameMetadata(
-        &result.back(), options_.result_time_column_rule.result_column_name));
+        &result->back(),
+        options_.result_time_column_rule.result_column_name));
 
-    if (has_measurement) {
+    if (plan.has_measurement) {
       ARROW_RETURN_NOT_OK(metadata::setMeasurementColumnNameMetadata(
-          &result.back(), measurement_column_name));
+          &result->back(), measurement_column_name));
     }
   }
 
-  return result;
+  return arrow::Status::OK();
+}
+
+arrow::Result<AggregateHandler::SchemaPlan> AggregateHandler::compilePlan(
+    const std::shared_ptr<arrow::Schema>& schema,
+    const std::vector<std::string>& grouping_columns_names) const {
+  SchemaPlan plan;
+  plan.grouping_columns = grouping_columns_names;
+
+  ARROW_ASSIGN_OR_RAISE(plan.time_column_name,
+                        metadata::getTimeColumnNameMetadata(*schema));
+
+  auto& grouping_columns = plan.grouping_columns;
+  for (auto group_iter = grouping_columns.begin();
+       group_iter != grouping_columns.end(); ++group_iter) {
+    if (*group_iter == plan.time_column_name) {
+      grouping_columns.erase(
+          group_iter);  // we should remove time grouping -- time column
+                        // will be replaced with aggregated one
+      break;
+    }
+  }
+
+  auto measurement_column_name_result =
+      metadata::getMeasurementColumnNameMetadata(*schema);
+
+  if (measurement_column_name_result.ok()) {
+    plan.has_measurement = true;
+    plan.explicitly_add_measurement = true;
+    plan.measurement_column_name =
+        std::move(measurement_column_name_result).ValueOrDie();
+    for (auto& grouping_column : grouping_columns) {
+      if (grouping_column == plan.measurement_column_name) {
+        plan.explicitly_add_measurement = false;
+        break;
+      }
+    }
+  }
+
+  for ([[maybe_unused]] auto& [column_name, _] : options_.aggregate_columns) {
+    if (schema->GetFieldByName(column_name) == nullptr) {
+      return plan;
+    }
+  }
+
+  ARROW_ASSIGN_OR_RAISE(
+      plan.result_schema,
+      createResultSchema({schema}, grouping_columns,
+                         plan.explicitly_add_measurement,
+                         plan.measurement_column_name,
+                         plan.time_column_name));
+
+  return plan;
 }
 
 arrow::Result<std::shared_ptr<arrow::Schema>>
 AggregateHandler::createResultSchema(
-    const arrow::RecordBatchVector& record_batches,
+    const std::vector<std::shared_ptr<arrow::Schema>>& schemas,
     const std::vector<std::string>& grouping_columns,
     bool explicitly_add_measurement,
     const std::string& measurement_column_name,
@@ -168,7 +428,7 @@ AggregateHandler::createResultSchema(
   arrow::FieldVector result_fields;
 
   auto time_column_type =
-      record_batches.front()->GetColumnByName(time_column_name)->type();
+      schemas.front()->GetFieldByName(time_column_name)->type();
 
   result_fields.push_back(arrow::field(
       options_.result_time_column_rule.result_column_name, time_column_type));
@@ -185,8 +445,8 @@ AggregateHandler::createResultSchema(
   }
 
   for (auto& grouping_column_name : grouping_columns) {
-    auto column_field = record_batches.front()->schema()->GetFieldByName(
-        grouping_column_name);
+    auto column_field =
+        schemas.front()->GetFieldByName(grouping_column_name);
 
     if (column_field != nullptr) {
       result_fields.push_back(
@@ -197,17 +457,23 @@ AggregateHandler::createResultSchema(
 
   for (auto& [column_name, aggregate_cases] : options_.aggregate_columns) {
     std::shared_ptr<arrow::DataType> column_type = arrow::null();
-    for (auto& record_batch : record_batches) {
-      auto column = record_batch->GetColumnByName(column_name);
-      if (column != nullptr) {
-        column_type = column->type();
+    for (auto& schema : schemas) {
+      auto field = schema->GetFieldByName(column_name);
+      if (field != nullptr) {
+        column_type = field->type();
         break;
       }
     }
 
     for (auto& aggregate_case : aggregate_cases) {
+      auto result_type = column_type;
+      if (column_type->id() != arrow::Type::NA) {
+        result_type = ColumnAccumulator::getResultType(
+            column_type, getStatistic(aggregate_case.aggregate_function));
+      }
+
       result_fields.push_back(
-          arrow::field(aggregate_case.result_column_name, column_type));
+          arrow::field(aggregate_case.result_column_name, result_type));
 
       ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
           &result_fields.back(), aggregate_case.result_column_type));
@@ -217,154 +483,95 @@ AggregateHandler::createResultSchema(
   return arrow::schema(result_fields);
 }
 
-arrow::Status AggregateHandler::aggregate(
-    const arrow::RecordBatchVector& groups,
-    const std::string& aggregate_column_name,
-    const AggregateFunctionEnumType& aggregate_function,
-    arrow::ArrayVector* result_arrays, arrow::MemoryPool* pool) const {
-  auto aggregate_column_field =
-      groups.front()->schema()->GetFieldByName(aggregate_column_name);
-
-  if (aggregate_column_field == nullptr) {
-    arrow::NullBuilder null_builder;
-    ARROW_RETURN_NOT_OK(null_builder.AppendNulls(groups.size()));
-    result_arrays->emplace_back();
-    ARROW_RETURN_NOT_OK(null_builder.Finish(&result_arrays->back()));
-    return arrow::Status::OK();
-  }
-
-  std::shared_ptr<arrow::ArrayBuilder> builder;
-  if (aggregate_column_field->type()->id() == arrow::Type::TIMESTAMP) {
-    ARROW_ASSIGN_OR_RAISE(builder, arrow_utils::createTimestampArrayBuilder(
-                                       aggregate_column_field->type(), pool));
-  } else {
-    ARROW_ASSIGN_OR_RAISE(builder,
-                          arrow_utils::createArrayBuilder(
-                              aggregate_column_field->type()->id(), pool));
-  }
+arrow::Result<std::shared_ptr<arrow::Array>>
+AggregateHandler::finishTimeAggregate(
+    const ColumnAccumulator& accumulator,
+    AggregateFunctionEnumType aggregate_function) {
+  // Mean of timestamps is already a timestamp
+  return accumulator.finish(getStatistic(aggregate_function));
+}
 
-  for (auto& group : groups) {
-    ARROW_ASSIGN_OR_RAISE(auto aggregated_value,
-                          TYPES_TO_FUNCTIONS.at(aggregate_function)
-                              ->aggregate(*group, aggregate_column_name));
-
-    if (aggregate_column_field->type()->id() == arrow::Type::TIMESTAMP) {
-      ARROW_RETURN_NOT_OK(arrow_utils::appendToTimestampBuilder(
-          aggregated_value, &builder, aggregate_column_field->type()));
-    } else {
-      ARROW_RETURN_NOT_OK(arrow_utils::appendToBuilder(
-          aggregated_value, &builder, aggregate_column_field->type()->id()));
-    }
+ColumnAccumulator::Statistic AggregateHandler::getStatistic(
+    AggregateFunctionEnumType aggregate_function) {
+  switch (aggregate_function) {
+    case kFirst:
+      return ColumnAccumulator::kFirstValue;
+    case kLast:
+      return ColumnAccumulator::kLastValue;
+    case kMax:
+      return ColumnAccumulator::kMaxValue;
+    case kMin:
+      return ColumnAccumulator::kMinValue;
+    case kQuantile:
+      return ColumnAccumulator::kQuantileValue;
+    case kCountDistinct:
+      return ColumnAccumulator::kDistinctCount;
+    default:
+      return ColumnAccumulator::kMeanValue;
   }
-
-  result_arrays->emplace_back();
-  ARROW_RETURN_NOT_OK(builder->Finish(&result_arrays->back()));
-  return arrow::Status::OK();
 }
 
-arrow::Status AggregateHandler::aggregateTimeColumn(
-    const arrow::RecordBatchVector& record_batch_vector,
-    arrow::ArrayVector* result_arrays, arrow::MemoryPool* pool) const {
-  ARROW_ASSIGN_OR_RAISE(
-      auto time_column_name,
-      metadata::getTimeColumnNameMetadata(*record_batch_vector.front()));
-
-  auto ts_column_type =
-      record_batch_vector.front()->GetColumnByName(time_column_name)->type();
-
-  arrow::NumericBuilder<arrow::TimestampType> ts_builder(ts_column_type,
-                                                         pool);
-  for (auto& group : record_batch_vector) {
-    std::shared_ptr<arrow::Scalar> ts;
-
-    ARROW_ASSIGN_OR_RAISE(
-        ts, TYPES_TO_FUNCTIONS
-                .at(options_.result_time_column_rule.aggregate_function)
-                ->aggregate(*group, time_column_name));
-
-    ARROW_ASSIGN_OR_RAISE(ts, ts->CastTo(ts_column_type));
-    ARROW_RETURN_NOT_OK(ts_builder.Append(
-        std::static_pointer_cast<arrow::TimestampScalar>(ts)->value));
+ColumnAccumulator AggregateHandler::createAccumulator(
+    const std::shared_ptr<arrow::DataType>& type,
+    const std::vector<AggregateCase>& aggregate_cases) {
+  bool track_quantiles = false;
+  bool track_distinct_count = false;
+  for (auto& aggregate_case : aggregate_cases) {
+    track_quantiles |= aggregate_case.aggregate_function == kQuantile;
+    track_distinct_count |=
+        aggregate_case.aggregate_function == kCountDistinct;
   }
 
-  result_arrays->push_back(std::shared_ptr<arrow::TimestampArray>());
-  ARROW_RETURN_NOT_OK(ts_builder.Finish(&result_arrays->back()));
-  return arrow::Status::OK();
+  return ColumnAccumulator(type, track_quantiles, track_distinct_count);
 }
 
 arrow::Status AggregateHandler::fillGroupingColumns(
-    const arrow::RecordBatchVector& grouped,
+    const arrow::RecordBatch& front, int64_t front_row, int64_t rows_number,
     arrow::ArrayVector* result_arrays,
     const std::vector<std::string>& grouping_columns) {
-  std::unordered_set<std::string> grouping_columns_set;
   for (auto& grouping_column : grouping_columns) {
-    grouping_columns_set.insert(grouping_column);
-  }
-
-  std::shared_ptr<arrow::RecordBatch> cropped_record_batch = grouped.front();
-  int i = 0;
-  for (auto& column_name : grouped.front()->schema()->field_names()) {
-    if (grouping_columns_set.find(column_name) ==
-        grouping_columns_set.end()) {
-      ARROW_ASSIGN_OR_RAISE(cropped_record_batch,
-                            cropped_record_batch->RemoveColumn(i));
-
-      --i;
+    auto column = front.GetColumnByName(grouping_column);
+    if (column == nullptr) {
+      continue;
     }
 
-    ++i;
-  }
-
-  arrow::RecordBatchVector cropped_groups;
-  cropped_record_batch = cropped_record_batch->Slice(0, 1);
-  for (int j = 0; j < grouped.size(); ++j) {
-    cropped_groups.push_back(arrow::RecordBatch::Make(
-        cropped_record_batch->schema(), cropped_record_batch->num_rows(),
-        cropped_record_batch->columns()));
-  }
-
-  std::shared_ptr<arrow::RecordBatch> unique_record_batch;
-  ARROW_ASSIGN_OR_RAISE(
-      unique_record_batch,
-      convert_utils::concatenateRecordBatches(cropped_groups));
-
-  for (auto& grouping_column : grouping_columns) {
-    result_arrays->push_back(
-        unique_record_batch->GetColumnByName(grouping_column));
-  }
-
-  return arrow::Status();
-}
+    // Dictionary-encoded columns are repeated by index to keep the
+    // dictionary
+    if (column->type_id() == arrow::Type::DICTIONARY) {
+      ARROW_ASSIGN_OR_RAISE(
+          auto front_indices,
+          arrow::MakeArrayFromScalar(arrow::Int64Scalar(front_row),
+                                     rows_number));
 
-std::unordered_map<std::string, arrow::RecordBatchVector>
-AggregateHandler::splitByGroups(
-    const arrow::RecordBatchVector& record_batches) {
-  std::unordered_map<std::string, arrow::RecordBatchVector> grouped;
-  for (auto& record_batch : record_batches) {
-    auto group_string = metadata::extractGroupMetadata(*record_batch);
+      ARROW_ASSIGN_OR_RAISE(auto group_datum,
+                            arrow::compute::Take(column, front_indices));
 
-    if (grouped.find(group_string) == grouped.end()) {
-      grouped[group_string] = arrow::RecordBatchVector();
+      result_arrays->push_back(group_datum.make_array());
+      continue;
     }
 
-    grouped[group_string].push_back(record_batch);
+    ARROW_ASSIGN_OR_RAISE(auto group_value, column->GetScalar(front_row));
+    ARROW_ASSIGN_OR_RAISE(
+        result_arrays->emplace_back(),
+        arrow::MakeArrayFromScalar(*group_value, rows_number));
   }
 
-  return grouped;
+  return arrow::Status::OK();
 }
 
 arrow::Status AggregateHandler::isValid(
-    const arrow::RecordBatchVector& record_batches) const {
+    const std::vector<GroupedRecordBatch>& record_batches) {
   std::string time_column_name{""};
 
-  for (auto& record_batch : record_batches) {
+  for (auto& grouped : record_batches) {
+    auto& record_batch = *grouped.record_batch;
     if (time_column_name.empty()) {
       ARROW_ASSIGN_OR_RAISE(
           time_column_name,
-          metadata::getTimeColumnNameMetadata(*record_batch));
+          metadata::getTimeColumnNameMetadata(record_batch));
     }
 
-    auto time_column = record_batch->GetColumnByName(time_column_name);
+    auto time_column = record_batch.GetColumnByName(time_column_name);
 
     if (time_column == nullptr) {
       return arrow::Status::Invalid(fmt::format(
@@ -381,22 +588,26 @@ arrow::Status AggregateHandler::isValid(
 
   return arrow::Status::OK();
 }
+
 arrow::Status AggregateHandler::fillMeasurementColumn(
-    const arrow::RecordBatchVector& grouped,
+    const std::vector<GroupedRecordBatch>& record_batches,
+    const std::vector<std::pair<size_t, int64_t>>& fronts,
     arrow::ArrayVector* result_arrays,
     const std::string& measurement_column_name) {
   arrow::StringBuilder measurement_column_builder;
-  for (auto& record_batch : grouped) {
+  for (auto& [record_batch_index, front_row] : fronts) {
     auto measurement_column =
-        record_batch->GetColumnByName(measurement_column_name);
+        record_batches[record_batch_index].record_batch->GetColumnByName(
+            measurement_column_name);
 
     if (measurement_column == nullptr) {
       return arrow::Status::Invalid(fmt::format(
           "Measurement column {} is not present", measurement_column_name));
     }
 
-    ARROW_ASSIGN_OR_RAISE(auto measurement_value,
-                          measurement_column->GetScalar(0));
+    ARROW_ASSIGN_OR_RAISE(
+        auto measurement_value,
+        arrow_utils::getDecodedScalar(*measurement_column, front_row));
 
     ARROW_RETURN_NOT_OK(
         measurement_column_builder.Append(measurement_value->ToString()));
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include "aggregate_functions/aggregate_function.h"
+#include "aggregate_functions/column_accumulator.h"
+#include "metadata/grouping.h"
 #include "record_batch_handler.h"
+#include "schema_plans.h"
 
 #include "metadata.pb.h"
 
@@ -13,12 +17,21 @@ namespace stream_data_processor {
 
 class AggregateHandler : public RecordBatchHandler {
  public:
-  enum AggregateFunctionEnumType { kFirst, kLast, kMax, kMin, kMean };
+  enum AggregateFunctionEnumType {
+    kFirst,
+    kLast,
+    kMax,
+    kMin,
+    kMean,
+    kQuantile,
+    kCountDistinct
+  };
 
   struct AggregateCase {
     AggregateFunctionEnumType aggregate_function;
     std::string result_column_name;
     metadata::ColumnType result_column_type{metadata::FIELD};
+    double quantile{0.5};
   };
 
   struct AggregateOptions {
@@ -36,47 +49,102 @@ class AggregateHandler : public RecordBatchHandler {
   arrow::Result<arrow::RecordBatchVector> handle(
       const arrow::RecordBatchVector& record_batches) override;
 
+  static ColumnAccumulator::Statistic getStatistic(
+      AggregateFunctionEnumType aggregate_function);
+
+  static ColumnAccumulator createAccumulator(
+      const std::shared_ptr<arrow::DataType>& type,
+      const std::vector<AggregateCase>& aggregate_cases);
+
+  static arrow::Result<std::shared_ptr<arrow::Array>> finishTimeAggregate(
+      const ColumnAccumulator& accumulator,
+      AggregateFunctionEnumType aggregate_function);
+
+ private:
+  struct SchemaPlan {
+    std::string time_column_name;
+    std::vector<std::string> grouping_columns;
+    bool has_measurement{false};
+    bool explicitly_add_measurement{false};
+    std::string measurement_column_name;
+
+    // Null if some aggregate columns are missing in the schema, so the
+    // result schema depends on the other record batches
+    std::shared_ptr<arrow::Schema> result_schema;
+  };
+
+  // Input record batch with groups of its rows. Rows of multi-group record
+  // batches are grouped by keys of the group column without splitting.
+  struct GroupedRecordBatch {
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    std::optional<int64_t> chunk_id;
+    std::vector<metadata::InternedGroupPtr> groups;
+    std::vector<int64_t> groups_first_rows;
+
+    // Index of the group of each row, empty if there is only one group
+    std::vector<int64_t> rows_groups;
+
+    // Result of each group and its row the group rows are aggregated to
+    std::vector<size_t> groups_results;
+    std::vector<int64_t> groups_result_rows;
+  };
+
+  // Result of a group has a row for each logical record batch of the
+  // group. Measurement and grouping columns values are taken from the
+  // front rows of logical record batches.
+  struct GroupResult {
+    metadata::InternedGroupPtr group;
+    std::shared_ptr<const SchemaPlan> plan;
+    std::vector<std::pair<size_t, int64_t>> fronts;
+    size_t last_record_batch{0};
+    std::optional<int64_t> last_chunk_id;
+    int64_t rows_offset{0};
+  };
+
  private:
-  static std::unordered_map<std::string, arrow::RecordBatchVector>
-  splitByGroups(const arrow::RecordBatchVector& record_batches);
+  arrow::Result<SchemaPlan> compilePlan(
+      const std::shared_ptr<arrow::Schema>& schema,
+      const std::vector<std::string>& grouping_columns) const;
+
+  arrow::Result<std::shared_ptr<const SchemaPlan>> getPlan(
+      const arrow::RecordBatch& record_batch,
+      const metadata::InternedGroup& group);
 
-  arrow::Status isValid(const arrow::RecordBatchVector& record_batches) const;
+  static arrow::Result<GroupedRecordBatch> groupRows(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch);
+
+  static arrow::Status isValid(
+      const std::vector<GroupedRecordBatch>& record_batches);
+
+  // Aggregates groups with the same plan in one pass over each record
+  // batch
+  arrow::Status aggregateGroups(
+      const std::vector<GroupedRecordBatch>& record_batches,
+      const std::vector<size_t>& groups_results_indices,
+      std::vector<GroupResult>* groups_results,
+      arrow::RecordBatchVector* result) const;
 
   arrow::Result<std::shared_ptr<arrow::Schema>> createResultSchema(
-      const arrow::RecordBatchVector& record_batches,
+      const std::vector<std::shared_ptr<arrow::Schema>>& schemas,
       const std::vector<std::string>& grouping_columns,
       bool explicitly_add_measurement,
       const std::string& measurement_column_name,
       const std::string& time_column_name) const;
 
   static arrow::Status fillGroupingColumns(
-      const arrow::RecordBatchVector& grouped,
-      arrow::ArrayVector* result_arrays,
+      const arrow::RecordBatch& front, int64_t front_row,
+      int64_t rows_number, arrow::ArrayVector* result_arrays,
       const std::vector<std::string>& grouping_columns);
 
-  arrow::Status aggregate(
-      const arrow::RecordBatchVector& groups,
-      const std::string& aggregate_column_name,
-      const AggregateFunctionEnumType& aggregate_function,
-      arrow::ArrayVector* result_arrays,
-      arrow::MemoryPool* pool = arrow::default_memory_pool()) const;
-
-  arrow::Status aggregateTimeColumn(
-      const arrow::RecordBatchVector& record_batch_vector,
-      arrow::ArrayVector* result_arrays,
-      arrow::MemoryPool* pool = arrow::default_memory_pool()) const;
-
   static arrow::Status fillMeasurementColumn(
-      const arrow::RecordBatchVector& grouped,
+      const std::vector<GroupedRecordBatch>& record_batches,
+      const std::vector<std::pair<size_t, int64_t>>& fronts,
       arrow::ArrayVector* result_arrays,
       const std::string& measurement_column_name);
 
  private:
-  static const std::unordered_map<AggregateFunctionEnumType,
-                                  std::unique_ptr<AggregateFunction>>
-      TYPES_TO_FUNCTIONS;
-
   AggregateOptions options_;
+  SchemaPlans<SchemaPlan> plans_;
 };
 
 }  // namespace stream_data_processor
@@ -1,6 +1,7 @@
 #include "default_handler.h"
 
 #include "metadata/column_typing.h"
+#include "utils/compute_utils.h"
 #include "utils/serialize_utils.h"
 
 namespace stream_data_processor {
@@ -140,7 +141,11 @@ arrow::Status DefaultHandler::addMissingColumn<bool>(
 }
 
 arrow::Result<arrow::RecordBatchVector> DefaultHandler::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
   auto copy_record_batch = arrow::RecordBatch::Make(record_batch->schema(),
                                                     record_batch->num_rows(),
                                                     record_batch->columns());
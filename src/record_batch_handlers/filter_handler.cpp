@@ -1,30 +1,79 @@
 #include <arrow/compute/api.h>
-#include <gandiva/selection_vector.h>
 #include <gandiva/tree_expr_builder.h>
+#include <spdlog/spdlog.h>
 
 #include "filter_handler.h"
+#include "utils/compute_utils.h"
 #include "utils/serialize_utils.h"
 
 namespace stream_data_processor {
 
+namespace {
+
+inline const std::string SELECTION_COLUMN_NAME{"__selection"};
+
+}  // namespace
+
 arrow::Result<arrow::RecordBatchVector> FilterHandler::handle(
     const std::shared_ptr<arrow::RecordBatch>& record_batch) {
   auto pool = arrow::default_memory_pool();
-  ARROW_ASSIGN_OR_RAISE(auto filter, createFilter(record_batch->schema()));
+
+  auto input_record_batch = record_batch;
+  ARROW_ASSIGN_OR_RAISE(auto input_selection,
+                        compute_utils::extractSelection(&input_record_batch));
+
+  // Conditions are evaluated on the columns they use only, selected rows
+  // are taken from the input
+  ARROW_ASSIGN_OR_RAISE(
+      auto condition_record_batch,
+      gandiva_utils::makeInput(*input_record_batch, condition_columns_));
+
+  ARROW_ASSIGN_OR_RAISE(auto filter,
+                        createFilter(condition_record_batch->schema()));
 
   std::shared_ptr<gandiva::SelectionVector> selection;
   ARROW_RETURN_NOT_OK(gandiva::SelectionVector::MakeInt64(
-      record_batch->num_rows(), pool, &selection));
+      input_record_batch->num_rows(), pool, &selection));
+
+  ARROW_RETURN_NOT_OK(filter->Evaluate(*condition_record_batch, selection));
+  if (input_selection != nullptr) {
+    intersectSelection(*input_selection, selection.get());
+  }
 
-  ARROW_RETURN_NOT_OK(filter->Evaluate(*record_batch, selection));
+  auto selected_rows = selection->GetNumSlots();
+  if (selected_rows == input_record_batch->num_rows()) {
+    return arrow::RecordBatchVector{input_record_batch};
+  }
+
+  int64_t first_selected_row = 0;
+  if (selected_rows > 0) {
+    first_selected_row = selection->GetIndex(0);
+  }
+
+  if (selected_rows == 0 ||
+      static_cast<int64_t>(selection->GetIndex(selected_rows - 1)) -
+              first_selected_row + 1 ==
+          selected_rows) {
+    return arrow::RecordBatchVector{
+        input_record_batch->Slice(first_selected_row, selected_rows)};
+  }
+
+  if (propagate_selection_) {
+    ARROW_ASSIGN_OR_RAISE(auto result_record_batch,
+                          attachSelection(input_record_batch, *selection));
+
+    return arrow::RecordBatchVector{result_record_batch};
+  }
 
   arrow::Datum take_datum;
   ARROW_ASSIGN_OR_RAISE(
-      take_datum, arrow::compute::Take(record_batch, selection->ToArray()));
+      take_datum,
+      arrow::compute::Take(input_record_batch, selection->ToArray()));
 
   auto result_record_batch = take_datum.record_batch();
-  copySchemaMetadata(*record_batch, &result_record_batch);
-  ARROW_RETURN_NOT_OK(copyColumnTypes(*record_batch, &result_record_batch));
+  copySchemaMetadata(*input_record_batch, &result_record_batch);
+  ARROW_RETURN_NOT_OK(
+      copyColumnTypes(*input_record_batch, &result_record_batch));
 
   return arrow::RecordBatchVector{result_record_batch};
 }
@@ -56,4 +105,59 @@ arrow::Result<std::shared_ptr<gandiva::Filter>> FilterHandler::createFilter(
   return filter;
 }
 
+void FilterHandler::intersectSelection(
+    const arrow::BooleanArray& input_selection,
+    gandiva::SelectionVector* selection) {
+  int64_t selected_rows = 0;
+  for (int64_t i = 0; i < selection->GetNumSlots(); ++i) {
+    auto row = selection->GetIndex(i);
+    if (input_selection.Value(row)) {
+      selection->SetIndex(selected_rows++, row);
+    }
+  }
+
+  selection->SetNumSlots(selected_rows);
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>>
+FilterHandler::attachSelection(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    const gandiva::SelectionVector& selection) {
+  if (record_batch->schema()->GetFieldIndex(SELECTION_COLUMN_NAME) != -1) {
+    return arrow::Status::Invalid(fmt::format(
+        "Can't attach selection to RecordBatch with column named {}",
+        SELECTION_COLUMN_NAME));
+  }
+
+  arrow::BooleanBuilder selection_builder;
+  ARROW_RETURN_NOT_OK(selection_builder.Reserve(record_batch->num_rows()));
+
+  int64_t next_slot = 0;
+  for (int64_t i = 0; i < record_batch->num_rows(); ++i) {
+    bool is_selected = false;
+    if (next_slot < selection.GetNumSlots() &&
+        selection.GetIndex(next_slot) == static_cast<uint64_t>(i)) {
+      is_selected = true;
+      ++next_slot;
+    }
+
+    selection_builder.UnsafeAppend(is_selected);
+  }
+
+  std::shared_ptr<arrow::Array> selection_array;
+  ARROW_RETURN_NOT_OK(selection_builder.Finish(&selection_array));
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto result_record_batch,
+      record_batch->AddColumn(
+          record_batch->num_columns(),
+          arrow::field(SELECTION_COLUMN_NAME, arrow::boolean()),
+          selection_array));
+
+  ARROW_RETURN_NOT_OK(metadata::setSelectionColumnNameMetadata(
+      &result_record_batch, SELECTION_COLUMN_NAME));
+
+  return result_record_batch;
+}
+
 }  // namespace stream_data_processor
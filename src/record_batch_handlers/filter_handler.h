@@ -1,19 +1,34 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 #include <gandiva/condition.h>
 #include <gandiva/filter.h>
+#include <gandiva/selection_vector.h>
 
 #include "record_batch_handler.h"
+#include "utils/gandiva_utils.h"
 
 namespace stream_data_processor {
 
 class FilterHandler : public RecordBatchHandler {
  public:
+  // With propagate_selection enabled sparse selections are not
+  // materialized: the input is passed further with an extra boolean
+  // selection column which is consumed by MapHandler and AggregateHandler.
   template <typename ConditionVectorType>
-  explicit FilterHandler(ConditionVectorType&& conditions)
-      : conditions_(std::forward<ConditionVectorType>(conditions)) {}
+  explicit FilterHandler(ConditionVectorType&& conditions,
+                         bool propagate_selection = false)
+      : conditions_(std::forward<ConditionVectorType>(conditions)),
+        propagate_selection_(propagate_selection) {
+    for (auto& condition : conditions_) {
+      gandiva_utils::collectColumnNames(condition->root(),
+                                        &condition_columns_);
+    }
+  }
 
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
@@ -22,8 +37,17 @@ class FilterHandler : public RecordBatchHandler {
   arrow::Result<std::shared_ptr<gandiva::Filter>> createFilter(
       const std::shared_ptr<arrow::Schema>& schema) const;
 
+  static void intersectSelection(const arrow::BooleanArray& input_selection,
+                                 gandiva::SelectionVector* selection);
+
+  static arrow::Result<std::shared_ptr<arrow::RecordBatch>> attachSelection(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch,
+      const gandiva::SelectionVector& selection);
+
  private:
   std::vector<gandiva::ConditionPtr> conditions_;
+  std::unordered_set<std::string> condition_columns_;
+  bool propagate_selection_;
 };
 
 }  // namespace stream_data_processor
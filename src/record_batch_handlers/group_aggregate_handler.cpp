@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+
+#include <arrow/compute/api.h>
+#include <spdlog/spdlog.h>
+
+#include "group_aggregate_handler.h"
+#include "metadata/column_typing.h"
+#include "utils/utils.h"
+
+namespace stream_data_processor {
+
+arrow::Result<arrow::RecordBatchVector> GroupAggregateHandler::handle(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  return handle(arrow::RecordBatchVector{record_batch});
+}
+
+arrow::Result<arrow::RecordBatchVector> GroupAggregateHandler::handle(
+    const arrow::RecordBatchVector& input_record_batches) {
+  arrow::RecordBatchVector record_batches;
+  for (auto& input_record_batch : input_record_batches) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batch,
+        compute_utils::materializeSelection(input_record_batch));
+
+    if (record_batch->num_rows() > 0) {
+      record_batches.push_back(std::move(record_batch));
+    }
+  }
+
+  if (record_batches.empty()) {
+    return arrow::RecordBatchVector{};
+  }
+
+  auto& front_record_batch = *record_batches.front();
+  ARROW_ASSIGN_OR_RAISE(
+      auto time_column_name,
+      metadata::getTimeColumnNameMetadata(front_record_batch));
+
+  auto front_time_column =
+      front_record_batch.GetColumnByName(time_column_name);
+  if (front_time_column == nullptr) {
+    return arrow::Status::Invalid(fmt::format(
+        "Time column with name {} should be presented", time_column_name));
+  }
+
+  if (front_time_column->type_id() != arrow::Type::TIMESTAMP) {
+    return arrow::Status::NotImplemented(
+        "Aggregation currently supports arrow::Type::TIMESTAMP type for "
+        "timestamp field only");
+  }
+
+  auto time_type = front_time_column->type();
+  auto grouping_columns =
+      getGroupingColumns(front_record_batch, time_column_name);
+
+  std::vector<ResultColumn> result_columns;
+
+  result_columns.push_back(
+      {arrow::field(options_.result_time_column_rule.result_column_name,
+                    time_type),
+       std::make_unique<ColumnAccumulator>(time_type)});
+
+  ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
+      &result_columns.back().field, metadata::TIME));
+
+  std::optional<std::string> measurement_column_name;
+  auto measurement_column_name_result =
+      metadata::getMeasurementColumnNameMetadata(front_record_batch);
+
+  if (measurement_column_name_result.ok()) {
+    measurement_column_name = measurement_column_name_result.ValueOrDie();
+  }
+
+  bool explicitly_add_measurement =
+      measurement_column_name.has_value() &&
+      std::find(grouping_columns.begin(), grouping_columns.end(),
+                measurement_column_name.value()) == grouping_columns.end();
+
+  std::vector<std::string> first_value_columns;
+  if (explicitly_add_measurement) {
+    first_value_columns.push_back(measurement_column_name.value());
+  }
+
+  first_value_columns.insert(first_value_columns.end(),
+                             grouping_columns.begin(),
+                             grouping_columns.end());
+
+  for (auto& column_name : first_value_columns) {
+    auto field = front_record_batch.schema()->GetFieldByName(column_name);
+    if (field == nullptr) {
+      return arrow::Status::Invalid(
+          fmt::format("Column {} is not present", column_name));
+    }
+
+    result_columns.push_back(
+        {field, std::make_unique<ColumnAccumulator>(field->type())});
+  }
+
+  std::unordered_map<std::string, size_t> aggregate_columns_idx;
+  for (auto& [column_name, aggregate_cases] : options_.aggregate_columns) {
+    aggregate_columns_idx[column_name] = result_columns.size();
+    result_columns.push_back({nullptr, nullptr});
+  }
+
+  compute_utils::KeyTable key_table;
+  std::vector<int64_t> group_ids;
+  for (auto& record_batch : record_batches) {
+    if (grouping_columns.empty()) {
+      group_ids.assign(record_batch->num_rows(), 0);
+    } else {
+      arrow::ArrayVector key_columns;
+      for (auto& grouping_column : grouping_columns) {
+        auto key_column = record_batch->GetColumnByName(grouping_column);
+        if (key_column == nullptr) {
+          return arrow::Status::Invalid(fmt::format(
+              "Grouping column {} is not present", grouping_column));
+        }
+
+        key_columns.push_back(key_column);
+      }
+
+      ARROW_RETURN_NOT_OK(key_table.encode(key_columns, &group_ids));
+    }
+
+    ARROW_ASSIGN_OR_RAISE(
+        auto time_column,
+        getTimeColumn(*record_batch, time_column_name, time_type));
+
+    auto times =
+        std::static_pointer_cast<arrow::TimestampArray>(time_column)
+            ->raw_values();
+
+    ARROW_RETURN_NOT_OK(result_columns.front().accumulator->consume(
+        time_column, times, group_ids));
+
+    for (size_t i = 0; i < first_value_columns.size(); ++i) {
+      auto column = record_batch->GetColumnByName(first_value_columns[i]);
+      if (column == nullptr) {
+        return arrow::Status::Invalid(fmt::format(
+            "Column {} is not present", first_value_columns[i]));
+      }
+
+      ARROW_RETURN_NOT_OK(
+          result_columns[i + 1].accumulator->consume(column, times,
+                                                     group_ids));
+    }
+
+    for (auto& [column_name, result_column_idx] : aggregate_columns_idx) {
+      auto column = record_batch->GetColumnByName(column_name);
+      if (column == nullptr) {
+        continue;
+      }
+
+      auto& accumulator = result_columns[result_column_idx].accumulator;
+      if (accumulator == nullptr) {
+        accumulator = std::make_unique<ColumnAccumulator>(
+            AggregateHandler::createAccumulator(
+                column->type(), options_.aggregate_columns.at(column_name)));
+      }
+
+      ARROW_RETURN_NOT_OK(accumulator->consume(column, times, group_ids));
+    }
+  }
+
+  int64_t groups_number = grouping_columns.empty() ? 1 : key_table.size();
+
+  arrow::FieldVector result_fields;
+  arrow::ArrayVector result_arrays;
+  for (size_t i = 0; i <= first_value_columns.size(); ++i) {
+    auto& result_column = result_columns[i];
+    result_column.accumulator->ensureGroupsNumber(groups_number);
+    result_fields.push_back(result_column.field);
+    if (i == 0) {
+      ARROW_ASSIGN_OR_RAISE(
+          result_arrays.emplace_back(),
+          AggregateHandler::finishTimeAggregate(
+              *result_column.accumulator,
+              options_.result_time_column_rule.aggregate_function));
+    } else {
+      ARROW_ASSIGN_OR_RAISE(
+          result_arrays.emplace_back(),
+          result_column.accumulator->finish(ColumnAccumulator::kFirstValue));
+    }
+  }
+
+  for (auto& [column_name, aggregate_cases] : options_.aggregate_columns) {
+    auto& accumulator =
+        result_columns[aggregate_columns_idx[column_name]].accumulator;
+
+    for (auto& aggregate_case : aggregate_cases) {
+      if (accumulator == nullptr) {
+        result_fields.push_back(
+            arrow::field(aggregate_case.result_column_name, arrow::null()));
+
+        result_arrays.push_back(
+            std::make_shared<arrow::NullArray>(groups_number));
+      } else {
+        auto statistic =
+            AggregateHandler::getStatistic(aggregate_case.aggregate_function);
+
+        accumulator->ensureGroupsNumber(groups_number);
+        result_fields.push_back(arrow::field(
+            aggregate_case.result_column_name,
+            ColumnAccumulator::getResultType(accumulator->getType(),
+                                             statistic)));
+
+        ARROW_ASSIGN_OR_RAISE(
+            result_arrays.emplace_back(),
+            accumulator->finish(statistic, aggregate_case.quantile));
+      }
+
+      ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
+          &result_fields.back(), aggregate_case.result_column_type));
+    }
+  }
+
+  auto result = arrow::RecordBatch::Make(arrow::schema(result_fields),
+                                         groups_number, result_arrays);
+
+  ARROW_RETURN_NOT_OK(metadata::setTimeColumnNameMetadata(
+      &result, options_.result_time_column_rule.result_column_name));
+
+  if (measurement_column_name.has_value()) {
+    ARROW_RETURN_NOT_OK(metadata::setMeasurementColumnNameMetadata(
+        &result, measurement_column_name.value()));
+  }
+
+  return arrow::RecordBatchVector{result};
+}
+
+std::vector<std::string> GroupAggregateHandler::getGroupingColumns(
+    const arrow::RecordBatch& record_batch,
+    const std::string& time_column_name) const {
+  std::vector<std::string> grouping_columns;
+  for (auto& grouping_column : grouping_columns_) {
+    if (grouping_column != time_column_name &&
+        record_batch.GetColumnByName(grouping_column) != nullptr) {
+      grouping_columns.push_back(grouping_column);
+    }
+  }
+
+  return grouping_columns;
+}
+
+arrow::Result<std::shared_ptr<arrow::Array>>
+GroupAggregateHandler::getTimeColumn(
+    const arrow::RecordBatch& record_batch,
+    const std::string& time_column_name,
+    const std::shared_ptr<arrow::DataType>& time_type) {
+  auto time_column = record_batch.GetColumnByName(time_column_name);
+  if (time_column == nullptr) {
+    return arrow::Status::Invalid(fmt::format(
+        "Time column with name {} should be presented", time_column_name));
+  }
+
+  if (!time_column->type()->Equals(time_type)) {
+    return arrow::compute::Cast(*time_column, time_type);
+  }
+
+  return time_column;
+}
+
+}  // namespace stream_data_processor
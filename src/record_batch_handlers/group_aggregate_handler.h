@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <arrow/api.h>
+
+#include "aggregate_handler.h"
+#include "record_batch_handler.h"
+
+namespace stream_data_processor {
+
+// Groups rows by values of grouping columns with a hash table and
+// aggregates each group in the same pass. The result is a single record
+// batch with one row per group.
+class GroupAggregateHandler : public RecordBatchHandler {
+ public:
+  template <typename StringVectorType, typename OptionsType>
+  GroupAggregateHandler(StringVectorType&& grouping_columns,
+                        OptionsType&& options)
+      : grouping_columns_(std::forward<StringVectorType>(grouping_columns)),
+        options_(std::forward<OptionsType>(options)) {}
+
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
+
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const arrow::RecordBatchVector& record_batches) override;
+
+ private:
+  struct ResultColumn {
+    std::shared_ptr<arrow::Field> field;
+    std::unique_ptr<ColumnAccumulator> accumulator;
+  };
+
+ private:
+  std::vector<std::string> getGroupingColumns(
+      const arrow::RecordBatch& record_batch,
+      const std::string& time_column_name) const;
+
+  static arrow::Result<std::shared_ptr<arrow::Array>> getTimeColumn(
+      const arrow::RecordBatch& record_batch,
+      const std::string& time_column_name,
+      const std::shared_ptr<arrow::DataType>& time_type);
+
+ private:
+  std::vector<std::string> grouping_columns_;
+  AggregateHandler::AggregateOptions options_;
+};
+
+}  // namespace stream_data_processor
@@ -1,21 +1,218 @@
+#include <future>
+
 #include "group_dispatcher.h"
 #include "metadata/grouping.h"
+#include "utils/utils.h"
 
 namespace stream_data_processor {
 
 GroupDispatcher::GroupDispatcher(
     std::shared_ptr<HandlerFactory> handler_factory)
-    : handler_factory_(std::move(handler_factory)) {}
+    : GroupDispatcher(std::move(handler_factory), Options{}) {}
 
 arrow::Result<arrow::RecordBatchVector> GroupDispatcher::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
-  auto group_metadata = metadata::extractGroupMetadata(*record_batch);
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  if (metadata::isMultiGroup(*input_record_batch)) {
+    return handle(arrow::RecordBatchVector{input_record_batch});
+  }
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
+  auto group = metadata::extractInternedGroup(*record_batch);
+  return handleInShard(&shards_[getShardIndex(group->id)], group,
+                       record_batch);
+}
+
+arrow::Result<arrow::RecordBatchVector> GroupDispatcher::handle(
+    const arrow::RecordBatchVector& input_record_batches) {
+  // Groups are carried along with the split record batches, so they are
+  // not looked up by the group metadata again
+  arrow::RecordBatchVector record_batches;
+  std::vector<metadata::InternedGroupPtr> groups;
+  for (auto& input_record_batch : input_record_batches) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batch,
+        compute_utils::materializeSelection(input_record_batch));
 
-  if (groups_states_.find(group_metadata) == groups_states_.end()) {
-    groups_states_[group_metadata] = handler_factory_->createHandler();
+    ARROW_ASSIGN_OR_RAISE(auto record_batch_groups,
+                          compute_utils::splitGroups(record_batch, &groups));
+
+    convert_utils::append(std::move(record_batch_groups), record_batches);
+  }
+
+  if (shards_.size() == 1 || record_batches.size() < 2) {
+    arrow::RecordBatchVector result;
+    for (size_t i = 0; i < record_batches.size(); ++i) {
+      ARROW_ASSIGN_OR_RAISE(
+          auto batch_result,
+          handleInShard(&shards_[getShardIndex(groups[i]->id)], groups[i],
+                        record_batches[i]));
+
+      convert_utils::append(std::move(batch_result), result);
+    }
+
+    return result;
+  }
+
+  if (thread_pool_ == nullptr) {
+    ARROW_ASSIGN_OR_RAISE(
+        thread_pool_, arrow::internal::ThreadPool::Make(shards_.size()));
   }
 
-  return groups_states_[group_metadata]->handle(record_batch);
+  std::vector<std::vector<size_t>> shards_batches(shards_.size());
+  for (size_t i = 0; i < record_batches.size(); ++i) {
+    shards_batches[getShardIndex(groups[i]->id)].push_back(i);
+  }
+
+  std::vector<arrow::RecordBatchVector> results(record_batches.size());
+  std::vector<std::promise<arrow::Status>> shards_statuses(shards_.size());
+  std::vector<std::future<arrow::Status>> shards_futures;
+  for (size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+    shards_futures.push_back(shards_statuses[shard_index].get_future());
+    if (shards_batches[shard_index].empty()) {
+      shards_statuses[shard_index].set_value(arrow::Status::OK());
+      continue;
+    }
+
+    // Each batch index belongs to one shard, so tasks write to different
+    // elements of results
+    auto shard_task = [&, shard_index]() {
+      auto status = arrow::Status::OK();
+      for (auto i : shards_batches[shard_index]) {
+        auto result = handleInShard(&shards_[shard_index], groups[i],
+                                    record_batches[i]);
+
+        if (!result.ok()) {
+          status = result.status();
+          break;
+        }
+
+        results[i] = std::move(result).ValueOrDie();
+      }
+
+      shards_statuses[shard_index].set_value(status);
+    };
+
+    auto spawn_status = thread_pool_->Spawn(shard_task);
+    if (!spawn_status.ok()) {
+      shard_task();
+    }
+  }
+
+  auto status = arrow::Status::OK();
+  for (auto& shard_future : shards_futures) {
+    auto shard_status = shard_future.get();
+    if (status.ok()) {
+      status = shard_status;
+    }
+  }
+
+  ARROW_RETURN_NOT_OK(status);
+
+  arrow::RecordBatchVector result;
+  for (auto& batch_result : results) {
+    convert_utils::append(std::move(batch_result), result);
+  }
+
+  return result;
+}
+
+arrow::Result<arrow::RecordBatchVector> GroupDispatcher::flush() {
+  arrow::RecordBatchVector result;
+  for (auto& shard : shards_) {
+    for (auto& group : shard.groups_states) {
+      ARROW_ASSIGN_OR_RAISE(auto group_result, group.state.handler->flush());
+      convert_utils::append(std::move(group_result), result);
+      updateStateSize(&shard, &group.state);
+    }
+  }
+
+  return result;
+}
+
+arrow::Result<arrow::RecordBatchVector> GroupDispatcher::poll() {
+  auto now = std::chrono::steady_clock::now();
+  arrow::RecordBatchVector result;
+  for (auto& shard : shards_) {
+    for (auto& group : shard.groups_states) {
+      ARROW_ASSIGN_OR_RAISE(auto group_result, group.state.handler->poll());
+      convert_utils::append(std::move(group_result), result);
+      updateStateSize(&shard, &group.state);
+    }
+
+    ARROW_RETURN_NOT_OK(evictGroups(&shard, now, &result));
+  }
+
+  return result;
+}
+
+size_t GroupDispatcher::getStateSize() const {
+  size_t state_size = 0;
+  for (auto& shard : shards_) {
+    state_size += shard.state_bytes;
+  }
+
+  return state_size;
+}
+
+GroupDispatcher::Metrics GroupDispatcher::getMetrics() const {
+  Metrics metrics;
+  for (auto& shard : shards_) {
+    metrics.live_groups += shard.groups_states.size();
+    metrics.evictions += shard.evictions;
+    metrics.state_bytes += shard.state_bytes;
+  }
+
+  if (metrics.live_groups > 0) {
+    metrics.bytes_per_group = metrics.state_bytes / metrics.live_groups;
+  }
+
+  return metrics;
+}
+
+size_t GroupDispatcher::getShardIndex(metadata::GroupId group_id) const {
+  return group_id % shards_.size();
+}
+
+arrow::Result<arrow::RecordBatchVector> GroupDispatcher::handleInShard(
+    Shard* shard, const metadata::InternedGroupPtr& group,
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  auto now = std::chrono::steady_clock::now();
+  auto group_state = shard->groups_states.get(group->id, now, [&]() {
+    return GroupState{group, handler_factory_->createHandler()};
+  });
+
+  ARROW_ASSIGN_OR_RAISE(auto result,
+                        group_state->handler->handle(record_batch));
+
+  updateStateSize(shard, group_state);
+
+  ARROW_RETURN_NOT_OK(evictGroups(shard, now, &result));
+  return result;
+}
+
+arrow::Status GroupDispatcher::evictGroups(
+    Shard* shard, std::chrono::steady_clock::time_point now,
+    arrow::RecordBatchVector* result) {
+  return shard->groups_states.evict(
+      now, options_.idle_ttl, options_.max_groups, [&](auto* group) {
+        ARROW_ASSIGN_OR_RAISE(auto group_result,
+                              group->state.handler->flush());
+
+        convert_utils::append(std::move(group_result), *result);
+        shard->state_bytes -= group->state.state_bytes;
+        ++shard->evictions;
+        return arrow::Status::OK();
+      });
+}
+
+void GroupDispatcher::updateStateSize(Shard* shard, GroupState* group) {
+  auto state_bytes = group->handler->getStateSize();
+  shard->state_bytes += state_bytes;
+  shard->state_bytes -= group->state_bytes;
+  group->state_bytes = state_bytes;
 }
 
 }  // namespace stream_data_processor
@@ -1,25 +1,108 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
+#include <arrow/util/thread_pool.h>
+
+#include "group_states.h"
+#include "metadata/grouping.h"
 #include "record_batch_handler.h"
 #include "stateful_handlers/handler_factory.h"
 
 namespace stream_data_processor {
 
+// Keeps a handler created by the factory for each group. Group states are
+// ordered by the last access, so groups idle for longer than idle_ttl and
+// the least recently used groups above max_groups are evicted. Evicted
+// handlers are flushed and their output is returned with the current
+// result.
+//
+// With several shards groups are split between shards by the group id
+// and record batches of different shards are handled in parallel, one
+// thread per shard at a time, so handlers don't need to be thread-safe.
+// Results are returned in the order of incoming record batches. Shards are
+// a library option only, UDFs dispatch groups in one shard.
+// Multi-group record batches are split to groups before dispatching.
 class GroupDispatcher : public RecordBatchHandler {
  public:
+  struct Options {
+    std::optional<std::chrono::seconds> idle_ttl{std::nullopt};
+
+    // Limit is applied to each shard separately
+    std::optional<size_t> max_groups{std::nullopt};
+
+    size_t shards{1};
+  };
+
+  struct Metrics {
+    size_t live_groups{0};
+    size_t evictions{0};
+    size_t state_bytes{0};
+    size_t bytes_per_group{0};
+  };
+
   explicit GroupDispatcher(std::shared_ptr<HandlerFactory> handler_factory);
 
+  template <typename OptionsType>
+  GroupDispatcher(std::shared_ptr<HandlerFactory> handler_factory,
+                  OptionsType&& options)
+      : handler_factory_(std::move(handler_factory)),
+        options_(std::forward<OptionsType>(options)),
+        shards_(std::max<size_t>(options_.shards, 1)) {}
+
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
 
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const arrow::RecordBatchVector& input_record_batches) override;
+
+  arrow::Result<arrow::RecordBatchVector> flush() override;
+
+  // Polls handlers of all groups and evicts groups idle for longer than
+  // idle_ttl, so idle groups are released without new data
+  arrow::Result<arrow::RecordBatchVector> poll() override;
+
+  [[nodiscard]] size_t getStateSize() const override;
+
+  [[nodiscard]] Metrics getMetrics() const;
+
+ private:
+  // Group states hold the interned groups, so evicted groups are released
+  struct GroupState {
+    metadata::InternedGroupPtr group;
+    std::shared_ptr<RecordBatchHandler> handler;
+    size_t state_bytes{0};
+  };
+
+  struct Shard {
+    GroupStates<metadata::GroupId, GroupState> groups_states;
+    size_t evictions{0};
+    size_t state_bytes{0};
+  };
+
+ private:
+  [[nodiscard]] size_t getShardIndex(metadata::GroupId group_id) const;
+
+  arrow::Result<arrow::RecordBatchVector> handleInShard(
+      Shard* shard, const metadata::InternedGroupPtr& group,
+      const std::shared_ptr<arrow::RecordBatch>& record_batch);
+
+  arrow::Status evictGroups(Shard* shard,
+                            std::chrono::steady_clock::time_point now,
+                            arrow::RecordBatchVector* result);
+
+  static void updateStateSize(Shard* shard, GroupState* group);
+
  private:
   std::shared_ptr<HandlerFactory> handler_factory_;
-  std::unordered_map<std::string, std::shared_ptr<RecordBatchHandler>>
-      groups_states_;
+  Options options_;
+  std::vector<Shard> shards_;
+  std::shared_ptr<arrow::internal::ThreadPool> thread_pool_;
 };
 
 }  // namespace stream_data_processor
@@ -6,22 +6,39 @@
 namespace stream_data_processor {
 
 arrow::Result<arrow::RecordBatchVector> GroupHandler::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
-  arrow::RecordBatchVector grouped_record_batches;
-
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
   ARROW_ASSIGN_OR_RAISE(
-      grouped_record_batches,
-      compute_utils::groupSortingByColumns(grouping_columns_, record_batch));
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
+  ARROW_ASSIGN_OR_RAISE(auto input_groups,
+                        compute_utils::splitGroups(record_batch));
 
   arrow::RecordBatchVector result;
-  for (auto& group : grouped_record_batches) {
-    copySchemaMetadata(*record_batch, &group);
+  for (auto& input_group : input_groups) {
+    arrow::RecordBatchVector grouped_record_batches;
+
+    ARROW_ASSIGN_OR_RAISE(
+        grouped_record_batches,
+        compute_utils::groupByColumns(grouping_columns_, input_group));
+
+    for (auto& group : grouped_record_batches) {
+      copySchemaMetadata(*input_group, &group);
+
+      ARROW_RETURN_NOT_OK(
+          metadata::fillGroupMetadata(&group, grouping_columns_));
+
+      ARROW_RETURN_NOT_OK(copyColumnTypes(*input_group, &group));
+      result.push_back(group);
+    }
+  }
 
-    ARROW_RETURN_NOT_OK(
-        metadata::fillGroupMetadata(&group, grouping_columns_));
+  if (group_column_name_.has_value() && !result.empty()) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto combined,
+        compute_utils::combineGroups(result, group_column_name_.value()));
 
-    ARROW_RETURN_NOT_OK(copyColumnTypes(*record_batch, &group));
-    result.push_back(group);
+    return arrow::RecordBatchVector{combined};
   }
 
   return result;
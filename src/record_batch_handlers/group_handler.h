@@ -1,23 +1,36 @@
 #pragma once
 
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "record_batch_handler.h"
 
 namespace stream_data_processor {
 
+// Splits record batches by values of grouping columns. Multi-group input
+// record batches are split by their group column first. With the group
+// column name all groups of the record batch are returned as one
+// multi-group record batch.
 class GroupHandler : public RecordBatchHandler {
  public:
   template <typename StringVectorType>
   explicit GroupHandler(StringVectorType&& grouping_columns)
       : grouping_columns_(std::forward<StringVectorType>(grouping_columns)) {}
 
+  template <typename StringVectorType>
+  GroupHandler(StringVectorType&& grouping_columns,
+               std::string group_column_name)
+      : grouping_columns_(std::forward<StringVectorType>(grouping_columns)),
+        group_column_name_(std::move(group_column_name)) {}
+
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
 
  private:
   std::vector<std::string> grouping_columns_;
+  std::optional<std::string> group_column_name_;
 };
 
 }  // namespace stream_data_processor
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include <arrow/api.h>
+
+namespace stream_data_processor {
+
+// Keeps states of groups ordered by the last access, the most recently used
+// groups are at the front, so groups idle for longer than idle_ttl and the
+// least recently used groups above max_groups are evicted from the back.
+// Groups are indexed by keys stored in the list, so string keys aren't
+// copied.
+template <typename KeyType, typename StateType>
+class GroupStates {
+ public:
+  struct Entry {
+    KeyType key;
+    StateType state;
+    std::chrono::steady_clock::time_point last_access;
+  };
+
+  using EntriesList = std::list<Entry>;
+
+  GroupStates() = default;
+
+  // Index refers to the list nodes, so it is moved along with them only
+  GroupStates(const GroupStates& /* non-used */) = delete;
+  GroupStates& operator=(const GroupStates& /* non-used */) = delete;
+
+  GroupStates(GroupStates&& /* non-used */) = default;
+  GroupStates& operator=(GroupStates&& /* non-used */) = default;
+
+  // Returns the state of the group making it the most recently used. State
+  // of a new group is created by create_state.
+  template <typename CreateFunctionType>
+  StateType* get(const KeyType& key,
+                 std::chrono::steady_clock::time_point now,
+                 CreateFunctionType&& create_state) {
+    auto index_iter = index_.find(key);
+    if (index_iter == index_.end()) {
+      entries_.push_front({key, create_state(), now});
+      index_iter =
+          index_.emplace(entries_.front().key, entries_.begin()).first;
+    } else {
+      entries_.splice(entries_.begin(), entries_, index_iter->second);
+      index_iter->second->last_access = now;
+    }
+
+    return &index_iter->second->state;
+  }
+
+  // Evicts expired and over limit groups passing each of them to on_evict
+  // before it is dropped
+  template <typename EvictFunctionType>
+  arrow::Status evict(std::chrono::steady_clock::time_point now,
+                      const std::optional<std::chrono::seconds>& idle_ttl,
+                      const std::optional<size_t>& max_groups,
+                      EvictFunctionType&& on_evict) {
+    while (!entries_.empty()) {
+      auto& entry = entries_.back();
+      bool is_expired =
+          idle_ttl.has_value() && now - entry.last_access > idle_ttl.value();
+
+      bool is_over_limit =
+          max_groups.has_value() && entries_.size() > max_groups.value();
+
+      if (!is_expired && !is_over_limit) {
+        break;
+      }
+
+      ARROW_RETURN_NOT_OK(on_evict(&entry));
+      index_.erase(entry.key);
+      entries_.pop_back();
+    }
+
+    return arrow::Status::OK();
+  }
+
+  void clear() {
+    index_.clear();
+    entries_.clear();
+  }
+
+  [[nodiscard]] size_t size() const { return entries_.size(); }
+
+  typename EntriesList::iterator begin() { return entries_.begin(); }
+  typename EntriesList::iterator end() { return entries_.end(); }
+
+  [[nodiscard]] const EntriesList& getEntries() const { return entries_; }
+
+ private:
+  using IndexKeyType =
+      std::conditional_t<std::is_same_v<KeyType, std::string>,
+                         std::string_view, KeyType>;
+
+  EntriesList entries_;
+  std::unordered_map<IndexKeyType, typename EntriesList::iterator> index_;
+};
+
+}  // namespace stream_data_processor
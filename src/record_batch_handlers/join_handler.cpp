@@ -1,7 +1,9 @@
-#include <set>
-#include <sstream>
+#include <algorithm>
 #include <unordered_map>
 
+#include <arrow/array/concatenate.h>
+#include <arrow/compute/api.h>
+
 #include "join_handler.h"
 #include "metadata/metadata.h"
 #include "utils/utils.h"
@@ -9,131 +11,146 @@
 namespace stream_data_processor {
 
 arrow::Result<arrow::RecordBatchVector> JoinHandler::handle(
-    const arrow::RecordBatchVector& record_batches) {
-  if (record_batches.empty()) {
+    const arrow::RecordBatchVector& input_record_batches) {
+  if (input_record_batches.empty()) {
     return arrow::RecordBatchVector{};
   }
 
-  auto pool = arrow::default_memory_pool();
-
-  std::unordered_map<std::string, std::shared_ptr<arrow::DataType>>
-      column_types;
+  // Multi-group record batches are split, so the group column isn't joined
+  // as a data column
+  arrow::RecordBatchVector record_batches;
+  for (auto& input_record_batch : input_record_batches) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batch,
+        compute_utils::materializeSelection(input_record_batch));
 
-  std::unordered_map<
-      std::string,
-      std::shared_ptr<arrow::ArrayBuilder>>  // TODO: check fields on quality
-      column_builders;
+    ARROW_ASSIGN_OR_RAISE(auto groups,
+                          compute_utils::splitGroups(record_batch));
 
-  std::unordered_map<std::string, std::set<JoinValue, JoinValueCompare>>
-      keys_to_rows;
+    convert_utils::append(std::move(groups), record_batches);
+  }
 
   ARROW_ASSIGN_OR_RAISE(
       auto time_column_name,
       metadata::getTimeColumnNameMetadata(*record_batches.front()));
 
+  std::vector<ResultColumn> result_columns;
+  std::unordered_map<std::string, size_t> result_columns_idx;
+  std::vector<int64_t> result_columns_lengths;
+
+  // for each record batch: pairs of result column index and offset of the
+  // record batch rows in the concatenated result column values
+  std::vector<std::vector<std::pair<size_t, int64_t>>> batch_columns(
+      record_batches.size());
+
+  compute_utils::KeyTable key_table;
+  std::vector<JoinValue> join_values;
   for (size_t i = 0; i < record_batches.size(); ++i) {
-    for (auto& field : record_batches[i]->schema()->fields()) {
-      if (column_builders.find(field->name()) == column_builders.end()) {
-        column_builders[field->name()] =
-            std::shared_ptr<arrow::ArrayBuilder>();
-
-        if (field->type()->id() == arrow::Type::TIMESTAMP) {
-          ARROW_ASSIGN_OR_RAISE(
-              column_builders[field->name()],
-              arrow_utils::createTimestampArrayBuilder(field->type(), pool));
-        } else {
-          ARROW_ASSIGN_OR_RAISE(
-              column_builders[field->name()],
-              arrow_utils::createArrayBuilder(field->type()->id(), pool));
-        }
-
-        column_types[field->name()] = field->type();
+    auto& record_batch = record_batches[i];
+    for (int j = 0; j < record_batch->num_columns(); ++j) {
+      auto field = record_batch->schema()->field(j);
+      auto result_column_iter = result_columns_idx.find(field->name());
+      if (result_column_iter == result_columns_idx.end()) {
+        result_column_iter =
+            result_columns_idx.emplace(field->name(), result_columns.size())
+                .first;
+
+        result_columns.push_back(
+            {field, {}, std::make_unique<arrow::Int64Builder>()});
+
+        result_columns_lengths.push_back(0);
       }
-    }
 
-    for (size_t j = 0; j < record_batches[i]->num_rows(); ++j) {
-      JoinKey join_key;
-      ARROW_ASSIGN_OR_RAISE(
-          join_key, getJoinKey(record_batches[i], j, time_column_name));
+      auto result_column_idx = result_column_iter->second;
+      result_columns[result_column_idx].chunks.push_back(
+          record_batch->column(j));
 
-      if (keys_to_rows.find(join_key.key_string) == keys_to_rows.end()) {
-        keys_to_rows[join_key.key_string] =
-            std::set<JoinValue, JoinValueCompare>();
-      }
+      batch_columns[i].emplace_back(
+          result_column_idx, result_columns_lengths[result_column_idx]);
 
-      keys_to_rows[join_key.key_string].insert({i, j, join_key.time});
+      result_columns_lengths[result_column_idx] += record_batch->num_rows();
     }
+
+    ARROW_ASSIGN_OR_RAISE(
+        auto plan, plans_.get(record_batch->schema(),
+                              [this](const arrow::Schema& schema) {
+                                return compilePlan(schema);
+                              }));
+
+    ARROW_RETURN_NOT_OK(appendJoinValues(*record_batch, *plan, i,
+                                         time_column_name, &key_table,
+                                         &join_values));
   }
 
-  std::unordered_map<std::string, bool> filled;
-  for (auto& column : column_builders) { filled[column.first] = false; }
+  std::sort(join_values.begin(), join_values.end(),
+            [](const JoinValue& left, const JoinValue& right) {
+              if (left.key_id != right.key_id) {
+                return left.key_id < right.key_id;
+              }
 
-  size_t row_count = 0;
-  for (auto& joined_values : keys_to_rows) {
-    if (joined_values.second.empty()) {
-      continue;
-    }
+              if (left.time != right.time) {
+                return left.time < right.time;
+              }
 
-    auto last_ts = joined_values.second.begin()->time;
-    for (auto& column : column_builders) { filled[column.first] = false; }
+              if (left.record_batch_idx != right.record_batch_idx) {
+                return left.record_batch_idx < right.record_batch_idx;
+              }
 
-    for (auto& value : joined_values.second) {
-      if (std::abs(value.time - last_ts) > tolerance_) {
-        for (auto& column : filled) {
-          if (!column.second) {
-            ARROW_RETURN_NOT_OK(column_builders[column.first]->AppendNull());
-          } else {
-            column.second = false;
-          }
-        }
+              return left.row_idx < right.row_idx;
+            });
 
-        last_ts = value.time;
-        ++row_count;
+  std::vector<int64_t> row_indices(result_columns.size(), -1);
+  auto flush_row = [&result_columns, &row_indices]() -> arrow::Status {
+    for (size_t i = 0; i < result_columns.size(); ++i) {
+      if (row_indices[i] == -1) {
+        ARROW_RETURN_NOT_OK(result_columns[i].indices_builder->AppendNull());
+      } else {
+        ARROW_RETURN_NOT_OK(
+            result_columns[i].indices_builder->Append(row_indices[i]));
       }
 
-      auto record_batch = record_batches[value.record_batch_idx];
-      for (size_t i = 0; i < record_batch->num_columns(); ++i) {
-        auto column_name = record_batch->schema()->field_names()[i];
-        if (filled[column_name]) {
-          continue;
-        }
-
-        std::shared_ptr<arrow::Scalar> value_scalar;
-        ARROW_ASSIGN_OR_RAISE(
-            value_scalar, record_batch->column(i)->GetScalar(value.row_idx));
-
-        if (record_batch->schema()->field(i)->type()->id() ==
-            arrow::Type::TIMESTAMP) {
-          ARROW_RETURN_NOT_OK(arrow_utils::appendToTimestampBuilder(
-              value_scalar, &column_builders[column_name],
-              record_batch->schema()->field(i)->type()));
-        } else {
-          ARROW_RETURN_NOT_OK(arrow_utils::appendToBuilder(
-              value_scalar, &column_builders[column_name],
-              record_batch->schema()->field(i)->type()->id()));
-        }
-
-        filled[column_name] = true;
+      row_indices[i] = -1;
+    }
+
+    return arrow::Status::OK();
+  };
+
+  int64_t row_count = 0;
+  int64_t last_ts = 0;
+  for (size_t i = 0; i < join_values.size(); ++i) {
+    auto& value = join_values[i];
+    if (i == 0 || join_values[i - 1].key_id != value.key_id) {
+      if (i != 0) {
+        ARROW_RETURN_NOT_OK(flush_row());
+        ++row_count;
       }
+
+      last_ts = value.time;
+    } else if (std::abs(value.time - last_ts) > tolerance_) {
+      ARROW_RETURN_NOT_OK(flush_row());
+      ++row_count;
+      last_ts = value.time;
     }
 
-    for (auto& column : filled) {
-      if (!column.second) {
-        ARROW_RETURN_NOT_OK(column_builders[column.first]->AppendNull());
-      } else {
-        column.second = false;
+    for (auto& [result_column_idx, offset] :
+         batch_columns[value.record_batch_idx]) {
+      if (row_indices[result_column_idx] == -1) {
+        row_indices[result_column_idx] = offset + value.row_idx;
       }
     }
+  }
 
+  if (!join_values.empty()) {
+    ARROW_RETURN_NOT_OK(flush_row());
     ++row_count;
   }
 
   arrow::FieldVector fields;
   arrow::ArrayVector result_arrays;
-  for (auto& column : column_builders) {
-    result_arrays.emplace_back();
-    ARROW_RETURN_NOT_OK(column.second->Finish(&result_arrays.back()));
-    fields.push_back(arrow::field(column.first, column_types[column.first]));
+  for (auto& result_column : result_columns) {
+    fields.push_back(result_column.field);
+    ARROW_ASSIGN_OR_RAISE(result_arrays.emplace_back(),
+                          buildResultArray(&result_column));
   }
 
   auto result_record_batch = arrow::RecordBatch::Make(
@@ -147,62 +164,74 @@ arrow::Result<arrow::RecordBatchVector> JoinHandler::handle(
       &result_record_batch,
       time_column_name));  // TODO: set measurement column name metadata
 
-  return arrow::RecordBatchVector{
-      result_record_batch};  // TODO: copy column types
+  return arrow::RecordBatchVector{result_record_batch};
 }
 
-arrow::Result<JoinHandler::JoinKey> JoinHandler::getJoinKey(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch, size_t row_idx,
-    std::string time_column_name) const {
-  std::stringstream key_string_builder;
+arrow::Result<JoinHandler::SchemaPlan> JoinHandler::compilePlan(
+    const arrow::Schema& schema) const {
+  SchemaPlan plan;
   for (auto& join_column_name : join_on_columns_) {
-    std::shared_ptr<arrow::Scalar> value_scalar;
-    ARROW_ASSIGN_OR_RAISE(
-        value_scalar,
-        record_batch->GetColumnByName(join_column_name)->GetScalar(row_idx));
-
-    key_string_builder << join_column_name << '=' << value_scalar->ToString()
-                       << ',';
+    plan.join_columns_indices.push_back(
+        schema.GetFieldIndex(join_column_name));
   }
 
-  JoinKey join_key;
-  join_key.key_string = std::move(key_string_builder.str());
+  return plan;
+}
+
+arrow::Status JoinHandler::appendJoinValues(
+    const arrow::RecordBatch& record_batch, const SchemaPlan& plan,
+    size_t record_batch_idx, const std::string& time_column_name,
+    compute_utils::KeyTable* key_table,
+    std::vector<JoinValue>* join_values) const {
+  arrow::ArrayVector key_columns;
+  for (size_t i = 0; i < join_on_columns_.size(); ++i) {
+    if (plan.join_columns_indices[i] == -1) {
+      return arrow::Status::Invalid(
+          fmt::format("Join column with name {} should be presented",
+                      join_on_columns_[i]));
+    }
+
+    key_columns.push_back(record_batch.column(plan.join_columns_indices[i]));
+  }
 
-  auto time_column = record_batch->GetColumnByName(time_column_name);
-  if (time_column == nullptr) {
-    return arrow::Status::Invalid(fmt::format(
-        "Time column with name {} should be presented", time_column_name));
+  std::vector<int64_t> key_ids;
+  if (key_columns.empty()) {
+    key_ids.assign(record_batch.num_rows(), 0);
+  } else {
+    ARROW_RETURN_NOT_OK(key_table->encode(key_columns, &key_ids));
   }
 
-  ARROW_ASSIGN_OR_RAISE(auto value_scalar, time_column->GetScalar(row_idx));
+  std::vector<int64_t> times;
+  ARROW_RETURN_NOT_OK(compute_utils::getTimeValues(
+      record_batch, time_column_name, time_utils::SECOND, &times));
 
-  if (value_scalar->type->id() == arrow::Type::TIMESTAMP) {
-    ARROW_ASSIGN_OR_RAISE(
-        value_scalar,
-        value_scalar->CastTo(arrow::timestamp(arrow::TimeUnit::SECOND)));
+  for (int64_t i = 0; i < record_batch.num_rows(); ++i) {
+    join_values->push_back({key_ids[i], times[i], record_batch_idx, i});
+  }
+
+  return arrow::Status::OK();
+}
 
-    join_key.time =
-        std::static_pointer_cast<arrow::TimestampScalar>(value_scalar)->value;
+arrow::Result<std::shared_ptr<arrow::Array>> JoinHandler::buildResultArray(
+    ResultColumn* result_column) {
+  std::shared_ptr<arrow::Array> values;
+  if (result_column->chunks.size() == 1) {
+    values = result_column->chunks.front();
   } else {
-    if (value_scalar->type->id() != arrow::Type::INT64) {
-      return arrow::Status::NotImplemented(
-          "JoinHandler currently supports arrow::Type::INT64 type as "
-          "non-timestamp time column's type only");
-    }
+    // Chunks of dictionary-encoded columns may have different dictionaries
+    ARROW_RETURN_NOT_OK(
+        arrow_utils::unifyDictionaries(&result_column->chunks));
 
-    ARROW_ASSIGN_OR_RAISE(
-        auto value_time_unit,
-        metadata::getTimeUnitMetadata(*record_batch, time_column_name));
+    ARROW_ASSIGN_OR_RAISE(values, arrow::Concatenate(result_column->chunks));
+  }
 
-    int64_t time_value =
-        std::static_pointer_cast<arrow::Int64Scalar>(value_scalar)->value;
+  std::shared_ptr<arrow::Array> indices;
+  ARROW_RETURN_NOT_OK(result_column->indices_builder->Finish(&indices));
 
-    ARROW_ASSIGN_OR_RAISE(join_key.time,
-                          time_utils::convertTime(time_value, value_time_unit,
-                                                  time_utils::SECOND));
-  }
+  ARROW_ASSIGN_OR_RAISE(auto result_datum,
+                        arrow::compute::Take(values, indices));
 
-  return join_key;
+  return result_datum.make_array();
 }
 
 arrow::Result<arrow::RecordBatchVector> JoinHandler::handle(
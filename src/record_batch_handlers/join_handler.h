@@ -1,11 +1,14 @@
 #pragma once
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <arrow/api.h>
 
 #include "record_batch_handler.h"
+#include "schema_plans.h"
+#include "utils/compute_utils.h"
 
 namespace stream_data_processor {
 
@@ -24,40 +27,41 @@ class JoinHandler : public RecordBatchHandler {
       const arrow::RecordBatchVector& record_batches) override;
 
  private:
-  struct JoinKey {
-    std::string key_string;
-    int64_t time{0};
-  };
-
   struct JoinValue {
-    size_t record_batch_idx;
-    size_t row_idx;
+    int64_t key_id;
     int64_t time;
+    size_t record_batch_idx;
+    int64_t row_idx;
   };
 
-  class JoinValueCompare {
-   public:
-    bool operator()(const JoinValue& v1, const JoinValue& v2) const {
-      if (v1.time == v2.time) {
-        if (v1.record_batch_idx == v2.record_batch_idx) {
-          return v1.row_idx < v2.row_idx;
-        } else {
-          return v1.record_batch_idx < v2.record_batch_idx;
-        }
-      } else {
-        return v1.time < v2.time;
-      }
-    }
+  struct ResultColumn {
+    std::shared_ptr<arrow::Field> field;
+    arrow::ArrayVector chunks;
+    std::unique_ptr<arrow::Int64Builder> indices_builder;
+  };
+
+  // Missing join columns have index -1
+  struct SchemaPlan {
+    std::vector<int> join_columns_indices;
   };
 
  private:
-  arrow::Result<JoinKey> getJoinKey(
-      const std::shared_ptr<arrow::RecordBatch>& record_batch, size_t row_idx,
-      std::string time_column_name) const;
+  arrow::Result<SchemaPlan> compilePlan(const arrow::Schema& schema) const;
+
+  arrow::Status appendJoinValues(const arrow::RecordBatch& record_batch,
+                                 const SchemaPlan& plan,
+                                 size_t record_batch_idx,
+                                 const std::string& time_column_name,
+                                 compute_utils::KeyTable* key_table,
+                                 std::vector<JoinValue>* join_values) const;
+
+  static arrow::Result<std::shared_ptr<arrow::Array>> buildResultArray(
+      ResultColumn* result_column);
 
  private:
   std::vector<std::string> join_on_columns_;
   int64_t tolerance_;
+  SchemaPlans<SchemaPlan> plans_;
 };
 
 }  // namespace stream_data_processor
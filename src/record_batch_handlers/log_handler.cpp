@@ -1,12 +1,18 @@
 #include "log_handler.h"
 
+#include "utils/compute_utils.h"
+
 namespace stream_data_processor {
 
 LogHandler::LogHandler(const spdlog::level::level_enum& log_level)
     : log_level_(log_level) {}
 
 arrow::Result<arrow::RecordBatchVector> LogHandler::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
   spdlog::log(log_level_, "RecordBatch schema:\n{}\n\nRecordBatch:\n{}",
               record_batch->schema()->ToString(true),
               record_batch->ToString());
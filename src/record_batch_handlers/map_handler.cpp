@@ -1,7 +1,13 @@
 #include <vector>
 
+#include <arrow/compute/api.h>
+#include <gandiva/configuration.h>
+#include <gandiva/selection_vector.h>
+
 #include "map_handler.h"
 
+#include "utils/compute_utils.h"
+#include "utils/gandiva_utils.h"
 #include "utils/serialize_utils.h"
 
 namespace stream_data_processor {
@@ -9,6 +15,9 @@ namespace stream_data_processor {
 MapHandler::MapHandler(const std::vector<MapCase>& map_cases) {
   for (auto& map_case : map_cases) {
     expressions_.push_back(map_case.expression);
+    gandiva_utils::collectColumnNames(map_case.expression->root(),
+                                      &expressions_columns_);
+
     column_types_.push_back(map_case.result_column_type);
   }
 }
@@ -19,16 +28,32 @@ arrow::Result<arrow::RecordBatchVector> MapHandler::handle(
       record_batch->schema(), record_batch->num_rows(),
       record_batch->columns());
 
-  std::shared_ptr<gandiva::Projector> projector;
-  ARROW_RETURN_NOT_OK(gandiva::Projector::Make(result_record_batch->schema(),
-                                               expressions_, &projector));
+  ARROW_ASSIGN_OR_RAISE(
+      auto selection, compute_utils::extractSelection(&result_record_batch));
+
+  auto input_record_batch = result_record_batch;
 
   ARROW_ASSIGN_OR_RAISE(auto result_schema,
                         createResultSchema(result_record_batch->schema()));
 
-  ARROW_RETURN_NOT_OK(eval(&result_record_batch, projector, result_schema));
+  // Expressions are evaluated on the columns they use only
+  ARROW_ASSIGN_OR_RAISE(
+      auto expressions_input,
+      gandiva_utils::makeInput(*result_record_batch, expressions_columns_));
+
+  if (selection != nullptr) {
+    ARROW_RETURN_NOT_OK(evalSelected(&result_record_batch, *expressions_input,
+                                     *selection, result_schema));
+  } else {
+    std::shared_ptr<gandiva::Projector> projector;
+    ARROW_RETURN_NOT_OK(gandiva::Projector::Make(
+        expressions_input->schema(), expressions_, &projector));
+
+    ARROW_RETURN_NOT_OK(eval(&result_record_batch, *expressions_input,
+                             projector, result_schema));
+  }
 
-  copySchemaMetadata(*record_batch, &result_record_batch);
+  copySchemaMetadata(*input_record_batch, &result_record_batch);
   return arrow::RecordBatchVector{result_record_batch};
 }
 
@@ -50,15 +75,67 @@ arrow::Result<std::shared_ptr<arrow::Schema>> MapHandler::createResultSchema(
 
 arrow::Status MapHandler::eval(
     std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const arrow::RecordBatch& expressions_input,
     const std::shared_ptr<gandiva::Projector>& projector,
     const std::shared_ptr<arrow::Schema>& result_schema) {
-  auto input_schema_size = record_batch->get()->schema()->num_fields();
   auto pool = arrow::default_memory_pool();
   arrow::ArrayVector result_arrays;
 
   ARROW_RETURN_NOT_OK(
-      projector->Evaluate(**record_batch, pool, &result_arrays));
+      projector->Evaluate(expressions_input, pool, &result_arrays));
+
+  ARROW_RETURN_NOT_OK(
+      appendResultColumns(record_batch, result_arrays, result_schema));
 
+  return arrow::Status::OK();
+}
+
+arrow::Status MapHandler::evalSelected(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const arrow::RecordBatch& expressions_input,
+    const arrow::BooleanArray& selection,
+    const std::shared_ptr<arrow::Schema>& result_schema) const {
+  auto pool = arrow::default_memory_pool();
+
+  std::shared_ptr<gandiva::SelectionVector> selection_vector;
+  ARROW_RETURN_NOT_OK(gandiva::SelectionVector::MakeInt64(
+      selection.length(), pool, &selection_vector));
+
+  int64_t selected_rows = 0;
+  for (int64_t i = 0; i < selection.length(); ++i) {
+    if (selection.Value(i)) {
+      selection_vector->SetIndex(selected_rows++, i);
+    }
+  }
+
+  selection_vector->SetNumSlots(selected_rows);
+
+  std::shared_ptr<gandiva::Projector> projector;
+  ARROW_RETURN_NOT_OK(gandiva::Projector::Make(
+      expressions_input.schema(), expressions_,
+      gandiva::SelectionVector::MODE_UINT64,
+      gandiva::ConfigurationBuilder::DefaultConfiguration(), &projector));
+
+  arrow::ArrayVector result_arrays;
+  ARROW_RETURN_NOT_OK(projector->Evaluate(
+      expressions_input, selection_vector.get(), pool, &result_arrays));
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto take_datum,
+      arrow::compute::Take(*record_batch, selection_vector->ToArray()));
+
+  *record_batch = take_datum.record_batch();
+  ARROW_RETURN_NOT_OK(
+      appendResultColumns(record_batch, result_arrays, result_schema));
+
+  return arrow::Status::OK();
+}
+
+arrow::Status MapHandler::appendResultColumns(
+    std::shared_ptr<arrow::RecordBatch>* record_batch,
+    const arrow::ArrayVector& result_arrays,
+    const std::shared_ptr<arrow::Schema>& result_schema) {
+  auto input_schema_size = record_batch->get()->schema()->num_fields();
   for (int i = 0; i < result_arrays.size(); ++i) {
     ARROW_ASSIGN_OR_RAISE(
         *record_batch,
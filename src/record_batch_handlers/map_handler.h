@@ -1,6 +1,9 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 #include <arrow/api.h>
 
@@ -28,14 +31,27 @@ class MapHandler : public RecordBatchHandler {
  private:
   static arrow::Status eval(
       std::shared_ptr<arrow::RecordBatch>* record_batch,
+      const arrow::RecordBatch& expressions_input,
       const std::shared_ptr<gandiva::Projector>& projector,
       const std::shared_ptr<arrow::Schema>& result_schema);
 
+  arrow::Status evalSelected(
+      std::shared_ptr<arrow::RecordBatch>* record_batch,
+      const arrow::RecordBatch& expressions_input,
+      const arrow::BooleanArray& selection,
+      const std::shared_ptr<arrow::Schema>& result_schema) const;
+
+  static arrow::Status appendResultColumns(
+      std::shared_ptr<arrow::RecordBatch>* record_batch,
+      const arrow::ArrayVector& result_arrays,
+      const std::shared_ptr<arrow::Schema>& result_schema);
+
   arrow::Result<std::shared_ptr<arrow::Schema>> createResultSchema(
       const std::shared_ptr<arrow::Schema>& input_schema) const;
 
  private:
   gandiva::ExpressionVector expressions_;
+  std::unordered_set<std::string> expressions_columns_;
   std::vector<metadata::ColumnType> column_types_;
 };
 
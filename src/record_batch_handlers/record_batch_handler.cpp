@@ -1,5 +1,7 @@
 #include "record_batch_handler.h"
 
+#include "metadata/grouping.h"
+
 namespace stream_data_processor {
 
 RecordBatchHandler::~RecordBatchHandler() = default;
@@ -13,21 +15,39 @@ void RecordBatchHandler::copySchemaMetadata(
 
 arrow::Status RecordBatchHandler::copyColumnTypes(
     const arrow::RecordBatch& from, std::shared_ptr<arrow::RecordBatch>* to) {
-  for (auto& from_field : from.schema()->fields()) {
-    auto to_field = to->get()->schema()->GetFieldByName(from_field->name());
-    if (to_field == nullptr) {
+  auto to_fields = to->get()->schema()->fields();
+  bool is_changed = false;
+  for (auto& to_field : to_fields) {
+    auto from_field = from.schema()->GetFieldByName(to_field->name());
+    if (from_field == nullptr || !to_field->Equals(from_field)) {
       continue;
     }
 
-    if (to_field->Equals(from_field)) {
-      ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
-          &to_field, metadata::getColumnType(*from_field)));
-      auto set_field_result = to->get()->schema()->SetField(
-          to->get()->schema()->GetFieldIndex(from_field->name()), to_field);
-      ARROW_RETURN_NOT_OK(set_field_result.status());
+    auto column_type = metadata::getColumnType(*from_field);
+    if (metadata::getColumnType(*to_field) != column_type) {
+      ARROW_RETURN_NOT_OK(
+          metadata::setColumnTypeMetadata(&to_field, column_type));
+      is_changed = true;
     }
   }
 
+  if (is_changed) {
+    *to = arrow::RecordBatch::Make(
+        arrow::schema(to_fields, to->get()->schema()->metadata()),
+        to->get()->num_rows(), to->get()->column_data());
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Status RecordBatchHandler::checkSingleGroup(
+    const arrow::RecordBatch& record_batch) {
+  if (metadata::isMultiGroup(record_batch)) {
+    return arrow::Status::Invalid(
+        "Multi-group RecordBatch should be split by groups before the "
+        "handler");
+  }
+
   return arrow::Status::OK();
 }
 
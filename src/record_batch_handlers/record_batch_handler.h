@@ -26,6 +26,21 @@ class RecordBatchHandler {
     return result;
   }
 
+  // Emits everything buffered in the handler state. Called before the
+  // handler is dropped, e.g. when GroupDispatcher evicts an idle group.
+  virtual arrow::Result<arrow::RecordBatchVector> flush() {
+    return arrow::RecordBatchVector{};
+  }
+
+  // Emits what became ready without new data, e.g. windows closed by
+  // timeouts. Called periodically, e.g. by the UDF timer.
+  virtual arrow::Result<arrow::RecordBatchVector> poll() {
+    return arrow::RecordBatchVector{};
+  }
+
+  // Estimated size in bytes of the data kept in the handler state
+  [[nodiscard]] virtual size_t getStateSize() const { return 0; }
+
   virtual ~RecordBatchHandler() = 0;
 
  protected:
@@ -45,6 +60,11 @@ class RecordBatchHandler {
   static arrow::Status copyColumnTypes(
       const arrow::RecordBatch& from,
       std::shared_ptr<arrow::RecordBatch>* to);
+
+  // Handlers keeping state of one group don't accept multi-group record
+  // batches, they should be split by GroupDispatcher before
+  static arrow::Status checkSingleGroup(
+      const arrow::RecordBatch& record_batch);
 };
 
 }  // namespace stream_data_processor
@@ -3,6 +3,7 @@
 #include "aggregate_handler.h"
 #include "default_handler.h"
 #include "filter_handler.h"
+#include "group_aggregate_handler.h"
 #include "group_handler.h"
 #include "log_handler.h"
 #include "map_handler.h"
@@ -14,5 +15,8 @@
 #include "pipeline_handler.h"
 
 #include "stateful_handlers/derivative_handler.h"
+#include "stateful_handlers/multi_group_window_handler.h"
+#include "stateful_handlers/streaming_join_handler.h"
 #include "stateful_handlers/threshold_state_machine.h"
+#include "stateful_handlers/window_aggregate_handler.h"
 #include "stateful_handlers/window_handler.h"
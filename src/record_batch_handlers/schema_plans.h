@@ -0,0 +1,125 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <arrow/api.h>
+
+#include "metadata/column_typing.h"
+
+namespace stream_data_processor {
+
+// Keeps plans compiled by a handler for the schemas it has seen. A plan
+// holds what the handler resolves from the schema by names and metadata,
+// e.g. column indices, types and time units, so it is done once per schema
+// instead of for every record batch.
+//
+// Plans are found by the last schema object first and by the fields and
+// the time and measurement metadata then. Other schema metadata, e.g.
+// per-batch chunk ids and groups, doesn't affect plans, so batches
+// differing in it share a plan. Handlers with plans depending on more
+// metadata provide it as plan_key.
+template <typename PlanType>
+class SchemaPlans {
+ public:
+  template <typename CompileFunctionType>
+  arrow::Result<std::shared_ptr<const PlanType>> get(
+      const std::shared_ptr<arrow::Schema>& schema,
+      CompileFunctionType&& compile) {
+    return get(schema, "", std::forward<CompileFunctionType>(compile));
+  }
+
+  template <typename CompileFunctionType>
+  arrow::Result<std::shared_ptr<const PlanType>> get(
+      const std::shared_ptr<arrow::Schema>& schema,
+      const std::string& plan_key, CompileFunctionType&& compile) {
+    if (last_plan_ != nullptr && last_schema_.lock() == schema &&
+        last_plan_key_ == plan_key) {
+      return last_plan_;
+    }
+
+    auto key = makeKey(*schema, plan_key);
+    auto plan_iter = plans_.find(key);
+    if (plan_iter == plans_.end() ||
+        !fieldsEqual(plan_iter->second.fields, schema->fields())) {
+      ARROW_ASSIGN_OR_RAISE(auto compiled_plan, compile(*schema));
+      if (plan_iter == plans_.end() && plans_.size() >= MAX_PLANS_NUMBER) {
+        plans_.erase(plans_.begin());
+      }
+
+      plans_[key] = {schema->fields(), std::make_shared<const PlanType>(
+                                           std::move(compiled_plan))};
+
+      plan_iter = plans_.find(key);
+    }
+
+    last_schema_ = schema;
+    last_plan_key_ = plan_key;
+    last_plan_ = plan_iter->second.plan;
+    return last_plan_;
+  }
+
+ private:
+  static constexpr size_t MAX_PLANS_NUMBER = 1024;
+
+  struct FieldsPlan {
+    arrow::FieldVector fields;
+    std::shared_ptr<const PlanType> plan;
+  };
+
+ private:
+  static std::string makeKey(const arrow::Schema& schema,
+                             const std::string& plan_key) {
+    std::string key;
+    for (auto& field : schema.fields()) {
+      key += field->name();
+      key.push_back('\0');
+    }
+
+    key.push_back('\0');
+    auto time_column_name_result =
+        metadata::getTimeColumnNameMetadata(schema);
+    if (time_column_name_result.ok()) {
+      key += time_column_name_result.ValueUnsafe();
+    }
+
+    key.push_back('\0');
+    auto measurement_column_name_result =
+        metadata::getMeasurementColumnNameMetadata(schema);
+    if (measurement_column_name_result.ok()) {
+      key += measurement_column_name_result.ValueUnsafe();
+    }
+
+    key.push_back('\0');
+    key += plan_key;
+    return key;
+  }
+
+  static bool fieldsEqual(const arrow::FieldVector& left,
+                          const arrow::FieldVector& right) {
+    if (left.size() != right.size()) {
+      return false;
+    }
+
+    for (size_t i = 0; i < left.size(); ++i) {
+      if (left[i] != right[i] && !left[i]->Equals(right[i], true)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+ private:
+  std::unordered_map<std::string, FieldsPlan> plans_;
+
+  // The schema is weak, so another schema allocated at the same address
+  // doesn't match
+  std::weak_ptr<arrow::Schema> last_schema_;
+  std::string last_plan_key_;
+  std::shared_ptr<const PlanType> last_plan_;
+};
+
+}  // namespace stream_data_processor
@@ -2,25 +2,117 @@
 
 #include "sort_handler.h"
 
+#include "metadata/chunking.h"
+#include "metadata/grouping.h"
+#include "metadata/sorting.h"
 #include "utils/utils.h"
 
 namespace stream_data_processor {
 
+SortHandler::SortHandler(const std::vector<std::string>& sort_by_columns) {
+  for (auto& column_name : sort_by_columns) {
+    options_.sort_keys.push_back({column_name});
+  }
+}
+
+SortHandler::SortHandler(const SortHandler::SortOptions& options)
+    : options_(options) {}
+
+SortHandler::SortHandler(SortHandler::SortOptions&& options)
+    : options_(std::move(options)) {}
+
 arrow::Result<arrow::RecordBatchVector> SortHandler::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
-  std::vector<std::shared_ptr<arrow::RecordBatch>> sorted_record_batches;
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
   ARROW_ASSIGN_OR_RAISE(
-      sorted_record_batches,
-      compute_utils::groupSortingByColumns(sort_by_columns_, record_batch));
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
 
-  std::shared_ptr<arrow::RecordBatch> sorted_record_batch;
-  ARROW_ASSIGN_OR_RAISE(
-      sorted_record_batch,
-      convert_utils::concatenateRecordBatches(sorted_record_batches));
+  // Groups are sorted and limited separately
+  if (metadata::isMultiGroup(*record_batch)) {
+    ARROW_ASSIGN_OR_RAISE(auto groups,
+                          compute_utils::splitGroups(record_batch));
+
+    arrow::RecordBatchVector result;
+    for (auto& group : groups) {
+      ARROW_ASSIGN_OR_RAISE(auto sorted_group, handle(group));
+      convert_utils::append(std::move(sorted_group), result);
+    }
 
+    return result;
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto sorted_indices,
+                        compute_utils::sortIndices(*record_batch,
+                                                   options_.sort_keys,
+                                                   options_.limit));
+
+  ARROW_ASSIGN_OR_RAISE(auto sorted_datum,
+                        arrow::compute::Take(record_batch, sorted_indices));
+
+  auto sorted_record_batch = sorted_datum.record_batch();
   copySchemaMetadata(*record_batch, &sorted_record_batch);
   ARROW_RETURN_NOT_OK(copyColumnTypes(*record_batch, &sorted_record_batch));
+  ARROW_RETURN_NOT_OK(setSortedByMetadata(&sorted_record_batch));
   return arrow::RecordBatchVector{sorted_record_batch};
 }
 
+arrow::Status SortHandler::setSortedByMetadata(
+    std::shared_ptr<arrow::RecordBatch>* record_batch) const {
+  ARROW_RETURN_NOT_OK(metadata::removeSortedByMetadata(record_batch));
+  for (auto& sort_key : options_.sort_keys) {
+    auto column = record_batch->get()->GetColumnByName(sort_key.column_name);
+    if (column == nullptr) {
+      continue;
+    }
+
+    if (sort_key.order == compute_utils::kAscending &&
+        column->null_count() == 0) {
+      ARROW_RETURN_NOT_OK(metadata::setSortedByMetadata(
+          record_batch, sort_key.column_name));
+    }
+
+    break;
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Result<arrow::RecordBatchVector> SortHandler::handle(
+    const arrow::RecordBatchVector& record_batches) {
+  auto logical_batches_ids = metadata::getLogicalBatchesIds(record_batches);
+
+  arrow::RecordBatchVector result;
+  size_t chunks_begin = 0;
+  while (chunks_begin < record_batches.size()) {
+    auto chunks_end = chunks_begin + 1;
+    while (chunks_end < record_batches.size() &&
+           logical_batches_ids[chunks_end] ==
+               logical_batches_ids[chunks_begin]) {
+      ++chunks_end;
+    }
+
+    auto logical_batch = record_batches[chunks_begin];
+    if (chunks_end - chunks_begin > 1) {
+      // Chunks are concatenated without their selections
+      arrow::RecordBatchVector chunks;
+      for (auto i = chunks_begin; i < chunks_end; ++i) {
+        ARROW_ASSIGN_OR_RAISE(
+            chunks.emplace_back(),
+            compute_utils::materializeSelection(record_batches[i]));
+      }
+
+      ARROW_ASSIGN_OR_RAISE(logical_batch,
+                            convert_utils::concatenateRecordBatches(chunks));
+
+      copySchemaMetadata(*chunks.front(), &logical_batch);
+    }
+
+    ARROW_ASSIGN_OR_RAISE(auto sorted_batch, handle(logical_batch));
+    convert_utils::append(std::move(sorted_batch), result);
+    chunks_begin = chunks_end;
+  }
+
+  return result;
+}
+
 }  // namespace stream_data_processor
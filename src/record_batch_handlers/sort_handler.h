@@ -1,26 +1,44 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include <arrow/api.h>
 
 #include "record_batch_handler.h"
+#include "utils/compute_utils.h"
 
 namespace stream_data_processor {
 
 class SortHandler : public RecordBatchHandler {
  public:
-  template <typename StringVectorType>
-  explicit SortHandler(StringVectorType&& sort_by_columns)
-      : sort_by_columns_(std::forward<StringVectorType>(sort_by_columns)) {}
+  struct SortOptions {
+    std::vector<compute_utils::SortKey> sort_keys;
+    std::optional<size_t> limit{std::nullopt};
+  };
+
+  explicit SortHandler(const std::vector<std::string>& sort_by_columns);
+
+  explicit SortHandler(const SortOptions& options);
+  explicit SortHandler(SortOptions&& options);
 
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
 
+  // Chunks of one logical record batch are sorted together.
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const arrow::RecordBatchVector& record_batches) override;
+
+ private:
+  // Only the first present sort key is known to be sorted in whole record
+  // batch
+  arrow::Status setSortedByMetadata(
+      std::shared_ptr<arrow::RecordBatch>* record_batch) const;
+
  private:
-  std::vector<std::string> sort_by_columns_;
+  SortOptions options_;
 };
 
 }  // namespace stream_data_processor
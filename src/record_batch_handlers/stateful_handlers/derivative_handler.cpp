@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <utility>
+
+#include <arrow/compute/api.h>
 #include <spdlog/spdlog.h>
 
 #include "derivative_handler.h"
@@ -7,44 +11,95 @@
 namespace stream_data_processor {
 
 arrow::Result<arrow::RecordBatchVector> DerivativeHandler::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
-  ARROW_ASSIGN_OR_RAISE(auto time_column_name,
-                        metadata::getTimeColumnNameMetadata(*record_batch));
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
+  ARROW_RETURN_NOT_OK(checkSingleGroup(*record_batch));
+
+  ARROW_ASSIGN_OR_RAISE(auto plan, getPlan(record_batch->schema()));
 
   ARROW_ASSIGN_OR_RAISE(
       auto sorted_record_batch,
-      compute_utils::sortByColumn(time_column_name, record_batch));
+      compute_utils::sortByColumn(plan->time_column_name, record_batch));
 
-  auto concat_record_batch = sorted_record_batch;
-  if (buffered_batch_ != nullptr) {
-    ARROW_ASSIGN_OR_RAISE(concat_record_batch,
-                          convert_utils::concatenateRecordBatches(
-                              {buffered_batch_, sorted_record_batch}));
+  if (sorted_record_batch->num_rows() == 0) {
+    return arrow::RecordBatchVector{};
   }
 
-  auto time_column = concat_record_batch->GetColumnByName(time_column_name);
-  if (time_column == nullptr) {
-    return arrow::Status::Invalid(fmt::format(
-        "Concatenated RecordBatch has no time column with name {}",
-        time_column_name));
+  arrow::RecordBatchVector chunks(buffered_batches_);
+  chunks.push_back(sorted_record_batch);
+  return calculateDerivatives(chunks, sorted_record_batch->num_rows(),
+                              !options_.no_wait_future);
+}
+
+arrow::Result<arrow::RecordBatchVector> DerivativeHandler::flush() {
+  if (buffered_batches_.empty()) {
+    return arrow::RecordBatchVector{};
   }
 
-  std::unordered_map<std::string, arrow::Array*> value_columns;
+  // Rows waiting for the future values get derivatives by the values
+  // buffered so far
+  auto chunks = std::move(buffered_batches_);
+  buffered_batches_.clear();
+  ARROW_ASSIGN_OR_RAISE(auto result, calculateDerivatives(chunks, 0, false));
+
+  all_buffered_times_.clear();
+  buffered_values_.clear();
+  return result;
+}
+
+arrow::Result<arrow::RecordBatchVector>
+DerivativeHandler::calculateDerivatives(
+    const arrow::RecordBatchVector& chunks, int64_t new_rows,
+    bool wait_future) {
+  std::vector<std::shared_ptr<const SchemaPlan>> chunks_plans;
+  arrow::ArrayVector time_chunks;
+  for (auto& chunk : chunks) {
+    ARROW_ASSIGN_OR_RAISE(chunks_plans.emplace_back(),
+                          getPlan(chunk->schema()));
+
+    auto& chunk_plan = *chunks_plans.back();
+    if (chunk_plan.time_column_index == -1) {
+      return arrow::Status::Invalid(fmt::format(
+          "Buffered RecordBatch has no time column with name {}",
+          chunk_plan.time_column_name));
+    }
+
+    time_chunks.push_back(chunk->column(chunk_plan.time_column_index));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto time_column,
+                        arrow::ChunkedArray::Make(time_chunks));
+
+  std::vector<double> scaled_times;
+  ARROW_RETURN_NOT_OK(getScaledPositionTimes(*time_column, &scaled_times));
+
+  std::unordered_map<std::string, ValueColumn> value_columns;
   std::unordered_map<std::string, arrow::DoubleBuilder>
       derivative_columns_builders;
   for (const auto& [result_column_name, derivative_case] :
        options_.derivative_cases) {
     auto& value_column_name = derivative_case.values_column_name;
     if (value_columns.find(value_column_name) == value_columns.end()) {
-      value_columns[value_column_name] =
-          concat_record_batch->GetColumnByName(value_column_name).get();
-
-      if (value_columns[value_column_name] == nullptr) {
-        return arrow::Status::KeyError(fmt::format(
-            "Concatenated RecordBatch has not column with name {} "
-            "to calculate derivative",
-            value_column_name));
+      arrow::ArrayVector value_chunks;
+      for (size_t i = 0; i < chunks.size(); ++i) {
+        auto value_column_index =
+            chunks_plans[i]->values_columns_indices.at(value_column_name);
+
+        if (value_column_index == -1) {
+          return arrow::Status::KeyError(fmt::format(
+              "Buffered RecordBatch has not column with name {} "
+              "to calculate derivative",
+              value_column_name));
+        }
+
+        value_chunks.push_back(chunks[i]->column(value_column_index));
       }
+
+      ARROW_RETURN_NOT_OK(
+          getDoubleValues(value_chunks, &value_columns[value_column_name]));
     }
 
     derivative_columns_builders[result_column_name];
@@ -52,27 +107,19 @@ arrow::Result<arrow::RecordBatchVector> DerivativeHandler::handle(
 
   double left_bound_time, derivative_time, right_bound_time;
   if (all_buffered_times_.empty()) {
-    ARROW_ASSIGN_OR_RAISE(left_bound_time,
-                          getScaledPositionTime(0, *time_column));
+    left_bound_time = scaled_times.front();
   } else {
     left_bound_time = all_buffered_times_.front();
   }
 
   int64_t derivative_row_id = 0;
-  int64_t right_bound_row_id = 0;
-  if (buffered_batch_ != nullptr) {
-    right_bound_row_id = buffered_batch_->num_rows();
-  }
-
-  ARROW_ASSIGN_OR_RAISE(
-      right_bound_time,
-      getScaledPositionTime(right_bound_row_id, *time_column));
-
   auto total_rows = time_column->length();
+  int64_t right_bound_row_id = total_rows - new_rows;
+  right_bound_time =
+      scaled_times[std::min(right_bound_row_id, total_rows - 1)];
+
   while (derivative_row_id < total_rows) {
-    ARROW_ASSIGN_OR_RAISE(
-        derivative_time,
-        getScaledPositionTime(derivative_row_id, *time_column));
+    derivative_time = scaled_times[derivative_row_id];
 
     while ((derivative_time - left_bound_time) *
                options_.unit_time_segment.count() >
@@ -101,20 +148,13 @@ arrow::Result<arrow::RecordBatchVector> DerivativeHandler::handle(
                options_.derivative_neighbourhood.count()) {
       all_buffered_times_.push_back(right_bound_time);
       for (auto& [column_name, column] : value_columns) {
-        ARROW_ASSIGN_OR_RAISE(auto value_scalar,
-                              column->GetScalar(right_bound_row_id));
-
-        if (!value_scalar->is_valid) {
+        if (!column.is_valid[right_bound_row_id]) {
           continue;
         }
 
-        ARROW_ASSIGN_OR_RAISE(value_scalar,
-                              value_scalar->CastTo(arrow::float64()));
-
-        buffered_values_[column_name].times.push_back(right_bound_time);
-        buffered_values_[column_name].values.push_back(
-            std::static_pointer_cast<arrow::DoubleScalar>(value_scalar)
-                ->value);
+        auto& buffered_values = buffered_values_[column_name];
+        buffered_values.times.push_back(right_bound_time);
+        buffered_values.values.push_back(column.values[right_bound_row_id]);
       }
 
       ++right_bound_row_id;
@@ -122,12 +162,10 @@ arrow::Result<arrow::RecordBatchVector> DerivativeHandler::handle(
         break;
       }
 
-      ARROW_ASSIGN_OR_RAISE(
-          right_bound_time,
-          getScaledPositionTime(right_bound_row_id, *time_column));
+      right_bound_time = scaled_times[right_bound_row_id];
     }
 
-    if (!options_.no_wait_future &&
+    if (wait_future &&
         (right_bound_time - derivative_time) *
                 options_.unit_time_segment.count() <=
             options_.derivative_neighbourhood.count()) {
@@ -160,43 +198,154 @@ arrow::Result<arrow::RecordBatchVector> DerivativeHandler::handle(
     ++derivative_row_id;
   }
 
-  buffered_batch_ = concat_record_batch->Slice(derivative_row_id);
-  auto calculated_batch = concat_record_batch->Slice(0, derivative_row_id);
-  copySchemaMetadata(*record_batch, &calculated_batch);
-  ARROW_RETURN_NOT_OK(copyColumnTypes(*record_batch, &calculated_batch));
-
+  arrow::FieldVector result_fields;
+  arrow::ArrayVector result_columns;
   for (auto& [result_column_name, column_builder] :
        derivative_columns_builders) {
-    ARROW_ASSIGN_OR_RAISE(auto result_column, column_builder.Finish());
-    auto result_field = arrow::field(result_column_name, arrow::float64());
+    result_fields.push_back(
+        arrow::field(result_column_name, arrow::float64()));
+
+    ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
+        &result_fields.back(), metadata::FIELD));
+
+    ARROW_ASSIGN_OR_RAISE(result_columns.emplace_back(),
+                          column_builder.Finish());
+  }
+
+  arrow::RecordBatchVector result;
+  buffered_batches_.clear();
+  int64_t chunk_offset = 0;
+  for (auto& chunk : chunks) {
+    auto calculated_rows = std::clamp<int64_t>(
+        derivative_row_id - chunk_offset, 0, chunk->num_rows());
+
+    if (calculated_rows < chunk->num_rows()) {
+      buffered_batches_.push_back(chunk->Slice(calculated_rows));
+    }
 
+    if (calculated_rows > 0) {
+      auto calculated_batch = chunk->Slice(0, calculated_rows);
+      copySchemaMetadata(*chunks.back(), &calculated_batch);
+      ARROW_RETURN_NOT_OK(
+          copyColumnTypes(*chunks.back(), &calculated_batch));
+
+      for (size_t i = 0; i < result_fields.size(); ++i) {
+        ARROW_ASSIGN_OR_RAISE(
+            calculated_batch,
+            calculated_batch->AddColumn(
+                calculated_batch->num_columns(), result_fields[i],
+                result_columns[i]->Slice(chunk_offset, calculated_rows)));
+      }
+
+      result.push_back(std::move(calculated_batch));
+    }
+
+    chunk_offset += chunk->num_rows();
+  }
+
+  if (!result.empty()) {
     ARROW_RETURN_NOT_OK(
-        metadata::setColumnTypeMetadata(&result_field, metadata::FIELD));
+        metadata::setChunksMetadata(&result, metadata::nextChunkId()));
+  }
+
+  return result;
+}
 
-    ARROW_ASSIGN_OR_RAISE(
-        calculated_batch,
-        calculated_batch->AddColumn(calculated_batch->num_columns(),
-                                    result_field, result_column));
+size_t DerivativeHandler::getStateSize() const {
+  size_t state_size = all_buffered_times_.size() * sizeof(double);
+  for ([[maybe_unused]] auto& [_, buffered_values] : buffered_values_) {
+    state_size += (buffered_values.times.size() +
+                   buffered_values.values.size()) *
+                  sizeof(double);
   }
 
-  return arrow::RecordBatchVector{calculated_batch};
+  for (auto& buffered_batch : buffered_batches_) {
+    state_size += arrow_utils::getBuffersSize(*buffered_batch);
+  }
+
+  return state_size;
+}
+
+arrow::Result<std::shared_ptr<const DerivativeHandler::SchemaPlan>>
+DerivativeHandler::getPlan(const std::shared_ptr<arrow::Schema>& schema) {
+  return plans_.get(schema, [this](const arrow::Schema& schema) {
+    return compilePlan(schema);
+  });
 }
 
-arrow::Result<double> DerivativeHandler::getScaledPositionTime(
-    int64_t row_id, const arrow::Array& time_column) const {
-  ARROW_ASSIGN_OR_RAISE(auto time_scalar, arrow_utils::castTimestampScalar(
-                                              time_column.GetScalar(row_id),
-                                              arrow::TimeUnit::NANO));
+arrow::Result<DerivativeHandler::SchemaPlan> DerivativeHandler::compilePlan(
+    const arrow::Schema& schema) const {
+  SchemaPlan plan;
+  ARROW_ASSIGN_OR_RAISE(plan.time_column_name,
+                        metadata::getTimeColumnNameMetadata(schema));
 
-  return std::static_pointer_cast<arrow::TimestampScalar>(time_scalar)
-             ->value /
-         options_.unit_time_segment.count();
+  plan.time_column_index = schema.GetFieldIndex(plan.time_column_name);
+  for ([[maybe_unused]] auto& [_, derivative_case] :
+       options_.derivative_cases) {
+    plan.values_columns_indices[derivative_case.values_column_name] =
+        schema.GetFieldIndex(derivative_case.values_column_name);
+  }
+
+  return plan;
+}
+
+arrow::Status DerivativeHandler::getScaledPositionTimes(
+    const arrow::ChunkedArray& time_column,
+    std::vector<double>* scaled_times) const {
+  scaled_times->clear();
+  scaled_times->reserve(time_column.length());
+  for (auto& chunk : time_column.chunks()) {
+    ARROW_ASSIGN_OR_RAISE(auto timestamps,
+                          arrow_utils::TimestampsView::make(
+                              *chunk, arrow::TimeUnit::NANO));
+
+    for (int64_t i = 0; i < timestamps.length(); ++i) {
+      scaled_times->push_back(timestamps[i] /
+                              options_.unit_time_segment.count());
+    }
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Status DerivativeHandler::getDoubleValues(
+    const arrow::ArrayVector& chunks, ValueColumn* value_column) {
+  value_column->values.clear();
+  value_column->is_valid.clear();
+  for (auto& chunk : chunks) {
+    auto double_chunk = chunk;
+    if (chunk->type_id() != arrow::Type::DOUBLE) {
+      ARROW_ASSIGN_OR_RAISE(
+          double_chunk,
+          arrow::compute::Cast(
+              *chunk, arrow::float64(),
+              arrow::compute::CastOptions::Unsafe(arrow::float64())));
+    }
+
+    auto raw_values =
+        std::static_pointer_cast<arrow::DoubleArray>(double_chunk)
+            ->raw_values();
+
+    value_column->values.insert(value_column->values.end(), raw_values,
+                                raw_values + double_chunk->length());
+
+    for (int64_t i = 0; i < double_chunk->length(); ++i) {
+      value_column->is_valid.push_back(double_chunk->IsValid(i));
+    }
+  }
+
+  return arrow::Status::OK();
 }
 
 std::shared_ptr<RecordBatchHandler> DerivativeHandlerFactory::createHandler()
     const {
-  return std::make_shared<DerivativeHandler>(derivative_calculator_,
-                                             options_);
+  auto derivative_calculator = derivative_calculator_->clone();
+  if (derivative_calculator == nullptr) {
+    derivative_calculator = derivative_calculator_;
+  }
+
+  return std::make_shared<DerivativeHandler>(
+      std::move(derivative_calculator), options_);
 }
 
 }  // namespace stream_data_processor
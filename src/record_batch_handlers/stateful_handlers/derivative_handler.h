@@ -12,6 +12,7 @@
 
 #include "handler_factory.h"
 #include "record_batch_handlers/record_batch_handler.h"
+#include "record_batch_handlers/schema_plans.h"
 #include "utils/compute_utils.h"
 
 namespace stream_data_processor {
@@ -43,22 +44,54 @@ class DerivativeHandler : public RecordBatchHandler {
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
 
+  arrow::Result<arrow::RecordBatchVector> flush() override;
+
+  [[nodiscard]] size_t getStateSize() const override;
+
  private:
   struct BufferedValues {
     std::deque<double> times;
     std::deque<double> values;
   };
 
+  struct ValueColumn {
+    std::vector<double> values;
+    std::vector<bool> is_valid;
+  };
+
+  // Missing columns have index -1
+  struct SchemaPlan {
+    std::string time_column_name;
+    int time_column_index{-1};
+    std::unordered_map<std::string, int> values_columns_indices;
+  };
+
  private:
-  arrow::Result<double> getScaledPositionTime(
-      int64_t row_id, const arrow::Array& time_column) const;
+  arrow::Result<std::shared_ptr<const SchemaPlan>> getPlan(
+      const std::shared_ptr<arrow::Schema>& schema);
+
+  arrow::Result<SchemaPlan> compilePlan(const arrow::Schema& schema) const;
+
+  // The last new_rows rows of chunks are not buffered yet. Without
+  // wait_future derivatives of all rows are calculated
+  arrow::Result<arrow::RecordBatchVector> calculateDerivatives(
+      const arrow::RecordBatchVector& chunks, int64_t new_rows,
+      bool wait_future);
+
+  arrow::Status getScaledPositionTimes(
+      const arrow::ChunkedArray& time_column,
+      std::vector<double>* scaled_times) const;
+
+  static arrow::Status getDoubleValues(const arrow::ArrayVector& chunks,
+                                       ValueColumn* value_column);
 
  private:
   std::shared_ptr<DerivativeCalculator> derivative_calculator_;
   DerivativeOptions options_;
   std::deque<double> all_buffered_times_;
   std::unordered_map<std::string, BufferedValues> buffered_values_;
-  std::shared_ptr<arrow::RecordBatch> buffered_batch_{nullptr};
+  arrow::RecordBatchVector buffered_batches_;
+  SchemaPlans<SchemaPlan> plans_;
 };
 
 class DerivativeHandlerFactory : public HandlerFactory {
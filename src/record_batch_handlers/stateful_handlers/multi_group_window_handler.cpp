@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <numeric>
+
+#include <arrow/compute/api.h>
+#include <spdlog/spdlog.h>
+
+#include "metadata/chunking.h"
+#include "metadata/column_typing.h"
+#include "metadata/grouping.h"
+#include "multi_group_window_handler.h"
+#include "utils/utils.h"
+
+namespace stream_data_processor {
+
+namespace {
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> takeRows(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    const std::vector<int64_t>& rows) {
+  arrow::Int64Builder indices_builder;
+  ARROW_RETURN_NOT_OK(indices_builder.AppendValues(rows));
+  std::shared_ptr<arrow::Array> indices;
+  ARROW_RETURN_NOT_OK(indices_builder.Finish(&indices));
+
+  ARROW_ASSIGN_OR_RAISE(auto taken_datum,
+                        arrow::compute::Take(record_batch, indices));
+
+  return taken_datum.record_batch();
+}
+
+}  // namespace
+
+arrow::Result<arrow::RecordBatchVector> MultiGroupWindowHandler::handle(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  return handle(arrow::RecordBatchVector{record_batch});
+}
+
+arrow::Result<arrow::RecordBatchVector> MultiGroupWindowHandler::handle(
+    const arrow::RecordBatchVector& record_batches) {
+  if (!isSupported(options_)) {
+    return arrow::Status::NotImplemented(
+        "MultiGroupWindowHandler supports only period, every, fill_period "
+        "and allowed_lateness options");
+  }
+
+  for (auto& input_record_batch : record_batches) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batch,
+        compute_utils::materializeSelection(input_record_batch));
+
+    ARROW_ASSIGN_OR_RAISE(auto groups,
+                          compute_utils::splitGroups(record_batch));
+
+    for (auto& group : groups) {
+      ARROW_RETURN_NOT_OK(append(group));
+    }
+  }
+
+  arrow::RecordBatchVector result;
+  for (auto group_id : touched_groups_) {
+    auto& group = groups_.at(group_id);
+    group.touched = false;
+    ARROW_RETURN_NOT_OK(emitWindows(
+        &group, group.max_time - options_.allowed_lateness.count(),
+        &result));
+  }
+
+  touched_groups_.clear();
+  if (max_time_ >= next_eviction_time_) {
+    ARROW_RETURN_NOT_OK(evictGroups(&result));
+    next_eviction_time_ = max_time_ + options_.period.count();
+  }
+
+  return result;
+}
+
+arrow::Result<arrow::RecordBatchVector> MultiGroupWindowHandler::flush() {
+  arrow::RecordBatchVector result;
+  for (auto& [group_id, group] : groups_) {
+    if (group.buffered_rows > 0) {
+      ARROW_RETURN_NOT_OK(emitWindows(
+          &group, group.max_time + options_.period.count(), &result));
+    }
+  }
+
+  groups_.clear();
+  touched_groups_.clear();
+  metrics_.groups = 0;
+  metrics_.buffered_rows = 0;
+  return result;
+}
+
+bool MultiGroupWindowHandler::isSupported(
+    const WindowHandler::WindowOptions& options) {
+  return !options.idle_timeout.has_value() &&
+         !options.max_buffered_rows.has_value() &&
+         !options.keep_late_rows && !options.memory_budget_bytes.has_value();
+}
+
+arrow::Status MultiGroupWindowHandler::append(
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
+  if (record_batch->num_rows() == 0) {
+    return arrow::Status::OK();
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto time_column_name,
+                        metadata::getTimeColumnNameMetadata(*record_batch));
+
+  auto time_column = record_batch->GetColumnByName(time_column_name);
+  if (time_column == nullptr) {
+    return arrow::Status::Invalid(fmt::format(
+        "RecordBatch has no time column with name {}", time_column_name));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto timestamps,
+                        arrow_utils::TimestampsView::make(
+                            *time_column, arrow::TimeUnit::SECOND));
+
+  auto interned_group = metadata::extractInternedGroup(*record_batch);
+  auto group_id = interned_group->id;
+  auto [group_iter, inserted] = groups_.try_emplace(group_id);
+  auto& group = group_iter->second;
+  if (inserted) {
+    group.group = std::move(interned_group);
+    metrics_.groups = groups_.size();
+  }
+
+  group.metadata = record_batch->schema()->metadata();
+  if (!group.touched) {
+    group.touched = true;
+    touched_groups_.push_back(group_id);
+  }
+
+  if (group.next_emit == 0) {
+    std::time_t min_time = timestamps[0];
+    for (int64_t i = 1; i < timestamps.length(); ++i) {
+      min_time = std::min<std::time_t>(min_time, timestamps[i]);
+    }
+
+    group.max_time = min_time;
+    group.next_emit = min_time + (options_.fill_period
+                                      ? options_.period.count()
+                                      : options_.every.count());
+  }
+
+  auto window_start = group.next_emit - options_.period.count();
+  std::vector<int64_t> actual_rows;
+  actual_rows.reserve(timestamps.length());
+  for (int64_t i = 0; i < timestamps.length(); ++i) {
+    if (timestamps[i] >= window_start) {
+      actual_rows.push_back(i);
+    }
+  }
+
+  metrics_.late_rows += timestamps.length() - actual_rows.size();
+  if (actual_rows.empty()) {
+    return arrow::Status::OK();
+  }
+
+  auto store_iter =
+      std::find_if(group.stores.begin(), group.stores.end(),
+                   [&record_batch](const Store& store) {
+                     return store.schema->Equals(*record_batch->schema(),
+                                                 false);
+                   });
+
+  if (store_iter == group.stores.end()) {
+    group.stores.push_back({record_batch->schema()->RemoveMetadata()});
+    store_iter = group.stores.end() - 1;
+  }
+
+  auto chunk = arrow::RecordBatch::Make(
+      store_iter->schema, record_batch->num_rows(), record_batch->columns());
+
+  if (static_cast<int64_t>(actual_rows.size()) < record_batch->num_rows()) {
+    ARROW_ASSIGN_OR_RAISE(chunk, takeRows(chunk, actual_rows));
+  }
+
+  store_iter->chunks.push_back(chunk);
+  for (auto row : actual_rows) {
+    if (!store_iter->times.empty() &&
+        timestamps[row] < store_iter->times.back()) {
+      store_iter->is_sorted = false;
+    }
+
+    store_iter->times.push_back(timestamps[row]);
+    group.max_time = std::max<std::time_t>(group.max_time, timestamps[row]);
+  }
+
+  max_time_ = std::max(max_time_, group.max_time);
+  group.buffered_rows += actual_rows.size();
+  metrics_.buffered_rows += actual_rows.size();
+  return arrow::Status::OK();
+}
+
+arrow::Status MultiGroupWindowHandler::emitWindows(
+    GroupState* group, std::time_t watermark,
+    arrow::RecordBatchVector* result) {
+  if (watermark < group->next_emit) {
+    return arrow::Status::OK();
+  }
+
+  for (auto& store : group->stores) {
+    ARROW_RETURN_NOT_OK(sortStore(&store));
+  }
+
+  while (watermark >= group->next_emit) {
+    auto window_start = group->next_emit - options_.period.count();
+    arrow::RecordBatchVector window_chunks;
+    for (auto& store : group->stores) {
+      auto window_begin = std::lower_bound(store.times.begin(),
+                                           store.times.end(), window_start);
+
+      auto window_end = std::lower_bound(window_begin, store.times.end(),
+                                         group->next_emit);
+
+      if (window_begin != window_end) {
+        window_chunks.push_back(
+            store.chunks.front()
+                ->Slice(window_begin - store.times.begin(),
+                        window_end - window_begin)
+                ->ReplaceSchemaMetadata(group->metadata));
+      }
+    }
+
+    group->next_emit += options_.every.count();
+    if (window_chunks.empty()) {
+      continue;
+    }
+
+    ARROW_RETURN_NOT_OK(metadata::setChunksMetadata(
+        &window_chunks, metadata::nextChunkId()));
+
+    convert_utils::append(std::move(window_chunks), *result);
+  }
+
+  return removeOldRows(group);
+}
+
+arrow::Status MultiGroupWindowHandler::removeOldRows(GroupState* group) {
+  auto window_start = group->next_emit - options_.period.count();
+  for (auto& store : group->stores) {
+    auto old_rows =
+        std::lower_bound(store.times.begin(), store.times.end(),
+                         window_start) -
+        store.times.begin();
+
+    if (old_rows == 0) {
+      continue;
+    }
+
+    group->buffered_rows -= old_rows;
+    metrics_.buffered_rows -= old_rows;
+    store.times.erase(store.times.begin(), store.times.begin() + old_rows);
+    if (store.times.empty()) {
+      store.chunks.clear();
+    } else {
+      store.chunks.front() = store.chunks.front()->Slice(old_rows);
+    }
+  }
+
+  group->stores.erase(
+      std::remove_if(group->stores.begin(), group->stores.end(),
+                     [](const Store& store) { return store.times.empty(); }),
+      group->stores.end());
+
+  return arrow::Status::OK();
+}
+
+arrow::Status MultiGroupWindowHandler::evictGroups(
+    arrow::RecordBatchVector* result) {
+  auto watermark = max_time_ - options_.allowed_lateness.count();
+  for (auto group_iter = groups_.begin(); group_iter != groups_.end();) {
+    auto& group = group_iter->second;
+    if (group.max_time + options_.period.count() >= watermark) {
+      ++group_iter;
+      continue;
+    }
+
+    // All rows of the group are older than the window closed by the
+    // watermark of the whole stream. Windows ending later than a period
+    // after the last row of the group are empty, so they are not iterated.
+    ARROW_RETURN_NOT_OK(emitWindows(
+        &group, group.max_time + options_.period.count(), result));
+    group_iter = groups_.erase(group_iter);
+  }
+
+  metrics_.groups = groups_.size();
+  return arrow::Status::OK();
+}
+
+arrow::Status MultiGroupWindowHandler::sortStore(Store* store) {
+  if (store->chunks.size() > 1) {
+    ARROW_ASSIGN_OR_RAISE(
+        auto consolidated,
+        convert_utils::concatenateRecordBatches(store->chunks));
+
+    store->chunks = {consolidated};
+  }
+
+  if (store->is_sorted) {
+    return arrow::Status::OK();
+  }
+
+  auto& times = store->times;
+  std::vector<int64_t> rows(times.size());
+  std::iota(rows.begin(), rows.end(), 0);
+  std::stable_sort(rows.begin(), rows.end(),
+                   [&times](int64_t left, int64_t right) {
+                     return times[left] < times[right];
+                   });
+
+  ARROW_ASSIGN_OR_RAISE(store->chunks.front(),
+                        takeRows(store->chunks.front(), rows));
+
+  std::sort(times.begin(), times.end());
+  store->is_sorted = true;
+  return arrow::Status::OK();
+}
+
+std::shared_ptr<RecordBatchHandler>
+MultiGroupWindowHandlerFactory::createHandler() const {
+  return std::make_shared<MultiGroupWindowHandler>(options_);
+}
+
+}  // namespace stream_data_processor
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <arrow/api.h>
+
+#include "handler_factory.h"
+#include "metadata/grouping.h"
+#include "record_batch_handlers/record_batch_handler.h"
+#include "window_handler.h"
+
+namespace stream_data_processor {
+
+// Windows record batches of many groups in one handler. Unlike
+// GroupDispatcher with a WindowHandler per group, a group costs only its
+// window bounds and the buffered rows which are kept per group and schema
+// in time order, so windows are emitted as zero-copy slices and emitting
+// windows of a group doesn't touch rows of other groups. A group which
+// rows are all a period behind the watermark of the whole stream is flushed
+// with this watermark and evicted.
+//
+// Uses period, every, fill_period and allowed_lateness options, other
+// options are not supported.
+class MultiGroupWindowHandler : public RecordBatchHandler {
+ public:
+  struct Metrics {
+    size_t groups{0};
+    size_t buffered_rows{0};
+    size_t late_rows{0};
+  };
+
+  template <typename OptionsType>
+  explicit MultiGroupWindowHandler(OptionsType&& options)
+      : options_(std::forward<OptionsType>(options)) {}
+
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
+
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const arrow::RecordBatchVector& record_batches) override;
+
+  // Emits all windows having buffered rows and drops all groups
+  arrow::Result<arrow::RecordBatchVector> flush() override;
+
+  [[nodiscard]] const Metrics& getMetrics() const { return metrics_; }
+
+  static bool isSupported(const WindowHandler::WindowOptions& options);
+
+ private:
+  // Rows of one schema in time order, times are kept per row. Appended
+  // chunks are merged on the next emission.
+  struct Store {
+    std::shared_ptr<arrow::Schema> schema;
+    arrow::RecordBatchVector chunks;
+    std::vector<std::time_t> times;
+    bool is_sorted{true};
+  };
+
+  // Group states hold the interned groups, so evicted groups are released
+  struct GroupState {
+    metadata::InternedGroupPtr group;
+    std::shared_ptr<const arrow::KeyValueMetadata> metadata;
+    std::time_t next_emit{0};
+    std::time_t max_time{0};
+    std::vector<Store> stores;
+    size_t buffered_rows{0};
+    bool touched{false};
+  };
+
+ private:
+  arrow::Status append(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch);
+
+  arrow::Status emitWindows(GroupState* group, std::time_t watermark,
+                            arrow::RecordBatchVector* result);
+
+  arrow::Status removeOldRows(GroupState* group);
+
+  arrow::Status evictGroups(arrow::RecordBatchVector* result);
+
+  static arrow::Status sortStore(Store* store);
+
+ private:
+  WindowHandler::WindowOptions options_;
+  std::unordered_map<metadata::GroupId, GroupState> groups_;
+  std::vector<metadata::GroupId> touched_groups_;
+  std::time_t max_time_{0};
+  std::time_t next_eviction_time_{0};
+  Metrics metrics_;
+};
+
+class MultiGroupWindowHandlerFactory : public HandlerFactory {
+ public:
+  template <typename OptionsType>
+  explicit MultiGroupWindowHandlerFactory(OptionsType&& options)
+      : options_(std::forward<OptionsType>(options)) {}
+
+  std::shared_ptr<RecordBatchHandler> createHandler() const override;
+
+ private:
+  WindowHandler::WindowOptions options_;
+};
+
+}  // namespace stream_data_processor
@@ -0,0 +1,392 @@
+#include <algorithm>
+
+#include <arrow/compute/api.h>
+
+#include "metadata/metadata.h"
+#include "streaming_join_handler.h"
+#include "utils/utils.h"
+
+namespace stream_data_processor {
+
+namespace {
+
+// Values are prefixed with their lengths, so different tuples of values
+// don't give the same key
+arrow::Result<std::string> getKeyValue(const arrow::ArrayVector& key_columns,
+                                       int64_t row) {
+  std::string key_value;
+  for (auto& key_column : key_columns) {
+    ARROW_ASSIGN_OR_RAISE(auto value,
+                          arrow_utils::getDecodedScalar(*key_column, row));
+
+    if (!value->is_valid) {
+      key_value += '-';
+      continue;
+    }
+
+    auto value_string = value->ToString();
+    key_value += std::to_string(value_string.size());
+    key_value += ':';
+    key_value += value_string;
+  }
+
+  return key_value;
+}
+
+}  // namespace
+
+arrow::Result<arrow::RecordBatchVector> StreamingJoinHandler::handle(
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
+  ARROW_RETURN_NOT_OK(checkSingleGroup(*record_batch));
+
+  if (record_batch->num_rows() == 0) {
+    return arrow::RecordBatchVector{};
+  }
+
+  std::vector<KeysMap::value_type*> touched_keys;
+  ARROW_RETURN_NOT_OK(appendRecordBatch(record_batch, &touched_keys));
+
+  ReadyRows ready_rows;
+  for (auto key : touched_keys) {
+    key->second.is_touched = false;
+    selectReadyRows(key, &ready_rows);
+  }
+
+  auto expiration_period =
+      options_.tolerance.count() + options_.grace_period.count();
+
+  while (!keys_by_time_.empty() &&
+         max_seen_time_.value() - keys_by_time_.begin()->first >
+             expiration_period) {
+    auto key = keys_.find(*keys_by_time_.begin()->second);
+    selectReadyRows(&*key, &ready_rows);
+  }
+
+  if (options_.max_buffered_rows.has_value()) {
+    while (metrics_.buffered_rows > options_.max_buffered_rows.value()) {
+      evictOldestSlot(&ready_rows);
+    }
+  }
+
+  metrics_.buffered_keys = keys_.size();
+  return emitReadyRows(ready_rows);
+}
+
+arrow::Status StreamingJoinHandler::appendRecordBatch(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    std::vector<KeysMap::value_type*>* touched_keys) {
+  ARROW_ASSIGN_OR_RAISE(auto time_column_name,
+                        metadata::getTimeColumnNameMetadata(*record_batch));
+
+  std::vector<int64_t> times;
+  ARROW_RETURN_NOT_OK(compute_utils::getTimeValues(
+      *record_batch, time_column_name, time_utils::SECOND, &times));
+
+  arrow::ArrayVector key_columns;
+  for (auto& join_column_name : options_.join_on_columns) {
+    auto join_column = record_batch->GetColumnByName(join_column_name);
+    if (join_column == nullptr) {
+      return arrow::Status::Invalid(fmt::format(
+          "Join column with name {} should be presented", join_column_name));
+    }
+
+    key_columns.push_back(join_column);
+  }
+
+  // Keys are encoded within the record batch and looked up once per
+  // distinct key
+  std::vector<int64_t> local_key_ids;
+  std::vector<KeysMap::value_type*> local_keys(1, nullptr);
+  if (key_columns.empty()) {
+    local_key_ids.assign(record_batch->num_rows(), 0);
+  } else {
+    compute_utils::KeyTable key_table;
+    ARROW_RETURN_NOT_OK(key_table.encode(key_columns, &local_key_ids));
+    local_keys.assign(key_table.size(), nullptr);
+  }
+
+  std::vector<SourcesMap::value_type*> sources;
+  ARROW_RETURN_NOT_OK(getSources(*record_batch, &sources));
+
+  auto record_batch_id = next_record_batch_id_++;
+  for (int64_t i = 0; i < record_batch->num_rows(); ++i) {
+    auto& local_key = local_keys[local_key_ids[i]];
+    if (local_key == nullptr) {
+      ARROW_ASSIGN_OR_RAISE(auto key_value, getKeyValue(key_columns, i));
+      local_key = &*keys_.try_emplace(std::move(key_value)).first;
+      if (!local_key->second.is_touched) {
+        local_key->second.is_touched = true;
+        touched_keys->push_back(local_key);
+      }
+    }
+
+    auto& key_state = local_key->second;
+    if (!key_state.rows.empty() && key_state.rows.back().time > times[i]) {
+      key_state.is_sorted = false;
+    }
+
+    key_state.rows.push_back({times[i], sources[i], record_batch_id, i});
+    ++sources[i]->second;
+  }
+
+  auto max_time = *std::max_element(times.begin(), times.end());
+  if (!max_seen_time_.has_value() || max_seen_time_.value() < max_time) {
+    max_seen_time_ = max_time;
+  }
+
+  metrics_.buffered_rows += record_batch->num_rows();
+  buffered_record_batches_[record_batch_id] = {record_batch,
+                                               record_batch->num_rows()};
+
+  return arrow::Status::OK();
+}
+
+arrow::Status StreamingJoinHandler::getSources(
+    const arrow::RecordBatch& record_batch,
+    std::vector<SourcesMap::value_type*>* sources) {
+  std::shared_ptr<arrow::Array> source_column{nullptr};
+
+  auto measurement_column_name_result =
+      metadata::getMeasurementColumnNameMetadata(record_batch);
+
+  if (measurement_column_name_result.ok()) {
+    source_column = record_batch.GetColumnByName(
+        measurement_column_name_result.ValueOrDie());
+  }
+
+  if (source_column != nullptr &&
+      source_column->type_id() == arrow::Type::DICTIONARY &&
+      static_cast<const arrow::DictionaryType&>(*source_column->type())
+              .value_type()
+              ->id() == arrow::Type::STRING) {
+    getDictionarySources(
+        static_cast<const arrow::DictionaryArray&>(*source_column), sources);
+
+    return arrow::Status::OK();
+  }
+
+  if (source_column == nullptr ||
+      source_column->type_id() != arrow::Type::STRING) {
+    std::string columns_signature;
+    for (auto& field_name : record_batch.schema()->field_names()) {
+      columns_signature += field_name;
+      columns_signature += ',';
+    }
+
+    auto& source = *sources_.try_emplace(columns_signature, 0).first;
+    sources->assign(record_batch.num_rows(), &source);
+    return arrow::Status::OK();
+  }
+
+  auto& source_values =
+      static_cast<const arrow::StringArray&>(*source_column);
+  for (int64_t i = 0; i < record_batch.num_rows(); ++i) {
+    if (i > 0 && source_values.GetView(i) == source_values.GetView(i - 1)) {
+      sources->push_back(sources->back());
+      continue;
+    }
+
+    sources->push_back(
+        &*sources_.try_emplace(source_values.GetString(i), 0).first);
+  }
+
+  return arrow::Status::OK();
+}
+
+void StreamingJoinHandler::getDictionarySources(
+    const arrow::DictionaryArray& source_column,
+    std::vector<SourcesMap::value_type*>* sources) {
+  auto& dictionary_values =
+      static_cast<const arrow::StringArray&>(*source_column.dictionary());
+
+  // Sources are looked up once for each dictionary value, rows with null
+  // measurement share the source of the empty one
+  std::vector<SourcesMap::value_type*> dictionary_sources(
+      dictionary_values.length() + 1, nullptr);
+
+  for (int64_t i = 0; i < source_column.length(); ++i) {
+    auto index = source_column.IsNull(i) ? dictionary_values.length()
+                                         : source_column.GetValueIndex(i);
+
+    auto& source = dictionary_sources[index];
+    if (source == nullptr) {
+      auto source_name = index == dictionary_values.length()
+                             ? std::string{}
+                             : dictionary_values.GetString(index);
+
+      source = &*sources_.try_emplace(std::move(source_name), 0).first;
+    }
+
+    sources->push_back(source);
+  }
+}
+
+void StreamingJoinHandler::selectReadyRows(KeysMap::value_type* key,
+                                           ReadyRows* ready_rows) {
+  auto& key_state = key->second;
+  auto slots = getSlots(&key_state);
+
+  auto expiration_period =
+      options_.tolerance.count() + options_.grace_period.count();
+
+  std::vector<bool> ready_slots(slots.size(), false);
+  std::vector<const SourcesMap::value_type*> slot_sources;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    slot_sources.clear();
+    for (size_t j = slots[i].begin; j < slots[i].end; ++j) {
+      auto source = key_state.rows[j].source;
+      if (std::find(slot_sources.begin(), slot_sources.end(), source) ==
+          slot_sources.end()) {
+        slot_sources.push_back(source);
+      }
+    }
+
+    if (slot_sources.size() >= options_.inputs_number) {
+      ready_slots[i] = true;
+    } else if (max_seen_time_.value() - slots[i].start_time >
+               expiration_period) {
+      ready_slots[i] = true;
+      ++metrics_.expired_slots;
+    }
+  }
+
+  takeSlotsRows(key, ready_slots, slots, ready_rows);
+}
+
+void StreamingJoinHandler::evictOldestSlot(ReadyRows* ready_rows) {
+  // The first slot of the key with the oldest row is the oldest slot
+  auto key = &*keys_.find(*keys_by_time_.begin()->second);
+  auto slots = getSlots(&key->second);
+
+  std::vector<bool> ready_slots(slots.size(), false);
+  ready_slots.front() = true;
+  metrics_.evicted_rows += slots.front().end - slots.front().begin;
+
+  takeSlotsRows(key, ready_slots, slots, ready_rows);
+}
+
+std::vector<StreamingJoinHandler::Slot> StreamingJoinHandler::getSlots(
+    KeyState* key_state) const {
+  auto& rows = key_state->rows;
+  if (!key_state->is_sorted) {
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const BufferedRow& left, const BufferedRow& right) {
+                       return left.time < right.time;
+                     });
+
+    key_state->is_sorted = true;
+  }
+
+  auto tolerance = options_.tolerance.count();
+  std::vector<Slot> slots;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    if (i == 0 || rows[i].time - slots.back().start_time > tolerance) {
+      slots.push_back({i, i, rows[i].time});
+    }
+
+    ++slots.back().end;
+  }
+
+  return slots;
+}
+
+void StreamingJoinHandler::takeSlotsRows(KeysMap::value_type* key,
+                                         const std::vector<bool>& ready_slots,
+                                         const std::vector<Slot>& slots,
+                                         ReadyRows* ready_rows) {
+  auto& key_state = key->second;
+  std::vector<BufferedRow> waiting_rows;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    for (size_t j = slots[i].begin; j < slots[i].end; ++j) {
+      auto& row = key_state.rows[j];
+      if (!ready_slots[i]) {
+        waiting_rows.push_back(row);
+        continue;
+      }
+
+      (*ready_rows)[row.record_batch_id].push_back(row.row_idx);
+      // Erased by iterator as the key is owned by the erased node
+      if (--row.source->second == 0) {
+        sources_.erase(sources_.find(row.source->first));
+      }
+
+      --metrics_.buffered_rows;
+    }
+  }
+
+  key_state.rows = std::move(waiting_rows);
+  if (key_state.indexed_time.has_value()) {
+    keys_by_time_.erase({key_state.indexed_time.value(), &key->first});
+    key_state.indexed_time.reset();
+  }
+
+  if (key_state.rows.empty()) {
+    keys_.erase(keys_.find(key->first));
+    return;
+  }
+
+  key_state.indexed_time = key_state.rows.front().time;
+  keys_by_time_.emplace(key_state.indexed_time.value(), &key->first);
+}
+
+arrow::Result<arrow::RecordBatchVector> StreamingJoinHandler::emitReadyRows(
+    const ReadyRows& ready_rows) {
+  arrow::RecordBatchVector ready_record_batches;
+  for (auto& [record_batch_id, rows] : ready_rows) {
+    auto buffered_iter = buffered_record_batches_.find(record_batch_id);
+    auto& buffered = buffered_iter->second;
+    if (static_cast<int64_t>(rows.size()) ==
+        buffered.record_batch->num_rows()) {
+      ready_record_batches.push_back(buffered.record_batch);
+    } else {
+      auto sorted_rows = rows;
+      std::sort(sorted_rows.begin(), sorted_rows.end());
+      ARROW_ASSIGN_OR_RAISE(ready_record_batches.emplace_back(),
+                            takeRows(buffered.record_batch, sorted_rows));
+    }
+
+    buffered.waiting_rows -= rows.size();
+    if (buffered.waiting_rows == 0) {
+      buffered_record_batches_.erase(buffered_iter);
+    }
+  }
+
+  if (ready_record_batches.empty()) {
+    return arrow::RecordBatchVector{};
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto result,
+                        join_handler_.handle(ready_record_batches));
+
+  for (auto& result_record_batch : result) {
+    metrics_.emitted_rows += result_record_batch->num_rows();
+  }
+
+  return result;
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>>
+StreamingJoinHandler::takeRows(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    const std::vector<int64_t>& rows) {
+  arrow::Int64Builder indices_builder;
+  ARROW_RETURN_NOT_OK(indices_builder.AppendValues(rows));
+  std::shared_ptr<arrow::Array> indices;
+  ARROW_RETURN_NOT_OK(indices_builder.Finish(&indices));
+
+  ARROW_ASSIGN_OR_RAISE(auto taken_datum,
+                        arrow::compute::Take(record_batch, indices));
+
+  return taken_datum.record_batch();
+}
+
+std::shared_ptr<RecordBatchHandler>
+StreamingJoinHandlerFactory::createHandler() const {
+  return std::make_shared<StreamingJoinHandler>(options_);
+}
+
+}  // namespace stream_data_processor
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <arrow/api.h>
+
+#include "handler_factory.h"
+#include "record_batch_handlers/join_handler.h"
+#include "record_batch_handlers/record_batch_handler.h"
+#include "utils/compute_utils.h"
+
+namespace stream_data_processor {
+
+// Joins rows of several input streams arriving in different record batches.
+// Rows are buffered until all inputs for a key/time slot have arrived or
+// the slot is older than tolerance plus grace period. Inputs are told apart
+// by measurement column values or by the set of columns if there is no
+// measurement column.
+//
+// Waiting rows are kept per key, so only keys of the incoming record batch
+// and keys with expired slots are looked at. Keys are ordered by their
+// oldest waiting row and are dropped when all their rows are emitted.
+class StreamingJoinHandler : public RecordBatchHandler {
+ public:
+  struct StreamingJoinOptions {
+    std::vector<std::string> join_on_columns;
+    std::chrono::seconds tolerance{0};
+    std::chrono::seconds grace_period{0};
+    size_t inputs_number{2};
+    std::optional<size_t> max_buffered_rows{std::nullopt};
+  };
+
+  struct Metrics {
+    size_t buffered_rows{0};
+    size_t emitted_rows{0};
+    size_t expired_slots{0};
+    size_t evicted_rows{0};
+    size_t buffered_keys{0};
+  };
+
+  template <typename OptionsType>
+  explicit StreamingJoinHandler(OptionsType&& options)
+      : options_(std::forward<OptionsType>(options)),
+        join_handler_(options_.join_on_columns, options_.tolerance.count()) {}
+
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
+
+  [[nodiscard]] const Metrics& getMetrics() const { return metrics_; }
+
+ private:
+  struct BufferedRecordBatch {
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    int64_t waiting_rows;
+  };
+
+  // Number of waiting rows of the input
+  using SourcesMap = std::unordered_map<std::string, size_t>;
+
+  struct BufferedRow {
+    int64_t time;
+    SourcesMap::value_type* source;
+    int64_t record_batch_id;
+    int64_t row_idx;
+  };
+
+  struct KeyState {
+    std::vector<BufferedRow> rows;
+    bool is_sorted{true};
+    bool is_touched{false};
+    std::optional<int64_t> indexed_time{std::nullopt};
+  };
+
+  using KeysMap = std::unordered_map<std::string, KeyState>;
+
+  struct Slot {
+    size_t begin;
+    size_t end;
+    int64_t start_time;
+  };
+
+  // Ready rows indices by buffered record batch ids
+  using ReadyRows = std::map<int64_t, std::vector<int64_t>>;
+
+ private:
+  arrow::Status appendRecordBatch(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch,
+      std::vector<KeysMap::value_type*>* touched_keys);
+
+  arrow::Status getSources(const arrow::RecordBatch& record_batch,
+                           std::vector<SourcesMap::value_type*>* sources);
+
+  void getDictionarySources(const arrow::DictionaryArray& source_column,
+                            std::vector<SourcesMap::value_type*>* sources);
+
+  void selectReadyRows(KeysMap::value_type* key, ReadyRows* ready_rows);
+
+  void evictOldestSlot(ReadyRows* ready_rows);
+
+  std::vector<Slot> getSlots(KeyState* key_state) const;
+
+  void takeSlotsRows(KeysMap::value_type* key,
+                     const std::vector<bool>& ready_slots,
+                     const std::vector<Slot>& slots, ReadyRows* ready_rows);
+
+  arrow::Result<arrow::RecordBatchVector> emitReadyRows(
+      const ReadyRows& ready_rows);
+
+  static arrow::Result<std::shared_ptr<arrow::RecordBatch>> takeRows(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch,
+      const std::vector<int64_t>& rows);
+
+ private:
+  StreamingJoinOptions options_;
+  JoinHandler join_handler_;
+  KeysMap keys_;
+  std::set<std::pair<int64_t, const std::string*>> keys_by_time_;
+  SourcesMap sources_;
+  std::map<int64_t, BufferedRecordBatch> buffered_record_batches_;
+  int64_t next_record_batch_id_{0};
+  std::optional<int64_t> max_seen_time_{std::nullopt};
+  Metrics metrics_;
+};
+
+class StreamingJoinHandlerFactory : public HandlerFactory {
+ public:
+  template <typename OptionsType>
+  explicit StreamingJoinHandlerFactory(OptionsType&& options)
+      : options_(std::forward<OptionsType>(options)) {}
+
+  std::shared_ptr<RecordBatchHandler> createHandler() const override;
+
+ private:
+  StreamingJoinHandler::StreamingJoinOptions options_;
+};
+
+}  // namespace stream_data_processor
@@ -1,288 +1,196 @@
 #include <algorithm>
 
+#include <arrow/compute/api.h>
 #include <spdlog/spdlog.h>
 
 #include "metadata/column_typing.h"
+#include "metadata/time_metadata.h"
 #include "threshold_state_machine.h"
-#include "utils/arrow_utils.h"
+#include "utils/compute_utils.h"
 
 namespace stream_data_processor {
 
-namespace internal {
-
-ThresholdState::~ThresholdState() = default;
-
-arrow::Result<double> ThresholdState::getColumnValueAtRow(
-    const arrow::RecordBatch& record_batch, const std::string& column_name,
-    int row_id) {
-  auto column = record_batch.GetColumnByName(column_name);
-  if (column == nullptr) {
-    return arrow::Status::KeyError(
-        fmt::format("Can't get value from column {}: no such column exists",
-                    column_name));
-  }
-
-  if (!arrow_utils::isNumericType(column->type_id())) {
-    return arrow::Status::TypeError(fmt::format(
-        "Threshold state machine requires numeric type, but {} type "
-        "provided",
-        column->type()->ToString()));
-  }
-
-  ARROW_ASSIGN_OR_RAISE(auto value, column->GetScalar(row_id));
-  ARROW_ASSIGN_OR_RAISE(value, value->CastTo(arrow::float64()));
-  return std::static_pointer_cast<arrow::DoubleScalar>(value)->value;
-}
-
-arrow::Result<std::time_t> ThresholdState::getTimeAtRow(
-    const arrow::RecordBatch& record_batch, int row_id) {
-  ARROW_ASSIGN_OR_RAISE(auto time_column_name,
-                        metadata::getTimeColumnNameMetadata(record_batch));
-
-  std::shared_ptr<arrow::Scalar> time_scalar;
+arrow::Result<arrow::RecordBatchVector> ThresholdStateMachine::handle(
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
   ARROW_ASSIGN_OR_RAISE(
-      time_scalar,
-      arrow_utils::castTimestampScalar(
-          record_batch.GetColumnByName(time_column_name)->GetScalar(row_id),
-          arrow::TimeUnit::SECOND));
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
 
-  return std::static_pointer_cast<arrow::TimestampScalar>(time_scalar)->value;
-}
-
-StateOK::StateOK(const std::shared_ptr<ThresholdStateMachine>& state_machine,
-                 double current_threshold)
-    : state_machine_(state_machine), current_threshold_(current_threshold) {}
-
-StateOK::StateOK(std::weak_ptr<ThresholdStateMachine> state_machine,
-                 double current_threshold)
-    : state_machine_(std::move(state_machine)),
-      current_threshold_(current_threshold) {}
-
-arrow::Status StateOK::addThresholdForRow(
-    const arrow::RecordBatch& record_batch, int row_id,
-    arrow::DoubleBuilder* threshold_column_builder) {
-  double value = 0;
-  auto& options = state_machine_.lock()->getOptions();
+  ARROW_RETURN_NOT_OK(checkSingleGroup(*record_batch));
 
   ARROW_ASSIGN_OR_RAISE(
-      value,
-      getColumnValueAtRow(record_batch, options.watch_column_name, row_id));
-
-  ARROW_RETURN_NOT_OK(threshold_column_builder->Append(current_threshold_));
+      auto plan, plans_.get(record_batch->schema(),
+                            [this](const arrow::Schema& schema) {
+                              return compilePlan(schema);
+                            }));
 
-  if (value <= current_threshold_ &&
-      value >= current_threshold_ * options.decrease_trigger_factor) {
-    return arrow::Status::OK();
-  }
-
-  auto self = state_machine_.lock()->getState();
-  std::time_t alert_start = 0;
-  ARROW_ASSIGN_OR_RAISE(alert_start, getTimeAtRow(record_batch, row_id));
+  std::vector<double> values;
+  ARROW_RETURN_NOT_OK(getWatchValues(*record_batch, *plan, &values));
 
-  if (value > current_threshold_) {
-    state_machine_.lock()->changeState(std::make_shared<StateIncrease>(
-        state_machine_, current_threshold_, alert_start));
+  // Time is needed on state changes only, so batches without time column
+  // are fine while the state stays OK
+  auto timestamps_result = getTimestamps(*record_batch, *plan);
 
-    return arrow::Status::OK();
+  arrow::DoubleBuilder threshold_builder;
+  ARROW_RETURN_NOT_OK(threshold_builder.Reserve(record_batch->num_rows()));
+  for (int64_t row = 0; row < record_batch->num_rows(); ++row) {
+    std::time_t row_time = 0;
+    if (isTimeNeeded(values[row])) {
+      ARROW_RETURN_NOT_OK(timestamps_result.status());
+      row_time = timestamps_result.ValueUnsafe()[row];
+    }
+
+    threshold_builder.UnsafeAppend(addThreshold(values[row], row_time));
   }
 
-  if (value <= current_threshold_ * options.decrease_trigger_factor) {
-    state_machine_.lock()->changeState(std::make_shared<StateDecrease>(
-        state_machine_, current_threshold_, alert_start));
-
-    return arrow::Status::OK();
-  }
+  std::shared_ptr<arrow::Array> threshold_array;
+  ARROW_RETURN_NOT_OK(threshold_builder.Finish(&threshold_array));
 
-  return arrow::Status::OK();
+  auto columns = record_batch->columns();
+  columns.push_back(threshold_array);
+  return arrow::RecordBatchVector{arrow::RecordBatch::Make(
+      arrow::schema(plan->result_fields, record_batch->schema()->metadata()),
+      record_batch->num_rows(), std::move(columns))};
 }
 
-StateIncrease::StateIncrease(
-    const std::shared_ptr<ThresholdStateMachine>& state_machine,
-    double current_threshold, std::time_t alert_start)
-    : state_machine_(state_machine),
-      current_threshold_(current_threshold),
-      alert_start_(alert_start) {}
-
-StateIncrease::StateIncrease(
-    std::weak_ptr<ThresholdStateMachine> state_machine,
-    double current_threshold, std::time_t alert_start)
-    : state_machine_(std::move(state_machine)),
-      current_threshold_(current_threshold),
-      alert_start_(alert_start) {}
-
-arrow::Status StateIncrease::addThresholdForRow(
-    const arrow::RecordBatch& record_batch, int row_id,
-    arrow::DoubleBuilder* threshold_column_builder) {
-  double value = 0;
-  auto& options = state_machine_.lock()->getOptions();
-
-  ARROW_ASSIGN_OR_RAISE(
-      value,
-      getColumnValueAtRow(record_batch, options.watch_column_name, row_id));
-
-  std::time_t row_time = 0;
-  ARROW_ASSIGN_OR_RAISE(row_time, getTimeAtRow(record_batch, row_id));
-
-  if (value > current_threshold_ && row_time > alert_start_ &&
-      row_time - alert_start_ > options.increase_after.count()) {
-    auto self =
-        state_machine_.lock()
-            ->getState();  // need to save this to avoid freeing our memory
-
-    std::shared_ptr<ThresholdState> new_state = std::make_shared<StateOK>(
-        state_machine_,
-        std::min(current_threshold_ * options.increase_scale_factor,
-                 options.max_threshold));
-
-    state_machine_.lock()->changeState(new_state);
-
-    ARROW_RETURN_NOT_OK(
-        new_state->addThresholdForRow(  // delegate work to the new state
-            record_batch, row_id, threshold_column_builder));
-
-    return arrow::Status::OK();
+arrow::Result<ThresholdStateMachine::SchemaPlan>
+ThresholdStateMachine::compilePlan(const arrow::Schema& schema) const {
+  SchemaPlan plan;
+  plan.watch_column_index = schema.GetFieldIndex(options_.watch_column_name);
+
+  auto time_column_name_result = metadata::getTimeColumnNameMetadata(schema);
+  if (!time_column_name_result.ok()) {
+    plan.time_column_status = time_column_name_result.status();
+  } else {
+    auto& time_column_name = time_column_name_result.ValueUnsafe();
+    plan.time_column_index = schema.GetFieldIndex(time_column_name);
+    if (plan.time_column_index == -1) {
+      plan.time_column_status = arrow::Status::KeyError(fmt::format(
+          "Can't get time from column {}: no such column exists",
+          time_column_name));
+    }
   }
 
-  ARROW_RETURN_NOT_OK(threshold_column_builder->Append(current_threshold_));
+  auto threshold_field =
+      arrow::field(options_.threshold_column_name, arrow::float64());
 
-  if (value <= current_threshold_) {
-    auto self = state_machine_.lock()->getState();
+  ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
+      &threshold_field, options_.threshold_column_type));
 
-    state_machine_.lock()->changeState(
-        std::make_shared<StateOK>(state_machine_, current_threshold_));
+  plan.result_fields = schema.fields();
+  plan.result_fields.push_back(threshold_field);
 
-    return arrow::Status::OK();
-  }
-
-  return arrow::Status::OK();
+  return plan;
 }
 
-StateDecrease::StateDecrease(
-    const std::shared_ptr<ThresholdStateMachine>& state_machine,
-    double current_threshold, std::time_t decrease_start)
-    : state_machine_(state_machine),
-      current_threshold_(current_threshold),
-      decrease_start_(decrease_start) {}
-
-StateDecrease::StateDecrease(
-    std::weak_ptr<ThresholdStateMachine> state_machine,
-    double current_threshold, std::time_t decrease_start)
-    : state_machine_(std::move(state_machine)),
-      current_threshold_(current_threshold),
-      decrease_start_(decrease_start) {}
-
-arrow::Status StateDecrease::addThresholdForRow(
-    const arrow::RecordBatch& record_batch, int row_id,
-    arrow::DoubleBuilder* threshold_column_builder) {
-  double value = 0;
-  auto& options = state_machine_.lock()->getOptions();
-
-  ARROW_ASSIGN_OR_RAISE(
-      value,
-      getColumnValueAtRow(record_batch, options.watch_column_name, row_id));
-
-  std::time_t row_time = 0;
-  ARROW_ASSIGN_OR_RAISE(row_time, getTimeAtRow(record_batch, row_id));
-
-  if (value <= current_threshold_ * options.decrease_trigger_factor &&
-      row_time > decrease_start_ &&
-      row_time - decrease_start_ > options.decrease_after.count()) {
-    auto self =
-        state_machine_.lock()
-            ->getState();  // need to save this to avoid freeing our memory
-
-    std::shared_ptr<ThresholdState> new_state = std::make_shared<StateOK>(
-        state_machine_,
-        std::max(current_threshold_ * options.decrease_scale_factor,
-                 options.min_threshold));
-
-    state_machine_.lock()->changeState(new_state);
-
-    ARROW_RETURN_NOT_OK(
-        new_state->addThresholdForRow(  // delegate work to the new state
-            record_batch, row_id, threshold_column_builder));
+bool ThresholdStateMachine::isTimeNeeded(double value) const {
+  return state_.type != OK || value > state_.threshold ||
+         value < state_.threshold * options_.decrease_trigger_factor;
+}
 
-    return arrow::Status::OK();
+double ThresholdStateMachine::addThreshold(double value, std::time_t time) {
+  auto threshold = state_.threshold;
+  switch (state_.type) {
+    case INCREASE:
+      if (value > threshold && time > state_.start &&
+          time - state_.start > options_.increase_after.count()) {
+        // The value is handled by the new OK state
+        state_ = {OK, std::min(threshold * options_.increase_scale_factor,
+                               options_.max_threshold)};
+        break;
+      }
+
+      if (value <= threshold) {
+        state_ = {OK, threshold};
+      }
+
+      return threshold;
+    case DECREASE:
+      if (value <= threshold * options_.decrease_trigger_factor &&
+          time > state_.start &&
+          time - state_.start > options_.decrease_after.count()) {
+        state_ = {OK, std::max(threshold * options_.decrease_scale_factor,
+                               options_.min_threshold)};
+        break;
+      }
+
+      if (value > threshold) {
+        state_ = {INCREASE, threshold, time};
+      } else if (value > threshold * options_.decrease_trigger_factor) {
+        state_ = {OK, threshold * options_.decrease_scale_factor};
+      }
+
+      return threshold;
+    case OK: break;
   }
 
-  ARROW_RETURN_NOT_OK(threshold_column_builder->Append(current_threshold_));
-
-  if (value > current_threshold_) {
-    auto self = state_machine_.lock()->getState();
-
-    state_machine_.lock()->changeState(std::make_shared<StateIncrease>(
-        state_machine_, current_threshold_, row_time));
-
-    return arrow::Status::OK();
+  threshold = state_.threshold;
+  if (value > threshold) {
+    state_ = {INCREASE, threshold, time};
+  } else if (value < threshold * options_.decrease_trigger_factor) {
+    state_ = {DECREASE, threshold, time};
   }
 
-  if (value > current_threshold_ * options.decrease_trigger_factor) {
-    auto self = state_machine_.lock()->getState();
-
-    state_machine_.lock()->changeState(std::make_shared<StateOK>(
-        state_machine_, current_threshold_ * options.decrease_scale_factor));
+  return threshold;
+}
 
+arrow::Status ThresholdStateMachine::getWatchValues(
+    const arrow::RecordBatch& record_batch, const SchemaPlan& plan,
+    std::vector<double>* values) const {
+  values->clear();
+  if (record_batch.num_rows() == 0) {
     return arrow::Status::OK();
   }
 
-  return arrow::Status::OK();
-}
-
-}  // namespace internal
-
-arrow::Result<arrow::RecordBatchVector> ThresholdStateMachine::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
-  if (state_ == nullptr) {
-    return arrow::Status::Invalid("Threshold state is not set");
+  if (plan.watch_column_index == -1) {
+    return arrow::Status::KeyError(
+        fmt::format("Can't get value from column {}: no such column exists",
+                    options_.watch_column_name));
   }
 
-  arrow::DoubleBuilder threshold_builder;
-  for (int i = 0; i < record_batch->num_rows(); ++i) {
-    ARROW_RETURN_NOT_OK(
-        state_->addThresholdForRow(*record_batch, i, &threshold_builder));
+  auto column = record_batch.column(plan.watch_column_index);
+  if (!arrow_utils::isNumericType(column->type_id())) {
+    return arrow::Status::TypeError(fmt::format(
+        "Threshold state machine requires numeric type, but {} type "
+        "provided",
+        column->type()->ToString()));
   }
 
-  std::shared_ptr<arrow::Array> threshold_array;
-  ARROW_RETURN_NOT_OK(threshold_builder.Finish(&threshold_array));
+  if (column->type_id() != arrow::Type::DOUBLE) {
+    ARROW_ASSIGN_OR_RAISE(
+        column, arrow::compute::Cast(
+                    *column, arrow::float64(),
+                    arrow::compute::CastOptions::Unsafe(arrow::float64())));
+  }
 
-  std::shared_ptr<arrow::RecordBatch> result_record_batch;
-  ARROW_ASSIGN_OR_RAISE(
-      result_record_batch,
-      record_batch->AddColumn(
-          record_batch->num_columns(),
-          arrow::field(options_.threshold_column_name, arrow::float64()),
-          threshold_array));
+  auto raw_values =
+      std::static_pointer_cast<arrow::DoubleArray>(column)->raw_values();
 
-  ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
-      &result_record_batch, options_.threshold_column_name,
-      options_.threshold_column_type));
-
-  return arrow::RecordBatchVector{result_record_batch};
-}
+  values->assign(raw_values, raw_values + column->length());
 
-void ThresholdStateMachine::changeState(
-    std::shared_ptr<internal::ThresholdState> new_threshold_state) {
-  state_ = new_threshold_state;
-}
+  // Null values are compared as zeros
+  if (column->null_count() > 0) {
+    for (int64_t i = 0; i < column->length(); ++i) {
+      if (column->IsNull(i)) {
+        (*values)[i] = 0;
+      }
+    }
+  }
 
-const ThresholdStateMachine::Options& ThresholdStateMachine::getOptions()
-    const {
-  return options_;
+  return arrow::Status::OK();
 }
 
-std::shared_ptr<const internal::ThresholdState>
-ThresholdStateMachine::getState() const {
-  return state_;
+arrow::Result<arrow_utils::TimestampsView>
+ThresholdStateMachine::getTimestamps(const arrow::RecordBatch& record_batch,
+                                     const SchemaPlan& plan) {
+  ARROW_RETURN_NOT_OK(plan.time_column_status);
+  return arrow_utils::TimestampsView::make(
+      *record_batch.column(plan.time_column_index), arrow::TimeUnit::SECOND);
 }
 
 std::shared_ptr<RecordBatchHandler>
 ThresholdStateMachineFactory::createHandler() const {
-  auto handler = std::make_shared<ThresholdStateMachine>(options_);
-
-  handler->changeState(std::make_shared<internal::StateOK>(
-      handler, options_.default_threshold));
-
-  return handler;
+  return std::make_shared<ThresholdStateMachine>(options_);
 }
 
 }  // namespace stream_data_processor
@@ -5,99 +5,24 @@
 #include <limits>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <arrow/api.h>
 
 #include "handler_factory.h"
 #include "metadata/column_typing.h"
 #include "record_batch_handlers/record_batch_handler.h"
+#include "record_batch_handlers/schema_plans.h"
+#include "utils/arrow_utils.h"
 
 namespace stream_data_processor {
 
-class ThresholdStateMachine;
-
-namespace internal {
-
-class ThresholdState {
- public:
-  virtual arrow::Status addThresholdForRow(
-      const arrow::RecordBatch& record_batch, int row_id,
-      arrow::DoubleBuilder* threshold_column_builder) = 0;
-
-  virtual ~ThresholdState() = 0;
-
- protected:
-  arrow::Result<double> getColumnValueAtRow(
-      const arrow::RecordBatch& record_batch, const std::string& column_name,
-      int row_id);
-
-  arrow::Result<std::time_t> getTimeAtRow(
-      const arrow::RecordBatch& record_batch, int row_id);
-
-  ThresholdState() = default;
-
-  ThresholdState(const ThresholdState& /* non-used */) = default;
-  ThresholdState& operator=(const ThresholdState& /* non-used */) = default;
-
-  ThresholdState(ThresholdState&& /* non-used */) = default;
-  ThresholdState& operator=(ThresholdState&& /* non-used */) = default;
-};
-
-class StateOK : public ThresholdState {
- public:
-  StateOK(const std::shared_ptr<ThresholdStateMachine>& state_machine,
-          double current_threshold);
-
-  StateOK(std::weak_ptr<ThresholdStateMachine> state_machine,
-          double current_threshold);
-
-  arrow::Status addThresholdForRow(
-      const arrow::RecordBatch& record_batch, int row_id,
-      arrow::DoubleBuilder* threshold_column_builder) override;
-
- private:
-  std::weak_ptr<ThresholdStateMachine> state_machine_;
-  double current_threshold_;
-};
-
-class StateIncrease : public ThresholdState {
- public:
-  StateIncrease(const std::shared_ptr<ThresholdStateMachine>& state_machine,
-                double current_threshold, std::time_t alert_start);
-
-  StateIncrease(std::weak_ptr<ThresholdStateMachine> state_machine,
-                double current_threshold, std::time_t alert_start);
-
-  arrow::Status addThresholdForRow(
-      const arrow::RecordBatch& record_batch, int row_id,
-      arrow::DoubleBuilder* threshold_column_builder) override;
-
- private:
-  std::weak_ptr<ThresholdStateMachine> state_machine_;
-  double current_threshold_;
-  std::time_t alert_start_;
-};
-
-class StateDecrease : public ThresholdState {
- public:
-  StateDecrease(const std::shared_ptr<ThresholdStateMachine>& state_machine,
-                double current_threshold, std::time_t decrease_start);
-
-  StateDecrease(std::weak_ptr<ThresholdStateMachine> state_machine,
-                double current_threshold, std::time_t decrease_start);
-
-  arrow::Status addThresholdForRow(
-      const arrow::RecordBatch& record_batch, int row_id,
-      arrow::DoubleBuilder* threshold_column_builder) override;
-
- private:
-  std::weak_ptr<ThresholdStateMachine> state_machine_;
-  double current_threshold_;
-  std::time_t decrease_start_;
-};
-
-}  // namespace internal
-
+// Adds threshold column adapting to the watch column values. Threshold is
+// increased when values stay above it longer than increase_after and is
+// decreased when values stay below decrease_trigger_factor of it longer than
+// decrease_after. State is a plain struct updated in one pass over the
+// typed watch and time columns.
 class ThresholdStateMachine : public RecordBatchHandler {
  public:
   struct Options {
@@ -119,22 +44,57 @@ class ThresholdStateMachine : public RecordBatchHandler {
     metadata::ColumnType threshold_column_type{metadata::FIELD};
   };
 
+  enum StateType { OK, INCREASE, DECREASE };
+
+  struct State {
+    StateType type{OK};
+    double threshold{0};
+
+    // Time when values crossed the threshold for INCREASE and DECREASE
+    std::time_t start{0};
+  };
+
   template <typename OptionsType>
   explicit ThresholdStateMachine(OptionsType&& options)
-      : options_(std::forward<OptionsType>(options)) {}
+      : options_(std::forward<OptionsType>(options)),
+        state_{OK, options_.default_threshold} {}
 
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
 
-  void changeState(
-      std::shared_ptr<internal::ThresholdState> new_threshold_state);
+  // Moves the state by one value and returns threshold for it. Lets
+  // callers having single points skip building record batches.
+  double addThreshold(double value, std::time_t time);
+
+  [[nodiscard]] const Options& getOptions() const { return options_; }
+  [[nodiscard]] const State& getState() const { return state_; }
+  void setState(const State& state) { state_ = state; }
+
+ private:
+  // Errors of missing columns are kept until the column is needed
+  struct SchemaPlan {
+    int watch_column_index{-1};
+    int time_column_index{-1};
+    arrow::Status time_column_status;
+    arrow::FieldVector result_fields;
+  };
+
+ private:
+  arrow::Result<SchemaPlan> compilePlan(const arrow::Schema& schema) const;
+
+  [[nodiscard]] bool isTimeNeeded(double value) const;
+
+  arrow::Status getWatchValues(const arrow::RecordBatch& record_batch,
+                               const SchemaPlan& plan,
+                               std::vector<double>* values) const;
 
-  const Options& getOptions() const;
-  std::shared_ptr<const internal::ThresholdState> getState() const;
+  static arrow::Result<arrow_utils::TimestampsView> getTimestamps(
+      const arrow::RecordBatch& record_batch, const SchemaPlan& plan);
 
  private:
   Options options_;
-  std::shared_ptr<internal::ThresholdState> state_{nullptr};
+  State state_;
+  SchemaPlans<SchemaPlan> plans_;
 };
 
 class ThresholdStateMachineFactory : public HandlerFactory {
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <numeric>
+
+#include <arrow/compute/api.h>
+#include <spdlog/spdlog.h>
+
+#include "metadata/column_typing.h"
+#include "metadata/grouping.h"
+#include "metadata/time_metadata.h"
+#include "utils/utils.h"
+#include "window_aggregate_handler.h"
+
+namespace stream_data_processor {
+
+arrow::Result<arrow::RecordBatchVector> WindowAggregateHandler::handle(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  ARROW_ASSIGN_OR_RAISE(auto materialized_record_batch,
+                        compute_utils::materializeSelection(record_batch));
+
+  ARROW_RETURN_NOT_OK(checkSingleGroup(*materialized_record_batch));
+
+  if (materialized_record_batch->num_rows() == 0) {
+    return arrow::RecordBatchVector{};
+  }
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto time_column_name,
+      metadata::getTimeColumnNameMetadata(*materialized_record_batch));
+
+  ARROW_ASSIGN_OR_RAISE(auto sorted_record_batch,
+                        compute_utils::sortByColumn(
+                            time_column_name, materialized_record_batch));
+
+  auto time_column = sorted_record_batch->GetColumnByName(time_column_name);
+  if (time_column == nullptr) {
+    return arrow::Status::Invalid(fmt::format(
+        "RecordBatch has no time column with name {}", time_column_name));
+  }
+
+  if (time_column->type_id() != arrow::Type::TIMESTAMP) {
+    return arrow::Status::NotImplemented(
+        "Aggregation currently supports arrow::Type::TIMESTAMP type for "
+        "timestamp field only");
+  }
+
+  if (time_type_ == nullptr) {
+    time_type_ = time_column->type();
+  } else if (!time_column->type()->Equals(time_type_)) {
+    ARROW_ASSIGN_OR_RAISE(time_column,
+                          arrow::compute::Cast(*time_column, time_type_));
+  }
+
+  std::vector<int64_t> seconds;
+  ARROW_RETURN_NOT_OK(compute_utils::getTimeValues(
+      *sorted_record_batch, time_column_name, time_utils::SECOND, &seconds));
+
+  auto period = options_.window_options.period.count();
+  auto every = options_.window_options.every.count();
+  if (next_emit_ == 0) {
+    if (period <= 0 || every <= 0) {
+      return arrow::Status::Invalid(
+          "Window period and every options should be positive");
+    }
+
+    origin_ = seconds.front();
+    pane_size_ = std::gcd(period, every);
+    next_emit_ = origin_ + (options_.window_options.fill_period ? period
+                                                                 : every);
+  }
+
+  group_record_batch_ = sorted_record_batch->Slice(0, 1);
+
+  arrow::RecordBatchVector result;
+  std::set<std::time_t> touched_panes;
+  int64_t begin = 0;
+  while (seconds.back() >= next_emit_) {
+    int64_t divide_index =
+        std::lower_bound(seconds.begin() + begin, seconds.end(),
+                         next_emit_) -
+        seconds.begin();
+
+    ARROW_RETURN_NOT_OK(consume(*sorted_record_batch, time_column, seconds,
+                                begin, divide_index, &touched_panes));
+
+    ARROW_ASSIGN_OR_RAISE(auto window, emitWindow(time_column_name));
+    if (window != nullptr) {
+      result.push_back(std::move(window));
+    }
+
+    next_emit_ += every;
+    panes_.erase(panes_.begin(), panes_.lower_bound(next_emit_ - period));
+    begin = divide_index;
+  }
+
+  ARROW_RETURN_NOT_OK(consume(*sorted_record_batch, time_column, seconds,
+                              begin, seconds.size(), &touched_panes));
+
+  for (auto pane_start : touched_panes) {
+    auto pane_iter = panes_.find(pane_start);
+    if (pane_iter == panes_.end()) {
+      continue;
+    }
+
+    ARROW_RETURN_NOT_OK(pane_iter->second.time_accumulator->compact());
+    for (auto& accumulator : pane_iter->second.accumulators) {
+      if (accumulator != nullptr) {
+        ARROW_RETURN_NOT_OK(accumulator->compact());
+      }
+    }
+  }
+
+  return result;
+}
+
+arrow::Status WindowAggregateHandler::consume(
+    const arrow::RecordBatch& record_batch,
+    const std::shared_ptr<arrow::Array>& time_column,
+    const std::vector<int64_t>& seconds, int64_t begin, int64_t end,
+    std::set<std::time_t>* touched_panes) {
+  auto& aggregate_columns = options_.aggregate_options.aggregate_columns;
+  auto expired_before = next_emit_ - options_.window_options.period.count();
+  while (begin < end) {
+    auto pane_start = getPaneStart(seconds[begin]);
+    int64_t pane_end =
+        std::lower_bound(seconds.begin() + begin, seconds.begin() + end,
+                         pane_start + pane_size_) -
+        seconds.begin();
+
+    if (pane_start < expired_before) {
+      begin = pane_end;
+      continue;
+    }
+
+    auto [pane_iter, inserted] = panes_.try_emplace(pane_start);
+    auto& pane = pane_iter->second;
+    if (inserted) {
+      pane.time_accumulator = std::make_unique<ColumnAccumulator>(time_type_);
+      pane.accumulators.resize(aggregate_columns_names_.size());
+    }
+
+    touched_panes->insert(pane_start);
+
+    auto length = pane_end - begin;
+    auto pane_times = time_column->Slice(begin, length);
+    auto times =
+        std::static_pointer_cast<arrow::TimestampArray>(pane_times)
+            ->raw_values();
+
+    ARROW_RETURN_NOT_OK(pane.time_accumulator->consume(pane_times, times, 0));
+
+    for (size_t i = 0; i < aggregate_columns_names_.size(); ++i) {
+      auto column = record_batch.GetColumnByName(aggregate_columns_names_[i]);
+      if (column == nullptr) {
+        continue;
+      }
+
+      auto& accumulator = pane.accumulators[i];
+      if (accumulator == nullptr) {
+        accumulator = std::make_unique<ColumnAccumulator>(
+            AggregateHandler::createAccumulator(
+                column->type(),
+                aggregate_columns.at(aggregate_columns_names_[i])));
+      }
+
+      ARROW_RETURN_NOT_OK(
+          accumulator->consume(column->Slice(begin, length), times, 0));
+    }
+
+    begin = pane_end;
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>>
+WindowAggregateHandler::emitWindow(
+    const std::string& time_column_name) const {
+  auto window_begin =
+      panes_.lower_bound(next_emit_ - options_.window_options.period.count());
+  auto window_end = panes_.lower_bound(next_emit_);
+  if (window_begin == window_end) {
+    return nullptr;
+  }
+
+  auto& aggregate_options = options_.aggregate_options;
+  const std::vector<int64_t> window_group{0};
+
+  ColumnAccumulator time_accumulator(time_type_);
+  std::vector<std::unique_ptr<ColumnAccumulator>> accumulators(
+      aggregate_columns_names_.size());
+
+  for (auto pane_iter = window_begin; pane_iter != window_end; ++pane_iter) {
+    auto& pane = pane_iter->second;
+    ARROW_RETURN_NOT_OK(
+        time_accumulator.merge(*pane.time_accumulator, window_group));
+
+    for (size_t i = 0; i < aggregate_columns_names_.size(); ++i) {
+      if (pane.accumulators[i] == nullptr) {
+        continue;
+      }
+
+      if (accumulators[i] == nullptr) {
+        accumulators[i] = std::make_unique<ColumnAccumulator>(
+            AggregateHandler::createAccumulator(
+                pane.accumulators[i]->getType(),
+                aggregate_options.aggregate_columns.at(
+                    aggregate_columns_names_[i])));
+      }
+
+      ARROW_RETURN_NOT_OK(
+          accumulators[i]->merge(*pane.accumulators[i], window_group));
+    }
+  }
+
+  arrow::FieldVector result_fields;
+  arrow::ArrayVector result_arrays;
+
+  auto& time_rule = aggregate_options.result_time_column_rule;
+  result_fields.push_back(
+      arrow::field(time_rule.result_column_name, time_type_));
+
+  ARROW_RETURN_NOT_OK(
+      metadata::setColumnTypeMetadata(&result_fields.back(), metadata::TIME));
+
+  ARROW_ASSIGN_OR_RAISE(result_arrays.emplace_back(),
+                        AggregateHandler::finishTimeAggregate(
+                            time_accumulator, time_rule.aggregate_function));
+
+  auto grouping_columns =
+      metadata::extractGroupingColumnsNames(*group_record_batch_);
+
+  grouping_columns.erase(std::remove(grouping_columns.begin(),
+                                     grouping_columns.end(),
+                                     time_column_name),
+                         grouping_columns.end());
+
+  auto measurement_column_name_result =
+      metadata::getMeasurementColumnNameMetadata(*group_record_batch_);
+
+  std::vector<std::string> group_columns;
+  if (measurement_column_name_result.ok() &&
+      std::find(grouping_columns.begin(), grouping_columns.end(),
+                measurement_column_name_result.ValueOrDie()) ==
+          grouping_columns.end()) {
+    group_columns.push_back(measurement_column_name_result.ValueOrDie());
+  }
+
+  group_columns.insert(group_columns.end(), grouping_columns.begin(),
+                       grouping_columns.end());
+
+  for (auto& column_name : group_columns) {
+    auto field = group_record_batch_->schema()->GetFieldByName(column_name);
+    if (field != nullptr) {
+      result_fields.push_back(field);
+      result_arrays.push_back(
+          group_record_batch_->GetColumnByName(column_name));
+    }
+  }
+
+  for (size_t i = 0; i < aggregate_columns_names_.size(); ++i) {
+    auto& accumulator = accumulators[i];
+    auto& aggregate_cases =
+        aggregate_options.aggregate_columns.at(aggregate_columns_names_[i]);
+
+    for (auto& aggregate_case : aggregate_cases) {
+      if (accumulator == nullptr) {
+        result_fields.push_back(
+            arrow::field(aggregate_case.result_column_name, arrow::null()));
+
+        result_arrays.push_back(std::make_shared<arrow::NullArray>(1));
+      } else {
+        auto statistic =
+            AggregateHandler::getStatistic(aggregate_case.aggregate_function);
+
+        result_fields.push_back(arrow::field(
+            aggregate_case.result_column_name,
+            ColumnAccumulator::getResultType(accumulator->getType(),
+                                             statistic)));
+
+        ARROW_ASSIGN_OR_RAISE(
+            result_arrays.emplace_back(),
+            accumulator->finish(statistic, aggregate_case.quantile));
+      }
+
+      ARROW_RETURN_NOT_OK(metadata::setColumnTypeMetadata(
+          &result_fields.back(), aggregate_case.result_column_type));
+    }
+  }
+
+  auto result = arrow::RecordBatch::Make(arrow::schema(result_fields), 1,
+                                         result_arrays);
+
+  ARROW_RETURN_NOT_OK(metadata::fillGroupMetadata(&result, grouping_columns));
+
+  ARROW_RETURN_NOT_OK(metadata::setTimeColumnNameMetadata(
+      &result, time_rule.result_column_name));
+
+  if (measurement_column_name_result.ok()) {
+    ARROW_RETURN_NOT_OK(metadata::setMeasurementColumnNameMetadata(
+        &result, measurement_column_name_result.ValueOrDie()));
+  }
+
+  return result;
+}
+
+std::time_t WindowAggregateHandler::getPaneStart(std::time_t ts) const {
+  auto pane_index = (ts - origin_) / pane_size_;
+  if ((ts - origin_) % pane_size_ < 0) {
+    --pane_index;
+  }
+
+  return origin_ + pane_index * pane_size_;
+}
+
+std::shared_ptr<RecordBatchHandler>
+WindowAggregateHandlerFactory::createHandler() const {
+  return std::make_shared<WindowAggregateHandler>(options_);
+}
+
+}  // namespace stream_data_processor
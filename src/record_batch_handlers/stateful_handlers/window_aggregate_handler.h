@@ -0,0 +1,85 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <arrow/api.h>
+
+#include "handler_factory.h"
+#include "record_batch_handlers/aggregate_handler.h"
+#include "record_batch_handlers/record_batch_handler.h"
+#include "window_handler.h"
+
+namespace stream_data_processor {
+
+// Aggregates sliding windows without buffering raw rows. Time is split into
+// panes of gcd(period, every) seconds, each pane keeps partial aggregates
+// and emitted window is a merge of panes it covers. Windows are emitted at
+// the same moments as WindowHandler emits them, one row per window.
+class WindowAggregateHandler : public RecordBatchHandler {
+ public:
+  struct WindowAggregateOptions {
+    WindowHandler::WindowOptions window_options;
+    AggregateHandler::AggregateOptions aggregate_options;
+  };
+
+  template <typename OptionsType>
+  explicit WindowAggregateHandler(OptionsType&& options)
+      : options_(std::forward<OptionsType>(options)) {
+    for ([[maybe_unused]] auto& [column_name, _] :
+         options_.aggregate_options.aggregate_columns) {
+      aggregate_columns_names_.push_back(column_name);
+    }
+  }
+
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
+
+  [[nodiscard]] size_t getPanesNumber() const { return panes_.size(); }
+
+ private:
+  struct Pane {
+    std::unique_ptr<ColumnAccumulator> time_accumulator;
+    std::vector<std::unique_ptr<ColumnAccumulator>> accumulators;
+  };
+
+ private:
+  arrow::Status consume(const arrow::RecordBatch& record_batch,
+                        const std::shared_ptr<arrow::Array>& time_column,
+                        const std::vector<int64_t>& seconds, int64_t begin,
+                        int64_t end, std::set<std::time_t>* touched_panes);
+
+  arrow::Result<std::shared_ptr<arrow::RecordBatch>> emitWindow(
+      const std::string& time_column_name) const;
+
+  [[nodiscard]] std::time_t getPaneStart(std::time_t ts) const;
+
+ private:
+  WindowAggregateOptions options_;
+  std::vector<std::string> aggregate_columns_names_;
+  std::map<std::time_t, Pane> panes_;
+  std::shared_ptr<arrow::DataType> time_type_;
+  std::shared_ptr<arrow::RecordBatch> group_record_batch_;
+  std::time_t origin_{0};
+  std::time_t pane_size_{0};
+  std::time_t next_emit_{0};
+};
+
+class WindowAggregateHandlerFactory : public HandlerFactory {
+ public:
+  template <typename OptionsType>
+  explicit WindowAggregateHandlerFactory(OptionsType&& options)
+      : options_(std::forward<OptionsType>(options)) {}
+
+  std::shared_ptr<RecordBatchHandler> createHandler() const override;
+
+ private:
+  WindowAggregateHandler::WindowAggregateOptions options_;
+};
+
+}  // namespace stream_data_processor
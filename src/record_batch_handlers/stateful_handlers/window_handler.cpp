@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <filesystem>
+
 #include <spdlog/spdlog.h>
+#include <unistd.h>
 
+#include "metadata/chunking.h"
+#include "metadata/column_typing.h"
 #include "metadata/time_metadata.h"
 #include "utils/utils.h"
 #include "window_handler.h"
@@ -7,27 +13,42 @@
 namespace stream_data_processor {
 
 arrow::Result<arrow::RecordBatchVector> WindowHandler::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
-  ARROW_ASSIGN_OR_RAISE(auto time_column_name,
-                        metadata::getTimeColumnNameMetadata(*record_batch));
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
+  ARROW_RETURN_NOT_OK(checkSingleGroup(*record_batch));
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto plan, plans_.get(record_batch->schema(),
+                            [](const arrow::Schema& schema) {
+                              return compilePlan(schema);
+                            }));
+
+  if (plan->time_column_index == -1) {
+    return arrow::Status::Invalid(
+        fmt::format("RecordBatch has no time column with name {}",
+                    plan->time_column_name));
+  }
 
   ARROW_ASSIGN_OR_RAISE(
       auto sorted_record_batch,
-      compute_utils::sortByColumn(time_column_name, record_batch));
+      compute_utils::sortByColumn(plan->time_column_name, record_batch));
 
-  auto time_column = sorted_record_batch->GetColumnByName(time_column_name);
-  if (time_column == nullptr) {
-    return arrow::Status::Invalid(fmt::format(
-        "RecordBatch has no time column with name {}", time_column_name));
+  ARROW_ASSIGN_OR_RAISE(
+      auto timestamps,
+      arrow_utils::TimestampsView::make(
+          *sorted_record_batch->column(plan->time_column_index),
+          arrow::TimeUnit::SECOND));
+
+  if (timestamps.length() == 0) {
+    return arrow::RecordBatchVector{};
   }
 
   if (next_emit_ == 0) {
-    ARROW_ASSIGN_OR_RAISE(
-        auto min_ts, arrow_utils::castTimestampScalar(
-                         time_column->GetScalar(0), arrow::TimeUnit::SECOND));
-
-    next_emit_ =
-        std::static_pointer_cast<arrow::TimestampScalar>(min_ts)->value;
+    next_emit_ = timestamps[0];
+    max_event_time_ = timestamps[0];
     if (options_.fill_period) {
       next_emit_ += options_.period.count();
     } else {
@@ -35,109 +56,343 @@ arrow::Result<arrow::RecordBatchVector> WindowHandler::handle(
     }
   }
 
-  ARROW_ASSIGN_OR_RAISE(
-      auto max_ts_scalar,
-      arrow_utils::castTimestampScalar(
-          time_column->GetScalar(sorted_record_batch->num_rows() - 1),
-          arrow::TimeUnit::SECOND));
+  arrow::RecordBatchVector result;
+  auto arrival_time = std::chrono::steady_clock::now();
+  ARROW_RETURN_NOT_OK(emitIdleWindows(arrival_time, &result));
+  last_arrival_time_ = arrival_time;
+
+  auto late_rows = timestamps.partitionPoint([this](int64_t ts) {
+    return ts >= next_emit_ - options_.period.count();
+  });
+
+  metrics_.late_rows += late_rows;
+  if (late_rows > 0 && options_.keep_late_rows) {
+    ARROW_RETURN_NOT_OK(
+        keepLateRows(sorted_record_batch->Slice(0, late_rows)));
+  }
 
-  std::time_t max_ts(
-      std::static_pointer_cast<arrow::TimestampScalar>(max_ts_scalar)->value);
+  auto length = timestamps.length();
+  if (late_rows < length) {
+    auto row_size =
+        arrow_utils::getBuffersSize(*sorted_record_batch) / length + 1;
 
-  arrow::RecordBatchVector result;
-  while (max_ts >= next_emit_) {
-    time_column = sorted_record_batch->GetColumnByName(time_column_name);
-    ARROW_ASSIGN_OR_RAISE(
-        auto divide_index,
-        compute_utils::tsLowerBound(
-            *time_column, [this](int64_t ts) { return ts >= next_emit_; },
-            arrow::TimeUnit::SECOND));
+    buffered_record_batches_.push_back(
+        {sorted_record_batch, timestamps, nullptr, length, timestamps[0],
+         timestamps[length - 1], row_size});
 
-    if (divide_index > 0) {
-      buffered_record_batches_.push_back(
-          sorted_record_batch->Slice(0, divide_index));
+    if (late_rows > 0) {
+      buffered_record_batches_.back() = sliceBufferedRecordBatch(
+          buffered_record_batches_.back(), late_rows, length - late_rows);
     }
 
-    if (!buffered_record_batches_.empty()) {
-      ARROW_ASSIGN_OR_RAISE(auto window, emitWindow());
-      convert_utils::append(std::move(window), result);
+    metrics_.buffered_rows += length - late_rows;
+    max_event_time_ =
+        std::max<std::time_t>(max_event_time_, timestamps[length - 1]);
+  }
+
+  ARROW_RETURN_NOT_OK(emitWindows(
+      max_event_time_ - options_.allowed_lateness.count(), &result));
+
+  if (options_.max_buffered_rows.has_value()) {
+    while (metrics_.buffered_rows > options_.max_buffered_rows.value() &&
+           max_event_time_ >= next_emit_) {
+      ARROW_RETURN_NOT_OK(emitNextWindow(&result));
+      ++metrics_.forced_windows;
     }
+  }
 
-    emitted_first_ = true;
-    next_emit_ += options_.every.count();
-    ARROW_RETURN_NOT_OK(removeOldRecords());
+  ARROW_RETURN_NOT_OK(spillRecordBatches());
+  return result;
+}
 
-    sorted_record_batch = sorted_record_batch->Slice(divide_index);
+arrow::Result<arrow::RecordBatchVector> WindowHandler::flush() {
+  arrow::RecordBatchVector result;
+  if (!buffered_record_batches_.empty()) {
+    ARROW_RETURN_NOT_OK(
+        emitWindows(max_event_time_ + options_.period.count(), &result));
   }
 
-  buffered_record_batches_.push_back(sorted_record_batch);
+  ARROW_RETURN_NOT_OK(spillRecordBatches());
+  return result;
+}
 
+arrow::Result<arrow::RecordBatchVector> WindowHandler::poll() {
+  arrow::RecordBatchVector result;
+  ARROW_RETURN_NOT_OK(
+      emitIdleWindows(std::chrono::steady_clock::now(), &result));
+
+  convert_utils::append(takeLateRecordBatches(), result);
   return result;
 }
 
+arrow::RecordBatchVector WindowHandler::takeLateRecordBatches() {
+  arrow::RecordBatchVector late_record_batches;
+  std::swap(late_record_batches, late_record_batches_);
+  return late_record_batches;
+}
+
+arrow::Result<WindowHandler::SchemaPlan> WindowHandler::compilePlan(
+    const arrow::Schema& schema) {
+  SchemaPlan plan;
+  ARROW_ASSIGN_OR_RAISE(plan.time_column_name,
+                        metadata::getTimeColumnNameMetadata(schema));
+
+  plan.time_column_index = schema.GetFieldIndex(plan.time_column_name);
+  return plan;
+}
+
+arrow::Status WindowHandler::emitWindows(std::time_t watermark,
+                                         arrow::RecordBatchVector* result) {
+  while (watermark >= next_emit_) {
+    ARROW_RETURN_NOT_OK(emitNextWindow(result));
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Status WindowHandler::emitIdleWindows(
+    std::chrono::steady_clock::time_point now,
+    arrow::RecordBatchVector* result) {
+  if (options_.idle_timeout.has_value() &&
+      !buffered_record_batches_.empty() &&
+      now - last_arrival_time_ > options_.idle_timeout.value()) {
+    return emitWindows(max_event_time_, result);
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Status WindowHandler::emitNextWindow(
+    arrow::RecordBatchVector* result) {
+  ARROW_ASSIGN_OR_RAISE(auto window, emitWindow());
+  convert_utils::append(std::move(window), *result);
+
+  emitted_first_ = true;
+  next_emit_ += options_.every.count();
+  return removeOldRecords();
+}
+
+arrow::Status WindowHandler::keepLateRows(
+    std::shared_ptr<arrow::RecordBatch> late_rows) {
+  auto measurement_column_name =
+      metadata::getMeasurementColumnNameMetadata(*late_rows);
+
+  if (options_.late_rows_measurement.has_value() &&
+      measurement_column_name.ok()) {
+    auto i = late_rows->schema()->GetFieldIndex(
+        measurement_column_name.ValueOrDie());
+
+    if (i != -1) {
+      ARROW_ASSIGN_OR_RAISE(
+          auto measurement_column,
+          arrow::MakeArrayFromScalar(
+              arrow::StringScalar(options_.late_rows_measurement.value()),
+              late_rows->num_rows()));
+
+      ARROW_ASSIGN_OR_RAISE(
+          late_rows,
+          late_rows->SetColumn(
+              i, late_rows->schema()->field(i)->WithType(arrow::utf8()),
+              measurement_column));
+    }
+  }
+
+  late_record_batches_.push_back(std::move(late_rows));
+  return arrow::Status::OK();
+}
+
 arrow::Result<arrow::RecordBatchVector> WindowHandler::emitWindow() {
   ARROW_RETURN_NOT_OK(removeOldRecords());
 
+  // Buffered record batches are split by the window end, so the rest of
+  // rows is emitted as separate chunks of the next windows
+  std::deque<BufferedRecordBatch> split_record_batches;
+  arrow::RecordBatchVector window_batches;
+  for (auto& buffered : buffered_record_batches_) {
+    if (buffered.record_batch == nullptr) {
+      if (buffered.min_time >= next_emit_) {
+        split_record_batches.push_back(std::move(buffered));
+        continue;
+      }
+
+      ARROW_RETURN_NOT_OK(reloadRecordBatch(&buffered));
+    }
+
+    auto length = buffered.num_rows;
+    auto window_end = buffered.timestamps.partitionPoint(
+        [this](int64_t ts) { return ts >= next_emit_; });
+
+    if (window_end == 0 || window_end == length) {
+      if (window_end > 0) {
+        window_batches.push_back(buffered.record_batch);
+      }
+
+      split_record_batches.push_back(std::move(buffered));
+      continue;
+    }
+
+    split_record_batches.push_back(
+        sliceBufferedRecordBatch(buffered, 0, window_end));
+
+    window_batches.push_back(split_record_batches.back().record_batch);
+    split_record_batches.push_back(sliceBufferedRecordBatch(
+        buffered, window_end, length - window_end));
+  }
+
+  buffered_record_batches_ = std::move(split_record_batches);
+
   arrow::RecordBatchVector window;
-  if (buffered_record_batches_.empty()) {
+  if (window_batches.empty()) {
     return window;
   }
 
-  auto current_schema = buffered_record_batches_.front()->schema();
-  arrow::RecordBatchVector window_batches;
-  for (auto& batch : buffered_record_batches_) {
+  auto current_schema = window_batches.front()->schema();
+  arrow::RecordBatchVector schema_batches;
+  for (auto& batch : window_batches) {
     if (!current_schema->Equals(batch->schema(), false)) {
-      window.emplace_back();
-
-      ARROW_ASSIGN_OR_RAISE(
-          window.back(),
-          convert_utils::concatenateRecordBatches(window_batches));
+      ARROW_RETURN_NOT_OK(metadata::setChunksMetadata(
+          &schema_batches, metadata::nextChunkId()));
 
-      window_batches.clear();
+      convert_utils::append(std::move(schema_batches), window);
+      schema_batches.clear();
       current_schema = batch->schema();
     }
 
-    window_batches.push_back(batch);
+    schema_batches.push_back(batch);
   }
 
-  window.emplace_back();
-  ARROW_ASSIGN_OR_RAISE(
-      window.back(), convert_utils::concatenateRecordBatches(window_batches));
+  ARROW_RETURN_NOT_OK(
+      metadata::setChunksMetadata(&schema_batches, metadata::nextChunkId()));
 
+  convert_utils::append(std::move(schema_batches), window);
   return window;
 }
 
 arrow::Status WindowHandler::removeOldRecords() {
-  while (true) {
-    if (buffered_record_batches_.empty()) {
-      return arrow::Status::OK();
+  auto window_start = next_emit_ - options_.period.count();
+  std::deque<BufferedRecordBatch> actual_record_batches;
+  for (auto& buffered : buffered_record_batches_) {
+    if (buffered.record_batch == nullptr) {
+      if (buffered.max_time < window_start) {
+        metrics_.buffered_rows -= buffered.num_rows;
+        continue;
+      }
+
+      if (buffered.min_time >= window_start) {
+        actual_record_batches.push_back(std::move(buffered));
+        continue;
+      }
+
+      ARROW_RETURN_NOT_OK(reloadRecordBatch(&buffered));
     }
 
-    auto& oldest_batch = buffered_record_batches_.front();
-    ARROW_ASSIGN_OR_RAISE(auto time_column_name,
-                          metadata::getTimeColumnNameMetadata(*oldest_batch));
+    auto length = buffered.num_rows;
+    auto old_rows = buffered.timestamps.partitionPoint(
+        [window_start](int64_t ts) { return ts >= window_start; });
 
-    auto time_column = oldest_batch->GetColumnByName(time_column_name);
-    size_t divide_index;
-    ARROW_ASSIGN_OR_RAISE(
-        divide_index, compute_utils::tsLowerBound(
-                          *time_column,
-                          [this](int64_t ts) {
-                            return ts >= next_emit_ - options_.period.count();
-                          },
-                          arrow::TimeUnit::SECOND));
-
-    if (divide_index < oldest_batch->num_rows()) {
-      oldest_batch = oldest_batch->Slice(divide_index);
-      return arrow::Status::OK();
-    } else {
-      buffered_record_batches_.pop_front();
+    metrics_.buffered_rows -= old_rows;
+    if (old_rows == 0) {
+      actual_record_batches.push_back(std::move(buffered));
+    } else if (old_rows < length) {
+      actual_record_batches.push_back(
+          sliceBufferedRecordBatch(buffered, old_rows, length - old_rows));
     }
   }
+
+  buffered_record_batches_ = std::move(actual_record_batches);
+  return arrow::Status::OK();
+}
+
+arrow::Status WindowHandler::spillRecordBatches() {
+  size_t buffered_bytes = 0;
+  for (auto& buffered : buffered_record_batches_) {
+    if (buffered.record_batch != nullptr) {
+      buffered_bytes += buffered.num_rows * buffered.row_size;
+    }
+  }
+
+  if (options_.memory_budget_bytes.has_value()) {
+    for (auto& buffered : buffered_record_batches_) {
+      if (buffered_bytes <= options_.memory_budget_bytes.value()) {
+        break;
+      }
+
+      if (buffered.record_batch == nullptr) {
+        continue;
+      }
+
+      // Reloaded record batch is released only as its spill file is kept
+      if (buffered.spill_file == nullptr) {
+        auto spill_path =
+            std::filesystem::path(options_.spill_directory) /
+            fmt::format("window_{}_{}_{}.arrow", ::getpid(), fmt::ptr(this),
+                        next_spill_id_++);
+
+        ARROW_ASSIGN_OR_RAISE(
+            buffered.spill_file,
+            serialize_utils::SpillFile::create(spill_path.string(),
+                                               *buffered.record_batch));
+
+        ++metrics_.spilled_batches;
+        metrics_.spilled_bytes += buffered.spill_file->getSize();
+      }
+
+      buffered.record_batch = nullptr;
+      buffered.timestamps = arrow_utils::TimestampsView();
+      buffered_bytes -= buffered.num_rows * buffered.row_size;
+    }
+  }
+
+  metrics_.buffered_bytes = buffered_bytes;
+  return arrow::Status::OK();
+}
+
+arrow::Status WindowHandler::reloadRecordBatch(
+    BufferedRecordBatch* buffered) {
+  auto reload_start = std::chrono::steady_clock::now();
+  ARROW_ASSIGN_OR_RAISE(buffered->record_batch, buffered->spill_file->read());
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto time_column_name,
+      metadata::getTimeColumnNameMetadata(*buffered->record_batch));
+
+  auto time_column =
+      buffered->record_batch->GetColumnByName(time_column_name);
+  if (time_column == nullptr) {
+    return arrow::Status::Invalid(fmt::format(
+        "RecordBatch has no time column with name {}", time_column_name));
+  }
+
+  ARROW_ASSIGN_OR_RAISE(buffered->timestamps,
+                        arrow_utils::TimestampsView::make(
+                            *time_column, arrow::TimeUnit::SECOND));
+
+  ++metrics_.reloaded_batches;
+  metrics_.reload_time +=
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - reload_start);
+
+  return arrow::Status::OK();
+}
+
+WindowHandler::BufferedRecordBatch WindowHandler::sliceBufferedRecordBatch(
+    const BufferedRecordBatch& buffered, int64_t offset, int64_t length) {
+  // Spill file holds the whole record batch, so slices are spilled anew
+  return {buffered.record_batch->Slice(offset, length),
+          buffered.timestamps.slice(offset, length),
+          nullptr,
+          length,
+          buffered.timestamps[offset],
+          buffered.timestamps[offset + length - 1],
+          buffered.row_size};
 }
 
 arrow::Result<arrow::RecordBatchVector> DynamicWindowHandler::handle(
-    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+    const std::shared_ptr<arrow::RecordBatch>& input_record_batch) {
+  ARROW_ASSIGN_OR_RAISE(
+      auto record_batch,
+      compute_utils::materializeSelection(input_record_batch));
+
   bool is_new_period_possible =
       options_.period_column_name.has_value() &&
       (record_batch->GetColumnByName(options_.period_column_name.value()) !=
@@ -209,15 +464,13 @@ arrow::Result<arrow::RecordBatchVector> DynamicWindowHandler::handle(
       break;
     }
 
-    std::shared_ptr<arrow::Scalar> new_options_ts_scalar;
     ARROW_ASSIGN_OR_RAISE(
-        new_options_ts_scalar,
-        arrow_utils::castTimestampScalar(
-            sorted_by_time->GetColumnByName(time_column_name)->GetScalar(0),
+        auto timestamps,
+        arrow_utils::TimestampsView::make(
+            *sorted_by_time->GetColumnByName(time_column_name),
             arrow::TimeUnit::SECOND));
-    new_options_ts = std::static_pointer_cast<arrow::TimestampScalar>(
-                         new_options_ts_scalar)
-                         ->value;
+
+    new_options_ts = timestamps[0];
 
     if (is_new_period_possible && new_options_index == new_period_index) {
       ARROW_ASSIGN_OR_RAISE(
@@ -8,6 +8,7 @@
 
 #include "handler_factory.h"
 #include "record_batch_handlers/record_batch_handler.h"
+#include "record_batch_handlers/schema_plans.h"
 #include "utils/utils.h"
 
 namespace stream_data_processor {
@@ -23,12 +24,50 @@ class IWindowHandler : public RecordBatchHandler {
                               std::time_t change_ts) = 0;
 };
 
+// Emits windows as zero-copy slices of buffered record batches. Slices of
+// one window are marked with the same chunk id metadata.
+//
+// Windows are closed by the watermark which is the max seen event time minus
+// allowed lateness, so rows arriving out of order within allowed lateness
+// still get into their windows. Rows older than all not emitted windows are
+// late: they are counted and dropped or kept for the side output.
 class WindowHandler : public IWindowHandler {
  public:
   struct WindowOptions {
     std::chrono::seconds period;
     std::chrono::seconds every;
     bool fill_period{false};
+    std::chrono::seconds allowed_lateness{0};
+
+    // Watermark is moved to the max seen event time if there was no data
+    // for this wall clock time. It is checked on new data and on poll.
+    std::optional<std::chrono::seconds> idle_timeout{std::nullopt};
+
+    // Windows are closed ignoring allowed lateness while there are more
+    // buffered rows
+    std::optional<size_t> max_buffered_rows{std::nullopt};
+
+    // Late rows are kept and emitted on poll as separate record batches
+    // with the measurement replaced by late_rows_measurement if it is set,
+    // so they can be routed to a side output
+    bool keep_late_rows{false};
+    std::optional<std::string> late_rows_measurement{std::nullopt};
+
+    // The oldest buffered record batches are spilled to Arrow IPC files in
+    // spill_directory while buffered rows take more memory
+    std::optional<size_t> memory_budget_bytes{std::nullopt};
+    std::string spill_directory{"/tmp"};
+  };
+
+  struct Metrics {
+    size_t buffered_rows{0};
+    size_t late_rows{0};
+    size_t forced_windows{0};
+    size_t buffered_bytes{0};
+    size_t spilled_batches{0};
+    size_t spilled_bytes{0};
+    size_t reloaded_batches{0};
+    std::chrono::microseconds reload_time{0};
   };
 
   template <typename OptionsType>
@@ -38,6 +77,16 @@ class WindowHandler : public IWindowHandler {
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
 
+  // Emits all windows having buffered rows regardless of the watermark
+  arrow::Result<arrow::RecordBatchVector> flush() override;
+
+  // Emits windows closed by the idle timeout and kept late rows
+  arrow::Result<arrow::RecordBatchVector> poll() override;
+
+  [[nodiscard]] size_t getStateSize() const override {
+    return metrics_.buffered_bytes;
+  }
+
   std::chrono::seconds getPeriodOption() const override {
     return options_.period;
   }
@@ -46,6 +95,12 @@ class WindowHandler : public IWindowHandler {
     return options_.every;
   }
 
+  [[nodiscard]] const Metrics& getMetrics() const { return metrics_; }
+
+  // Returns late rows kept since the previous call if keep_late_rows option
+  // is set.
+  arrow::RecordBatchVector takeLateRecordBatches();
+
   void setPeriodOption(std::chrono::seconds new_period_option,
                        std::time_t change_ts) override {
     if (next_emit_ != 0 && !emitted_first_ && options_.fill_period &&
@@ -72,14 +127,56 @@ class WindowHandler : public IWindowHandler {
   }
 
  private:
+  // Spilled record batch has no record_batch and timestamps until reloaded.
+  // Reloaded record batch counts against the memory budget until it's
+  // emitted or released again.
+  struct BufferedRecordBatch {
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrow_utils::TimestampsView timestamps;
+    std::shared_ptr<serialize_utils::SpillFile> spill_file;
+    int64_t num_rows;
+    std::time_t min_time;
+    std::time_t max_time;
+    int64_t row_size;
+  };
+
+  struct SchemaPlan {
+    std::string time_column_name;
+    int time_column_index{-1};
+  };
+
+ private:
+  static arrow::Result<SchemaPlan> compilePlan(const arrow::Schema& schema);
+
+  arrow::Status emitWindows(std::time_t watermark,
+                            arrow::RecordBatchVector* result);
+
+  arrow::Status emitIdleWindows(std::chrono::steady_clock::time_point now,
+                                arrow::RecordBatchVector* result);
+
+  arrow::Status emitNextWindow(arrow::RecordBatchVector* result);
+  arrow::Status keepLateRows(std::shared_ptr<arrow::RecordBatch> late_rows);
+
   arrow::Result<arrow::RecordBatchVector> emitWindow();
   arrow::Status removeOldRecords();
 
+  arrow::Status spillRecordBatches();
+  arrow::Status reloadRecordBatch(BufferedRecordBatch* buffered);
+
+  static BufferedRecordBatch sliceBufferedRecordBatch(
+      const BufferedRecordBatch& buffered, int64_t offset, int64_t length);
+
  private:
   WindowOptions options_;
-  std::deque<std::shared_ptr<arrow::RecordBatch>> buffered_record_batches_;
+  std::deque<BufferedRecordBatch> buffered_record_batches_;
+  arrow::RecordBatchVector late_record_batches_;
   std::time_t next_emit_{0};
+  std::time_t max_event_time_{0};
+  std::chrono::steady_clock::time_point last_arrival_time_;
   bool emitted_first_{false};
+  int64_t next_spill_id_{0};
+  Metrics metrics_;
+  SchemaPlans<SchemaPlan> plans_;
 };
 
 class DynamicWindowHandler : public RecordBatchHandler {
@@ -98,6 +195,18 @@ class DynamicWindowHandler : public RecordBatchHandler {
   arrow::Result<arrow::RecordBatchVector> handle(
       const std::shared_ptr<arrow::RecordBatch>& record_batch) override;
 
+  arrow::Result<arrow::RecordBatchVector> flush() override {
+    return window_handler_->flush();
+  }
+
+  arrow::Result<arrow::RecordBatchVector> poll() override {
+    return window_handler_->poll();
+  }
+
+  [[nodiscard]] size_t getStateSize() const override {
+    return window_handler_->getStateSize();
+  }
+
  private:
   arrow::Result<int64_t> findNewWindowOptionIndex(
       const arrow::RecordBatch& record_batch,
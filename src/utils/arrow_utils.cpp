@@ -1,3 +1,7 @@
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
 #include "arrow_utils.h"
 
 namespace stream_data_processor {
@@ -115,5 +119,130 @@ arrow::Result<std::shared_ptr<arrow::Scalar>> castTimestampScalar(
   return timestamp_scalar.ValueOrDie()->CastTo(arrow::timestamp(time_unit));
 }
 
+namespace {
+
+int64_t getBuffersSize(const arrow::ArrayData& array_data) {
+  int64_t size = 0;
+  for (auto& buffer : array_data.buffers) {
+    if (buffer != nullptr) {
+      size += buffer->size();
+    }
+  }
+
+  for (auto& child_data : array_data.child_data) {
+    size += getBuffersSize(*child_data);
+  }
+
+  if (array_data.dictionary != nullptr) {
+    size += getBuffersSize(*array_data.dictionary);
+  }
+
+  return size;
+}
+
+}  // namespace
+
+int64_t getBuffersSize(const arrow::RecordBatch& record_batch) {
+  int64_t size = 0;
+  for (int i = 0; i < record_batch.num_columns(); ++i) {
+    size += getBuffersSize(*record_batch.column_data(i));
+  }
+
+  return size;
+}
+
+arrow::Result<std::shared_ptr<arrow::Scalar>> getDecodedScalar(
+    const arrow::Array& array, int64_t i) {
+  if (array.type_id() != arrow::Type::DICTIONARY) {
+    return array.GetScalar(i);
+  }
+
+  auto& dictionary_array = static_cast<const arrow::DictionaryArray&>(array);
+  if (dictionary_array.IsNull(i)) {
+    return arrow::MakeNullScalar(dictionary_array.dictionary()->type());
+  }
+
+  return dictionary_array.dictionary()->GetScalar(
+      dictionary_array.GetValueIndex(i));
+}
+
+arrow::Status unifyDictionaries(arrow::ArrayVector* arrays) {
+  if (arrays->size() < 2 ||
+      arrays->front()->type_id() != arrow::Type::DICTIONARY) {
+    return arrow::Status::OK();
+  }
+
+  auto& dictionary_data = arrays->front()->data()->dictionary;
+  if (std::all_of(arrays->begin(), arrays->end(),
+                  [&dictionary_data](const std::shared_ptr<arrow::Array>&
+                                         array) {
+                    return array->data()->dictionary == dictionary_data;
+                  })) {
+    return arrow::Status::OK();
+  }
+
+  auto& dictionary_type =
+      static_cast<const arrow::DictionaryType&>(*arrays->front()->type());
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto unifier,
+      arrow::DictionaryUnifier::Make(dictionary_type.value_type()));
+
+  std::vector<std::shared_ptr<arrow::Buffer>> transpose_maps;
+  for (auto& array : *arrays) {
+    ARROW_RETURN_NOT_OK(unifier->Unify(
+        *static_cast<const arrow::DictionaryArray&>(*array).dictionary(),
+        &transpose_maps.emplace_back()));
+  }
+
+  std::shared_ptr<arrow::DataType> unified_type;
+  std::shared_ptr<arrow::Array> unified_dictionary;
+  ARROW_RETURN_NOT_OK(
+      unifier->GetResult(&unified_type, &unified_dictionary));
+
+  // Unified type may have narrower indices, the source type is kept for
+  // all arrays to have the same type
+  for (size_t i = 0; i < arrays->size(); ++i) {
+    auto& dictionary_array =
+        static_cast<const arrow::DictionaryArray&>(*(*arrays)[i]);
+
+    ARROW_ASSIGN_OR_RAISE(
+        (*arrays)[i],
+        dictionary_array.Transpose(
+            dictionary_array.type(), unified_dictionary,
+            reinterpret_cast<const int32_t*>(transpose_maps[i]->data())));
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Result<TimestampsView> TimestampsView::make(
+    const arrow::Array& array, arrow::TimeUnit::type time_unit) {
+  if (array.type_id() != arrow::Type::TIMESTAMP) {
+    return arrow::Status::TypeError(fmt::format(
+        "Timestamps view requires arrow::Type::TIMESTAMP type, but {} type "
+        "provided",
+        array.type()->ToString()));
+  }
+
+  auto array_time_unit =
+      std::static_pointer_cast<arrow::TimestampType>(array.type())->unit();
+
+  // arrow::TimeUnit values are ordered from SECOND to NANO with 1000 times
+  // step between neighbours
+  int64_t factor = 1;
+  for (int unit = std::min(array_time_unit, time_unit);
+       unit < std::max(array_time_unit, time_unit); ++unit) {
+    factor *= 1000;
+  }
+
+  const int64_t* raw_values = array.data()->GetValues<int64_t>(1);
+  if (array_time_unit < time_unit) {
+    return TimestampsView(raw_values, array.length(), factor, 1);
+  } else {
+    return TimestampsView(raw_values, array.length(), 1, factor);
+  }
+}
+
 }  // namespace arrow_utils
 }  // namespace stream_data_processor
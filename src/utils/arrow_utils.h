@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 
 #include <arrow/api.h>
@@ -31,5 +32,77 @@ arrow::Result<std::shared_ptr<arrow::Scalar>> castTimestampScalar(
     const arrow::Result<std::shared_ptr<arrow::Scalar>>& timestamp_scalar,
     arrow::TimeUnit::type time_unit);
 
+// Returns total size of the record batch buffers. Buffers shared between
+// slices are counted fully for each slice.
+int64_t getBuffersSize(const arrow::RecordBatch& record_batch);
+
+// Returns the value of the array slot. Dictionary-encoded values are
+// returned as scalars of the dictionary value type.
+arrow::Result<std::shared_ptr<arrow::Scalar>> getDecodedScalar(
+    const arrow::Array& array, int64_t i);
+
+// Replaces dictionary-encoded arrays with ones sharing the same unified
+// dictionary, so they can be concatenated. Other arrays are left as is.
+arrow::Status unifyDictionaries(arrow::ArrayVector* arrays);
+
+// Non-owning view of timestamp array values converted to the requested time
+// unit. Values are read from the array buffer and converted with integer
+// arithmetic on access, so no scalars are created and nothing is copied when
+// units match. Null slots have unspecified values.
+class TimestampsView {
+ public:
+  TimestampsView() = default;
+
+  static arrow::Result<TimestampsView> make(const arrow::Array& array,
+                                            arrow::TimeUnit::type time_unit);
+
+  int64_t operator[](int64_t i) const {
+    if (divisor_ > 1) {
+      return raw_values_[i] / divisor_;
+    }
+
+    return raw_values_[i] * multiplier_;
+  }
+
+  [[nodiscard]] int64_t length() const { return length_; }
+
+  [[nodiscard]] TimestampsView slice(int64_t offset, int64_t length) const {
+    return TimestampsView(raw_values_ + offset, length, multiplier_,
+                          divisor_);
+  }
+
+  // Returns the first index in [begin, length) for which pred is true. The
+  // predicate should be monotonic over the view.
+  template <typename PredicateType>
+  [[nodiscard]] int64_t partitionPoint(const PredicateType& pred,
+                                       int64_t begin = 0) const {
+    int64_t end = length_;
+    while (begin < end) {
+      auto middle = begin + (end - begin) / 2;
+      if (pred((*this)[middle])) {
+        end = middle;
+      } else {
+        begin = middle + 1;
+      }
+    }
+
+    return begin;
+  }
+
+ private:
+  TimestampsView(const int64_t* raw_values, int64_t length,
+                 int64_t multiplier, int64_t divisor)
+      : raw_values_(raw_values),
+        length_(length),
+        multiplier_(multiplier),
+        divisor_(divisor) {}
+
+ private:
+  const int64_t* raw_values_{nullptr};
+  int64_t length_{0};
+  int64_t multiplier_{1};
+  int64_t divisor_{1};
+};
+
 }  // namespace arrow_utils
 }  // namespace stream_data_processor
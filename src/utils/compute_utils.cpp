@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string_view>
+#include <type_traits>
 #include <unordered_set>
 
 #include <arrow/compute/api.h>
@@ -6,80 +11,1014 @@
 
 #include "arrow_utils.h"
 #include "compute_utils.h"
+#include "convert_utils.h"
+#include "metadata/column_typing.h"
+#include "metadata/grouping.h"
+#include "metadata/sorting.h"
+#include "metadata/time_metadata.h"
 
 namespace stream_data_processor {
 namespace compute_utils {
 
+namespace internal {
+
+class KeyColumnEncoder {
+ public:
+  virtual void encode(const arrow::Array& array,
+                      std::vector<int64_t>* codes) = 0;
+
+  [[nodiscard]] int64_t size() const { return next_code_; }
+
+  virtual ~KeyColumnEncoder() = default;
+
+ protected:
+  KeyColumnEncoder() = default;
+
+  KeyColumnEncoder(const KeyColumnEncoder& /* non-used */) = default;
+  KeyColumnEncoder& operator=(const KeyColumnEncoder& /* non-used */) =
+      default;
+
+  KeyColumnEncoder(KeyColumnEncoder&& /* non-used */) = default;
+  KeyColumnEncoder& operator=(KeyColumnEncoder&& /* non-used */) = default;
+
+  int64_t nullCode() {
+    if (null_code_ == -1) {
+      null_code_ = next_code_++;
+    }
+
+    return null_code_;
+  }
+
+ protected:
+  int64_t next_code_{0};
+
+ private:
+  int64_t null_code_{-1};
+};
+
+}  // namespace internal
+
 namespace {
 
-arrow::Status sort(
-    const std::vector<std::string>& column_names, size_t i,
-    const std::shared_ptr<arrow::RecordBatch>& source,
-    std::vector<std::shared_ptr<arrow::RecordBatch>>* targets) {
-  if (i == column_names.size()) {
-    targets->push_back(source);
-    return arrow::Status::OK();
+template <typename ArrowType>
+class NumericKeyEncoder : public internal::KeyColumnEncoder {
+  using ValueType = typename ArrowType::c_type;
+
+ public:
+  void encode(const arrow::Array& array,
+              std::vector<int64_t>* codes) override {
+    auto& numeric_array =
+        static_cast<const arrow::NumericArray<ArrowType>&>(array);
+
+    auto values = numeric_array.raw_values();
+
+    bool has_nulls = array.null_count() != 0;
+    codes->resize(array.length());
+    for (int64_t i = 0; i < array.length(); ++i) {
+      if (has_nulls && array.IsNull(i)) {
+        (*codes)[i] = nullCode();
+      } else {
+        (*codes)[i] = valueCode(values[i]);
+      }
+    }
   }
 
-  if (source->GetColumnByName(column_names[i]) == nullptr) {
-    ARROW_RETURN_NOT_OK(sort(column_names, i + 1, source, targets));
-    return arrow::Status::OK();
+ private:
+  int64_t valueCode(ValueType value) {
+    if constexpr (std::is_floating_point_v<ValueType>) {
+      if (std::isnan(value)) {
+        if (nan_code_ == -1) {
+          nan_code_ = next_code_++;
+        }
+
+        return nan_code_;
+      }
+
+      if (value == 0) {
+        value = 0;  // -0.0 and 0.0 are the same key
+      }
+    }
+
+    auto [code_iter, is_inserted] = codes_.try_emplace(value, next_code_);
+    if (is_inserted) {
+      ++next_code_;
+    }
+
+    return code_iter->second;
   }
 
-  ARROW_ASSIGN_OR_RAISE(auto sorted_batch,
-                        sortByColumn(column_names[i], source));
-  while (true) {
-    auto sorted_keys = sorted_batch->GetColumnByName(column_names[i]);
+ private:
+  std::unordered_map<ValueType, int64_t> codes_;
+  int64_t nan_code_{-1};
+};
 
-    ARROW_ASSIGN_OR_RAISE(auto min_val, sorted_keys->GetScalar(0));
+class BooleanKeyEncoder : public internal::KeyColumnEncoder {
+ public:
+  void encode(const arrow::Array& array,
+              std::vector<int64_t>* codes) override {
+    auto& boolean_array = static_cast<const arrow::BooleanArray&>(array);
 
-    ARROW_ASSIGN_OR_RAISE(auto max_val,
-                          sorted_keys->GetScalar(sorted_keys->length() - 1));
+    codes->resize(array.length());
+    for (int64_t i = 0; i < array.length(); ++i) {
+      if (array.IsNull(i)) {
+        (*codes)[i] = nullCode();
+        continue;
+      }
 
-    arrow::Datum equals_datum;
-    ARROW_ASSIGN_OR_RAISE(
-        equals_datum,
-        arrow::compute::Compare(sorted_keys, min_val,
-                                arrow::compute::CompareOptions(
-                                    arrow::compute::CompareOperator::EQUAL)));
+      auto& value_code = value_codes_[boolean_array.Value(i)];
+      if (value_code == -1) {
+        value_code = next_code_++;
+      }
 
-    ARROW_ASSIGN_OR_RAISE(auto filter_datum,
-                          arrow::compute::Filter(sorted_batch, equals_datum));
+      (*codes)[i] = value_code;
+    }
+  }
 
-    ARROW_RETURN_NOT_OK(
-        sort(column_names, i + 1, filter_datum.record_batch(), targets));
+ private:
+  int64_t value_codes_[2]{-1, -1};
+};
 
-    if (min_val->Equals(max_val)) {
-      break;
+template <typename ArrayType>
+class BinaryKeyEncoder : public internal::KeyColumnEncoder {
+ public:
+  void encode(const arrow::Array& array,
+              std::vector<int64_t>* codes) override {
+    auto& binary_array = static_cast<const ArrayType&>(array);
+
+    bool has_nulls = array.null_count() != 0;
+    codes->resize(array.length());
+    for (int64_t i = 0; i < array.length(); ++i) {
+      if (has_nulls && array.IsNull(i)) {
+        (*codes)[i] = nullCode();
+        continue;
+      }
+
+      auto value = binary_array.GetView(i);
+      std::string_view key(value.data(), value.size());
+
+      auto code_iter = codes_.find(key);
+      if (code_iter == codes_.end()) {
+        auto& stored_key = keys_.emplace_back(key);
+        code_iter =
+            codes_.emplace(std::string_view(stored_key), next_code_++).first;
+      }
+
+      (*codes)[i] = code_iter->second;
     }
+  }
 
-    arrow::Datum not_equals_datum;
-    ARROW_ASSIGN_OR_RAISE(
-        not_equals_datum,
-        arrow::compute::Compare(
-            sorted_keys, min_val,
-            arrow::compute::CompareOptions(
-                arrow::compute::CompareOperator::NOT_EQUAL)));
+ private:
+  std::deque<std::string> keys_;
+  std::unordered_map<std::string_view, int64_t> codes_;
+};
 
-    arrow::Datum filter_not_equals_datum;
-    ARROW_ASSIGN_OR_RAISE(
-        filter_not_equals_datum,
-        arrow::compute::Filter(sorted_batch, not_equals_datum));
+// Dictionary values are encoded once per dictionary, so rows are coded by
+// their dictionary indices only
+class DictionaryKeyEncoder : public internal::KeyColumnEncoder {
+ public:
+  explicit DictionaryKeyEncoder(
+      std::unique_ptr<internal::KeyColumnEncoder> values_encoder)
+      : values_encoder_(std::move(values_encoder)) {}
+
+  void encode(const arrow::Array& array,
+              std::vector<int64_t>* codes) override {
+    auto& dictionary_array =
+        static_cast<const arrow::DictionaryArray&>(array);
+
+    if (array.data()->dictionary != dictionary_data_) {
+      dictionary_data_ = array.data()->dictionary;
+      values_encoder_->encode(*dictionary_array.dictionary(),
+                              &dictionary_codes_);
+
+      for (auto& dictionary_code : dictionary_codes_) {
+        if (dictionary_code >= static_cast<int64_t>(value_codes_.size())) {
+          value_codes_.resize(dictionary_code + 1, -1);
+        }
+
+        auto& value_code = value_codes_[dictionary_code];
+        if (value_code == -1) {
+          value_code = next_code_++;
+        }
+
+        dictionary_code = value_code;
+      }
+    }
 
-    sorted_batch = filter_not_equals_datum.record_batch();
+    bool has_nulls = array.null_count() != 0;
+    codes->resize(array.length());
+    for (int64_t i = 0; i < array.length(); ++i) {
+      if (has_nulls && array.IsNull(i)) {
+        (*codes)[i] = nullCode();
+      } else {
+        (*codes)[i] = dictionary_codes_[dictionary_array.GetValueIndex(i)];
+      }
+    }
   }
 
-  return arrow::Status::OK();
+ private:
+  std::unique_ptr<internal::KeyColumnEncoder> values_encoder_;
+  std::shared_ptr<arrow::ArrayData> dictionary_data_;
+  std::vector<int64_t> dictionary_codes_;
+  std::vector<int64_t> value_codes_;
+};
+
+template <typename EncoderType>
+std::unique_ptr<internal::KeyColumnEncoder> makeKeyEncoder() {
+  return std::make_unique<EncoderType>();
+}
+
+arrow::Result<std::unique_ptr<internal::KeyColumnEncoder>>
+createKeyColumnEncoder(const arrow::DataType& type) {
+  switch (type.id()) {
+    case arrow::Type::BOOL: return makeKeyEncoder<BooleanKeyEncoder>();
+    case arrow::Type::INT8:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Int8Type>>();
+    case arrow::Type::INT16:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Int16Type>>();
+    case arrow::Type::INT32:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Int32Type>>();
+    case arrow::Type::INT64:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Int64Type>>();
+    case arrow::Type::UINT8:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::UInt8Type>>();
+    case arrow::Type::UINT16:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::UInt16Type>>();
+    case arrow::Type::UINT32:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::UInt32Type>>();
+    case arrow::Type::UINT64:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::UInt64Type>>();
+    case arrow::Type::FLOAT:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::FloatType>>();
+    case arrow::Type::DOUBLE:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::DoubleType>>();
+    case arrow::Type::DATE32:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Date32Type>>();
+    case arrow::Type::DATE64:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Date64Type>>();
+    case arrow::Type::TIME32:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Time32Type>>();
+    case arrow::Type::TIME64:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::Time64Type>>();
+    case arrow::Type::TIMESTAMP:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::TimestampType>>();
+    case arrow::Type::DURATION:
+      return makeKeyEncoder<NumericKeyEncoder<arrow::DurationType>>();
+    case arrow::Type::STRING:
+      return makeKeyEncoder<BinaryKeyEncoder<arrow::StringArray>>();
+    case arrow::Type::BINARY:
+      return makeKeyEncoder<BinaryKeyEncoder<arrow::BinaryArray>>();
+    case arrow::Type::LARGE_STRING:
+      return makeKeyEncoder<BinaryKeyEncoder<arrow::LargeStringArray>>();
+    case arrow::Type::LARGE_BINARY:
+      return makeKeyEncoder<BinaryKeyEncoder<arrow::LargeBinaryArray>>();
+    case arrow::Type::DICTIONARY: {
+      ARROW_ASSIGN_OR_RAISE(
+          auto values_encoder,
+          createKeyColumnEncoder(
+              *static_cast<const arrow::DictionaryType&>(type).value_type()));
+
+      return std::unique_ptr<internal::KeyColumnEncoder>(
+          std::make_unique<DictionaryKeyEncoder>(std::move(values_encoder)));
+    }
+    default:
+      return arrow::Status::NotImplemented(fmt::format(
+          "Column of type {} can't be used as a key", type.ToString()));
+  }
+}
+
+class ColumnComparator {
+ public:
+  virtual int compare(int64_t left, int64_t right) const = 0;
+
+  virtual ~ColumnComparator() = default;
+
+ protected:
+  ColumnComparator() = default;
+
+  ColumnComparator(const ColumnComparator& /* non-used */) = default;
+  ColumnComparator& operator=(const ColumnComparator& /* non-used */) =
+      default;
+
+  ColumnComparator(ColumnComparator&& /* non-used */) = default;
+  ColumnComparator& operator=(ColumnComparator&& /* non-used */) = default;
+};
+
+template <typename ValueType>
+int compareValues(const ValueType& left, const ValueType& right) {
+  if (left < right) {
+    return -1;
+  }
+
+  if (right < left) {
+    return 1;
+  }
+
+  return 0;
+}
+
+template <typename ArrayType, typename ValueGetterType>
+class TypedColumnComparator : public ColumnComparator {
+ public:
+  TypedColumnComparator(std::shared_ptr<arrow::Array> array,
+                        ValueGetterType getter, const SortKey& sort_key)
+      : array_holder_(std::move(array)),
+        array_(static_cast<const ArrayType&>(*array_holder_)),
+        getter_(std::move(getter)),
+        has_nulls_(array_.null_count() != 0),
+        descending_(sort_key.order == kDescending),
+        nulls_first_(sort_key.null_placement == kNullsFirst) {}
+
+  int compare(int64_t left, int64_t right) const override {
+    if (has_nulls_) {
+      bool left_is_null = array_.IsNull(left);
+      bool right_is_null = array_.IsNull(right);
+      if (left_is_null || right_is_null) {
+        if (left_is_null == right_is_null) {
+          return 0;
+        }
+
+        return left_is_null == nulls_first_ ? -1 : 1;
+      }
+    }
+
+    auto left_value = getter_(array_, left);
+    auto right_value = getter_(array_, right);
+
+    // NaNs are placed as nulls regardless of the order
+    if constexpr (std::is_floating_point_v<decltype(left_value)>) {
+      bool left_is_nan = std::isnan(left_value);
+      bool right_is_nan = std::isnan(right_value);
+      if (left_is_nan || right_is_nan) {
+        if (left_is_nan == right_is_nan) {
+          return 0;
+        }
+
+        return left_is_nan == nulls_first_ ? -1 : 1;
+      }
+    }
+
+    auto result = compareValues(left_value, right_value);
+    return descending_ ? -result : result;
+  }
+
+ private:
+  std::shared_ptr<arrow::Array> array_holder_;
+  const ArrayType& array_;
+  ValueGetterType getter_;
+  bool has_nulls_;
+  bool descending_;
+  bool nulls_first_;
+};
+
+template <typename ArrayType, typename ValueGetterType>
+std::unique_ptr<ColumnComparator> makeColumnComparator(
+    const std::shared_ptr<arrow::Array>& array, ValueGetterType getter,
+    const SortKey& sort_key) {
+  return std::make_unique<TypedColumnComparator<ArrayType, ValueGetterType>>(
+      array, std::move(getter), sort_key);
+}
+
+template <typename ArrowType>
+std::unique_ptr<ColumnComparator> makeNumericColumnComparator(
+    const std::shared_ptr<arrow::Array>& array, const SortKey& sort_key) {
+  using ArrayType = arrow::NumericArray<ArrowType>;
+  return makeColumnComparator<ArrayType>(
+      array,
+      [values = static_cast<const ArrayType&>(*array).raw_values()](
+          const ArrayType& /* array */, int64_t i) { return values[i]; },
+      sort_key);
+}
+
+template <typename ArrayType>
+std::unique_ptr<ColumnComparator> makeBinaryColumnComparator(
+    const std::shared_ptr<arrow::Array>& array, const SortKey& sort_key) {
+  return makeColumnComparator<ArrayType>(
+      array,
+      [](const ArrayType& binary_array, int64_t i) {
+        auto value = binary_array.GetView(i);
+        return std::string_view(value.data(), value.size());
+      },
+      sort_key);
+}
+
+// Rows are compared by ranks of their dictionary values, so the values are
+// compared once for the dictionary instead of for each pair of rows
+arrow::Result<std::unique_ptr<ColumnComparator>>
+makeDictionaryColumnComparator(const std::shared_ptr<arrow::Array>& array,
+                               const SortKey& sort_key) {
+  auto& dictionary_array = static_cast<const arrow::DictionaryArray&>(*array);
+  auto& dictionary = dictionary_array.dictionary();
+  if (dictionary->type_id() != arrow::Type::STRING &&
+      dictionary->type_id() != arrow::Type::BINARY) {
+    return arrow::Status::NotImplemented(
+        fmt::format("Sorting by column of type {} is not supported",
+                    array->type()->ToString()));
+  }
+
+  auto& values = static_cast<const arrow::BinaryArray&>(*dictionary);
+  std::vector<int64_t> values_order(values.length());
+  std::iota(values_order.begin(), values_order.end(), 0);
+  std::sort(values_order.begin(), values_order.end(),
+            [&values](int64_t left, int64_t right) {
+              return values.GetView(left) < values.GetView(right);
+            });
+
+  std::vector<int64_t> ranks(values.length());
+  int64_t rank = 0;
+  for (size_t i = 0; i < values_order.size(); ++i) {
+    if (i > 0 && values.GetView(values_order[i]) !=
+                     values.GetView(values_order[i - 1])) {
+      ++rank;
+    }
+
+    ranks[values_order[i]] = rank;
+  }
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto indices,
+      arrow::compute::Cast(*dictionary_array.indices(), arrow::int64()));
+
+  auto raw_indices =
+      std::static_pointer_cast<arrow::Int64Array>(indices)->raw_values();
+
+  return makeColumnComparator<arrow::DictionaryArray>(
+      array,
+      [ranks = std::move(ranks), indices, raw_indices](
+          const arrow::DictionaryArray& /* array */, int64_t i) {
+        return ranks[raw_indices[i]];
+      },
+      sort_key);
+}
+
+arrow::Result<std::unique_ptr<ColumnComparator>> createColumnComparator(
+    const std::shared_ptr<arrow::Array>& array, const SortKey& sort_key) {
+  switch (array->type_id()) {
+    case arrow::Type::BOOL:
+      return makeColumnComparator<arrow::BooleanArray>(
+          array,
+          [](const arrow::BooleanArray& boolean_array, int64_t i) {
+            return boolean_array.Value(i);
+          },
+          sort_key);
+    case arrow::Type::INT8:
+      return makeNumericColumnComparator<arrow::Int8Type>(array, sort_key);
+    case arrow::Type::INT16:
+      return makeNumericColumnComparator<arrow::Int16Type>(array, sort_key);
+    case arrow::Type::INT32:
+      return makeNumericColumnComparator<arrow::Int32Type>(array, sort_key);
+    case arrow::Type::INT64:
+      return makeNumericColumnComparator<arrow::Int64Type>(array, sort_key);
+    case arrow::Type::UINT8:
+      return makeNumericColumnComparator<arrow::UInt8Type>(array, sort_key);
+    case arrow::Type::UINT16:
+      return makeNumericColumnComparator<arrow::UInt16Type>(array, sort_key);
+    case arrow::Type::UINT32:
+      return makeNumericColumnComparator<arrow::UInt32Type>(array, sort_key);
+    case arrow::Type::UINT64:
+      return makeNumericColumnComparator<arrow::UInt64Type>(array, sort_key);
+    case arrow::Type::FLOAT:
+      return makeNumericColumnComparator<arrow::FloatType>(array, sort_key);
+    case arrow::Type::DOUBLE:
+      return makeNumericColumnComparator<arrow::DoubleType>(array, sort_key);
+    case arrow::Type::DATE32:
+      return makeNumericColumnComparator<arrow::Date32Type>(array, sort_key);
+    case arrow::Type::DATE64:
+      return makeNumericColumnComparator<arrow::Date64Type>(array, sort_key);
+    case arrow::Type::TIME32:
+      return makeNumericColumnComparator<arrow::Time32Type>(array, sort_key);
+    case arrow::Type::TIME64:
+      return makeNumericColumnComparator<arrow::Time64Type>(array, sort_key);
+    case arrow::Type::TIMESTAMP:
+      return makeNumericColumnComparator<arrow::TimestampType>(array,
+                                                               sort_key);
+    case arrow::Type::DURATION:
+      return makeNumericColumnComparator<arrow::DurationType>(array,
+                                                              sort_key);
+    case arrow::Type::STRING:
+      return makeBinaryColumnComparator<arrow::StringArray>(array, sort_key);
+    case arrow::Type::BINARY:
+      return makeBinaryColumnComparator<arrow::BinaryArray>(array, sort_key);
+    case arrow::Type::LARGE_STRING:
+      return makeBinaryColumnComparator<arrow::LargeStringArray>(array,
+                                                                 sort_key);
+    case arrow::Type::LARGE_BINARY:
+      return makeBinaryColumnComparator<arrow::LargeBinaryArray>(array,
+                                                                 sort_key);
+    case arrow::Type::DICTIONARY:
+      return makeDictionaryColumnComparator(array, sort_key);
+    default:
+      return arrow::Status::NotImplemented(
+          fmt::format("Sorting by column of type {} is not supported",
+                      array->type()->ToString()));
+  }
+}
+
+// Merging presorted runs is cheaper than the full sort only when there are
+// few of them
+constexpr size_t MAX_MERGED_SORTED_RUNS = 64;
+
+// Returns offsets of ascending runs of int64 values followed by the values
+// length.
+std::vector<int64_t> findAscendingRuns(const int64_t* values,
+                                       int64_t length) {
+  std::vector<int64_t> runs_offsets{0};
+  for (int64_t i = 1; i < length; ++i) {
+    if (values[i] < values[i - 1]) {
+      runs_offsets.push_back(i);
+    }
+  }
+
+  runs_offsets.push_back(length);
+  return runs_offsets;
+}
+
+// Stable bottom-up merge of ascending runs
+std::vector<int64_t> mergeAscendingRuns(const int64_t* values,
+                                        std::vector<int64_t> runs_offsets) {
+  std::vector<int64_t> indices(runs_offsets.back());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    indices[i] = i;
+  }
+
+  auto less = [values](int64_t left, int64_t right) {
+    return values[left] < values[right];
+  };
+
+  while (runs_offsets.size() > 2) {
+    std::vector<int64_t> merged_offsets{0};
+    for (size_t i = 0; i + 2 < runs_offsets.size(); i += 2) {
+      std::inplace_merge(indices.begin() + runs_offsets[i],
+                         indices.begin() + runs_offsets[i + 1],
+                         indices.begin() + runs_offsets[i + 2], less);
+
+      merged_offsets.push_back(runs_offsets[i + 2]);
+    }
+
+    if (runs_offsets.size() % 2 == 0) {
+      merged_offsets.push_back(runs_offsets.back());
+    }
+
+    runs_offsets = std::move(merged_offsets);
+  }
+
+  return indices;
+}
+
+// Splits record batch to slices by group ids numbered in order of the
+// groups first rows. Rows of groups are kept in the input order.
+arrow::Result<arrow::RecordBatchVector> splitByGroupIds(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    const std::vector<int64_t>& group_ids, int64_t groups_number) {
+  std::vector<int64_t> group_offsets(groups_number + 1, 0);
+  for (auto group_id : group_ids) {
+    ++group_offsets[group_id + 1];
+  }
+
+  for (int64_t i = 0; i < groups_number; ++i) {
+    group_offsets[i + 1] += group_offsets[i];
+  }
+
+  auto grouped_record_batch = record_batch;
+  if (!std::is_sorted(group_ids.begin(), group_ids.end())) {
+    std::vector<int64_t> group_positions(group_offsets.begin(),
+                                         group_offsets.end() - 1);
+
+    std::vector<int64_t> grouped_indices(group_ids.size());
+    for (size_t i = 0; i < group_ids.size(); ++i) {
+      grouped_indices[group_positions[group_ids[i]]++] = i;
+    }
+
+    arrow::Int64Builder indices_builder;
+    ARROW_RETURN_NOT_OK(indices_builder.AppendValues(grouped_indices));
+    std::shared_ptr<arrow::Array> indices;
+    ARROW_RETURN_NOT_OK(indices_builder.Finish(&indices));
+
+    ARROW_ASSIGN_OR_RAISE(auto grouped_datum,
+                          arrow::compute::Take(record_batch, indices));
+
+    grouped_record_batch = grouped_datum.record_batch();
+  }
+
+  arrow::RecordBatchVector groups;
+  for (int64_t i = 0; i < groups_number; ++i) {
+    groups.push_back(grouped_record_batch->Slice(
+        group_offsets[i], group_offsets[i + 1] - group_offsets[i]));
+  }
+
+  return groups;
 }
 
 }  // namespace
 
-arrow::Result<arrow::RecordBatchVector> groupSortingByColumns(
+KeyTable::KeyTable() = default;
+
+KeyTable::KeyTable(KeyTable&& other) noexcept = default;
+KeyTable& KeyTable::operator=(KeyTable&& other) noexcept = default;
+
+KeyTable::~KeyTable() = default;
+
+arrow::Status KeyTable::encode(const arrow::ArrayVector& key_columns,
+                               std::vector<int64_t>* key_ids) {
+  ARROW_RETURN_NOT_OK(prepareEncoders(key_columns));
+
+  auto length = key_columns.front()->length();
+  for (auto& key_column : key_columns) {
+    if (key_column->length() != length) {
+      return arrow::Status::Invalid("Key columns must have the same length");
+    }
+  }
+
+  column_encoders_.front()->encode(*key_columns.front(), key_ids);
+
+  std::vector<int64_t> column_codes;
+  for (size_t i = 1; i < key_columns.size(); ++i) {
+    column_encoders_[i]->encode(*key_columns[i], &column_codes);
+
+    auto& tuple_ids = tuple_ids_[i - 1];
+    for (int64_t row = 0; row < length; ++row) {
+      auto tuple_ids_iter =
+          tuple_ids
+              .try_emplace({(*key_ids)[row], column_codes[row]},
+                           tuple_ids.size())
+              .first;
+
+      (*key_ids)[row] = tuple_ids_iter->second;
+    }
+  }
+
+  return arrow::Status::OK();
+}
+
+int64_t KeyTable::size() const {
+  if (column_encoders_.empty()) {
+    return 0;
+  }
+
+  if (tuple_ids_.empty()) {
+    return column_encoders_.front()->size();
+  }
+
+  return tuple_ids_.back().size();
+}
+
+size_t KeyTable::KeyPairHash::operator()(
+    const std::pair<int64_t, int64_t>& key) const {
+  auto seed = std::hash<int64_t>{}(key.first);
+  return seed ^ (std::hash<int64_t>{}(key.second) + 0x9e3779b97f4a7c15ULL +
+                 (seed << 6) + (seed >> 2));
+}
+
+arrow::Status KeyTable::prepareEncoders(
+    const arrow::ArrayVector& key_columns) {
+  if (key_columns.empty()) {
+    return arrow::Status::Invalid("Expected at least one key column");
+  }
+
+  if (column_encoders_.empty()) {
+    for (auto& key_column : key_columns) {
+      ARROW_ASSIGN_OR_RAISE(auto column_encoder,
+                            createKeyColumnEncoder(*key_column->type()));
+
+      column_encoders_.push_back(std::move(column_encoder));
+      column_types_.push_back(key_column->type());
+    }
+
+    tuple_ids_.resize(key_columns.size() - 1);
+    return arrow::Status::OK();
+  }
+
+  if (key_columns.size() != column_encoders_.size()) {
+    return arrow::Status::Invalid(
+        fmt::format("Expected {} key columns, got {}",
+                    column_encoders_.size(), key_columns.size()));
+  }
+
+  for (size_t i = 0; i < key_columns.size(); ++i) {
+    if (!key_columns[i]->type()->Equals(column_types_[i])) {
+      return arrow::Status::TypeError(fmt::format(
+          "Key column {} has type {} while {} was expected", i,
+          key_columns[i]->type()->ToString(), column_types_[i]->ToString()));
+    }
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Result<arrow::RecordBatchVector> groupByColumns(
     const std::vector<std::string>& column_names,
     const std::shared_ptr<arrow::RecordBatch>& record_batch) {
-  arrow::RecordBatchVector grouped;
-  ARROW_RETURN_NOT_OK(sort(column_names, 0, record_batch, &grouped));
-  return grouped;
+  arrow::ArrayVector key_columns;
+  for (auto& column_name : column_names) {
+    auto column = record_batch->GetColumnByName(column_name);
+    if (column != nullptr) {
+      key_columns.push_back(column);
+    }
+  }
+
+  if (key_columns.empty() || record_batch->num_rows() == 0) {
+    return arrow::RecordBatchVector{record_batch};
+  }
+
+  KeyTable key_table;
+  std::vector<int64_t> group_ids;
+  ARROW_RETURN_NOT_OK(key_table.encode(key_columns, &group_ids));
+
+  auto groups_number = key_table.size();
+  if (groups_number == 1) {
+    return arrow::RecordBatchVector{record_batch};
+  }
+
+  return splitByGroupIds(record_batch, group_ids, groups_number);
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> combineGroups(
+    const arrow::RecordBatchVector& record_batches,
+    const std::string& group_column_name) {
+  arrow::RecordBatchVector groups;
+  for (auto& record_batch : record_batches) {
+    ARROW_ASSIGN_OR_RAISE(auto record_batch_groups,
+                          splitGroups(record_batch));
+
+    convert_utils::append(std::move(record_batch_groups), groups);
+  }
+
+  if (groups.empty()) {
+    return arrow::Status::Invalid("Can't combine empty set of groups");
+  }
+
+  if (groups.front()->GetColumnByName(group_column_name) != nullptr) {
+    return arrow::Status::Invalid(fmt::format(
+        "RecordBatch already has column with name {}", group_column_name));
+  }
+
+  std::unordered_map<std::string, int32_t> dictionary_ids;
+  arrow::BinaryBuilder dictionary_builder;
+  arrow::Int32Builder indices_builder;
+  for (auto& group : groups) {
+    auto [id_iter, inserted] = dictionary_ids.try_emplace(
+        metadata::extractGroupMetadata(*group),
+        static_cast<int32_t>(dictionary_ids.size()));
+
+    if (inserted) {
+      ARROW_RETURN_NOT_OK(dictionary_builder.Append(id_iter->first));
+    }
+
+    ARROW_RETURN_NOT_OK(indices_builder.Reserve(group->num_rows()));
+    for (int64_t i = 0; i < group->num_rows(); ++i) {
+      indices_builder.UnsafeAppend(id_iter->second);
+    }
+  }
+
+  std::shared_ptr<arrow::Array> dictionary;
+  ARROW_RETURN_NOT_OK(dictionary_builder.Finish(&dictionary));
+  std::shared_ptr<arrow::Array> indices;
+  ARROW_RETURN_NOT_OK(indices_builder.Finish(&indices));
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto group_column,
+      arrow::DictionaryArray::FromArrays(
+          arrow::dictionary(arrow::int32(), arrow::binary()), indices,
+          dictionary));
+
+  ARROW_ASSIGN_OR_RAISE(auto combined,
+                        convert_utils::concatenateRecordBatches(groups));
+
+  ARROW_RETURN_NOT_OK(metadata::removeGroupMetadata(&combined));
+  ARROW_ASSIGN_OR_RAISE(
+      combined, combined->AddColumn(combined->num_columns(),
+                                    group_column_name, group_column));
+
+  ARROW_RETURN_NOT_OK(
+      metadata::setGroupColumnNameMetadata(&combined, group_column_name));
+
+  return combined;
+}
+
+arrow::Result<arrow::RecordBatchVector> splitGroups(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  if (!metadata::isMultiGroup(*record_batch)) {
+    return arrow::RecordBatchVector{record_batch};
+  }
+
+  std::vector<metadata::InternedGroupPtr> groups;
+  return splitGroups(record_batch, &groups);
+}
+
+arrow::Result<arrow::RecordBatchVector> splitGroups(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    std::vector<metadata::InternedGroupPtr>* groups) {
+  if (!metadata::isMultiGroup(*record_batch)) {
+    groups->push_back(metadata::extractInternedGroup(*record_batch));
+    return arrow::RecordBatchVector{record_batch};
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto group_column_index,
+                        getGroupColumnIndex(*record_batch));
+
+  auto group_column = record_batch->column(group_column_index);
+  auto& dictionary_column =
+      static_cast<const arrow::DictionaryArray&>(*group_column);
+
+  auto dictionary = dictionary_column.dictionary();
+  auto& dictionary_values =
+      static_cast<const arrow::BinaryArray&>(*dictionary);
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto dictionary_indices,
+      arrow::compute::Cast(*dictionary_column.indices(), arrow::int64()));
+
+  auto raw_indices =
+      std::static_pointer_cast<arrow::Int64Array>(dictionary_indices)
+          ->raw_values();
+
+  // Rows with null group belong to the group without metadata
+  std::unordered_map<int64_t, int64_t> dictionary_groups;
+  auto groups_offset = groups->size();
+  std::vector<int64_t> group_ids(record_batch->num_rows());
+  for (int64_t i = 0; i < record_batch->num_rows(); ++i) {
+    auto dictionary_index =
+        dictionary_indices->IsNull(i) ? int64_t{-1} : raw_indices[i];
+
+    auto [group_iter, inserted] = dictionary_groups.try_emplace(
+        dictionary_index, groups->size() - groups_offset);
+
+    if (inserted) {
+      groups->push_back(metadata::internGroup(
+          dictionary_index == -1
+              ? ""
+              : dictionary_values.GetString(dictionary_index)));
+    }
+
+    group_ids[i] = group_iter->second;
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto data,
+                        record_batch->RemoveColumn(group_column_index));
+
+  ARROW_RETURN_NOT_OK(metadata::removeGroupColumnNameMetadata(&data));
+  ARROW_ASSIGN_OR_RAISE(
+      auto result,
+      splitByGroupIds(data, group_ids, groups->size() - groups_offset));
+
+  for (size_t i = 0; i < result.size(); ++i) {
+    ARROW_RETURN_NOT_OK(metadata::setGroupMetadata(
+        &result[i], *(*groups)[groups_offset + i]));
+  }
+
+  return result;
+}
+
+arrow::Result<arrow::RecordBatchVector> splitGroups(
+    const arrow::RecordBatchVector& record_batches) {
+  arrow::RecordBatchVector result;
+  for (auto& record_batch : record_batches) {
+    ARROW_ASSIGN_OR_RAISE(auto groups, splitGroups(record_batch));
+    convert_utils::append(std::move(groups), result);
+  }
+
+  return result;
+}
+
+arrow::Result<int> getGroupColumnIndex(
+    const arrow::RecordBatch& record_batch) {
+  ARROW_ASSIGN_OR_RAISE(auto group_column_name,
+                        metadata::getGroupColumnNameMetadata(record_batch));
+
+  auto group_column_index =
+      record_batch.schema()->GetFieldIndex(group_column_name);
+
+  if (group_column_index == -1) {
+    return arrow::Status::KeyError(fmt::format(
+        "RecordBatch has no group column with name {}", group_column_name));
+  }
+
+  auto group_column = record_batch.column(group_column_index);
+  if (group_column->type_id() != arrow::Type::DICTIONARY) {
+    return arrow::Status::TypeError(fmt::format(
+        "Group column should be dictionary-encoded, but {} type provided",
+        group_column->type()->ToString()));
+  }
+
+  auto& dictionary_type =
+      static_cast<const arrow::DictionaryType&>(*group_column->type());
+
+  auto value_type_id = dictionary_type.value_type()->id();
+  if (value_type_id != arrow::Type::BINARY &&
+      value_type_id != arrow::Type::STRING) {
+    return arrow::Status::TypeError(fmt::format(
+        "Group column dictionary should be binary, but {} type provided",
+        dictionary_type.value_type()->ToString()));
+  }
+
+  return group_column_index;
+}
+
+arrow::Status dictionaryEncodeTags(
+    std::shared_ptr<arrow::RecordBatch>* record_batch) {
+  auto columns = record_batch->get()->columns();
+  auto fields = record_batch->get()->schema()->fields();
+  bool is_encoded = false;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    auto column_type = metadata::getColumnType(*fields[i]);
+    if ((column_type != metadata::TAG &&
+         column_type != metadata::MEASUREMENT) ||
+        fields[i]->type()->id() != arrow::Type::STRING) {
+      continue;
+    }
+
+    ARROW_ASSIGN_OR_RAISE(auto encoded_datum,
+                          arrow::compute::DictionaryEncode(columns[i]));
+
+    columns[i] = encoded_datum.make_array();
+    fields[i] = fields[i]->WithType(columns[i]->type());
+    is_encoded = true;
+  }
+
+  if (is_encoded) {
+    *record_batch = arrow::RecordBatch::Make(
+        arrow::schema(fields, record_batch->get()->schema()->metadata()),
+        record_batch->get()->num_rows(), columns);
+  }
+
+  return arrow::Status::OK();
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> decodeDictionaries(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  auto columns = record_batch->columns();
+  auto fields = record_batch->schema()->fields();
+  bool is_decoded = false;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (fields[i]->type()->id() != arrow::Type::DICTIONARY) {
+      continue;
+    }
+
+    auto& value_type =
+        static_cast<const arrow::DictionaryType&>(*fields[i]->type())
+            .value_type();
+
+    ARROW_ASSIGN_OR_RAISE(columns[i],
+                          arrow::compute::Cast(*columns[i], value_type));
+
+    fields[i] = fields[i]->WithType(value_type);
+    is_decoded = true;
+  }
+
+  if (!is_decoded) {
+    return record_batch;
+  }
+
+  return arrow::RecordBatch::Make(
+      arrow::schema(fields, record_batch->schema()->metadata()),
+      record_batch->num_rows(), columns);
+}
+
+arrow::Result<std::shared_ptr<arrow::Array>> sortIndices(
+    const arrow::RecordBatch& record_batch,
+    const std::vector<SortKey>& sort_keys, std::optional<size_t> limit) {
+  std::vector<std::unique_ptr<ColumnComparator>> comparators;
+  for (auto& sort_key : sort_keys) {
+    auto column = record_batch.GetColumnByName(sort_key.column_name);
+    if (column == nullptr) {
+      continue;
+    }
+
+    ARROW_ASSIGN_OR_RAISE(auto comparator,
+                          createColumnComparator(column, sort_key));
+
+    comparators.push_back(std::move(comparator));
+  }
+
+  std::vector<int64_t> indices(record_batch.num_rows());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    indices[i] = i;
+  }
+
+  auto less = [&comparators](int64_t left, int64_t right) {
+    for (auto& comparator : comparators) {
+      auto result = comparator->compare(left, right);
+      if (result != 0) {
+        return result < 0;
+      }
+    }
+
+    return left < right;
+  };
+
+  if (limit.has_value() && limit.value() < indices.size()) {
+    std::partial_sort(indices.begin(), indices.begin() + limit.value(),
+                      indices.end(), less);
+
+    indices.resize(limit.value());
+  } else if (!comparators.empty()) {
+    std::sort(indices.begin(), indices.end(), less);
+  }
+
+  arrow::Int64Builder indices_builder;
+  ARROW_RETURN_NOT_OK(indices_builder.AppendValues(indices));
+  std::shared_ptr<arrow::Array> sorted_indices;
+  ARROW_RETURN_NOT_OK(indices_builder.Finish(&sorted_indices));
+  return sorted_indices;
 }
 
 arrow::Result<std::shared_ptr<arrow::RecordBatch>> sortByColumn(
@@ -91,18 +1030,132 @@ arrow::Result<std::shared_ptr<arrow::RecordBatch>> sortByColumn(
         fmt::format("No such column with name {}", column_name));
   }
 
+  if (metadata::isSortedByMetadata(*source, column_name)) {
+    return source;
+  }
+
   if (sorting_column->type_id() == arrow::Type::TIMESTAMP) {
     ARROW_ASSIGN_OR_RAISE(sorting_column,
                           sorting_column->View(arrow::int64()));
   }
 
-  ARROW_ASSIGN_OR_RAISE(auto sorted_idx,
-                        arrow::compute::SortIndices(*sorting_column));
+  std::shared_ptr<arrow::Array> sorted_idx;
+  if (sorting_column->type_id() == arrow::Type::INT64 &&
+      sorting_column->null_count() == 0) {
+    auto values =
+        std::static_pointer_cast<arrow::Int64Array>(sorting_column)
+            ->raw_values();
+
+    auto runs_offsets = findAscendingRuns(values, sorting_column->length());
+    if (runs_offsets.size() <= 2) {
+      return source;
+    }
+
+    if (runs_offsets.size() <= MAX_MERGED_SORTED_RUNS + 1) {
+      arrow::Int64Builder indices_builder;
+      ARROW_RETURN_NOT_OK(indices_builder.AppendValues(
+          mergeAscendingRuns(values, std::move(runs_offsets))));
+
+      ARROW_RETURN_NOT_OK(indices_builder.Finish(&sorted_idx));
+    }
+  }
+
+  if (sorted_idx == nullptr) {
+    ARROW_ASSIGN_OR_RAISE(sorted_idx,
+                          arrow::compute::SortIndices(*sorting_column));
+  }
 
   ARROW_ASSIGN_OR_RAISE(auto sorted_datum,
                         arrow::compute::Take(source, sorted_idx));
 
-  return sorted_datum.record_batch();
+  auto sorted_record_batch = sorted_datum.record_batch();
+  ARROW_RETURN_NOT_OK(metadata::removeSortedByMetadata(&sorted_record_batch));
+  return sorted_record_batch;
+}
+
+arrow::Result<std::shared_ptr<arrow::BooleanArray>> extractSelection(
+    std::shared_ptr<arrow::RecordBatch>* record_batch) {
+  auto selection_column_name_result =
+      metadata::getSelectionColumnNameMetadata(**record_batch);
+
+  if (!selection_column_name_result.ok()) {
+    return std::shared_ptr<arrow::BooleanArray>(nullptr);
+  }
+
+  auto selection_column_index =
+      record_batch->get()->schema()->GetFieldIndex(
+          selection_column_name_result.ValueOrDie());
+
+  if (selection_column_index == -1) {
+    return arrow::Status::Invalid(
+        fmt::format("Invalid selection column name metadata: {}",
+                    selection_column_name_result.ValueOrDie()));
+  }
+
+  auto selection = std::static_pointer_cast<arrow::BooleanArray>(
+      record_batch->get()->column(selection_column_index));
+
+  ARROW_ASSIGN_OR_RAISE(
+      *record_batch,
+      record_batch->get()->RemoveColumn(selection_column_index));
+
+  ARROW_RETURN_NOT_OK(
+      metadata::removeSelectionColumnNameMetadata(record_batch));
+
+  return selection;
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> materializeSelection(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch) {
+  auto result = record_batch;
+  ARROW_ASSIGN_OR_RAISE(auto selection, extractSelection(&result));
+  if (selection == nullptr) {
+    return result;
+  }
+
+  ARROW_ASSIGN_OR_RAISE(auto filtered_datum,
+                        arrow::compute::Filter(result, selection));
+
+  return filtered_datum.record_batch();
+}
+
+arrow::Status getTimeValues(const arrow::RecordBatch& record_batch,
+                            const std::string& time_column_name,
+                            time_utils::TimeUnit to,
+                            std::vector<int64_t>* times) {
+  auto time_column = record_batch.GetColumnByName(time_column_name);
+  if (time_column == nullptr) {
+    return arrow::Status::Invalid(fmt::format(
+        "Time column with name {} should be presented", time_column_name));
+  }
+
+  time_utils::TimeUnit time_unit;
+  if (time_column->type_id() == arrow::Type::TIMESTAMP) {
+    time_unit = time_utils::mapArrowTimeUnit(
+        std::static_pointer_cast<arrow::TimestampType>(time_column->type())
+            ->unit());
+  } else {
+    if (time_column->type_id() != arrow::Type::INT64) {
+      return arrow::Status::NotImplemented(
+          "Only arrow::Type::INT64 type is supported as non-timestamp time "
+          "column's type");
+    }
+
+    ARROW_ASSIGN_OR_RAISE(
+        time_unit,
+        metadata::getTimeUnitMetadata(record_batch, time_column_name));
+  }
+
+  auto time_values =
+      std::static_pointer_cast<arrow::Int64Array>(time_column)->raw_values();
+
+  times->resize(record_batch.num_rows());
+  for (int64_t i = 0; i < record_batch.num_rows(); ++i) {
+    ARROW_ASSIGN_OR_RAISE((*times)[i], time_utils::convertTime(
+                                           time_values[i], time_unit, to));
+  }
+
+  return arrow::Status::OK();
 }
 
 arrow::Result<std::pair<size_t, size_t>> argMinMax(
@@ -111,6 +1164,29 @@ arrow::Result<std::pair<size_t, size_t>> argMinMax(
     ARROW_ASSIGN_OR_RAISE(array, array->View(arrow::int64()));
   }
 
+  if (array->type_id() == arrow::Type::INT64) {
+    auto& int64_array = static_cast<const arrow::Int64Array&>(*array);
+    auto values = int64_array.raw_values();
+
+    int64_t arg_min = -1;
+    int64_t arg_max = -1;
+    for (int64_t i = 0; i < int64_array.length(); ++i) {
+      if (int64_array.IsNull(i)) {
+        continue;
+      }
+
+      if (arg_min == -1 || values[i] < values[arg_min]) {
+        arg_min = i;
+      }
+
+      if (arg_max == -1 || values[i] > values[arg_max]) {
+        arg_max = i;
+      }
+    }
+
+    return std::pair{arg_min, arg_max};
+  }
+
   ARROW_ASSIGN_OR_RAISE(auto min_max_ts, arrow::compute::MinMax(array));
 
   int64_t arg_min = -1;
@@ -137,37 +1213,11 @@ arrow::Result<std::pair<size_t, size_t>> argMinMax(
 arrow::Result<size_t> tsLowerBound(const arrow::Array& sorted_ts_array,
                                    const std::function<bool(int64_t)>& pred,
                                    arrow::TimeUnit::type time_unit) {
-  size_t left_bound = 0;
-  size_t right_bound = sorted_ts_array.length();
-  while (left_bound != right_bound - 1) {
-    auto middle = (left_bound + right_bound) / 2;
-
-    ARROW_ASSIGN_OR_RAISE(auto ts_scalar,
-                          arrow_utils::castTimestampScalar(
-                              sorted_ts_array.GetScalar(middle), time_unit));
-
-    int64_t ts =
-        std::static_pointer_cast<arrow::TimestampScalar>(ts_scalar)->value;
-
-    if (pred(ts)) {
-      right_bound = middle;
-    } else {
-      left_bound = middle;
-    }
-  }
-
   ARROW_ASSIGN_OR_RAISE(
-      auto ts_scalar, arrow_utils::castTimestampScalar(
-                          sorted_ts_array.GetScalar(left_bound), time_unit));
-
-  int64_t ts =
-      std::static_pointer_cast<arrow::TimestampScalar>(ts_scalar)->value;
+      auto timestamps,
+      arrow_utils::TimestampsView::make(sorted_ts_array, time_unit));
 
-  if (pred(ts)) {
-    return left_bound;
-  } else {
-    return right_bound;
-  }
+  return timestamps.partitionPoint(pred);
 }
 
 double FDDerivativeCalculator::calculateDerivative(
@@ -236,5 +1286,113 @@ double FDDerivativeCalculator::calculateDerivative(
   return der_result;
 }
 
+double FornbergDerivativeCalculator::calculateDerivative(
+    const std::deque<double>& xs, const std::deque<double>& ys, double x_der,
+    size_t order) const {
+  if (xs.size() != ys.size()) {
+    throw ComputeException(
+        fmt::format("Argument and value arrays have different sizes: {} and "
+                    "{}",
+                    xs.size(), ys.size()));
+  }
+
+  if (xs.size() < order + 1) {
+    throw ComputeException(
+        fmt::format("For calculating {}-order derivative at least {} values "
+                    "are needed",
+                    order, order + 1));
+  }
+
+  bool is_cache_valid = !cached_weights_.empty() && cached_order_ == order &&
+                        cached_offsets_.size() == xs.size();
+
+  cached_offsets_.resize(xs.size());
+  for (size_t i = 0; i < xs.size(); ++i) {
+    auto offset = xs[i] - x_der;
+    if (is_cache_valid &&
+        std::abs(offset - cached_offsets_[i]) >
+            1e-12 * std::max(1.0, std::abs(offset))) {
+      is_cache_valid = false;
+    }
+
+    if (!is_cache_valid) {
+      cached_offsets_[i] = offset;
+    }
+  }
+
+  if (!is_cache_valid) {
+    calculateWeights(order);
+  }
+
+  double der_result = 0;
+  for (size_t i = 0; i < ys.size(); ++i) {
+    der_result += ys[i] * cached_weights_[i];
+  }
+
+  return der_result;
+}
+
+std::shared_ptr<DerivativeCalculator> FornbergDerivativeCalculator::clone()
+    const {
+  return std::make_shared<FornbergDerivativeCalculator>();
+}
+
+void FornbergDerivativeCalculator::calculateWeights(size_t order) const {
+  auto& offsets = cached_offsets_;
+  auto n = offsets.size();
+
+  // weights[i * (order + 1) + k] is the weight of i-th value for k-th order
+  // derivative using the first processed values only
+  std::vector<double> weights(n * (order + 1), 0);
+  auto weight = [&weights, order](size_t i, size_t k) -> double& {
+    return weights[i * (order + 1) + k];
+  };
+
+  cached_weights_.clear();
+
+  weight(0, 0) = 1;
+  double c1 = 1;
+  double c4 = offsets[0];
+  for (size_t i = 1; i < n; ++i) {
+    auto max_k = std::min(i, order);
+    double c2 = 1;
+    double c5 = c4;
+    c4 = offsets[i];
+    for (size_t j = 0; j < i; ++j) {
+      double c3 = offsets[i] - offsets[j];
+      if (c3 == 0) {
+        throw ComputeException(fmt::format(
+            "Found repeating argument offset {} which is not allowed",
+            offsets[i]));
+      }
+
+      c2 *= c3;
+      if (j == i - 1) {
+        for (size_t k = max_k; k > 0; --k) {
+          weight(i, k) =
+              c1 * (k * weight(i - 1, k - 1) - c5 * weight(i - 1, k)) / c2;
+        }
+
+        weight(i, 0) = -c1 * c5 * weight(i - 1, 0) / c2;
+      }
+
+      for (size_t k = max_k; k > 0; --k) {
+        weight(j, k) = (c4 * weight(j, k) - k * weight(j, k - 1)) / c3;
+      }
+
+      weight(j, 0) = c4 * weight(j, 0) / c3;
+    }
+
+    c1 = c2;
+  }
+
+  cached_weights_.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    cached_weights_[i] = weight(i, order);
+  }
+
+  cached_order_ = order;
+}
+
 }  // namespace compute_utils
 }  // namespace stream_data_processor
@@ -2,11 +2,16 @@
 
 #include <deque>
 #include <memory>
+#include <optional>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <arrow/api.h>
 
+#include "metadata/grouping.h"
+#include "time_utils.h"
+
 namespace stream_data_processor {
 namespace compute_utils {
 
@@ -22,14 +27,123 @@ class ComputeException : public std::exception {
   std::string message_;
 };
 
-arrow::Result<arrow::RecordBatchVector> groupSortingByColumns(
+namespace internal {
+
+class KeyColumnEncoder;
+
+}  // namespace internal
+
+class KeyTable {
+ public:
+  KeyTable();
+
+  KeyTable(KeyTable&& other) noexcept;
+  KeyTable& operator=(KeyTable&& other) noexcept;
+
+  ~KeyTable();
+
+  // Assigns dense ids to distinct tuples of key columns values. Ids are
+  // stable between calls so the same table can be used for several arrays.
+  arrow::Status encode(const arrow::ArrayVector& key_columns,
+                       std::vector<int64_t>* key_ids);
+
+  [[nodiscard]] int64_t size() const;
+
+ private:
+  struct KeyPairHash {
+    size_t operator()(const std::pair<int64_t, int64_t>& key) const;
+  };
+
+  arrow::Status prepareEncoders(const arrow::ArrayVector& key_columns);
+
+ private:
+  std::vector<std::unique_ptr<internal::KeyColumnEncoder>> column_encoders_;
+  std::vector<std::shared_ptr<arrow::DataType>> column_types_;
+  std::vector<std::unordered_map<std::pair<int64_t, int64_t>, int64_t,
+                                 KeyPairHash>>
+      tuple_ids_;
+};
+
+arrow::Result<arrow::RecordBatchVector> groupByColumns(
     const std::vector<std::string>& column_names,
     const std::shared_ptr<arrow::RecordBatch>& record_batch);
 
+// Combines record batches of one schema to the multi-group record batch
+// with the group column of the provided name. Rows are kept in the input
+// order.
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> combineGroups(
+    const arrow::RecordBatchVector& record_batches,
+    const std::string& group_column_name);
+
+// Splits the multi-group record batch to record batches of one group in
+// order of the groups first rows. Other record batches are returned as is.
+arrow::Result<arrow::RecordBatchVector> splitGroups(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch);
+
+// Also returns the interned group of each returned record batch, so it is
+// not looked up by the group metadata again.
+arrow::Result<arrow::RecordBatchVector> splitGroups(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch,
+    std::vector<metadata::InternedGroupPtr>* groups);
+
+// Splits multi-group record batches of the vector keeping the order of
+// record batches.
+arrow::Result<arrow::RecordBatchVector> splitGroups(
+    const arrow::RecordBatchVector& record_batches);
+
+// Returns index of the group column of the multi-group record batch
+// checking it is dictionary-encoded with binary values.
+arrow::Result<int> getGroupColumnIndex(
+    const arrow::RecordBatch& record_batch);
+
+// Replaces utf8 TAG and MEASUREMENT columns with dictionary<int32, utf8>
+// ones keeping the columns metadata.
+arrow::Status dictionaryEncodeTags(
+    std::shared_ptr<arrow::RecordBatch>* record_batch);
+
+// Returns the record batch with dictionary-encoded columns replaced by
+// plain ones for consumers which don't support dictionaries, e.g. gandiva.
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> decodeDictionaries(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch);
+
+enum SortOrder { kAscending, kDescending };
+
+enum NullPlacement { kNullsLast, kNullsFirst };
+
+struct SortKey {
+  std::string column_name;
+  SortOrder order{kAscending};
+  NullPlacement null_placement{kNullsLast};
+};
+
+// Returns indices of rows ordered lexicographically by sort keys. Ties are
+// kept in the input order, NaNs are placed as nulls. With limit only first
+// limit indices are selected without sorting the rest of rows.
+arrow::Result<std::shared_ptr<arrow::Array>> sortIndices(
+    const arrow::RecordBatch& record_batch,
+    const std::vector<SortKey>& sort_keys,
+    std::optional<size_t> limit = std::nullopt);
+
+// Stable sort by the column. Record batches marked as sorted by this column
+// and already sorted ones are returned as is, a few presorted runs of
+// integer or timestamp columns are merged instead of the full sort.
 arrow::Result<std::shared_ptr<arrow::RecordBatch>> sortByColumn(
     const std::string& column_name,
     const std::shared_ptr<arrow::RecordBatch>& source);
 
+arrow::Result<std::shared_ptr<arrow::BooleanArray>> extractSelection(
+    std::shared_ptr<arrow::RecordBatch>* record_batch);
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> materializeSelection(
+    const std::shared_ptr<arrow::RecordBatch>& record_batch);
+
+// Reads time column values converted to the provided time unit. INT64 time
+// columns should have time unit metadata.
+arrow::Status getTimeValues(const arrow::RecordBatch& record_batch,
+                            const std::string& time_column_name,
+                            time_utils::TimeUnit to,
+                            std::vector<int64_t>* times);
+
 arrow::Result<std::pair<size_t, size_t>> argMinMax(
     std::shared_ptr<arrow::Array> array);
 
@@ -43,6 +157,13 @@ class DerivativeCalculator {
                                      const std::deque<double>& ys,
                                      double x_der, size_t order) const = 0;
 
+  // Returns a calculator for one more handler if the calculator keeps a
+  // state between calls, e.g. a cache, so handlers don't share it.
+  // Stateless calculators return nullptr and are shared.
+  [[nodiscard]] virtual std::shared_ptr<DerivativeCalculator> clone() const {
+    return nullptr;
+  }
+
   virtual ~DerivativeCalculator() = default;
 
  protected:
@@ -78,5 +199,27 @@ class FDDerivativeCalculator : public DerivativeCalculator {
   LinearSolver linear_solver_;
 };
 
+// Calculates derivatives with Fornberg's recursive finite difference weights
+// in O(n * n * order) without solving a linear system. Weights depend only
+// on offsets of arguments from x_der, so weights of the previous call are
+// reused when the offsets are the same, e.g. for uniformly sampled series.
+// The cache isn't synchronized, so each handler gets its own calculator.
+class FornbergDerivativeCalculator : public DerivativeCalculator {
+ public:
+  double calculateDerivative(const std::deque<double>& xs,
+                             const std::deque<double>& ys, double x_der,
+                             size_t order) const override;
+
+  [[nodiscard]] std::shared_ptr<DerivativeCalculator> clone() const override;
+
+ private:
+  void calculateWeights(size_t order) const;
+
+ private:
+  mutable std::vector<double> cached_offsets_;
+  mutable size_t cached_order_{0};
+  mutable std::vector<double> cached_weights_;
+};
+
 }  // namespace compute_utils
 }  // namespace stream_data_processor
@@ -1,7 +1,9 @@
 #include <map>
 
+#include <arrow/array/concatenate.h>
 #include <spdlog/spdlog.h>
 
+#include "arrow_utils.h"
 #include "convert_utils.h"
 
 namespace stream_data_processor {
@@ -9,16 +11,25 @@ namespace convert_utils {
 
 arrow::Result<std::shared_ptr<arrow::RecordBatch>> convertTableToRecordBatch(
     const arrow::Table& table) {
-  ARROW_ASSIGN_OR_RAISE(auto prepared_table, table.CombineChunks());
   arrow::ArrayVector table_columns;
   if (table.num_rows() != 0) {
-    for (auto& column : prepared_table->columns()) {
-      table_columns.push_back(column->chunk(0));
+    for (auto& column : table.columns()) {
+      auto chunks = column->chunks();
+      if (chunks.size() == 1) {
+        table_columns.push_back(chunks.front());
+        continue;
+      }
+
+      // Chunks of dictionary-encoded columns may have different
+      // dictionaries
+      ARROW_RETURN_NOT_OK(arrow_utils::unifyDictionaries(&chunks));
+      ARROW_ASSIGN_OR_RAISE(table_columns.emplace_back(),
+                            arrow::Concatenate(chunks));
     }
   }
 
-  return arrow::RecordBatch::Make(prepared_table->schema(),
-                                  prepared_table->num_rows(), table_columns);
+  return arrow::RecordBatch::Make(table.schema(), table.num_rows(),
+                                  table_columns);
 }
 
 arrow::Result<std::shared_ptr<arrow::RecordBatch>> concatenateRecordBatches(
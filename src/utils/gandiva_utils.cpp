@@ -0,0 +1,85 @@
+#include <arrow/compute/api.h>
+
+#include "gandiva_utils.h"
+
+namespace stream_data_processor {
+namespace gandiva_utils {
+
+namespace {
+
+template <typename Type>
+bool collectInExpressionColumnNames(
+    const gandiva::NodePtr& node,
+    std::unordered_set<std::string>* column_names) {
+  auto in_node =
+      std::dynamic_pointer_cast<gandiva::InExpressionNode<Type>>(node);
+
+  if (in_node == nullptr) {
+    return false;
+  }
+
+  collectColumnNames(in_node->eval_expr(), column_names);
+  return true;
+}
+
+}  // namespace
+
+void collectColumnNames(const gandiva::NodePtr& node,
+                        std::unordered_set<std::string>* column_names) {
+  if (auto field_node = std::dynamic_pointer_cast<gandiva::FieldNode>(node)) {
+    column_names->insert(field_node->field()->name());
+  } else if (auto function_node =
+                 std::dynamic_pointer_cast<gandiva::FunctionNode>(node)) {
+    for (auto& child : function_node->children()) {
+      collectColumnNames(child, column_names);
+    }
+  } else if (auto boolean_node =
+                 std::dynamic_pointer_cast<gandiva::BooleanNode>(node)) {
+    for (auto& child : boolean_node->children()) {
+      collectColumnNames(child, column_names);
+    }
+  } else if (auto if_node =
+                 std::dynamic_pointer_cast<gandiva::IfNode>(node)) {
+    collectColumnNames(if_node->condition(), column_names);
+    collectColumnNames(if_node->then_node(), column_names);
+    collectColumnNames(if_node->else_node(), column_names);
+  } else if (!collectInExpressionColumnNames<int32_t>(node, column_names) &&
+             !collectInExpressionColumnNames<int64_t>(node, column_names)) {
+    collectInExpressionColumnNames<std::string>(node, column_names);
+  }
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> makeInput(
+    const arrow::RecordBatch& record_batch,
+    const std::unordered_set<std::string>& column_names) {
+  arrow::FieldVector fields;
+  arrow::ArrayVector columns;
+  for (int i = 0; i < record_batch.num_columns(); ++i) {
+    auto& field = record_batch.schema()->field(i);
+    if (column_names.find(field->name()) == column_names.end()) {
+      continue;
+    }
+
+    auto column = record_batch.column(i);
+    if (field->type()->id() != arrow::Type::DICTIONARY) {
+      fields.push_back(field);
+      columns.push_back(std::move(column));
+      continue;
+    }
+
+    auto& value_type =
+        static_cast<const arrow::DictionaryType&>(*field->type())
+            .value_type();
+
+    ARROW_ASSIGN_OR_RAISE(columns.emplace_back(),
+                          arrow::compute::Cast(*column, value_type));
+
+    fields.push_back(field->WithType(value_type));
+  }
+
+  return arrow::RecordBatch::Make(arrow::schema(fields),
+                                  record_batch.num_rows(), columns);
+}
+
+}  // namespace gandiva_utils
+}  // namespace stream_data_processor
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include <arrow/api.h>
+#include <gandiva/node.h>
+
+namespace stream_data_processor {
+namespace gandiva_utils {
+
+// Adds names of the fields referenced by the expression tree.
+void collectColumnNames(const gandiva::NodePtr& node,
+                        std::unordered_set<std::string>* column_names);
+
+// Returns the record batch of the named columns only. Gandiva doesn't
+// support dictionaries, so dictionary-encoded columns of them are decoded
+// while other columns, e.g. tags not used by expressions, are not touched.
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> makeInput(
+    const arrow::RecordBatch& record_batch,
+    const std::unordered_set<std::string>& column_names);
+
+}  // namespace gandiva_utils
+}  // namespace stream_data_processor
@@ -1,3 +1,8 @@
+#include <cstdio>
+
+#include <spdlog/spdlog.h>
+
+#include "compute_utils.h"
 #include "serialize_utils.h"
 
 namespace stream_data_processor {
@@ -7,7 +12,12 @@ arrow::Result<arrow::BufferVector> serializeRecordBatches(
     const std::vector<std::shared_ptr<arrow::RecordBatch>>& record_batches) {
   arrow::BufferVector result;
 
-  for (auto& record_batch : record_batches) {
+  for (auto& input_record_batch : record_batches) {
+    // Deselected rows are not sent to other processes
+    ARROW_ASSIGN_OR_RAISE(
+        auto record_batch,
+        compute_utils::materializeSelection(input_record_batch));
+
     ARROW_ASSIGN_OR_RAISE(auto output_stream,
                           arrow::io::BufferOutputStream::Create());
 
@@ -39,5 +49,44 @@ arrow::Result<arrow::RecordBatchVector> deserializeRecordBatches(
   return record_batches;
 }
 
+arrow::Result<std::shared_ptr<SpillFile>> SpillFile::create(
+    std::string path, const arrow::RecordBatch& record_batch) {
+  ARROW_ASSIGN_OR_RAISE(auto output_stream,
+                        arrow::io::FileOutputStream::Open(path));
+
+  ARROW_ASSIGN_OR_RAISE(
+      auto file_writer,
+      arrow::ipc::MakeFileWriter(output_stream, record_batch.schema()));
+
+  ARROW_RETURN_NOT_OK(file_writer->WriteRecordBatch(record_batch));
+  ARROW_RETURN_NOT_OK(file_writer->Close());
+  ARROW_ASSIGN_OR_RAISE(auto size, output_stream->Tell());
+  ARROW_RETURN_NOT_OK(output_stream->Close());
+  return std::shared_ptr<SpillFile>(new SpillFile(std::move(path), size));
+}
+
+SpillFile::~SpillFile() {
+  if (std::remove(path_.c_str()) != 0) {
+    spdlog::warn("Can't remove spill file {}", path_);
+  }
+}
+
+arrow::Result<std::shared_ptr<arrow::RecordBatch>> SpillFile::read() const {
+  ARROW_ASSIGN_OR_RAISE(
+      auto mapped_file,
+      arrow::io::MemoryMappedFile::Open(path_, arrow::io::FileMode::READ));
+
+  ARROW_ASSIGN_OR_RAISE(auto file_reader,
+                        arrow::ipc::RecordBatchFileReader::Open(mapped_file));
+
+  if (file_reader->num_record_batches() != 1) {
+    return arrow::Status::IOError(fmt::format(
+        "Spill file {} is expected to contain exactly one record batch",
+        path_));
+  }
+
+  return file_reader->ReadRecordBatch(0);
+}
+
 }  // namespace serialize_utils
 }  // namespace stream_data_processor
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <arrow/api.h>
@@ -17,5 +18,33 @@ arrow::Result<arrow::BufferVector> serializeRecordBatches(
 arrow::Result<arrow::RecordBatchVector> deserializeRecordBatches(
     const arrow::Buffer& buffer);
 
+// Record batch written to a local Arrow IPC file. The file is removed when
+// the last reference to SpillFile is released.
+class SpillFile {
+ public:
+  static arrow::Result<std::shared_ptr<SpillFile>> create(
+      std::string path, const arrow::RecordBatch& record_batch);
+
+  ~SpillFile();
+
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  // Reads the record batch back from the memory-mapped file without copying
+  // its buffers.
+  arrow::Result<std::shared_ptr<arrow::RecordBatch>> read() const;
+
+  [[nodiscard]] const std::string& getPath() const { return path_; }
+  [[nodiscard]] int64_t getSize() const { return size_; }
+
+ private:
+  SpillFile(std::string path, int64_t size)
+      : path_(std::move(path)), size_(size) {}
+
+ private:
+  std::string path_;
+  int64_t size_;
+};
+
 }  // namespace serialize_utils
 }  // namespace stream_data_processor
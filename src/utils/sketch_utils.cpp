@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "sketch_utils.h"
+
+namespace stream_data_processor {
+namespace sketch_utils {
+
+namespace {
+
+inline constexpr double MIN_INDEXABLE_VALUE = 1e-9;
+
+inline constexpr uint8_t MIN_PRECISION = 4;
+inline constexpr uint8_t MAX_PRECISION = 18;
+
+}  // namespace
+
+DDSketch::DDSketch(double relative_accuracy, size_t max_buckets_number)
+    : gamma_((1 + relative_accuracy) / (1 - relative_accuracy)),
+      log_gamma_(std::log(gamma_)),
+      max_buckets_number_(std::max<size_t>(max_buckets_number, 1)) {}
+
+void DDSketch::add(double value) {
+  if (std::isnan(value)) {
+    return;
+  }
+
+  if (value > MIN_INDEXABLE_VALUE) {
+    ++positive_buckets_[getKey(value)];
+    collapse(&positive_buckets_);
+  } else if (value < -MIN_INDEXABLE_VALUE) {
+    ++negative_buckets_[getKey(-value)];
+    collapse(&negative_buckets_);
+  } else {
+    ++zero_count_;
+  }
+
+  ++count_;
+}
+
+void DDSketch::merge(const DDSketch& other) {
+  for (auto& [key, count] : other.positive_buckets_) {
+    positive_buckets_[key] += count;
+  }
+
+  for (auto& [key, count] : other.negative_buckets_) {
+    negative_buckets_[key] += count;
+  }
+
+  collapse(&positive_buckets_);
+  collapse(&negative_buckets_);
+  zero_count_ += other.zero_count_;
+  count_ += other.count_;
+}
+
+double DDSketch::getQuantile(double quantile) const {
+  if (count_ == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  auto rank = std::clamp(quantile, 0.0, 1.0) * (count_ - 1);
+
+  int64_t counted = 0;
+  for (auto bucket = negative_buckets_.rbegin();
+       bucket != negative_buckets_.rend(); ++bucket) {
+    counted += bucket->second;
+    if (counted > rank) {
+      return -getValue(bucket->first);
+    }
+  }
+
+  counted += zero_count_;
+  if (counted > rank) {
+    return 0;
+  }
+
+  for (auto& [key, count] : positive_buckets_) {
+    counted += count;
+    if (counted > rank) {
+      return getValue(key);
+    }
+  }
+
+  if (positive_buckets_.empty()) {
+    return 0;
+  }
+
+  return getValue(positive_buckets_.rbegin()->first);
+}
+
+int32_t DDSketch::getKey(double value) const {
+  return static_cast<int32_t>(std::ceil(std::log(value) / log_gamma_));
+}
+
+double DDSketch::getValue(int32_t key) const {
+  return 2 * std::exp(key * log_gamma_) / (gamma_ + 1);
+}
+
+void DDSketch::collapse(std::map<int32_t, int64_t>* buckets) const {
+  while (buckets->size() > max_buckets_number_) {
+    auto lowest_bucket = buckets->begin();
+    std::next(lowest_bucket)->second += lowest_bucket->second;
+    buckets->erase(lowest_bucket);
+  }
+}
+
+HyperLogLog::HyperLogLog(uint8_t precision)
+    : precision_(std::clamp(precision, MIN_PRECISION, MAX_PRECISION)),
+      registers_(size_t{1} << precision_, 0) {}
+
+void HyperLogLog::add(uint64_t hash) {
+  auto register_idx = hash >> (64 - precision_);
+  auto remaining_bits =
+      (hash << precision_) | (uint64_t{1} << (precision_ - 1));
+  auto rank = static_cast<uint8_t>(__builtin_clzll(remaining_bits) + 1);
+  registers_[register_idx] = std::max(registers_[register_idx], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+  if (other.precision_ != precision_) {
+    return;
+  }
+
+  for (size_t i = 0; i < registers_.size(); ++i) {
+    registers_[i] = std::max(registers_[i], other.registers_[i]);
+  }
+}
+
+int64_t HyperLogLog::getEstimate() const {
+  auto registers_number = static_cast<double>(registers_.size());
+
+  double inverse_sum = 0;
+  size_t zero_registers = 0;
+  for (auto register_value : registers_) {
+    inverse_sum += std::ldexp(1.0, -register_value);
+    if (register_value == 0) {
+      ++zero_registers;
+    }
+  }
+
+  double alpha;
+  switch (registers_.size()) {
+    case 16:
+      alpha = 0.673;
+      break;
+    case 32:
+      alpha = 0.697;
+      break;
+    case 64:
+      alpha = 0.709;
+      break;
+    default:
+      alpha = 0.7213 / (1 + 1.079 / registers_number);
+  }
+
+  auto estimate = alpha * registers_number * registers_number / inverse_sum;
+
+  if (estimate <= 2.5 * registers_number && zero_registers != 0) {
+    estimate =
+        registers_number * std::log(registers_number / zero_registers);
+  }
+
+  return std::llround(estimate);
+}
+
+uint64_t hash(uint64_t value) {
+  value += 0x9e3779b97f4a7c15;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+uint64_t hash(const void* data, size_t size) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  uint64_t fnv_hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < size; ++i) {
+    fnv_hash = (fnv_hash ^ bytes[i]) * 0x100000001b3;
+  }
+
+  return hash(fnv_hash);
+}
+
+}  // namespace sketch_utils
+}  // namespace stream_data_processor
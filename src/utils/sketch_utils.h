@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace stream_data_processor {
+namespace sketch_utils {
+
+// Quantiles sketch with relative accuracy guarantee (DDSketch). Values are
+// counted in logarithmically sized buckets, number of buckets is bounded by
+// collapsing the buckets of the smallest magnitude.
+class DDSketch {
+ public:
+  explicit DDSketch(double relative_accuracy = 0.01,
+                    size_t max_buckets_number = 2048);
+
+  void add(double value);
+  void merge(const DDSketch& other);
+
+  // Returns NaN for empty sketch.
+  [[nodiscard]] double getQuantile(double quantile) const;
+
+  [[nodiscard]] int64_t getCount() const { return count_; }
+
+ private:
+  [[nodiscard]] int32_t getKey(double value) const;
+  [[nodiscard]] double getValue(int32_t key) const;
+
+  void collapse(std::map<int32_t, int64_t>* buckets) const;
+
+ private:
+  double gamma_;
+  double log_gamma_;
+  size_t max_buckets_number_;
+  std::map<int32_t, int64_t> positive_buckets_;
+  std::map<int32_t, int64_t> negative_buckets_;
+  int64_t zero_count_{0};
+  int64_t count_{0};
+};
+
+// Distinct values count estimator (HyperLogLog) taking 2^precision bytes.
+class HyperLogLog {
+ public:
+  explicit HyperLogLog(uint8_t precision = 12);
+
+  void add(uint64_t hash);
+  void merge(const HyperLogLog& other);
+
+  [[nodiscard]] int64_t getEstimate() const;
+
+ private:
+  uint8_t precision_;
+  std::vector<uint8_t> registers_;
+};
+
+uint64_t hash(uint64_t value);
+uint64_t hash(const void* data, size_t size);
+
+}  // namespace sketch_utils
+}  // namespace stream_data_processor
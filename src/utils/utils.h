@@ -4,6 +4,7 @@
 #include "compute_utils.h"
 #include "convert_utils.h"
 #include "serialize_utils.h"
+#include "sketch_utils.h"
 #include "string_utils.h"
 #include "time_utils.h"
 #include "transport_utils.h"
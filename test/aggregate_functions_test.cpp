@@ -5,6 +5,7 @@
 #include <catch2/catch.hpp>
 
 #include "record_batch_handlers/aggregate_functions/aggregate_functions.h"
+#include "record_batch_handlers/aggregate_functions/column_accumulator.h"
 #include "test_help.h"
 
 using namespace stream_data_processor;
@@ -46,3 +47,84 @@ TEST_CASE( "mean of even and odd integers is non integer", "[MeanAggregateFuncti
   arrowAssignOrRaise(result, result->CastTo(arrow::float64()));
   REQUIRE( std::static_pointer_cast<arrow::DoubleScalar>(result)->value == 0.5 );
 }
+
+TEST_CASE( "accumulator computes all statistics of groups in one pass", "[ColumnAccumulator]" ) {
+  std::vector<int64_t> times{3, 1, 2, 5, 4};
+
+  arrow::Int64Builder array_builder;
+  arrowAssertNotOk(array_builder.AppendValues({10, 20, 30, 40, 50}));
+  std::shared_ptr<arrow::Array> array;
+  arrowAssertNotOk(array_builder.Finish(&array));
+
+  ColumnAccumulator accumulator(arrow::int64());
+  arrowAssertNotOk(accumulator.consume(array, times.data(), {0, 0, 1, 1, 0}));
+  REQUIRE( accumulator.getGroupsNumber() == 2 );
+
+  std::shared_ptr<arrow::Array> result;
+  arrowAssignOrRaise(result, accumulator.finish(ColumnAccumulator::kFirstValue));
+  REQUIRE( std::static_pointer_cast<arrow::Int64Array>(result)->Value(0) == 20 );
+  REQUIRE( std::static_pointer_cast<arrow::Int64Array>(result)->Value(1) == 30 );
+
+  arrowAssignOrRaise(result, accumulator.finish(ColumnAccumulator::kLastValue));
+  REQUIRE( std::static_pointer_cast<arrow::Int64Array>(result)->Value(0) == 50 );
+  REQUIRE( std::static_pointer_cast<arrow::Int64Array>(result)->Value(1) == 40 );
+
+  arrowAssignOrRaise(result, accumulator.finish(ColumnAccumulator::kMinValue));
+  REQUIRE( std::static_pointer_cast<arrow::Int64Array>(result)->Value(0) == 10 );
+
+  arrowAssignOrRaise(result, accumulator.finish(ColumnAccumulator::kMaxValue));
+  REQUIRE( std::static_pointer_cast<arrow::Int64Array>(result)->Value(1) == 40 );
+
+  arrowAssignOrRaise(result, accumulator.finish(ColumnAccumulator::kMeanValue));
+  REQUIRE( std::static_pointer_cast<arrow::DoubleArray>(result)->Value(0) == 80.0 / 3 );
+  REQUIRE( std::static_pointer_cast<arrow::DoubleArray>(result)->Value(1) == 35 );
+
+  ColumnAccumulator merged(arrow::int64());
+  arrowAssertNotOk(merged.merge(accumulator, {0, 0}));
+  REQUIRE( merged.getGroupsNumber() == 1 );
+
+  arrowAssignOrRaise(result, merged.finish(ColumnAccumulator::kLastValue));
+  REQUIRE( std::static_pointer_cast<arrow::Int64Array>(result)->Value(0) == 40 );
+
+  arrowAssignOrRaise(result, merged.finish(ColumnAccumulator::kMeanValue));
+  REQUIRE( std::static_pointer_cast<arrow::DoubleArray>(result)->Value(0) == 30 );
+}
+
+TEST_CASE( "accumulator sums integers exactly for mean", "[ColumnAccumulator]" ) {
+  std::vector<int64_t> times{1, 2, 3, 4, 5};
+
+  // 2^53 + 1 is not representable as double, so adding ones to the double
+  // sum loses them
+  arrow::Int64Builder array_builder;
+  arrowAssertNotOk(array_builder.AppendValues({int64_t{1} << 53, 1, 1, 1, 1}));
+  std::shared_ptr<arrow::Array> array;
+  arrowAssertNotOk(array_builder.Finish(&array));
+
+  ColumnAccumulator accumulator(arrow::int64());
+  arrowAssertNotOk(accumulator.consume(array, times.data(), 0));
+
+  std::shared_ptr<arrow::Array> result;
+  arrowAssignOrRaise(result, accumulator.finish(ColumnAccumulator::kMeanValue));
+  REQUIRE( std::static_pointer_cast<arrow::DoubleArray>(result)->Value(0) == 9007199254740996.0 / 5 );
+}
+
+TEST_CASE( "accumulator computes mean of timestamps as a timestamp", "[ColumnAccumulator]" ) {
+  std::vector<int64_t> times{1, 2};
+
+  // Nanosecond timestamps are not representable as doubles
+  auto type = arrow::timestamp(arrow::TimeUnit::NANO);
+  arrow::TimestampBuilder array_builder(type, arrow::default_memory_pool());
+  arrowAssertNotOk(array_builder.AppendValues(
+      {1700000000000000001, 1700000000000000004}));
+  std::shared_ptr<arrow::Array> array;
+  arrowAssertNotOk(array_builder.Finish(&array));
+
+  ColumnAccumulator accumulator(type);
+  arrowAssertNotOk(accumulator.consume(array, times.data(), 0));
+  REQUIRE( ColumnAccumulator::getResultType(type, ColumnAccumulator::kMeanValue)->Equals(type) );
+
+  std::shared_ptr<arrow::Array> result;
+  arrowAssignOrRaise(result, accumulator.finish(ColumnAccumulator::kMeanValue));
+  REQUIRE( result->type()->Equals(type) );
+  REQUIRE( std::static_pointer_cast<arrow::TimestampArray>(result)->Value(0) == 1700000000000000002 );
+}
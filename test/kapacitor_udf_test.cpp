@@ -17,6 +17,7 @@
 #include "record_batch_handlers/aggregate_handler.h"
 #include "record_batch_handlers/pipeline_handler.h"
 #include "record_batch_handlers/record_batch_handler.h"
+#include "record_batch_handlers/stateful_handlers/window_handler.h"
 #include "kapacitor_udf/kapacitor_udf.h"
 #include "kapacitor_udf/utils/grouping_utils.h"
 #include "kapacitor_udf/utils/points_converter.h"
@@ -168,6 +169,55 @@ SCENARIO("AggregateOptionsParser behavior", "[AggregateOptionsParser]") {
                     == AggregateHandler::kLast);
       }
     }
+
+    WHEN ("init_request contains percentile and distinct count functions") {
+      auto aggregates_option = init_request.mutable_options()->Add();
+      aggregates_option->set_name(AggregateOptionsParser::AGGREGATES_OPTION_NAME);
+      aggregates_option->mutable_values()->Add()->set_stringvalue(
+          "p99.5(latency) as latency.p99.5");
+      aggregates_option->mutable_values()->Add()->set_stringvalue(
+          "count_distinct(host) as hosts");
+
+      auto time_rule_option = init_request.mutable_options()->Add();
+      time_rule_option->set_name(AggregateOptionsParser::TIME_AGGREGATE_RULE_OPTION_NAME);
+      time_rule_option->mutable_values()->Add()->set_stringvalue("last");
+
+      THEN("parsing is successful with sketch aggregate functions") {
+        auto aggregate_options =
+            AggregateOptionsParser::parseOptions(init_request.options());
+
+        REQUIRE(aggregate_options.aggregate_columns.size() == 2);
+        const auto& latency_case =
+            aggregate_options.aggregate_columns["latency"].at(0);
+        REQUIRE(latency_case.aggregate_function == AggregateHandler::kQuantile);
+        REQUIRE(latency_case.quantile == Approx(0.995));
+        REQUIRE(latency_case.result_column_name == "latency.p99.5");
+
+        const auto& host_case =
+            aggregate_options.aggregate_columns["host"].at(0);
+        REQUIRE(host_case.aggregate_function
+                    == AggregateHandler::kCountDistinct);
+        REQUIRE(host_case.result_column_name == "hosts");
+      }
+    }
+
+    WHEN ("time aggregate rule is not a time aggregate function") {
+      auto time_rule_option = init_request.mutable_options()->Add();
+      time_rule_option->set_name(AggregateOptionsParser::TIME_AGGREGATE_RULE_OPTION_NAME);
+      auto time_rule_option_value = time_rule_option->mutable_values()->Add();
+
+      THEN("parsing fails") {
+        time_rule_option_value->set_stringvalue("count_distinct");
+        REQUIRE_THROWS_AS(
+            AggregateOptionsParser::parseOptions(init_request.options()),
+            InvalidOptionException);
+
+        time_rule_option_value->set_stringvalue("p50");
+        REQUIRE_THROWS_AS(
+            AggregateOptionsParser::parseOptions(init_request.options()),
+            InvalidOptionException);
+      }
+    }
   }
 }
 
@@ -489,6 +539,17 @@ TEST_CASE("successfully parses DynamicWindowUDF options with alternative configu
   options[emit_timeout_option_name].set_durationvalue(
       std::chrono::duration_cast<std::chrono::nanoseconds>(10s).count());
 
+  std::string idle_timeout_option_name{"idleTimeout"};
+  options[idle_timeout_option_name] = {};
+  options[idle_timeout_option_name].set_type(agent::DURATION);
+  options[idle_timeout_option_name].set_durationvalue(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(30s).count());
+
+  std::string late_rows_measurement_option_name{"lateRowsMeasurement"};
+  options[late_rows_measurement_option_name] = {};
+  options[late_rows_measurement_option_name].set_type(agent::STRING);
+  options[late_rows_measurement_option_name].set_stringvalue("late");
+
   google::protobuf::RepeatedPtrField<agent::Option> request_options;
   for (auto& [option_name, option_value] : options) {
     auto new_option = request_options.Add();
@@ -501,6 +562,9 @@ TEST_CASE("successfully parses DynamicWindowUDF options with alternative configu
 
   REQUIRE( (60s).count() == parsed_options.window_handler_options.period.count()  );
   REQUIRE( (1s).count() == parsed_options.window_handler_options.every.count() );
+  REQUIRE( parsed_options.window_handler_options.idle_timeout == 30s );
+  REQUIRE( parsed_options.window_handler_options.keep_late_rows );
+  REQUIRE( parsed_options.window_handler_options.late_rows_measurement == "late" );
   REQUIRE( !parsed_options.window_handler_options.fill_period );
   REQUIRE( !parsed_options.convert_options.period_option.has_value() );
 
@@ -674,7 +738,14 @@ TEST_CASE("DynamicWindowUDF info response is right", "[DynamicWindowUDF]") {
       {"defaultEvery", agent::DURATION},
       {"emitTimeout", agent::DURATION},
       {"staticPeriod", agent::DURATION},
-      {"staticEvery", agent::DURATION}
+      {"staticEvery", agent::DURATION},
+      {"allowedLateness", agent::DURATION},
+      {"idleTimeout", agent::DURATION},
+      {"lateRowsMeasurement", agent::STRING},
+      {"memoryBudget", agent::INT},
+      {"spillDirectory", agent::STRING},
+      {"groupIdleTimeout", agent::DURATION},
+      {"maxGroups", agent::INT}
   };
 
   std::string fill_period_option_name{"fillPeriod"};
@@ -718,7 +789,9 @@ TEST_CASE( "DerivativeUDF info response is right", "[DerivativeUDF]" ) {
       {"order", agent::INT},
       {"unit", agent::DURATION},
       {"neighbourhood", agent::DURATION},
-      {"emitTimeout", agent::DURATION}
+      {"emitTimeout", agent::DURATION},
+      {"groupIdleTimeout", agent::DURATION},
+      {"maxGroups", agent::INT}
   };
 
   std::unordered_set<std::string> info_options;
@@ -885,3 +958,213 @@ TEST_CASE("successfully parses DerivativeUDF default options with multiple deriv
   REQUIRE( 2 == derivative_cases.at("cpu_nice_der").order );
   REQUIRE( "cpu_nice" == derivative_cases.at("cpu_nice_der").values_column_name );
 }
+
+TEST_CASE( "StatefulThresholdUDF handles points one by one", "[StatefulThresholdUDF]" ) {
+  using namespace std::chrono_literals;
+
+  auto mock_agent = std::make_shared<::testing::StrictMock<MockUDFAgent>>();
+  StatefulThresholdRequestHandler request_handler(mock_agent.get());
+
+  agent::InitRequest init_request;
+  auto add_option = [&init_request](const std::string& name) {
+    auto option = init_request.add_options();
+    option->set_name(name);
+    return option->add_values();
+  };
+
+  auto value = add_option("watch");
+  value->set_type(agent::STRING);
+  value->set_stringvalue("value");
+  value = add_option("as");
+  value->set_type(agent::STRING);
+  value->set_stringvalue("level");
+  value = add_option("defaultLevel");
+  value->set_type(agent::DOUBLE);
+  value->set_doublevalue(10);
+  value = add_option("increaseScaleFactor");
+  value->set_type(agent::DOUBLE);
+  value->set_doublevalue(2);
+  value = add_option("increaseAfter");
+  value->set_type(agent::DURATION);
+  value->set_durationvalue(std::chrono::nanoseconds(5s).count());
+
+  auto init_response = request_handler.init(init_request);
+  REQUIRE( init_response.init().success() );
+
+  std::vector<double> levels;
+  EXPECT_CALL(*mock_agent, writeResponse(::testing::_))
+      .Times(3)
+      .WillRepeatedly([&levels](const agent::Response& response) {
+        levels.push_back(response.point().fieldsdouble().at("level"));
+      });
+
+  agent::Point point;
+  point.set_name("name");
+  point.set_group("host=a");
+  for (int64_t seconds : {100, 103, 106}) {
+    point.set_time(seconds * 1000000000);
+    (*point.mutable_fieldsint())["value"] = 15;
+    request_handler.point(point);
+  }
+
+  REQUIRE( levels == std::vector<double>{10, 10, 20} );
+}
+
+TEST_CASE( "StatefulThresholdUDF drops state machines of groups above the limit", "[StatefulThresholdUDF]" ) {
+  using namespace std::chrono_literals;
+
+  auto mock_agent = std::make_shared<::testing::StrictMock<MockUDFAgent>>();
+  StatefulThresholdRequestHandler request_handler(mock_agent.get());
+
+  agent::InitRequest init_request;
+  auto add_option = [&init_request](const std::string& name) {
+    auto option = init_request.add_options();
+    option->set_name(name);
+    return option->add_values();
+  };
+
+  auto value = add_option("watch");
+  value->set_type(agent::STRING);
+  value->set_stringvalue("value");
+  value = add_option("as");
+  value->set_type(agent::STRING);
+  value->set_stringvalue("level");
+  value = add_option("defaultLevel");
+  value->set_type(agent::DOUBLE);
+  value->set_doublevalue(10);
+  value = add_option("increaseScaleFactor");
+  value->set_type(agent::DOUBLE);
+  value->set_doublevalue(2);
+  value = add_option("increaseAfter");
+  value->set_type(agent::DURATION);
+  value->set_durationvalue(std::chrono::nanoseconds(5s).count());
+  value = add_option("maxGroups");
+  value->set_type(agent::INT);
+  value->set_intvalue(1);
+
+  auto init_response = request_handler.init(init_request);
+  REQUIRE( init_response.init().success() );
+
+  std::vector<double> levels;
+  EXPECT_CALL(*mock_agent, writeResponse(::testing::_))
+      .Times(5)
+      .WillRepeatedly([&levels](const agent::Response& response) {
+        levels.push_back(response.point().fieldsdouble().at("level"));
+      });
+
+  agent::Point point;
+  point.set_name("name");
+  for (auto& [group, seconds] : std::vector<std::pair<std::string, int64_t>>{
+           {"host=a", 100}, {"host=a", 103}, {"host=a", 106},
+           {"host=b", 107}, {"host=a", 108}}) {
+    point.set_group(group);
+    point.set_time(seconds * 1000000000);
+    (*point.mutable_fieldsint())["value"] = 15;
+    request_handler.point(point);
+  }
+
+  REQUIRE( levels == std::vector<double>{10, 10, 20, 10, 10} );
+}
+
+TEST_CASE( "StatefulThresholdUDF restores groups states from snapshot", "[StatefulThresholdUDF]" ) {
+  using namespace std::chrono_literals;
+
+  auto mock_agent = std::make_shared<::testing::NiceMock<MockUDFAgent>>();
+
+  agent::InitRequest init_request;
+  auto add_option = [&init_request](const std::string& name) {
+    auto option = init_request.add_options();
+    option->set_name(name);
+    return option->add_values();
+  };
+
+  auto value = add_option("watch");
+  value->set_type(agent::STRING);
+  value->set_stringvalue("value");
+  value = add_option("as");
+  value->set_type(agent::STRING);
+  value->set_stringvalue("level");
+  value = add_option("defaultLevel");
+  value->set_type(agent::DOUBLE);
+  value->set_doublevalue(10);
+  value = add_option("increaseScaleFactor");
+  value->set_type(agent::DOUBLE);
+  value->set_doublevalue(2);
+  value = add_option("increaseAfter");
+  value->set_type(agent::DURATION);
+  value->set_durationvalue(std::chrono::nanoseconds(5s).count());
+
+  std::vector<double> levels;
+  ON_CALL(*mock_agent, writeResponse(::testing::_))
+      .WillByDefault([&levels](const agent::Response& response) {
+        levels.push_back(response.point().fieldsdouble().at("level"));
+      });
+
+  agent::Point point;
+  point.set_name("name");
+  point.set_group("host=a");
+  (*point.mutable_fieldsint())["value"] = 15;
+
+  agent::RestoreRequest restore_request;
+  {
+    StatefulThresholdRequestHandler request_handler(mock_agent.get());
+    REQUIRE( request_handler.init(init_request).init().success() );
+    for (int64_t seconds : {100, 103, 106}) {
+      point.set_time(seconds * 1000000000);
+      request_handler.point(point);
+    }
+
+    restore_request.set_snapshot(request_handler.snapshot().snapshot().snapshot());
+  }
+
+  StatefulThresholdRequestHandler request_handler(mock_agent.get());
+  REQUIRE( request_handler.init(init_request).init().success() );
+  REQUIRE( request_handler.restore(restore_request).restore().success() );
+
+  point.set_time(107 * 1000000000L);
+  request_handler.point(point);
+  REQUIRE( levels == std::vector<double>{10, 10, 20, 20} );
+
+  restore_request.set_snapshot("invalid");
+  REQUIRE( !request_handler.restore(restore_request).restore().success() );
+}
+
+TEST_CASE( "window of several buffered batches is sent as one batch", "[PointsStorage]" ) {
+  using namespace std::chrono_literals;
+
+  auto mock_agent = std::make_shared<::testing::StrictMock<MockUDFAgent>>();
+  BasePointsConverter::PointsToRecordBatchesConversionOptions
+      to_record_batches_options{"time", "measurement"};
+
+  WindowHandler::WindowOptions window_options{10s, 10s};
+  storage_utils::PointsStorage points_storage(
+      mock_agent.get(),
+      std::make_unique<BasePointsConverter>(to_record_batches_options),
+      std::make_unique<WindowHandler>(window_options),
+      true);
+
+  std::vector<agent::Response> responses;
+  EXPECT_CALL(*mock_agent, writeResponse(::testing::_))
+      .WillRepeatedly([&responses](const agent::Response& response) {
+        responses.push_back(response);
+      });
+
+  agent::Point point;
+  point.set_name("name");
+  point.set_group("");
+  for (int64_t seconds : {100, 105, 111}) {
+    point.set_time(seconds * 1000000000);
+    (*point.mutable_fieldsint())["value"] = seconds;
+    points_storage.addPoint(point);
+    arrowAssertNotOk(points_storage.handleBatch());
+    points_storage.clear();
+  }
+
+  REQUIRE( responses.size() == 4 );
+  REQUIRE( responses[0].has_begin() );
+  REQUIRE( responses[0].begin().size() == 2 );
+  REQUIRE( responses[1].point().time() == 100000000000 );
+  REQUIRE( responses[2].point().time() == 105000000000 );
+  REQUIRE( responses[3].has_end() );
+  REQUIRE( responses[3].end().tmax() == 105000000000 );
+}
@@ -1,4 +1,5 @@
 #include <memory>
+#include <string>
 
 #include <catch2/catch.hpp>
 
@@ -23,3 +24,27 @@ TEST_CASE( "setting column type", "[metadata]" ) {
 
   REQUIRE( metadata::getColumnType(*record_batch->schema()->GetFieldByName(column_name)) == metadata::FIELD );
 }
+
+TEST_CASE( "column types of schemas differing in metadata only share fields", "[metadata]" ) {
+  std::string column_name{"field_name"};
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(1));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(column_name, {0}, metadata::UNKNOWN));
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  arrow::RecordBatchVector record_batches;
+  for (int i = 0; i < 2; ++i) {
+    record_batches.push_back(record_batch->ReplaceSchemaMetadata(
+        arrow::key_value_metadata({"chunk_id"}, {std::to_string(i)})));
+
+    arrowAssertNotOk(metadata::setColumnTypeMetadata(
+        &record_batches.back(), column_name, metadata::FIELD));
+  }
+
+  REQUIRE( record_batches[0]->schema()->field(0) == record_batches[1]->schema()->field(0) );
+  REQUIRE( metadata::getColumnType(*record_batches[1]->schema()->field(0)) == metadata::FIELD );
+  REQUIRE( record_batches[0]->schema()->metadata()->Get("chunk_id").ValueOrDie() == "0" );
+  REQUIRE( record_batches[1]->schema()->metadata()->Get("chunk_id").ValueOrDie() == "1" );
+}
@@ -8,6 +8,7 @@
 #include <catch2/catch.hpp>
 
 #include "test_help.h"
+#include "metadata/column_typing.h"
 #include "nodes/data_handlers/parsers/graphite_parser.h"
 
 using namespace stream_data_processor;
@@ -256,3 +257,25 @@ TEST_CASE( "merge two metrics with the same tag values set into the one record",
   checkValue<int64_t, arrow::Int64Scalar>(50, record_batch_vector[0],
                                           "cpu.value", 0);
 }
+
+TEST_CASE( "parse with dictionary-encoded tags", "[GraphiteParser]" ) {
+  GraphiteParser::GraphiteParserOptions parser_options {{
+    "measurement.measurement.field.field.region"
+  }, "time", ".", "measurement", true};
+  std::shared_ptr<Parser> parser = std::make_shared<GraphiteParser>(parser_options);
+  auto metric_buffer = arrow::Buffer::FromString(
+      "cpu.usage.idle.percent.eu-east 100\ncpu.usage.idle.percent.eu-west 90");
+  arrow::RecordBatchVector record_batch_vector;
+  arrowAssignOrRaise(record_batch_vector, parser->parseRecordBatches(*metric_buffer));
+
+  REQUIRE( record_batch_vector.size() == 1 );
+  auto& record_batch = record_batch_vector[0];
+  checkSize(record_batch, 2, 4);
+  REQUIRE( record_batch->GetColumnByName("measurement")->type_id() == arrow::Type::DICTIONARY );
+  REQUIRE( record_batch->GetColumnByName("region")->type_id() == arrow::Type::DICTIONARY );
+  REQUIRE( record_batch->GetColumnByName("idle.percent")->type_id() == arrow::Type::INT64 );
+
+  std::string measurement;
+  arrowAssignOrRaise(measurement, metadata::getMeasurementAndValidate(*record_batch));
+  REQUIRE( measurement == "cpu.usage" );
+}
@@ -1,6 +1,9 @@
 #include <chrono>
 #include <ctime>
+#include <filesystem>
+#include <limits>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <arrow/api.h>
@@ -8,6 +11,7 @@
 #include <gmock/gmock.h>
 #include <catch2/catch.hpp>
 
+#include "metadata/chunking.h"
 #include "metadata/column_typing.h"
 #include "metadata/grouping.h"
 #include "metadata/time_metadata.h"
@@ -74,6 +78,182 @@ TEST_CASE ( "filter one of two strings based on equal function", "[FilterHandler
                                           "field_name", 0);
 }
 
+TEST_CASE( "filter avoids materialization when selected rows are contiguous", "[FilterHandler]" ) {
+  auto field = arrow::field("field_name", arrow::int64());
+  auto schema = arrow::schema({field});
+
+  arrow::Int64Builder array_builder;
+  arrowAssertNotOk(array_builder.AppendValues({0, 1, 1, 0}));
+  std::shared_ptr<arrow::Array> array;
+  arrowAssertNotOk(array_builder.Finish(&array));
+  auto record_batch = arrow::RecordBatch::Make(schema, 4, {array});
+
+  auto less_than_node = gandiva::TreeExprBuilder::MakeFunction("less_than",{
+      gandiva::TreeExprBuilder::MakeField(field),
+      gandiva::TreeExprBuilder::MakeLiteral(int64_t(2))
+  }, arrow::boolean());
+  std::vector<gandiva::ConditionPtr> all_pass_conditions{gandiva::TreeExprBuilder::MakeCondition(less_than_node)};
+  std::shared_ptr<RecordBatchHandler> all_pass_handler = std::make_shared<FilterHandler>(std::move(all_pass_conditions));
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, all_pass_handler->handle(record_batch));
+
+  REQUIRE( result.size() == 1 );
+  REQUIRE( result[0] == record_batch );
+
+  auto equal_node = gandiva::TreeExprBuilder::MakeFunction("equal",{
+      gandiva::TreeExprBuilder::MakeLiteral(int64_t(1)),
+      gandiva::TreeExprBuilder::MakeField(field)
+  }, arrow::boolean());
+  std::vector<gandiva::ConditionPtr> contiguous_conditions{gandiva::TreeExprBuilder::MakeCondition(equal_node)};
+  std::shared_ptr<RecordBatchHandler> contiguous_handler = std::make_shared<FilterHandler>(std::move(contiguous_conditions));
+
+  arrowAssignOrRaise(result, contiguous_handler->handle(record_batch));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 1);
+  REQUIRE( result[0]->column(0)->data()->buffers[1] == array->data()->buffers[1] );
+  checkValue<int64_t, arrow::Int64Scalar>(1, result[0], "field_name", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(1, result[0], "field_name", 1);
+}
+
+TEST_CASE( "selection propagated by filter is consumed by map handler", "[FilterHandler]" ) {
+  auto field = arrow::field("field_name", arrow::int64());
+  auto schema = arrow::schema({field});
+
+  arrow::Int64Builder array_builder;
+  arrowAssertNotOk(array_builder.AppendValues({0, 1, 0, 1}));
+  std::shared_ptr<arrow::Array> array;
+  arrowAssertNotOk(array_builder.Finish(&array));
+  auto record_batch = arrow::RecordBatch::Make(schema, 4, {array});
+
+  auto equal_node = gandiva::TreeExprBuilder::MakeFunction("equal",{
+      gandiva::TreeExprBuilder::MakeLiteral(int64_t(0)),
+      gandiva::TreeExprBuilder::MakeField(field)
+  }, arrow::boolean());
+  std::vector<gandiva::ConditionPtr> conditions{gandiva::TreeExprBuilder::MakeCondition(equal_node)};
+  std::shared_ptr<RecordBatchHandler> filter_handler = std::make_shared<FilterHandler>(std::move(conditions), true);
+
+  arrow::RecordBatchVector filtered;
+  arrowAssignOrRaise(filtered, filter_handler->handle(record_batch));
+
+  REQUIRE( filtered.size() == 1 );
+  REQUIRE( filtered[0]->num_rows() == 4 );
+  REQUIRE( metadata::getSelectionColumnNameMetadata(*filtered[0]).ok() );
+
+  auto add_node = gandiva::TreeExprBuilder::MakeFunction("add", {
+      gandiva::TreeExprBuilder::MakeField(field),
+      gandiva::TreeExprBuilder::MakeLiteral(int64_t(40))
+  }, arrow::int64());
+  auto result_field = arrow::field("result_field", arrow::int64());
+  std::vector<MapHandler::MapCase> map_cases{{gandiva::TreeExprBuilder::MakeExpression(add_node, result_field)}};
+  std::shared_ptr<RecordBatchHandler> map_handler = std::make_shared<MapHandler>(map_cases);
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, map_handler->handle(filtered));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 2);
+  checkColumnsArePresent(result[0], {"field_name", "result_field"});
+  REQUIRE( !metadata::getSelectionColumnNameMetadata(*result[0]).ok() );
+  for (int i = 0; i < 2; ++i) {
+    checkValue<int64_t, arrow::Int64Scalar>(0, result[0], "field_name", i);
+    checkValue<int64_t, arrow::Int64Scalar>(40, result[0], "result_field", i);
+  }
+}
+
+TEST_CASE( "selection propagated by filter is materialized by other handlers", "[FilterHandler]" ) {
+  auto field = arrow::field("field_name", arrow::int64());
+  auto schema = arrow::schema({field});
+
+  arrow::Int64Builder array_builder;
+  arrowAssertNotOk(array_builder.AppendValues({1, 0, 1, 0}));
+  std::shared_ptr<arrow::Array> array;
+  arrowAssertNotOk(array_builder.Finish(&array));
+  auto record_batch = arrow::RecordBatch::Make(schema, 4, {array});
+
+  auto equal_node = gandiva::TreeExprBuilder::MakeFunction("equal",{
+      gandiva::TreeExprBuilder::MakeLiteral(int64_t(0)),
+      gandiva::TreeExprBuilder::MakeField(field)
+  }, arrow::boolean());
+  std::vector<gandiva::ConditionPtr> conditions{gandiva::TreeExprBuilder::MakeCondition(equal_node)};
+  FilterHandler filter_handler(std::move(conditions), true);
+
+  arrow::RecordBatchVector filtered;
+  arrowAssignOrRaise(filtered, filter_handler.handle(record_batch));
+  REQUIRE( metadata::getSelectionColumnNameMetadata(*filtered[0]).ok() );
+
+  SortHandler sort_handler({"field_name"});
+  arrow::RecordBatchVector sorted;
+  arrowAssignOrRaise(sorted, sort_handler.handle(filtered));
+  REQUIRE( sorted.size() == 1 );
+  checkSize(sorted[0], 2, 1);
+  REQUIRE( !metadata::getSelectionColumnNameMetadata(*sorted[0]).ok() );
+
+  arrow::BufferVector serialized;
+  arrowAssignOrRaise(serialized, serialize_utils::serializeRecordBatches(filtered));
+  arrow::RecordBatchVector deserialized;
+  arrowAssignOrRaise(deserialized, serialize_utils::deserializeRecordBatches(*serialized[0]));
+  REQUIRE( deserialized.size() == 1 );
+  checkSize(deserialized[0], 2, 1);
+  checkValue<int64_t, arrow::Int64Scalar>(0, deserialized[0], "field_name", 1);
+}
+
+TEST_CASE( "sort, filter and map over dictionary-encoded tags", "[SortHandler][FilterHandler][MapHandler]" ) {
+  RecordBatchBuilder builder;
+  arrowAssertNotOk(builder.setRowNumber(4));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+      "time", {100, 101, 102, 103}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<std::string>(
+      "tag", {"b", "a", "c", "a"}, metadata::TAG));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(
+      "field", {0, 1, 2, 3}, metadata::FIELD));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+  arrowAssertNotOk(compute_utils::dictionaryEncodeTags(&record_batch));
+  REQUIRE( record_batch->GetColumnByName("tag")->type_id() == arrow::Type::DICTIONARY );
+
+  SortHandler sort_handler(std::vector<std::string>{"tag", "field"});
+  arrow::RecordBatchVector sorted;
+  arrowAssignOrRaise(sorted, sort_handler.handle(record_batch));
+  REQUIRE( sorted.size() == 1 );
+  checkSize(sorted[0], 4, 3);
+  std::vector<int64_t> expected_fields{1, 3, 0, 2};
+  for (int i = 0; i < 4; ++i) {
+    checkValue<int64_t, arrow::Int64Scalar>(expected_fields[i], sorted[0], "field", i);
+  }
+
+  // Gandiva sees tags decoded
+  auto tag_field = arrow::field("tag", arrow::utf8());
+  auto equal_node = gandiva::TreeExprBuilder::MakeFunction("equal",{
+      gandiva::TreeExprBuilder::MakeField(tag_field),
+      gandiva::TreeExprBuilder::MakeStringLiteral("a")
+  }, arrow::boolean());
+
+  std::vector<gandiva::ConditionPtr> conditions{gandiva::TreeExprBuilder::MakeCondition(equal_node)};
+  FilterHandler filter_handler(std::move(conditions));
+  arrow::RecordBatchVector filtered;
+  arrowAssignOrRaise(filtered, filter_handler.handle(record_batch));
+  REQUIRE( filtered.size() == 1 );
+  checkSize(filtered[0], 2, 3);
+  REQUIRE( filtered[0]->GetColumnByName("tag")->type_id() == arrow::Type::DICTIONARY );
+  checkValue<int64_t, arrow::Int64Scalar>(1, filtered[0], "field", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(3, filtered[0], "field", 1);
+
+  auto result_field = arrow::field("is_a", arrow::boolean());
+  std::vector<MapHandler::MapCase> map_cases{{gandiva::TreeExprBuilder::MakeExpression(equal_node, result_field)}};
+  MapHandler map_handler(map_cases);
+  arrow::RecordBatchVector mapped;
+  arrowAssignOrRaise(mapped, map_handler.handle(record_batch));
+  REQUIRE( mapped.size() == 1 );
+  checkSize(mapped[0], 4, 4);
+  REQUIRE( mapped[0]->GetColumnByName("tag")->type_id() == arrow::Type::DICTIONARY );
+  for (int i = 0; i < 4; ++i) {
+    checkValue<bool, arrow::BooleanScalar>(i % 2 == 1, mapped[0], "is_a", i);
+  }
+}
+
 TEST_CASE ( "split one record batch to separate ones by grouping on column with different values", "[GroupHandler]") {
   auto field = arrow::field("field_name", arrow::int64());
   auto schema = arrow::schema({field});
@@ -110,6 +290,148 @@ TEST_CASE ( "split one record batch to separate ones by grouping on column with
             metadata::extractGroupMetadata(*result[1]) );
 }
 
+TEST_CASE( "groups are returned as one multi-group record batch", "[GroupHandler]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(4));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+      "time", {100, 101, 102, 103}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<std::string>(
+      "tag", {"a", "b", "a", "b"}, metadata::TAG));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(
+      "value", {1, 2, 3, 4}, metadata::FIELD));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  GroupHandler group_handler(std::vector<std::string>{"tag"}, "group");
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, group_handler.handle(record_batch));
+  REQUIRE( result.size() == 1 );
+  REQUIRE( metadata::isMultiGroup(*result[0]) );
+  checkSize(result[0], 4, 4);
+
+  arrow::RecordBatchVector groups;
+  arrowAssignOrRaise(groups, compute_utils::splitGroups(result[0]));
+  REQUIRE( groups.size() == 2 );
+  checkSize(groups[0], 2, 3);
+  checkValue<std::string, arrow::StringScalar>("a", groups[0], "tag", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(3, groups[0], "value", 1);
+  REQUIRE( metadata::extractInternedGroup(*groups[1])->group.group_columns_values(0) == "b" );
+  REQUIRE( metadata::getColumnType(*groups[1]->schema()->GetFieldByName("tag")) == metadata::TAG );
+
+  AggregateHandler::AggregateOptions options{
+      {{"value", {{AggregateHandler::kLast, "value_last"}}}},
+      {AggregateHandler::kLast, "time"}
+  };
+
+  AggregateHandler aggregate_handler(options);
+  arrowAssignOrRaise(result, aggregate_handler.handle(result[0]));
+  REQUIRE( result.size() == 2 );
+  if (!equals<std::string, arrow::StringScalar>("a", result[0], "tag", 0)) {
+    std::swap(result[0], result[1]);
+  }
+
+  checkValue<int64_t, arrow::Int64Scalar>(3, result[0], "value_last", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(4, result[1], "value_last", 0);
+}
+
+TEST_CASE( "groups of multi-group record batches are aggregated by the group column", "[AggregateHandler]" ) {
+  GroupHandler group_handler(std::vector<std::string>{"tag"}, "group");
+
+  arrow::RecordBatchVector multi_group_batches;
+  std::vector<std::vector<std::string>> tags{{"a", "b", "a"}, {"b", "a"}};
+  std::vector<std::vector<int64_t>> times{{100, 101, 102}, {103, 104}};
+  std::vector<std::vector<int64_t>> values{{1, 2, 3}, {4, 5}};
+  for (size_t i = 0; i < tags.size(); ++i) {
+    RecordBatchBuilder builder;
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(tags[i].size()));
+    arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+        "time", times[i], arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>(
+        "tag", tags[i], metadata::TAG));
+    arrowAssertNotOk(builder.buildColumn<int64_t>(
+        "value", values[i], metadata::FIELD));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+
+    arrow::RecordBatchVector grouped;
+    arrowAssignOrRaise(grouped, group_handler.handle(record_batch));
+    REQUIRE( grouped.size() == 1 );
+    multi_group_batches.push_back(grouped[0]);
+  }
+
+  AggregateHandler::AggregateOptions options{
+      {{"value", {{AggregateHandler::kLast, "value_last"}}}},
+      {AggregateHandler::kLast, "time"}
+  };
+
+  AggregateHandler aggregate_handler(options);
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, aggregate_handler.handle(multi_group_batches));
+  REQUIRE( result.size() == 2 );
+  REQUIRE( !metadata::isMultiGroup(*result[0]) );
+
+  checkSize(result[0], 2, 3);
+  checkValue<std::string, arrow::StringScalar>("a", result[0], "tag", 0);
+  checkValue<std::string, arrow::StringScalar>("a", result[0], "tag", 1);
+  checkValue<int64_t, arrow::TimestampScalar>(102, result[0], "time", 0);
+  checkValue<int64_t, arrow::TimestampScalar>(104, result[0], "time", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(3, result[0], "value_last", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(5, result[0], "value_last", 1);
+
+  checkSize(result[1], 2, 3);
+  checkValue<std::string, arrow::StringScalar>("b", result[1], "tag", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(2, result[1], "value_last", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(4, result[1], "value_last", 1);
+  REQUIRE( metadata::extractGroupMetadata(*result[0]) !=
+           metadata::extractGroupMetadata(*result[1]) );
+}
+
+TEST_CASE( "multi-group record batches are split or rejected by group handlers", "[SortHandler][WindowHandler]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(4));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+      "time", {100, 101, 102, 103}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<std::string>(
+      "tag", {"a", "b", "a", "b"}, metadata::TAG));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(
+      "value", {1, 2, 3, 4}, metadata::FIELD));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  GroupHandler group_handler(std::vector<std::string>{"tag"}, "group");
+  arrow::RecordBatchVector grouped;
+  arrowAssignOrRaise(grouped, group_handler.handle(record_batch));
+  REQUIRE( grouped.size() == 1 );
+
+  SortHandler::SortOptions options{{
+      {"value", compute_utils::kDescending}
+  }};
+
+  options.limit = 1;
+  SortHandler sort_handler(options);
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, sort_handler.handle(grouped[0]));
+  REQUIRE( result.size() == 2 );
+  checkSize(result[0], 1, 3);
+  checkValue<std::string, arrow::StringScalar>("a", result[0], "tag", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(3, result[0], "value", 0);
+  checkSize(result[1], 1, 3);
+  checkValue<std::string, arrow::StringScalar>("b", result[1], "tag", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(4, result[1], "value", 0);
+
+  WindowHandler window_handler(WindowHandler::WindowOptions{
+      std::chrono::seconds(5), std::chrono::seconds(5)});
+  REQUIRE( !window_handler.handle(grouped[0]).ok() );
+}
+
 TEST_CASE( "add new columns to empty record batch with different schema", "[DefaultHandler]") {
   auto schema = arrow::schema({arrow::field("field", arrow::null())});
 
@@ -173,6 +495,53 @@ TEST_CASE( "add new columns with default values to record batch with different s
                                           "string_field", 0);
 }
 
+
+class ColumnTypesCopyingHandler : public RecordBatchHandler {
+ public:
+  explicit ColumnTypesCopyingHandler(std::shared_ptr<arrow::RecordBatch> from)
+      : from_(std::move(from)) {
+  }
+
+  arrow::Result<arrow::RecordBatchVector> handle(
+      const std::shared_ptr<arrow::RecordBatch>& record_batch) override {
+    auto result = record_batch;
+    ARROW_RETURN_NOT_OK(copyColumnTypes(*from_, &result));
+    return arrow::RecordBatchVector{result};
+  }
+
+ private:
+  std::shared_ptr<arrow::RecordBatch> from_;
+};
+
+TEST_CASE( "column types are copied to equal fields", "[RecordBatchHandler]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(1));
+  arrowAssertNotOk(builder.buildColumn<int64_t>("field", {1}, metadata::FIELD));
+  arrowAssertNotOk(builder.buildColumn<std::string>("tag", {"tag_value"}, metadata::TAG));
+  arrowAssertNotOk(builder.buildColumn<double>("other", {3.14}, metadata::FIELD));
+  std::shared_ptr<arrow::RecordBatch> from;
+  arrowAssignOrRaise(from, builder.getResult());
+
+  auto to_schema = arrow::schema({
+      arrow::field("field", arrow::int64()),
+      arrow::field("tag", arrow::utf8()),
+      arrow::field("other", arrow::int64())
+  }, arrow::key_value_metadata({"key"}, {"value"}));
+  auto to = arrow::RecordBatch::Make(to_schema, 1, {
+      from->GetColumnByName("field"), from->GetColumnByName("tag"), from->GetColumnByName("field")
+  });
+
+  ColumnTypesCopyingHandler handler(from);
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler.handle(to));
+
+  REQUIRE( result.size() == 1 );
+  REQUIRE( metadata::getColumnType(*result[0]->schema()->GetFieldByName("field")) == metadata::FIELD );
+  REQUIRE( metadata::getColumnType(*result[0]->schema()->GetFieldByName("tag")) == metadata::TAG );
+  REQUIRE( metadata::getColumnType(*result[0]->schema()->GetFieldByName("other")) == metadata::UNKNOWN );
+  REQUIRE( result[0]->schema()->metadata()->Get("key").ValueOrDie() == "value" );
+}
 TEST_CASE( "join on timestamp and tag column", "[JoinHandler]" ) {
   auto ts_field = arrow::field("time", arrow::timestamp(arrow::TimeUnit::SECOND));
   auto tag_field = arrow::field("tag", arrow::utf8());
@@ -239,6 +608,49 @@ TEST_CASE( "join on timestamp and tag column", "[JoinHandler]" ) {
                                           "field_2", 0);
 }
 
+TEST_CASE( "join of batches with different tag dictionaries", "[JoinHandler]" ) {
+  RecordBatchBuilder builder;
+  auto make_record_batch = [&builder](const std::vector<std::string>& tags,
+                                      const std::string& field_name,
+                                      const std::vector<int64_t>& values) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(tags.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+        "time", std::vector<int64_t>(tags.size(), 100), arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>("tag", tags, metadata::TAG));
+    arrowAssertNotOk(builder.buildColumn<int64_t>(field_name, values, metadata::FIELD));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(compute_utils::dictionaryEncodeTags(&record_batch));
+    REQUIRE( record_batch->GetColumnByName("tag")->type_id() == arrow::Type::DICTIONARY );
+    return record_batch;
+  };
+
+  arrow::RecordBatchVector record_batches{
+      make_record_batch({"a", "b"}, "field_1", {1, 2}),
+      make_record_batch({"c", "b"}, "field_2", {3, 4})
+  };
+
+  std::vector<std::string> join_on_columns{"tag"};
+  std::shared_ptr<RecordBatchHandler> handler = std::make_shared<JoinHandler>(std::move(join_on_columns));
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler->handle(record_batches));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 3, 4);
+
+  std::shared_ptr<arrow::RecordBatch> decoded;
+  arrowAssignOrRaise(decoded, compute_utils::decodeDictionaries(result[0]));
+  checkValue<std::string, arrow::StringScalar>("a", decoded, "tag", 0);
+  checkValue<std::string, arrow::StringScalar>("b", decoded, "tag", 1);
+  checkValue<std::string, arrow::StringScalar>("c", decoded, "tag", 2);
+  checkValue<int64_t, arrow::Int64Scalar>(2, decoded, "field_1", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(4, decoded, "field_2", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(3, decoded, "field_2", 2);
+}
+
 TEST_CASE( "assign missed values to null", "[JoinHandler]" ) {
   auto ts_field = arrow::field("time", arrow::timestamp(arrow::TimeUnit::SECOND));
   auto tag_field = arrow::field("tag", arrow::utf8());
@@ -379,6 +791,148 @@ TEST_CASE( "join depending on tolerance", "[JoinHandler]" ) {
                                           "field_2", 0);
 }
 
+TEST_CASE( "join on integer column with int64 time column", "[JoinHandler]" ) {
+  auto time_field = arrow::field("time", arrow::int64());
+  auto id_field = arrow::field("id", arrow::int64());
+  auto field_1_field = arrow::field("field_1", arrow::int64());
+  auto field_2_field = arrow::field("field_2", arrow::int64());
+
+  arrow::Int64Builder builder;
+  std::shared_ptr<arrow::Array> time_array_1, id_array_1, field_1_array;
+  arrowAssertNotOk(builder.AppendValues({1000, 1500, 2000}));
+  arrowAssertNotOk(builder.Finish(&time_array_1));
+  arrowAssertNotOk(builder.AppendValues({1, 2, 1}));
+  arrowAssertNotOk(builder.Finish(&id_array_1));
+  arrowAssertNotOk(builder.AppendValues({10, 20, 30}));
+  arrowAssertNotOk(builder.Finish(&field_1_array));
+
+  std::shared_ptr<arrow::Array> time_array_2, id_array_2, field_2_array;
+  arrowAssertNotOk(builder.AppendValues({2400, 1200}));
+  arrowAssertNotOk(builder.Finish(&time_array_2));
+  arrowAssertNotOk(builder.AppendValues({1, 2}));
+  arrowAssertNotOk(builder.Finish(&id_array_2));
+  arrowAssertNotOk(builder.AppendValues({300, 200}));
+  arrowAssertNotOk(builder.Finish(&field_2_array));
+
+  arrow::RecordBatchVector record_batches;
+  record_batches.push_back(arrow::RecordBatch::Make(
+      arrow::schema({time_field, id_field, field_1_field}), 3,
+      {time_array_1, id_array_1, field_1_array}));
+
+  record_batches.push_back(arrow::RecordBatch::Make(
+      arrow::schema({time_field, id_field, field_2_field}), 2,
+      {time_array_2, id_array_2, field_2_array}));
+
+  for (auto& record_batch : record_batches) {
+    arrowAssertNotOk(metadata::setTimeColumnNameMetadata(&record_batch, "time"));
+    arrowAssertNotOk(metadata::setTimeUnitMetadata(&record_batch, "time", time_utils::MILLI));
+  }
+
+  std::vector<std::string> join_on_columns{"id"};
+  std::shared_ptr<RecordBatchHandler> handler = std::make_shared<JoinHandler>(std::move(join_on_columns));
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler->handle(record_batches));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 3, 4);
+  checkValue<int64_t, arrow::Int64Scalar>(1000, result[0], "time", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(10, result[0], "field_1", 0);
+  checkIsNull(result[0], "field_2", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(1500, result[0], "time", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(20, result[0], "field_1", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(200, result[0], "field_2", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(2000, result[0], "time", 2);
+  checkValue<int64_t, arrow::Int64Scalar>(30, result[0], "field_1", 2);
+  checkValue<int64_t, arrow::Int64Scalar>(300, result[0], "field_2", 2);
+
+  time_utils::TimeUnit time_unit;
+  arrowAssignOrRaise(time_unit, metadata::getTimeUnitMetadata(*result[0], "time"));
+  REQUIRE( time_unit == time_utils::MILLI );
+}
+
+SCENARIO( "streaming join of rows from different batches", "[StreamingJoinHandler]" ) {
+  GIVEN( "StreamingJoinHandler waiting for two inputs" ) {
+    StreamingJoinHandler::StreamingJoinOptions options{
+        {"tag"}, std::chrono::seconds(2), std::chrono::seconds(3), 2};
+    StreamingJoinHandler handler(options);
+
+    RecordBatchBuilder builder;
+    auto make_record_batch = [&builder](const std::string& measurement,
+                                        const std::string& field_name,
+                                        std::time_t time, int64_t value) {
+      builder.reset();
+      arrowAssertNotOk(builder.setRowNumber(1));
+      arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+          "time", {time}, arrow::TimeUnit::SECOND));
+      arrowAssertNotOk(builder.buildMeasurementColumn(
+          "measurement", {measurement}));
+      arrowAssertNotOk(builder.buildColumn<std::string>(
+          "tag", {"tag_value"}, metadata::TAG));
+      arrowAssertNotOk(builder.buildColumn<int64_t>(
+          field_name, {value}, metadata::FIELD));
+
+      std::shared_ptr<arrow::RecordBatch> record_batch;
+      arrowAssignOrRaise(record_batch, builder.getResult());
+      return record_batch;
+    };
+
+    arrow::RecordBatchVector result;
+    arrowAssignOrRaise(result, handler.handle(
+        make_record_batch("first", "field_1", 100, 42)));
+
+    WHEN( "row of the other input arrives within tolerance" ) {
+      arrowAssignOrRaise(result, handler.handle(
+          make_record_batch("second", "field_2", 101, 43)));
+
+      THEN( "joined row is emitted at once" ) {
+        REQUIRE( result.size() == 1 );
+        checkSize(result[0], 1, 5);
+        checkValue<int64_t, arrow::TimestampScalar>(100, result[0], "time", 0);
+        checkValue<int64_t, arrow::Int64Scalar>(42, result[0], "field_1", 0);
+        checkValue<int64_t, arrow::Int64Scalar>(43, result[0], "field_2", 0);
+        REQUIRE( handler.getMetrics().buffered_rows == 0 );
+        REQUIRE( handler.getMetrics().emitted_rows == 1 );
+        REQUIRE( handler.getMetrics().buffered_keys == 0 );
+      }
+    }
+
+    WHEN( "inputs of the same schema differ by dictionary-encoded measurement" ) {
+      StreamingJoinHandler encoded_handler(options);
+      for (auto& [measurement, time] :
+           std::vector<std::pair<std::string, std::time_t>>{{"first", 100}, {"second", 101}}) {
+        auto record_batch = make_record_batch(measurement, "field", time, 42);
+        arrowAssertNotOk(compute_utils::dictionaryEncodeTags(&record_batch));
+        REQUIRE( record_batch->GetColumnByName("measurement")->type_id() == arrow::Type::DICTIONARY );
+        arrowAssignOrRaise(result, encoded_handler.handle(record_batch));
+      }
+
+      THEN( "they are joined as different sources" ) {
+        REQUIRE( result.size() == 1 );
+        REQUIRE( result[0]->num_rows() == 1 );
+        REQUIRE( encoded_handler.getMetrics().buffered_rows == 0 );
+      }
+    }
+
+    WHEN( "the other input is silent longer than tolerance and grace period" ) {
+      REQUIRE( result.empty() );
+
+      arrowAssignOrRaise(result, handler.handle(
+          make_record_batch("first", "field_1", 106, 44)));
+
+      THEN( "expired slot is emitted without missing values" ) {
+        REQUIRE( result.size() == 1 );
+        checkSize(result[0], 1, 4);
+        checkValue<int64_t, arrow::TimestampScalar>(100, result[0], "time", 0);
+        checkValue<int64_t, arrow::Int64Scalar>(42, result[0], "field_1", 0);
+        REQUIRE( handler.getMetrics().buffered_rows == 1 );
+        REQUIRE( handler.getMetrics().expired_slots == 1 );
+        REQUIRE( handler.getMetrics().buffered_keys == 1 );
+      }
+    }
+  }
+}
+
 SCENARIO( "groups aggregation", "[AggregateHandler]" ) {
   GIVEN( "RecordBatches with different groups" ) {
     auto time_field =
@@ -548,6 +1102,143 @@ SCENARIO( "aggregating time", "[AggregateHandler]" ) {
   }
 }
 
+TEST_CASE( "chunks of one logical record batch are aggregated together", "[AggregateHandler]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(5));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+      "time", {100, 101, 102, 103, 104}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(
+      "value", {1, 2, 3, 4, 8}, metadata::FIELD));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  arrow::RecordBatchVector chunks{record_batch->Slice(0, 2),
+                                  record_batch->Slice(2, 2)};
+  arrowAssertNotOk(metadata::setChunksMetadata(&chunks, 0));
+  chunks.push_back(record_batch->Slice(4));
+
+  AggregateHandler::AggregateOptions options{
+      {{"value", {{AggregateHandler::kFirst, "value_first"},
+                  {AggregateHandler::kMean, "value_mean"}}}},
+      {AggregateHandler::kLast, "time"}
+  };
+
+  AggregateHandler handler(options);
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler.handle(chunks));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 3);
+  checkValue<int64_t, arrow::TimestampScalar>(103, result[0], "time", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(1, result[0], "value_first", 0);
+  checkValue<double, arrow::DoubleScalar>(2.5, result[0], "value_mean", 0);
+  checkValue<int64_t, arrow::TimestampScalar>(104, result[0], "time", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(8, result[0], "value_first", 1);
+  checkValue<double, arrow::DoubleScalar>(8, result[0], "value_mean", 1);
+}
+
+TEST_CASE( "aggregating groups in one pass", "[GroupAggregateHandler]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(5));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+      "time", {100, 101, 102, 103, 104}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<std::string>(
+      "host", {"a", "b", "a", "b", "a"}, metadata::TAG));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(
+      "value", {1, 2, 3, 4, 8}, metadata::FIELD));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  AggregateHandler::AggregateOptions options{
+      {{"value", {{AggregateHandler::kFirst, "value_first"},
+                  {AggregateHandler::kMax, "value_max"},
+                  {AggregateHandler::kMean, "value_mean"}}}},
+      {AggregateHandler::kLast, "time"}
+  };
+
+  GroupAggregateHandler handler(std::vector<std::string>{"host"}, options);
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler.handle(record_batch));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 5);
+  checkValue<int64_t, arrow::TimestampScalar>(104, result[0], "time", 0);
+  checkValue<std::string, arrow::StringScalar>("a", result[0], "host", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(1, result[0], "value_first", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(8, result[0], "value_max", 0);
+  checkValue<double, arrow::DoubleScalar>(4, result[0], "value_mean", 0);
+  checkValue<int64_t, arrow::TimestampScalar>(103, result[0], "time", 1);
+  checkValue<std::string, arrow::StringScalar>("b", result[0], "host", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(2, result[0], "value_first", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(4, result[0], "value_max", 1);
+  checkValue<double, arrow::DoubleScalar>(3, result[0], "value_mean", 1);
+}
+
+TEST_CASE( "aggregating dictionary-encoded tags", "[GroupAggregateHandler][AggregateHandler]" ) {
+  RecordBatchBuilder builder;
+  auto make_record_batch = [&builder](const std::vector<int64_t>& times,
+                                      const std::vector<std::string>& hosts,
+                                      const std::vector<std::string>& dcs) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+        "time", times, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>("host", hosts, metadata::TAG));
+    arrowAssertNotOk(builder.buildColumn<std::string>("dc", dcs, metadata::TAG));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(compute_utils::dictionaryEncodeTags(&record_batch));
+    REQUIRE( record_batch->GetColumnByName("host")->type_id() == arrow::Type::DICTIONARY );
+    return record_batch;
+  };
+
+  // Dictionaries of the record batches differ
+  arrow::RecordBatchVector record_batches{
+      make_record_batch({100, 101, 102}, {"a", "b", "a"}, {"x", "y", "y"}),
+      make_record_batch({103, 104}, {"b", "a"}, {"z", "z"})
+  };
+
+  AggregateHandler::AggregateOptions options{
+      {{"dc", {{AggregateHandler::kLast, "dc_last"},
+               {AggregateHandler::kCountDistinct, "dc_count"}}}},
+      {AggregateHandler::kLast, "time"}
+  };
+
+  GroupAggregateHandler group_aggregate_handler(std::vector<std::string>{"host"}, options);
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, group_aggregate_handler.handle(record_batches));
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 4);
+
+  std::shared_ptr<arrow::RecordBatch> decoded;
+  arrowAssignOrRaise(decoded, compute_utils::decodeDictionaries(result[0]));
+  checkValue<std::string, arrow::StringScalar>("a", decoded, "host", 0);
+  checkValue<std::string, arrow::StringScalar>("z", decoded, "dc_last", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(3, decoded, "dc_count", 0);
+  checkValue<std::string, arrow::StringScalar>("b", decoded, "host", 1);
+  checkValue<std::string, arrow::StringScalar>("z", decoded, "dc_last", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(2, decoded, "dc_count", 1);
+
+  AggregateHandler aggregate_handler(options);
+  arrowAssignOrRaise(result, aggregate_handler.handle(record_batches));
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 3);
+
+  arrowAssignOrRaise(decoded, compute_utils::decodeDictionaries(result[0]));
+  checkValue<std::string, arrow::StringScalar>("y", decoded, "dc_last", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(2, decoded, "dc_count", 0);
+  checkValue<std::string, arrow::StringScalar>("z", decoded, "dc_last", 1);
+  checkValue<int64_t, arrow::Int64Scalar>(1, decoded, "dc_count", 1);
+}
+
 using namespace std::chrono_literals;
 
 SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" ) {
@@ -565,7 +1256,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
     std::shared_ptr<ThresholdStateMachine> state_machine =
         std::static_pointer_cast<ThresholdStateMachine>(factory->createHandler());
 
-    REQUIRE(instanceOf<internal::StateOK>(state_machine->getState().get()));
+    REQUIRE(state_machine->getState().type == ThresholdStateMachine::OK);
 
     RecordBatchBuilder builder;
     builder.reset();
@@ -607,7 +1298,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
           checkValue<double, arrow::DoubleScalar>(
               options.default_threshold, result[0], options.threshold_column_name, 0);
 
-          REQUIRE(instanceOf<internal::StateOK>(state_machine->getState().get()));
+          REQUIRE(state_machine->getState().type == ThresholdStateMachine::OK);
         }
       }
     }
@@ -644,7 +1335,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
           checkValue<double, arrow::DoubleScalar>(
               options.default_threshold, result[0], options.threshold_column_name, 0);
 
-          REQUIRE(instanceOf<internal::StateIncrease>(state_machine->getState().get()));
+          REQUIRE(state_machine->getState().type == ThresholdStateMachine::INCREASE);
 
           AND_WHEN("value keeps bigger than threshold exceeding alert duration") {
             auto next_time = now + options.increase_after.count() + 1;
@@ -682,7 +1373,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
                   options.threshold_column_name,
                   0);
 
-              REQUIRE(instanceOf<internal::StateOK>(state_machine->getState().get()));
+              REQUIRE(state_machine->getState().type == ThresholdStateMachine::OK);
             }
           }
 
@@ -722,7 +1413,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
                   options.threshold_column_name,
                   0);
 
-              REQUIRE(instanceOf<internal::StateOK>(state_machine->getState().get()));
+              REQUIRE(state_machine->getState().type == ThresholdStateMachine::OK);
             }
           }
         }
@@ -764,7 +1455,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
               options.threshold_column_name,
               0);
 
-          REQUIRE(instanceOf<internal::StateDecrease>(state_machine->getState().get()));
+          REQUIRE(state_machine->getState().type == ThresholdStateMachine::DECREASE);
 
           AND_WHEN("value keeps low exceeding descrease timeout") {
             auto next_time = now + options.decrease_after.count() + 1;
@@ -802,7 +1493,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
                   options.threshold_column_name,
                   0);
 
-              REQUIRE(instanceOf<internal::StateOK>(state_machine->getState().get()));
+              REQUIRE(state_machine->getState().type == ThresholdStateMachine::OK);
             }
           }
 
@@ -842,7 +1533,7 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
                   options.threshold_column_name,
                   0);
 
-              REQUIRE(instanceOf<internal::StateOK>(state_machine->getState().get()));
+              REQUIRE(state_machine->getState().type == ThresholdStateMachine::OK);
             }
           }
         }
@@ -851,6 +1542,125 @@ SCENARIO( "threshold state machine changes states", "[ThresholdStateMachine]" )
   }
 }
 
+TEST_CASE( "threshold state machine changes states within one batch", "[ThresholdStateMachine]" ) {
+  ThresholdStateMachine::Options options{
+      "value", "level",
+      10,
+      2, 5s,
+      0.3, 0.5, 5s
+  };
+
+  ThresholdStateMachine state_machine(options);
+
+  RecordBatchBuilder builder;
+  builder.reset();
+  std::string time_column_name{"time"};
+  arrowAssertNotOk(builder.setRowNumber(6));
+  arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+      time_column_name, {100, 103, 106, 107, 113, 114}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<double>(
+      options.watch_column_name, {15, 16, 17, 2, 1, 0.5}));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, state_machine.handle(record_batch));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 6, 3);
+  std::vector<double> expected_thresholds{10, 10, 20, 20, 10, 10};
+  for (size_t i = 0; i < expected_thresholds.size(); ++i) {
+    checkValue<double, arrow::DoubleScalar>(
+        expected_thresholds[i], result[0], options.threshold_column_name, i);
+  }
+
+  REQUIRE( state_machine.getState().type == ThresholdStateMachine::DECREASE );
+  REQUIRE( state_machine.getState().threshold == 10 );
+  REQUIRE( state_machine.getState().start == 113 );
+}
+
+TEST_CASE( "threshold state machine handles record batches with different schemas", "[ThresholdStateMachine]" ) {
+  ThresholdStateMachine::Options options{
+      "value", "level",
+      10,
+      2, 5s
+  };
+
+  ThresholdStateMachine state_machine(options);
+
+  std::string time_column_name{"time"};
+  arrow::RecordBatchVector record_batches;
+  for (bool time_first : {true, true, false}) {
+    RecordBatchBuilder builder;
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(1));
+    if (time_first) {
+      arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+          time_column_name, {100}, arrow::TimeUnit::SECOND));
+    }
+
+    arrowAssertNotOk(builder.buildColumn<double>(
+        options.watch_column_name, {5}));
+    if (!time_first) {
+      arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+          time_column_name, {101}, arrow::TimeUnit::SECOND));
+    }
+
+    arrowAssignOrRaise(record_batches.emplace_back(), builder.getResult());
+  }
+
+  arrow::RecordBatchVector results;
+  for (auto& record_batch : record_batches) {
+    arrow::RecordBatchVector result;
+    arrowAssignOrRaise(result, state_machine.handle(record_batch));
+    REQUIRE( result.size() == 1 );
+    checkSize(result[0], 1, 3);
+    checkValue<double, arrow::DoubleScalar>(
+        10, result[0], options.threshold_column_name, 0);
+    REQUIRE( metadata::getColumnType(*result[0]->schema()->field(2)) == metadata::FIELD );
+    results.push_back(result[0]);
+  }
+
+  REQUIRE( results[0]->schema()->field(2) == results[1]->schema()->field(2) );
+  REQUIRE( results[2]->schema()->field(1)->name() == time_column_name );
+  REQUIRE( state_machine.getState().type == ThresholdStateMachine::OK );
+}
+
+TEST_CASE( "threshold column is appended to record batch already having it", "[ThresholdStateMachine]" ) {
+  ThresholdStateMachine::Options options{
+      "value", "level",
+      10,
+      2, 5s
+  };
+
+  ThresholdStateMachine state_machine(options);
+
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(1));
+  arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+      "time", {100}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<double>(
+      options.watch_column_name, {5}));
+  arrowAssertNotOk(builder.buildColumn<double>(
+      options.threshold_column_name, {42}));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, state_machine.handle(record_batch));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 1, 4);
+  REQUIRE( result[0]->schema()->field(3)->name() == options.threshold_column_name );
+
+  std::shared_ptr<arrow::Scalar> threshold;
+  arrowAssignOrRaise(threshold, result[0]->column(3)->GetScalar(0));
+  REQUIRE( std::static_pointer_cast<arrow::DoubleScalar>(threshold)->value == 10 );
+}
+
 TEST_CASE( "threshold not increasing over max", "[ThresholdStateMachine]" ) {
   ThresholdStateMachine::Options options{
     "value", "level",
@@ -1029,7 +1839,7 @@ SCENARIO( "WindowHandler behaviour with true fill_period flag", "[WindowHandler]
       arrowAssignOrRaise(result, handler->handle(record_batch));
 
       THEN( "all of them are emitted" ) {
-        REQUIRE( result.size() == 2 );
+        REQUIRE( result.size() == 3 );
 
         checkSize(result[0], 2, 1);
         checkColumnsArePresent(result[0], {time_column_name});
@@ -1038,17 +1848,69 @@ SCENARIO( "WindowHandler behaviour with true fill_period flag", "[WindowHandler]
         checkValue<int64_t, arrow::TimestampScalar>(
             4, result[0], time_column_name, 1);
 
-        checkSize(result[1], 2, 1);
+        REQUIRE( metadata::getLogicalBatchesIds(result) == std::vector<int64_t>{0, 1, 1} );
+
+        checkSize(result[1], 1, 1);
         checkColumnsArePresent(result[1], {time_column_name});
         checkValue<int64_t, arrow::TimestampScalar>(
             4, result[1], time_column_name, 0);
+
+        checkSize(result[2], 1, 1);
+        checkColumnsArePresent(result[2], {time_column_name});
         checkValue<int64_t, arrow::TimestampScalar>(
-            6, result[1], time_column_name, 1);
+            6, result[2], time_column_name, 0);
       }
     }
   }
 }
 
+TEST_CASE( "groups of window chunks are sorted separately", "[WindowHandler][GroupHandler][SortHandler]" ) {
+  RecordBatchBuilder builder;
+  arrowAssertNotOk(builder.setRowNumber(6));
+  arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+      "time", {0, 4, 4, 6, 6, 8}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<std::string>(
+      "tag", {"a", "b", "a", "b", "a", "a"}, metadata::TAG));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  WindowHandler window_handler(WindowHandler::WindowOptions{5s, 3s, true});
+  arrow::RecordBatchVector windows;
+  arrowAssignOrRaise(windows, window_handler.handle(record_batch));
+
+  // The second window is emitted as chunks
+  auto window_ids = metadata::getLogicalBatchesIds(windows);
+  REQUIRE( static_cast<int64_t>(window_ids.size()) > window_ids.back() + 1 );
+
+  std::shared_ptr<RecordBatchHandler> group_handler =
+      std::make_shared<GroupHandler>(std::vector<std::string>{"tag"});
+  arrow::RecordBatchVector groups;
+  arrowAssignOrRaise(groups, group_handler->handle(windows));
+
+  SortHandler sort_handler(std::vector<std::string>{"time"});
+  arrow::RecordBatchVector sorted;
+  arrowAssignOrRaise(sorted, sort_handler.handle(groups));
+
+  size_t rows = 0;
+  for (auto& sorted_batch : sorted) {
+    auto tag = sorted_batch->GetColumnByName("tag");
+    for (int i = 0; i < sorted_batch->num_rows(); ++i) {
+      REQUIRE( tag->GetScalar(i).ValueOrDie()->Equals(
+          *tag->GetScalar(0).ValueOrDie()) );
+    }
+
+    rows += sorted_batch->num_rows();
+  }
+
+  size_t groups_rows = 0;
+  for (auto& group : groups) {
+    groups_rows += group->num_rows();
+  }
+
+  REQUIRE( rows == groups_rows );
+}
+
 SCENARIO( "WindowHandler behaviour with false fill_period flag", "[WindowHandler]" ) {
   GIVEN( "WindowHandler with fill_period flag set to false" ) {
     WindowHandler::WindowOptions options{5s, 3s, false};
@@ -1089,15 +1951,19 @@ SCENARIO( "WindowHandler behaviour with false fill_period flag", "[WindowHandler
           arrowAssignOrRaise(record_batch, builder.getResult());
           arrowAssignOrRaise(result, handler->handle(record_batch));
 
-          THEN( "another window is emitted" ) {
-            REQUIRE(result.size() == 1);
-            checkSize(result[0], 2, 1);
-            checkColumnsArePresent(result[0], {time_column_name});
+          THEN( "another window is emitted as chunks of buffered batches" ) {
+            REQUIRE(result.size() == 2);
+            REQUIRE( metadata::getLogicalBatchesIds(result) == std::vector<int64_t>{0, 0} );
 
+            checkSize(result[0], 1, 1);
+            checkColumnsArePresent(result[0], {time_column_name});
             checkValue<int64_t, arrow::TimestampScalar>(
                 4, result[0], time_column_name, 0);
+
+            checkSize(result[1], 1, 1);
+            checkColumnsArePresent(result[1], {time_column_name});
             checkValue<int64_t, arrow::TimestampScalar>(
-                5, result[0], time_column_name, 1);
+                5, result[1], time_column_name, 0);
           }
         }
       }
@@ -1105,6 +1971,91 @@ SCENARIO( "WindowHandler behaviour with false fill_period flag", "[WindowHandler
   }
 }
 
+TEST_CASE( "window aggregates are merged from panes", "[WindowAggregateHandler]" ) {
+  WindowAggregateHandler::WindowAggregateOptions options{
+      {4s, 2s, false},
+      {{{"value", {{AggregateHandler::kMax, "value_max"},
+                   {AggregateHandler::kMean, "value_mean"}}}},
+       {AggregateHandler::kLast, "time"}}
+  };
+
+  WindowAggregateHandler handler(std::move(options));
+
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(4));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+      "time", {0, 1, 2, 3}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(
+      "value", {1, 2, 3, 4}, metadata::FIELD));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler.handle(record_batch));
+
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 1, 3);
+  checkValue<int64_t, arrow::TimestampScalar>(1, result[0], "time", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(2, result[0], "value_max", 0);
+  checkValue<double, arrow::DoubleScalar>(1.5, result[0], "value_mean", 0);
+
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(3));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>(
+      "time", {4, 5, 6}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<int64_t>(
+      "value", {10, 20, 30}, metadata::FIELD));
+
+  arrowAssignOrRaise(record_batch, builder.getResult());
+  arrowAssignOrRaise(result, handler.handle(record_batch));
+
+  REQUIRE( result.size() == 2 );
+  checkValue<int64_t, arrow::TimestampScalar>(3, result[0], "time", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(4, result[0], "value_max", 0);
+  checkValue<double, arrow::DoubleScalar>(2.5, result[0], "value_mean", 0);
+  checkValue<int64_t, arrow::TimestampScalar>(5, result[1], "time", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(20, result[1], "value_max", 0);
+  checkValue<double, arrow::DoubleScalar>(9.25, result[1], "value_mean", 0);
+  REQUIRE( handler.getPanesNumber() == 2 );
+}
+
+TEST_CASE( "grouping by several columns keeps rows order inside groups", "[GroupHandler]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(5));
+  arrowAssertNotOk(builder.buildColumn<std::string>("tag", {"a", "b", "a", "b", "a"}, metadata::TAG));
+  arrowAssertNotOk(builder.buildColumn<int64_t>("number", {1, 1, 1, 2, 1}));
+  arrowAssertNotOk(builder.buildColumn<int64_t>("row", {0, 1, 2, 3, 4}));
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  std::vector<std::string> grouping_columns{"tag", "number"};
+  std::shared_ptr<RecordBatchHandler> group_handler = std::make_shared<GroupHandler>(std::move(grouping_columns));
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, group_handler->handle(record_batch));
+
+  REQUIRE( result.size() == 3 );
+  checkSize(result[0], 3, 3);
+  checkSize(result[1], 1, 3);
+  checkSize(result[2], 1, 3);
+
+  std::vector<int64_t> first_group_rows{0, 2, 4};
+  for (size_t i = 0; i < first_group_rows.size(); ++i) {
+    checkValue<std::string, arrow::StringScalar>("a", result[0], "tag", i);
+    checkValue<int64_t, arrow::Int64Scalar>(1, result[0], "number", i);
+    checkValue<int64_t, arrow::Int64Scalar>(first_group_rows[i], result[0], "row", i);
+  }
+
+  checkValue<int64_t, arrow::Int64Scalar>(1, result[1], "row", 0);
+  checkValue<int64_t, arrow::Int64Scalar>(3, result[2], "row", 0);
+
+  REQUIRE( metadata::getColumnType(*result[0]->schema()->GetFieldByName("tag")) == metadata::TAG );
+  REQUIRE( metadata::extractGroupMetadata(*result[1]) != metadata::extractGroupMetadata(*result[2]) );
+}
+
 SCENARIO( "GroupHandler preserves old group metadata", "[GroupHandler]") {
   GIVEN( "RecordBatch with two columns" ) {
     RecordBatchBuilder builder;
@@ -1156,22 +2107,105 @@ SCENARIO( "GroupHandler preserves old group metadata", "[GroupHandler]") {
             checkValue<int64_t, arrow::Int64Scalar>(2, result[0],
                                                     column_name_2, 0);
 
-            group_column_names =
-                metadata::extractGroupingColumnsNames(*result[0]);
-            REQUIRE(group_column_names.size() == 2);
-            if (group_column_names[0] != column_name_1) {
-              std::swap(group_column_names[0], group_column_names[1]);
-            }
+            group_column_names =
+                metadata::extractGroupingColumnsNames(*result[0]);
+            REQUIRE(group_column_names.size() == 2);
+            if (group_column_names[0] != column_name_1) {
+              std::swap(group_column_names[0], group_column_names[1]);
+            }
+
+            REQUIRE(group_column_names[0] == column_name_1);
+            REQUIRE(group_column_names[1] == column_name_2);
+          }
+        }
+      }
+    }
+  }
+}
+
+SCENARIO( "SortHandler sorts by several keys", "[SortHandler]" ) {
+  GIVEN( "RecordBatch with tag and value columns" ) {
+    RecordBatchBuilder builder;
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(5));
+    arrowAssertNotOk(builder.buildColumn<std::string>("tag", {"b", "a", "a", "b", "a"}, metadata::TAG));
+    arrowAssertNotOk(builder.buildColumn<int64_t>("value", {1, 5, 0, 7, 3}, metadata::FIELD, {true, true, false, true, true}));
+    arrowAssertNotOk(builder.buildColumn<int64_t>("row", {0, 1, 2, 3, 4}));
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+
+    SortHandler::SortOptions options{{
+        {"tag"},
+        {"value", compute_utils::kDescending, compute_utils::kNullsFirst}
+    }};
+
+    WHEN( "all rows are sorted" ) {
+      std::shared_ptr<RecordBatchHandler> sort_handler = std::make_shared<SortHandler>(options);
+
+      arrow::RecordBatchVector result;
+      arrowAssignOrRaise(result, sort_handler->handle(record_batch));
+
+      THEN( "rows are ordered by tag ascending and by value descending with nulls first" ) {
+        REQUIRE( result.size() == 1 );
+        checkSize(result[0], 5, 3);
 
-            REQUIRE(group_column_names[0] == column_name_1);
-            REQUIRE(group_column_names[1] == column_name_2);
-          }
+        std::vector<int64_t> expected_rows{2, 1, 4, 3, 0};
+        for (size_t i = 0; i < expected_rows.size(); ++i) {
+          checkValue<int64_t, arrow::Int64Scalar>(expected_rows[i], result[0], "row", i);
         }
+
+        REQUIRE( metadata::getColumnType(*result[0]->schema()->GetFieldByName("tag")) == metadata::TAG );
+      }
+    }
+
+    WHEN( "only top rows are requested" ) {
+      options.limit = 2;
+      std::shared_ptr<RecordBatchHandler> sort_handler = std::make_shared<SortHandler>(options);
+
+      arrow::RecordBatchVector result;
+      arrowAssignOrRaise(result, sort_handler->handle(record_batch));
+
+      THEN( "only first rows of the full order are returned" ) {
+        REQUIRE( result.size() == 1 );
+        checkSize(result[0], 2, 3);
+        checkIsNull(result[0], "value", 0);
+        checkValue<int64_t, arrow::Int64Scalar>(2, result[0], "row", 0);
+        checkValue<int64_t, arrow::Int64Scalar>(1, result[0], "row", 1);
       }
     }
   }
 }
 
+TEST_CASE( "SortHandler places NaNs as nulls in both orders", "[SortHandler]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(4));
+  arrowAssertNotOk(builder.buildColumn<double>(
+      "value", {2, std::numeric_limits<double>::quiet_NaN(), 1, 3},
+      metadata::FIELD));
+  arrowAssertNotOk(builder.buildColumn<int64_t>("row", {0, 1, 2, 3}));
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  std::vector<std::pair<compute_utils::SortKey, std::vector<int64_t>>> cases{
+      {{"value", compute_utils::kAscending}, {2, 0, 3, 1}},
+      {{"value", compute_utils::kDescending}, {3, 0, 2, 1}},
+      {{"value", compute_utils::kDescending, compute_utils::kNullsFirst},
+       {1, 3, 0, 2}}
+  };
+
+  for (auto& [sort_key, expected_rows] : cases) {
+    SortHandler sort_handler(SortHandler::SortOptions{{sort_key}});
+
+    arrow::RecordBatchVector result;
+    arrowAssignOrRaise(result, sort_handler.handle(record_batch));
+    REQUIRE( result.size() == 1 );
+    for (size_t i = 0; i < expected_rows.size(); ++i) {
+      checkValue<int64_t, arrow::Int64Scalar>(expected_rows[i], result[0], "row", i);
+    }
+  }
+}
+
 TEST_CASE( "aggregating grouped by time column", "[AggregateHandler]" ) {
   RecordBatchBuilder builder;
   builder.reset();
@@ -1279,15 +2313,19 @@ SCENARIO( "WindowHandler correctly handles timestamps with arrow time type diffe
           arrowAssignOrRaise(record_batch, builder.getResult());
           arrowAssignOrRaise(result, handler->handle(record_batch));
 
-          THEN( "another window is emitted" ) {
-            REQUIRE(result.size() == 1);
-            checkSize(result[0], 2, 1);
-            checkColumnsArePresent(result[0], {time_column_name});
+          THEN( "another window is emitted as chunks of buffered batches" ) {
+            REQUIRE(result.size() == 2);
+            REQUIRE( metadata::getLogicalBatchesIds(result) == std::vector<int64_t>{0, 0} );
 
+            checkSize(result[0], 1, 1);
+            checkColumnsArePresent(result[0], {time_column_name});
             checkValue<int64_t, arrow::TimestampScalar>(
                 4000000000, result[0], time_column_name, 0);
+
+            checkSize(result[1], 1, 1);
+            checkColumnsArePresent(result[1], {time_column_name});
             checkValue<int64_t, arrow::TimestampScalar>(
-                5000000000, result[0], time_column_name, 1);
+                5000000000, result[1], time_column_name, 0);
           }
         }
       }
@@ -1782,6 +2820,514 @@ TEST_CASE("when period option is decreased emitted window is shorter", "[Dynamic
       1, result[0], time_column_name, 1);
 }
 
+TEST_CASE( "WindowHandler closes windows by watermark and drops late rows", "[WindowHandler]" ) {
+  WindowHandler::WindowOptions options{5s, 5s, true};
+  options.allowed_lateness = 2s;
+
+  auto handler = std::make_shared<WindowHandler>(options);
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrow::RecordBatchVector result;
+
+  auto handle_times = [&](const std::vector<std::time_t>& times) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, times, arrow::TimeUnit::SECOND));
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssignOrRaise(result, handler->handle(record_batch));
+  };
+
+  handle_times({0, 4, 6});
+  REQUIRE( result.empty() );
+
+  handle_times({3});
+  REQUIRE( result.empty() );
+
+  handle_times({8});
+  REQUIRE( result.size() == 2 );
+  REQUIRE( metadata::getLogicalBatchesIds(result) == std::vector<int64_t>{0, 0} );
+  checkSize(result[0], 2, 1);
+  checkValue<int64_t, arrow::TimestampScalar>(0, result[0], time_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(4, result[0], time_column_name, 1);
+  checkSize(result[1], 1, 1);
+  checkValue<int64_t, arrow::TimestampScalar>(3, result[1], time_column_name, 0);
+
+  handle_times({2, 7});
+  REQUIRE( result.empty() );
+  REQUIRE( handler->getMetrics().late_rows == 1 );
+  REQUIRE( handler->getMetrics().buffered_rows == 3 );
+
+  WindowHandler::WindowOptions bounded_options{5s, 5s, true};
+  bounded_options.allowed_lateness = 10s;
+  bounded_options.max_buffered_rows = 1;
+  handler = std::make_shared<WindowHandler>(bounded_options);
+
+  handle_times({0, 1, 6});
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 1);
+  REQUIRE( handler->getMetrics().forced_windows == 1 );
+  REQUIRE( handler->getMetrics().buffered_rows == 1 );
+}
+
+TEST_CASE( "WindowHandler emits kept late rows on poll", "[WindowHandler]" ) {
+  WindowHandler::WindowOptions options{5s, 5s, true};
+  options.keep_late_rows = true;
+  options.late_rows_measurement = "late";
+
+  auto handler = std::make_shared<WindowHandler>(options);
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::string measurement_column_name{"name"};
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrow::RecordBatchVector result;
+
+  auto handle_times = [&](const std::vector<std::time_t>& times) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, times, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildMeasurementColumn(
+        measurement_column_name,
+        std::vector<std::string>(times.size(), "measurement")));
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssignOrRaise(result, handler->handle(record_batch));
+  };
+
+  handle_times({0, 4});
+  handle_times({6});
+  REQUIRE( result.size() == 1 );
+
+  handle_times({1, 2, 7});
+  REQUIRE( result.empty() );
+  REQUIRE( handler->getMetrics().late_rows == 2 );
+  REQUIRE( handler->getMetrics().buffered_rows == 2 );
+
+  arrowAssignOrRaise(result, handler->poll());
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 2);
+  checkValue<int64_t, arrow::TimestampScalar>(1, result[0], time_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(2, result[0], time_column_name, 1);
+  checkValue<std::string, arrow::StringScalar>("late", result[0], measurement_column_name, 0);
+  checkValue<std::string, arrow::StringScalar>("late", result[0], measurement_column_name, 1);
+
+  std::string result_measurement_column_name;
+  arrowAssignOrRaise(result_measurement_column_name,
+                     metadata::getMeasurementColumnNameMetadata(*result[0]));
+  REQUIRE( result_measurement_column_name == measurement_column_name );
+
+  arrowAssignOrRaise(result, handler->poll());
+  REQUIRE( result.empty() );
+}
+
+TEST_CASE( "WindowHandler closes windows by idle timeout on poll", "[WindowHandler]" ) {
+  WindowHandler::WindowOptions options{5s, 5s, true};
+  options.allowed_lateness = 10s;
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  arrowAssertNotOk(builder.setRowNumber(3));
+  arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+      time_column_name, {0, 1, 6}, arrow::TimeUnit::SECOND));
+
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  arrow::RecordBatchVector result;
+  auto handler = std::make_shared<WindowHandler>(options);
+  arrowAssignOrRaise(result, handler->handle(record_batch));
+  REQUIRE( result.empty() );
+
+  std::this_thread::sleep_for(1ms);
+  arrowAssignOrRaise(result, handler->poll());
+  REQUIRE( result.empty() );
+
+  options.idle_timeout = 0s;
+  handler = std::make_shared<WindowHandler>(options);
+  arrowAssignOrRaise(result, handler->handle(record_batch));
+  REQUIRE( result.empty() );
+
+  std::this_thread::sleep_for(1ms);
+  arrowAssignOrRaise(result, handler->poll());
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 1);
+  checkValue<int64_t, arrow::TimestampScalar>(0, result[0], time_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(1, result[0], time_column_name, 1);
+  REQUIRE( handler->getMetrics().buffered_rows == 1 );
+
+  arrowAssignOrRaise(result, handler->poll());
+  REQUIRE( result.empty() );
+}
+
+TEST_CASE( "WindowHandler spills buffered rows over memory budget", "[WindowHandler]" ) {
+  auto spill_directory =
+      std::filesystem::temp_directory_path() / "window_handler_spill_test";
+  std::filesystem::create_directories(spill_directory);
+
+  WindowHandler::WindowOptions options{5s, 5s, true};
+  options.memory_budget_bytes = 0;
+  options.spill_directory = spill_directory.string();
+
+  auto handler = std::make_shared<WindowHandler>(options);
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::string value_column_name{"value"};
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrow::RecordBatchVector result;
+
+  auto handle_times = [&](const std::vector<std::time_t>& times) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, times, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<int64_t>(
+        value_column_name, std::vector<int64_t>(times.begin(), times.end())));
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssignOrRaise(result, handler->handle(record_batch));
+  };
+
+  handle_times({0, 1});
+  handle_times({3, 4});
+  REQUIRE( result.empty() );
+  REQUIRE( handler->getMetrics().spilled_batches == 2 );
+  REQUIRE( handler->getMetrics().spilled_bytes > 0 );
+  REQUIRE( handler->getMetrics().buffered_bytes == 0 );
+
+  handle_times({11});
+  REQUIRE( result.size() == 2 );
+  REQUIRE( handler->getMetrics().reloaded_batches == 2 );
+  checkSize(result[0], 2, 2);
+  checkValue<int64_t, arrow::Int64Scalar>(0, result[0], value_column_name, 0);
+  checkValue<int64_t, arrow::Int64Scalar>(1, result[0], value_column_name, 1);
+  checkSize(result[1], 2, 2);
+  checkValue<int64_t, arrow::Int64Scalar>(3, result[1], value_column_name, 0);
+  checkValue<int64_t, arrow::Int64Scalar>(4, result[1], value_column_name, 1);
+  REQUIRE( metadata::getLogicalBatchesIds(result) == std::vector<int64_t>{0, 0} );
+  REQUIRE( handler->getMetrics().buffered_rows == 1 );
+
+  // Rows of a reloaded record batch left for the next windows are spilled
+  // again
+  handle_times({12, 16});
+  auto spilled_batches = handler->getMetrics().spilled_batches;
+  handle_times({15});
+  REQUIRE( result.size() == 2 );
+  checkValue<int64_t, arrow::Int64Scalar>(11, result[0], value_column_name, 0);
+  checkValue<int64_t, arrow::Int64Scalar>(12, result[1], value_column_name, 0);
+  REQUIRE( handler->getMetrics().buffered_rows == 2 );
+  REQUIRE( handler->getMetrics().spilled_batches == spilled_batches + 2 );
+  REQUIRE( handler->getMetrics().buffered_bytes == 0 );
+  REQUIRE( handler->getStateSize() == 0 );
+
+  handler.reset();
+  result.clear();
+  REQUIRE( std::filesystem::is_empty(spill_directory) );
+  std::filesystem::remove_all(spill_directory);
+}
+
+TEST_CASE( "GroupDispatcher evicts and flushes least recently used groups", "[GroupDispatcher]" ) {
+  WindowHandler::WindowOptions window_options{5s, 5s, true};
+  auto factory = std::make_shared<DynamicWindowHandlerFactory>(
+      window_options, DynamicWindowHandler::DynamicWindowOptions{});
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::string tag_column_name{"tag"};
+
+  auto build_group_batch = [&](const std::string& tag_value,
+                               const std::vector<std::time_t>& times) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, times, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>(
+        tag_column_name, std::vector<std::string>(times.size(), tag_value)));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(metadata::fillGroupMetadata(&record_batch, {tag_column_name}));
+    return record_batch;
+  };
+
+  GroupDispatcher::Options options;
+  options.max_groups = 1;
+  GroupDispatcher dispatcher(factory, options);
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, dispatcher.handle(build_group_batch("a", {0, 1})));
+  REQUIRE( result.empty() );
+  REQUIRE( dispatcher.getMetrics().live_groups == 1 );
+  REQUIRE( dispatcher.getMetrics().state_bytes > 0 );
+  REQUIRE( dispatcher.getMetrics().bytes_per_group == dispatcher.getMetrics().state_bytes );
+  auto group_a_id = metadata::extractInternedGroup(*build_group_batch("a", {0}))->id;
+
+  arrowAssignOrRaise(result, dispatcher.handle(build_group_batch("b", {0})));
+  REQUIRE( result.size() == 1 );
+  checkSize(result[0], 2, 2);
+  checkValue<std::string, arrow::StringScalar>("a", result[0], tag_column_name, 0);
+  REQUIRE( dispatcher.getMetrics().live_groups == 1 );
+  REQUIRE( dispatcher.getMetrics().evictions == 1 );
+
+  // Evicted group is released by the dispatcher
+  REQUIRE( metadata::extractInternedGroup(*result[0])->id != group_a_id );
+
+  GroupDispatcher::Options ttl_options;
+  ttl_options.idle_ttl = 0s;
+  GroupDispatcher ttl_dispatcher(factory, ttl_options);
+
+  arrowAssignOrRaise(result, ttl_dispatcher.handle(build_group_batch("a", {0})));
+  REQUIRE( result.empty() );
+
+  std::this_thread::sleep_for(1ms);
+  arrowAssignOrRaise(result, ttl_dispatcher.handle(build_group_batch("b", {0})));
+  REQUIRE( result.size() == 1 );
+  checkValue<std::string, arrow::StringScalar>("a", result[0], tag_column_name, 0);
+  REQUIRE( ttl_dispatcher.getMetrics().evictions == 1 );
+
+  std::this_thread::sleep_for(1ms);
+  arrowAssignOrRaise(result, ttl_dispatcher.poll());
+  REQUIRE( result.size() == 1 );
+  checkValue<std::string, arrow::StringScalar>("b", result[0], tag_column_name, 0);
+  REQUIRE( ttl_dispatcher.getMetrics().live_groups == 0 );
+  REQUIRE( ttl_dispatcher.getMetrics().evictions == 2 );
+}
+
+TEST_CASE( "sharded GroupDispatcher keeps order of results", "[GroupDispatcher]" ) {
+  WindowHandler::WindowOptions window_options{5s, 5s, true};
+  auto factory = std::make_shared<DynamicWindowHandlerFactory>(
+      window_options, DynamicWindowHandler::DynamicWindowOptions{});
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::string tag_column_name{"tag"};
+
+  auto build_group_batch = [&](const std::string& tag_value,
+                               const std::vector<std::time_t>& times) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, times, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>(
+        tag_column_name, std::vector<std::string>(times.size(), tag_value)));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(metadata::fillGroupMetadata(&record_batch, {tag_column_name}));
+    return record_batch;
+  };
+
+  std::vector<std::string> tags{"a", "b", "c", "d", "e", "f", "g", "h"};
+  arrow::RecordBatchVector first_batches;
+  arrow::RecordBatchVector second_batches;
+  for (auto& tag : tags) {
+    first_batches.push_back(build_group_batch(tag, {0, 1}));
+    second_batches.push_back(build_group_batch(tag, {6}));
+  }
+
+  GroupDispatcher::Options options;
+  options.shards = 4;
+  GroupDispatcher dispatcher(factory, options);
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, dispatcher.handle(first_batches));
+  REQUIRE( result.empty() );
+  REQUIRE( dispatcher.getMetrics().live_groups == tags.size() );
+
+  arrowAssignOrRaise(result, dispatcher.handle(second_batches));
+  REQUIRE( result.size() == tags.size() );
+  for (size_t i = 0; i < tags.size(); ++i) {
+    checkSize(result[i], 2, 2);
+    checkValue<std::string, arrow::StringScalar>(tags[i], result[i], tag_column_name, 0);
+  }
+
+  arrowAssignOrRaise(result, dispatcher.flush());
+  REQUIRE( result.size() == tags.size() );
+}
+
+TEST_CASE( "chunked windows of different groups are sorted separately", "[GroupDispatcher]" ) {
+  WindowHandler::WindowOptions window_options{5s, 5s, true};
+  auto factory = std::make_shared<DynamicWindowHandlerFactory>(
+      window_options, DynamicWindowHandler::DynamicWindowOptions{});
+
+  GroupDispatcher dispatcher(factory);
+  SortHandler sort_handler(std::vector<std::string>{"time"});
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::string tag_column_name{"tag"};
+
+  auto build_group_batch = [&](const std::string& tag_value, std::time_t time) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(1));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, {time}, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>(tag_column_name, {tag_value}));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(metadata::fillGroupMetadata(&record_batch, {tag_column_name}));
+    return record_batch;
+  };
+
+  arrow::RecordBatchVector windows;
+  for (std::time_t time : {0, 2, 6}) {
+    arrowAssignOrRaise(windows, dispatcher.handle(arrow::RecordBatchVector{
+        build_group_batch("a", time), build_group_batch("b", time)}));
+  }
+
+  REQUIRE( windows.size() == 4 );
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, sort_handler.handle(windows));
+  REQUIRE( result.size() == 2 );
+  std::vector<std::string> tags{"a", "b"};
+  for (size_t i = 0; i < tags.size(); ++i) {
+    checkSize(result[i], 2, 2);
+    checkValue<std::string, arrow::StringScalar>(tags[i], result[i], tag_column_name, 0);
+    checkValue<std::string, arrow::StringScalar>(tags[i], result[i], tag_column_name, 1);
+  }
+}
+
+TEST_CASE( "equal groups are interned to the same id", "[grouping]" ) {
+  RecordBatchBuilder builder;
+  std::string tag_column_name{"tag"};
+
+  auto build_group_batch = [&](const std::string& tag_value) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(1));
+    arrowAssertNotOk(builder.buildColumn<std::string>(tag_column_name, {tag_value}));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(metadata::fillGroupMetadata(&record_batch, {tag_column_name}));
+    return record_batch;
+  };
+
+  auto record_batch_a = build_group_batch("a");
+  auto group_a = metadata::extractInternedGroup(*record_batch_a);
+  REQUIRE( group_a->id != 0 );
+  REQUIRE( group_a->grouping_columns_names == std::vector<std::string>{tag_column_name} );
+  REQUIRE( group_a->group.group_columns_values(0) == "a" );
+
+  REQUIRE( metadata::extractInternedGroup(*build_group_batch("a")) == group_a );
+  REQUIRE( metadata::extractInternedGroup(*build_group_batch("b"))->id != group_a->id );
+
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(1));
+  arrowAssertNotOk(builder.buildColumn<std::string>(tag_column_name, {"a"}));
+  std::shared_ptr<arrow::RecordBatch> not_grouped;
+  arrowAssignOrRaise(not_grouped, builder.getResult());
+  REQUIRE( metadata::extractInternedGroup(*not_grouped)->id == 0 );
+
+  // The group is erased with the last handle and its id is not reused
+  auto group_a_id = group_a->id;
+  group_a.reset();
+  auto reinterned_group_a = metadata::extractInternedGroup(*record_batch_a);
+  REQUIRE( reinterned_group_a->id != group_a_id );
+  REQUIRE( reinterned_group_a->group.group_columns_values(0) == "a" );
+}
+
+TEST_CASE( "windows of all groups are emitted by one handler", "[MultiGroupWindowHandler]" ) {
+  WindowHandler::WindowOptions options{5s, 5s, true};
+  auto handler = std::make_shared<MultiGroupWindowHandler>(options);
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::string tag_column_name{"tag"};
+
+  auto build_group_batch = [&](const std::string& tag_value,
+                               const std::vector<std::time_t>& times) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, times, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>(
+        tag_column_name, std::vector<std::string>(times.size(), tag_value)));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(metadata::fillGroupMetadata(&record_batch, {tag_column_name}));
+    return record_batch;
+  };
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler->handle(arrow::RecordBatchVector{
+      build_group_batch("a", {0, 3}), build_group_batch("b", {1, 2})}));
+  REQUIRE( result.empty() );
+  REQUIRE( handler->getMetrics().groups == 2 );
+
+  arrowAssignOrRaise(result, handler->handle(arrow::RecordBatchVector{
+      build_group_batch("a", {4, 6}), build_group_batch("b", {7})}));
+  REQUIRE( result.size() == 2 );
+  REQUIRE( metadata::getLogicalBatchesIds(result) == std::vector<int64_t>{0, 1} );
+
+  checkSize(result[0], 3, 2);
+  checkValue<std::string, arrow::StringScalar>("a", result[0], tag_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(0, result[0], time_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(3, result[0], time_column_name, 1);
+  checkValue<int64_t, arrow::TimestampScalar>(4, result[0], time_column_name, 2);
+  REQUIRE( metadata::extractGroupMetadata(*result[0]) ==
+           metadata::extractGroupMetadata(*build_group_batch("a", {0})) );
+
+  checkSize(result[1], 2, 2);
+  checkValue<std::string, arrow::StringScalar>("b", result[1], tag_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(1, result[1], time_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(2, result[1], time_column_name, 1);
+
+  REQUIRE( handler->getMetrics().buffered_rows == 2 );
+}
+
+TEST_CASE( "groups behind the stream are flushed and evicted", "[MultiGroupWindowHandler]" ) {
+  WindowHandler::WindowOptions options{5s, 5s, true};
+  REQUIRE( MultiGroupWindowHandler::isSupported(options) );
+  auto handler = std::make_shared<MultiGroupWindowHandler>(options);
+
+  RecordBatchBuilder builder;
+  std::string time_column_name{"time"};
+  std::string tag_column_name{"tag"};
+
+  auto build_group_batch = [&](const std::string& tag_value,
+                               const std::vector<std::time_t>& times) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(times.size()));
+    arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+        time_column_name, times, arrow::TimeUnit::SECOND));
+    arrowAssertNotOk(builder.buildColumn<std::string>(
+        tag_column_name, std::vector<std::string>(times.size(), tag_value)));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(metadata::fillGroupMetadata(&record_batch, {tag_column_name}));
+    return record_batch;
+  };
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, handler->handle(arrow::RecordBatchVector{
+      build_group_batch("a", {0, 1}), build_group_batch("b", {0})}));
+  REQUIRE( result.empty() );
+
+  arrowAssignOrRaise(result, handler->handle(build_group_batch("b", {12})));
+  REQUIRE( result.size() == 2 );
+
+  checkSize(result[0], 1, 2);
+  checkValue<std::string, arrow::StringScalar>("b", result[0], tag_column_name, 0);
+
+  checkSize(result[1], 2, 2);
+  checkValue<std::string, arrow::StringScalar>("a", result[1], tag_column_name, 0);
+  checkValue<int64_t, arrow::TimestampScalar>(1, result[1], time_column_name, 1);
+
+  REQUIRE( handler->getMetrics().groups == 1 );
+  REQUIRE( handler->getMetrics().buffered_rows == 1 );
+
+  options.memory_budget_bytes = 0;
+  REQUIRE( !MultiGroupWindowHandler::isSupported(options) );
+  MultiGroupWindowHandler budgeted_handler(options);
+  REQUIRE( !budgeted_handler.handle(build_group_batch("a", {0})).ok() );
+}
+
 TEST_CASE( "WindowHandler behaviour with different schemas", "[WindowHandler]" ) {
   WindowHandler::WindowOptions options{5s, 3s, true};
 
@@ -2055,32 +3601,41 @@ SCENARIO( "DerivativeHandler behaviour", "[DerivativeHandler]" ) {
       arrow::RecordBatchVector result_1;
       arrowAssignOrRaise(result_1, derivative_handler->handle(record_batch_1));
 
-      REQUIRE( result_1.size() == 1 );
+      REQUIRE( result_1.size() == 2 );
 
-      checkSize(result_1[0], 3, 3);
+      int64_t chunk_id_0, chunk_id_1;
+      arrowAssignOrRaise(chunk_id_0, metadata::getChunkIdMetadata(*result_1[0]));
+      arrowAssignOrRaise(chunk_id_1, metadata::getChunkIdMetadata(*result_1[1]));
+      REQUIRE( chunk_id_0 == chunk_id_1 );
+
+      checkSize(result_1[0], 2, 3);
+      checkSize(result_1[1], 1, 3);
       checkColumnsArePresent(result_1[0], {
           time_column_name, value_column_name, result_column_name
       });
+      checkColumnsArePresent(result_1[1], {
+          time_column_name, value_column_name, result_column_name
+      });
 
       checkValue<int64_t, arrow::TimestampScalar>(
           3, result_1[0], time_column_name, 0);
       checkValue<int64_t, arrow::TimestampScalar>(
           4, result_1[0], time_column_name, 1);
       checkValue<int64_t, arrow::TimestampScalar>(
-          7, result_1[0], time_column_name, 2);
+          7, result_1[1], time_column_name, 0);
 
       checkValue<int64_t, arrow::Int64Scalar>(
           2, result_1[0], value_column_name, 0);
       checkValue<int64_t, arrow::Int64Scalar>(
           3, result_1[0], value_column_name, 1);
       checkValue<int64_t, arrow::Int64Scalar>(
-          4, result_1[0], value_column_name, 2);
+          4, result_1[1], value_column_name, 0);
 
       checkValue<double, arrow::DoubleScalar>(
           2, result_1[0], result_column_name, 0);
       checkValue<double, arrow::DoubleScalar>(
           3, result_1[0], result_column_name, 1);
-      checkIsNull(result_1[0], result_column_name, 2);
+      checkIsNull(result_1[1], result_column_name, 0);
     }
   }
 }
@@ -2317,6 +3872,50 @@ SCENARIO( "DerivativeHandler behaviour with no_wait_option enabled", "[Derivativ
   }
 }
 
+TEST_CASE( "DerivativeHandler flushes rows waiting for future values", "[DerivativeHandler]" ) {
+  int64_t s_to_ns_factor = 1000 * 1000 * 1000;
+  DerivativeHandler::DerivativeOptions options {
+      std::chrono::nanoseconds{1 * s_to_ns_factor},
+      std::chrono::nanoseconds{2 * s_to_ns_factor},
+      { {"value_derivative", {"value", 1}} }
+  };
+
+  DerivativeHandler derivative_handler(
+      std::make_shared<compute_utils::FornbergDerivativeCalculator>(), options);
+
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(4));
+  arrowAssertNotOk(builder.buildTimeColumn<std::time_t>(
+      "time", {0, 1, 2, 3}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<int64_t>("value", {0, 2, 4, 6}));
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  arrow::RecordBatchVector result;
+  arrowAssignOrRaise(result, derivative_handler.handle(record_batch));
+  REQUIRE( derivative_handler.getStateSize() > 0 );
+
+  arrow::RecordBatchVector flushed;
+  arrowAssignOrRaise(flushed, derivative_handler.flush());
+  REQUIRE( !flushed.empty() );
+  REQUIRE( derivative_handler.getStateSize() == 0 );
+
+  convert_utils::append(std::move(flushed), result);
+  int64_t rows = 0;
+  for (auto& result_batch : result) {
+    for (int64_t i = 0; i < result_batch->num_rows(); ++i) {
+      std::shared_ptr<arrow::Scalar> derivative;
+      arrowAssignOrRaise(derivative, result_batch->GetColumnByName("value_derivative")->GetScalar(i));
+      REQUIRE( std::static_pointer_cast<arrow::DoubleScalar>(derivative)->value == Approx(2) );
+    }
+
+    rows += result_batch->num_rows();
+  }
+
+  REQUIRE( rows == 4 );
+}
+
 SCENARIO( "DerivativeHandler behaviour with missing values", "[DerivativeHandler]" ) {
   GIVEN( "DerivativeCalculator, DerivativeHandler instances" ) {
     using namespace ::testing;
@@ -2486,32 +4085,41 @@ SCENARIO( "DerivativeHandler behaviour with missing values", "[DerivativeHandler
       arrow::RecordBatchVector result_1;
       arrowAssignOrRaise(result_1, derivative_handler->handle(record_batch_1));
 
-      REQUIRE( result_1.size() == 1 );
+      REQUIRE( result_1.size() == 2 );
 
-      checkSize(result_1[0], 3, 3);
+      int64_t chunk_id_0, chunk_id_1;
+      arrowAssignOrRaise(chunk_id_0, metadata::getChunkIdMetadata(*result_1[0]));
+      arrowAssignOrRaise(chunk_id_1, metadata::getChunkIdMetadata(*result_1[1]));
+      REQUIRE( chunk_id_0 == chunk_id_1 );
+
+      checkSize(result_1[0], 2, 3);
+      checkSize(result_1[1], 1, 3);
       checkColumnsArePresent(result_1[0], {
           time_column_name, value_column_name, result_column_name
       });
+      checkColumnsArePresent(result_1[1], {
+          time_column_name, value_column_name, result_column_name
+      });
 
       checkValue<int64_t, arrow::TimestampScalar>(
           3, result_1[0], time_column_name, 0);
       checkValue<int64_t, arrow::TimestampScalar>(
           4, result_1[0], time_column_name, 1);
       checkValue<int64_t, arrow::TimestampScalar>(
-          7, result_1[0], time_column_name, 2);
+          7, result_1[1], time_column_name, 0);
 
       checkValue<int64_t, arrow::Int64Scalar>(
           2, result_1[0], value_column_name, 0);
       checkValue<int64_t, arrow::Int64Scalar>(
           3, result_1[0], value_column_name, 1);
       checkValue<int64_t, arrow::Int64Scalar>(
-          4, result_1[0], value_column_name, 2);
+          4, result_1[1], value_column_name, 0);
 
       checkValue<double, arrow::DoubleScalar>(
           2, result_1[0], result_column_name, 0);
       checkValue<double, arrow::DoubleScalar>(
           3, result_1[0], result_column_name, 1);
-      checkIsNull(result_1[0], result_column_name, 2);
+      checkIsNull(result_1[1], result_column_name, 0);
     }
   }
 }
@@ -1,9 +1,14 @@
+#include <cmath>
 #include <functional>
 #include <unordered_set>
 
 #include <arrow/api.h>
 #include <catch2/catch.hpp>
 
+#include "metadata/column_typing.h"
+#include "metadata/grouping.h"
+#include "metadata/sorting.h"
+#include "record_batch_builder.h"
 #include "test_help.h"
 #include "utils/utils.h"
 
@@ -53,6 +58,42 @@ TEST_CASE( "serialization and deserialization preserves schema metadata", "[Seri
   }
 }
 
+TEST_CASE( "multi-group record batch is passed through serialization", "[Serializer]" ) {
+  RecordBatchBuilder builder;
+  arrow::RecordBatchVector groups;
+  for (auto& tag : std::vector<std::string>{"a", "b"}) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(2));
+    arrowAssertNotOk(builder.buildColumn<std::string>("tag", {tag, tag}));
+    arrowAssertNotOk(builder.buildColumn<int64_t>("value", {0, 1}));
+
+    std::shared_ptr<arrow::RecordBatch> group;
+    arrowAssignOrRaise(group, builder.getResult());
+    arrowAssertNotOk(metadata::fillGroupMetadata(&group, {"tag"}));
+    groups.push_back(group);
+  }
+
+  std::shared_ptr<arrow::RecordBatch> combined;
+  arrowAssignOrRaise(combined, compute_utils::combineGroups(groups, "group"));
+  checkSize(combined, 4, 3);
+
+  arrow::BufferVector buffers;
+  arrowAssignOrRaise(buffers, serialize_utils::serializeRecordBatches({combined}));
+  arrow::RecordBatchVector deserialized;
+  arrowAssignOrRaise(deserialized, serialize_utils::deserializeRecordBatches(*buffers[0]));
+  REQUIRE( deserialized.size() == 1 );
+  REQUIRE( metadata::isMultiGroup(*deserialized[0]) );
+
+  arrow::RecordBatchVector split;
+  arrowAssignOrRaise(split, compute_utils::splitGroups(deserialized[0]));
+  REQUIRE( split.size() == 2 );
+  for (size_t i = 0; i < groups.size(); ++i) {
+    REQUIRE( !metadata::isMultiGroup(*split[i]) );
+    REQUIRE( split[i]->Equals(*groups[i]) );
+    REQUIRE( metadata::extractInternedGroup(*split[i]) == metadata::extractInternedGroup(*groups[i]) );
+  }
+}
+
 TEST_CASE( "check conversion between different TimeUnits", "[time_utils]" ) {
   using namespace time_utils;
   constexpr int64_t max_int64 = std::numeric_limits<int64_t>::max();
@@ -206,6 +247,176 @@ TEST_CASE("concatenation puts delimiter right between strings", "[string_utils]"
             concatenation_result == "second first") );
 }
 
+TEST_CASE( "key table assigns the same ids to the same keys between calls", "[KeyTable]" ) {
+  compute_utils::KeyTable key_table;
+
+  arrow::StringBuilder first_builder;
+  arrowAssertNotOk(first_builder.AppendValues({"x", "y", "x"}));
+  std::shared_ptr<arrow::Array> first_keys;
+  arrowAssertNotOk(first_builder.Finish(&first_keys));
+
+  std::vector<int64_t> key_ids;
+  arrowAssertNotOk(key_table.encode({first_keys}, &key_ids));
+  REQUIRE( key_ids == std::vector<int64_t>{0, 1, 0} );
+
+  arrow::StringBuilder second_builder;
+  arrowAssertNotOk(second_builder.AppendValues({"z", "y"}));
+  arrowAssertNotOk(second_builder.AppendNull());
+  std::shared_ptr<arrow::Array> second_keys;
+  arrowAssertNotOk(second_builder.Finish(&second_keys));
+
+  arrowAssertNotOk(key_table.encode({second_keys}, &key_ids));
+  REQUIRE( key_ids == std::vector<int64_t>{2, 1, 3} );
+  REQUIRE( key_table.size() == 4 );
+
+  arrow::Int64Builder int_builder;
+  arrowAssertNotOk(int_builder.Append(1));
+  std::shared_ptr<arrow::Array> int_keys;
+  arrowAssertNotOk(int_builder.Finish(&int_keys));
+  REQUIRE( !key_table.encode({int_keys}, &key_ids).ok() );
+}
+
+TEST_CASE( "dictionary-encoded keys are coded by dictionary values", "[KeyTable]" ) {
+  RecordBatchBuilder builder;
+  auto build_tags = [&](const std::vector<std::string>& tags) {
+    builder.reset();
+    arrowAssertNotOk(builder.setRowNumber(tags.size()));
+    arrowAssertNotOk(builder.buildColumn<std::string>("tag", tags, metadata::TAG));
+
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrowAssignOrRaise(record_batch, builder.getResult());
+    arrowAssertNotOk(compute_utils::dictionaryEncodeTags(&record_batch));
+    REQUIRE( record_batch->column(0)->type_id() == arrow::Type::DICTIONARY );
+    REQUIRE( metadata::getColumnType(*record_batch->schema()->field(0)) == metadata::TAG );
+    return record_batch;
+  };
+
+  auto first = build_tags({"x", "y", "x"});
+  auto second = build_tags({"z", "y"});
+
+  compute_utils::KeyTable key_table;
+  std::vector<int64_t> key_ids;
+  arrowAssertNotOk(key_table.encode({first->column(0)}, &key_ids));
+  REQUIRE( key_ids == std::vector<int64_t>{0, 1, 0} );
+  arrowAssertNotOk(key_table.encode({second->column(0)}, &key_ids));
+  REQUIRE( key_ids == std::vector<int64_t>{2, 1} );
+
+  std::shared_ptr<arrow::RecordBatch> concatenated;
+  arrowAssignOrRaise(concatenated, convert_utils::concatenateRecordBatches({first, second}));
+  REQUIRE( concatenated->num_rows() == 5 );
+
+  std::vector<std::string> values;
+  for (int64_t i = 0; i < concatenated->num_rows(); ++i) {
+    std::shared_ptr<arrow::Scalar> value;
+    arrowAssignOrRaise(value, arrow_utils::getDecodedScalar(*concatenated->column(0), i));
+    values.push_back(value->ToString());
+  }
+
+  REQUIRE( values == std::vector<std::string>{"x", "y", "x", "z", "y"} );
+
+  std::shared_ptr<arrow::RecordBatch> decoded;
+  arrowAssignOrRaise(decoded, compute_utils::decodeDictionaries(concatenated));
+  REQUIRE( decoded->column(0)->type_id() == arrow::Type::STRING );
+  checkValue<std::string, arrow::StringScalar>("z", decoded, "tag", 3);
+}
+
+TEST_CASE( "timestamps view converts values of sliced array", "[TimestampsView]" ) {
+  arrow::TimestampBuilder builder(arrow::timestamp(arrow::TimeUnit::MILLI),
+                                  arrow::default_memory_pool());
+  arrowAssertNotOk(builder.AppendValues({500, 1500, 2000, 3999, 4000}));
+  std::shared_ptr<arrow::Array> timestamps;
+  arrowAssertNotOk(builder.Finish(&timestamps));
+  auto sliced_timestamps = timestamps->Slice(1);
+
+  auto seconds_result = arrow_utils::TimestampsView::make(
+      *sliced_timestamps, arrow::TimeUnit::SECOND);
+  REQUIRE( seconds_result.ok() );
+  auto seconds = seconds_result.ValueOrDie();
+  REQUIRE( seconds.length() == 4 );
+  REQUIRE( seconds[0] == 1 );
+  REQUIRE( seconds[2] == 3 );
+  REQUIRE( seconds.partitionPoint([](int64_t ts) { return ts >= 3; }) == 2 );
+  REQUIRE( seconds.partitionPoint([](int64_t ts) { return ts >= 5; }) == 4 );
+
+  auto micros_result = arrow_utils::TimestampsView::make(
+      *sliced_timestamps, arrow::TimeUnit::MICRO);
+  REQUIRE( micros_result.ok() );
+  auto micros = micros_result.ValueOrDie();
+  REQUIRE( micros[1] == 2000000 );
+
+  std::shared_ptr<arrow::Array> int_array;
+  arrowAssignOrRaise(int_array, timestamps->View(arrow::int64()));
+  REQUIRE( !arrow_utils::TimestampsView::make(*int_array, arrow::TimeUnit::SECOND).ok() );
+}
+
+TEST_CASE( "presorted runs are merged stably and sorted mark is trusted", "[compute_utils]" ) {
+  RecordBatchBuilder builder;
+  builder.reset();
+  arrowAssertNotOk(builder.setRowNumber(6));
+  arrowAssertNotOk(builder.buildTimeColumn<int64_t>("time", {3, 5, 1, 3, 4, 0}, arrow::TimeUnit::SECOND));
+  arrowAssertNotOk(builder.buildColumn<int64_t>("position", {0, 1, 2, 3, 4, 5}));
+  std::shared_ptr<arrow::RecordBatch> record_batch;
+  arrowAssignOrRaise(record_batch, builder.getResult());
+
+  std::shared_ptr<arrow::RecordBatch> sorted;
+  arrowAssignOrRaise(sorted, compute_utils::sortByColumn("time", record_batch));
+  std::vector<int64_t> expected_positions{5, 2, 0, 3, 4, 1};
+  for (size_t i = 0; i < expected_positions.size(); ++i) {
+    checkValue<int64_t, arrow::Int64Scalar>(expected_positions[i], sorted, "position", i);
+  }
+
+  std::shared_ptr<arrow::RecordBatch> sorted_again;
+  arrowAssignOrRaise(sorted_again, compute_utils::sortByColumn("time", sorted));
+  REQUIRE( sorted_again == sorted );
+
+  arrowAssertNotOk(metadata::setSortedByMetadata(&record_batch, "position"));
+  REQUIRE( metadata::isSortedByMetadata(*record_batch, "position") );
+  std::shared_ptr<arrow::RecordBatch> marked;
+  arrowAssignOrRaise(marked, compute_utils::sortByColumn("position", record_batch));
+  REQUIRE( marked == record_batch );
+
+  arrowAssignOrRaise(sorted, compute_utils::sortByColumn("time", record_batch));
+  REQUIRE( !metadata::isSortedByMetadata(*sorted, "position") );
+}
+
+TEST_CASE( "merged quantile sketches keep relative accuracy", "[DDSketch]" ) {
+  sketch_utils::DDSketch first_sketch(0.01);
+  sketch_utils::DDSketch second_sketch(0.01);
+  REQUIRE( std::isnan(first_sketch.getQuantile(0.5)) );
+
+  for (int i = 1; i <= 500; ++i) {
+    first_sketch.add(i);
+    second_sketch.add(500 + i);
+  }
+
+  first_sketch.merge(second_sketch);
+  REQUIRE( first_sketch.getCount() == 1000 );
+  REQUIRE( first_sketch.getQuantile(0.5) == Approx(500).epsilon(0.01) );
+  REQUIRE( first_sketch.getQuantile(0.99) == Approx(990).epsilon(0.01) );
+  REQUIRE( first_sketch.getQuantile(1) == Approx(1000).epsilon(0.01) );
+}
+
+TEST_CASE( "distinct count estimation of merged sketches", "[HyperLogLog]" ) {
+  sketch_utils::HyperLogLog first_sketch;
+  sketch_utils::HyperLogLog second_sketch;
+  REQUIRE( first_sketch.getEstimate() == 0 );
+
+  for (uint64_t i = 0; i < 10000; ++i) {
+    first_sketch.add(sketch_utils::hash(i));
+    second_sketch.add(sketch_utils::hash(i + 5000));
+  }
+
+  first_sketch.merge(second_sketch);
+  REQUIRE( first_sketch.getEstimate() == Approx(15000).epsilon(0.05) );
+
+  sketch_utils::HyperLogLog small_sketch;
+  for (uint64_t i = 0; i < 10; ++i) {
+    small_sketch.add(sketch_utils::hash(i % 3));
+  }
+
+  REQUIRE( small_sketch.getEstimate() == 3 );
+}
+
 TEST_CASE("calculating derivatives for sinus", "[FDDerivativeCalculator]") {
   size_t n = 9;
   std::deque<double> xs(n);
@@ -256,6 +467,54 @@ TEST_CASE("calculating derivatives for sinus", "[FDDerivativeCalculator]") {
   }
 }
 
+TEST_CASE("Fornberg weights give the same derivatives as linear system", "[FornbergDerivativeCalculator]") {
+  std::deque<double> xs{0, 1, 2.5, 3, 5};
+  std::deque<double> ys;
+  for (auto x : xs) {
+    ys.push_back(std::exp(x / 4));
+  }
+
+  sdp::compute_utils::FDDerivativeCalculator fd_calculator;
+  sdp::compute_utils::FornbergDerivativeCalculator fornberg_calculator;
+  for (size_t order = 0; order < xs.size(); ++order) {
+    for (double x_der : {0.0, 2.0, 5.5}) {
+      REQUIRE( fornberg_calculator.calculateDerivative(xs, ys, x_der, order) ==
+               Approx(fd_calculator.calculateDerivative(xs, ys, x_der, order)).margin(1e-6) );
+    }
+  }
+
+  std::deque<double> shifted_xs{10, 11, 12};
+  std::deque<double> shifted_ys{100, 121, 144};
+  REQUIRE( fornberg_calculator.calculateDerivative(shifted_xs, shifted_ys, 12, 1) == Approx(24) );
+  for (auto& x : shifted_xs) {
+    x += 1;
+  }
+
+  REQUIRE( fornberg_calculator.calculateDerivative(shifted_xs, shifted_ys, 13, 1) == Approx(24) );
+  REQUIRE( fornberg_calculator.calculateDerivative(shifted_xs, shifted_ys, 13, 2) == Approx(2) );
+
+  std::deque<double> repeated_xs{0, 1, 1};
+  REQUIRE_THROWS_AS(
+      fornberg_calculator.calculateDerivative(repeated_xs, shifted_ys, 1, 1),
+      compute_utils::ComputeException);
+}
+
+TEST_CASE("Fornberg calculator is cloned for each handler while FD one is shared", "[FornbergDerivativeCalculator]") {
+  std::deque<double> xs{10, 11, 12};
+  std::deque<double> ys{100, 121, 144};
+
+  sdp::compute_utils::FornbergDerivativeCalculator fornberg_calculator;
+  REQUIRE( fornberg_calculator.calculateDerivative(xs, ys, 12, 1) == Approx(24) );
+
+  auto cloned_calculator = fornberg_calculator.clone();
+  REQUIRE( cloned_calculator != nullptr );
+  REQUIRE( cloned_calculator->calculateDerivative(xs, ys, 12, 2) == Approx(2) );
+  REQUIRE( fornberg_calculator.calculateDerivative(xs, ys, 12, 1) == Approx(24) );
+
+  sdp::compute_utils::FDDerivativeCalculator fd_calculator;
+  REQUIRE( fd_calculator.clone() == nullptr );
+}
+
 TEST_CASE("can't calculate first order derivative by one value", "[FDDerivativeCalculator]") {
   std::deque<double> xs{0};
   std::deque<double> ys{0};